@@ -0,0 +1,688 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include <unistd.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fdir_proto.h"
+#include "client_global.h"
+#include "client_async.h"
+
+#define PENDING_BUCKET(actx, req_id) ((actx)->pending.buckets + \
+        ((req_id) & (FDIR_CLIENT_ASYNC_PENDING_BUCKETS - 1)))
+
+static inline void queue_push(FDIRClientAsyncQueue *queue,
+        FDIRClientAsyncRequest *request)
+{
+    request->next = NULL;
+    if (queue->tail == NULL) {
+        queue->head = request;
+    } else {
+        queue->tail->next = request;
+    }
+    queue->tail = request;
+}
+
+static inline FDIRClientAsyncRequest *queue_pop(FDIRClientAsyncQueue *queue)
+{
+    FDIRClientAsyncRequest *request;
+
+    if ((request=queue->head) == NULL) {
+        return NULL;
+    }
+
+    queue->head = request->next;
+    if (queue->head == NULL) {
+        queue->tail = NULL;
+    }
+    return request;
+}
+
+static inline void complete_request(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const int result)
+{
+    request->result = result;
+    if (request->callback != NULL) {
+        request->callback(request);
+    } else {
+        queue_push(&actx->done_queue, request);
+    }
+}
+
+int fdir_client_async_init(FDIRClientAsyncContext *actx,
+        FDIRClientContext *client_ctx, const int target)
+{
+    int bytes;
+
+    if (client_ctx->router.count > 0) {
+        logError("file: "__FILE__", line: %d, "
+                "the namespaces are sharded, the async context should "
+                "use the context of the cluster", __LINE__);
+        return EINVAL;
+    }
+
+    memset(actx, 0, sizeof(FDIRClientAsyncContext));
+    bytes = sizeof(FDIRClientAsyncRequest *) *
+        FDIR_CLIENT_ASYNC_PENDING_BUCKETS;
+    actx->pending.buckets = (FDIRClientAsyncRequest **)malloc(bytes);
+    if (actx->pending.buckets == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(actx->pending.buckets, 0, bytes);
+
+    actx->client_ctx = client_ctx;
+    actx->target = target;
+    actx->conn.sock = -1;
+    actx->next_req_id = 1;
+    return 0;
+}
+
+/* close the connection and complete the requests in flight,
+ * the requests are detached first for the callbacks may submit again
+ */
+static void close_connection(FDIRClientAsyncContext *actx, const int result)
+{
+    FDIRClientAsyncQueue failed;
+    FDIRClientAsyncRequest *request;
+    FDIRClientAsyncRequest *next;
+    FDIRClientAsyncRequest **bucket;
+    FDIRClientAsyncRequest **end;
+
+    if (actx->conn.sock >= 0) {
+        close(actx->conn.sock);
+        actx->conn.sock = -1;
+    }
+    actx->recv.offset = 0;
+
+    failed = actx->send_queue;
+    actx->send_queue.head = actx->send_queue.tail = NULL;
+    if (actx->pending.count > 0) {
+        end = actx->pending.buckets + FDIR_CLIENT_ASYNC_PENDING_BUCKETS;
+        for (bucket=actx->pending.buckets; bucket<end; bucket++) {
+            request = *bucket;
+            while (request != NULL) {
+                next = request->next;
+                queue_push(&failed, request);
+                request = next;
+            }
+            *bucket = NULL;
+        }
+        actx->pending.count = 0;
+    }
+
+    while ((request=queue_pop(&failed)) != NULL) {
+        complete_request(actx, request, result);
+    }
+}
+
+void fdir_client_async_destroy(FDIRClientAsyncContext *actx)
+{
+    if (actx->pending.buckets == NULL) {
+        return;
+    }
+
+    close_connection(actx, ECANCELED);
+    free(actx->pending.buckets);
+    actx->pending.buckets = NULL;
+}
+
+static int make_connection(FDIRClientAsyncContext *actx)
+{
+    FDIRClientServerEntry server;
+    int result;
+
+    if (actx->target == FDIR_CLIENT_ASYNC_TARGET_MASTER) {
+        result = fdir_client_get_master(actx->client_ctx, &server);
+    } else {
+        result = fdir_client_get_readable_server(actx->client_ctx, &server);
+    }
+    if (result != 0) {
+        return result;
+    }
+
+    conn_pool_set_server_info(&actx->conn, server.conn.ip_addr,
+            server.conn.port);
+    if ((result=conn_pool_connect_server(&actx->conn,
+                    g_fdir_client_vars.connect_timeout)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=tcpsetnonblockopt(actx->conn.sock)) != 0) {
+        close(actx->conn.sock);
+        actx->conn.sock = -1;
+        return result;
+    }
+
+    actx->recv.offset = 0;
+    actx->last_io_time = time(NULL);
+    return 0;
+}
+
+static int send_requests(FDIRClientAsyncContext *actx)
+{
+    FDIRClientAsyncRequest *request;
+    FDIRClientAsyncRequest **bucket;
+    int bytes;
+    int result;
+
+    while ((request=actx->send_queue.head) != NULL) {
+        bytes = write(actx->conn.sock, request->out.buff +
+                request->out.offset, request->out.length -
+                request->out.offset);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "send data to server %s:%d fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    actx->conn.ip_addr, actx->conn.port,
+                    result, STRERROR(result));
+            return result;
+        }
+
+        request->out.offset += bytes;
+        if (request->out.offset < request->out.length) {
+            return 0;  //the socket buffer is full
+        }
+
+        queue_pop(&actx->send_queue);
+        bucket = PENDING_BUCKET(actx, request->req_id);
+        request->next = *bucket;
+        *bucket = request;
+        actx->pending.count++;
+    }
+
+    return 0;
+}
+
+static FDIRClientAsyncRequest *remove_pending(FDIRClientAsyncContext *actx,
+        const int req_id)
+{
+    FDIRClientAsyncRequest **prev;
+    FDIRClientAsyncRequest *request;
+
+    prev = PENDING_BUCKET(actx, req_id);
+    while ((request=*prev) != NULL) {
+        if (request->req_id == req_id) {
+            *prev = request->next;
+            actx->pending.count--;
+            return request;
+        }
+        prev = &request->next;
+    }
+
+    return NULL;
+}
+
+static int deal_response(FDIRClientAsyncContext *actx)
+{
+    FDIRClientAsyncRequest *request;
+    FDIRHeaderInfo *info;
+    FDIRProtoStatDEntryResp *stat_resp;
+    char *body;
+    int body_len;
+    int expect_body_len;
+    int64_t data_version;
+
+    info = &actx->recv.info;
+    if ((request=remove_pending(actx, info->req_id)) == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, unexpected response req_id: %d",
+                __LINE__, actx->conn.ip_addr, actx->conn.port,
+                info->req_id);
+        return EINVAL;
+    }
+
+    body = actx->recv.body;
+    body_len = info->body_len;
+    if (info->status != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, cmd: %d, status: %d, %.*s", __LINE__,
+                actx->conn.ip_addr, actx->conn.port, request->resp_cmd,
+                info->status, body_len, body);
+        complete_request(actx, request, info->status);
+        return 0;
+    }
+
+    if ((info->flags & FDIR_PROTO_FLAGS_DATA_VERSION) && body_len >= 8) {
+        data_version = buff2long(body);
+        body += 8;
+        body_len -= 8;
+    } else {
+        data_version = 0;
+    }
+    if (request->resp_cmd == FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP) {
+        expect_body_len = sizeof(FDIRProtoLookupInodeResp);
+    } else {
+        expect_body_len = sizeof(FDIRProtoStatDEntryResp);
+    }
+
+    if (info->cmd != request->resp_cmd || body_len != expect_body_len) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, response cmd: %d, expect: %d, "
+                "body length: %d, expect: %d", __LINE__,
+                actx->conn.ip_addr, actx->conn.port, info->cmd,
+                request->resp_cmd, body_len, expect_body_len);
+        complete_request(actx, request, EINVAL);
+        return EINVAL;
+    }
+
+    if (request->resp_cmd == FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP) {
+        request->output.inode = buff2long(((FDIRProtoLookupInodeResp *)
+                    body)->inode);
+    } else {
+        stat_resp = (FDIRProtoStatDEntryResp *)body;
+        request->output.dentry.inode = buff2long(stat_resp->inode);
+        fdir_proto_unpack_dentry_stat(&stat_resp->stat,
+                &request->output.dentry.stat);
+    }
+
+    if (data_version > 0) {  //the update for read your writes
+        fdir_client_update_data_version(actx->client_ctx, data_version);
+    }
+    complete_request(actx, request, 0);
+    return 0;
+}
+
+//return EAGAIN when no more data
+static int do_recv(FDIRClientAsyncContext *actx, char *buff, const int size)
+{
+    int bytes;
+    int result;
+
+    while ((bytes=read(actx->conn.sock, buff, size)) < 0 && errno == EINTR) {
+    }
+
+    if (bytes > 0) {
+        actx->recv.offset += bytes;
+        actx->last_io_time = time(NULL);
+        return 0;
+    }
+
+    if (bytes == 0) {
+        logError("file: "__FILE__", line: %d, "
+                "the connection closed by server %s:%d",
+                __LINE__, actx->conn.ip_addr, actx->conn.port);
+        return ECONNRESET;
+    }
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return EAGAIN;
+    }
+
+    result = errno != 0 ? errno : EIO;
+    logError("file: "__FILE__", line: %d, "
+            "recv data from server %s:%d fail, "
+            "errno: %d, error info: %s", __LINE__,
+            actx->conn.ip_addr, actx->conn.port,
+            result, STRERROR(result));
+    return result;
+}
+
+static int recv_responses(FDIRClientAsyncContext *actx)
+{
+    int total;
+    int result;
+
+    while (1) {
+        if (actx->recv.offset < sizeof(FDIRProtoHeader)) {
+            if ((result=do_recv(actx, (char *)&actx->recv.header +
+                            actx->recv.offset, sizeof(FDIRProtoHeader) -
+                            actx->recv.offset)) != 0)
+            {
+                return result == EAGAIN ? 0 : result;
+            }
+            if (actx->recv.offset < sizeof(FDIRProtoHeader)) {
+                continue;
+            }
+
+            fdir_proto_extract_header(&actx->recv.header, &actx->recv.info);
+            if (actx->recv.info.body_len < 0 || actx->recv.info.body_len >
+                    sizeof(actx->recv.body))
+            {
+                logError("file: "__FILE__", line: %d, "
+                        "server %s:%d, invalid response body length: %d",
+                        __LINE__, actx->conn.ip_addr, actx->conn.port,
+                        actx->recv.info.body_len);
+                return EOVERFLOW;
+            }
+        }
+
+        total = sizeof(FDIRProtoHeader) + actx->recv.info.body_len;
+        if (actx->recv.offset < total) {
+            if ((result=do_recv(actx, actx->recv.body + (actx->recv.offset -
+                                sizeof(FDIRProtoHeader)), total -
+                            actx->recv.offset)) != 0)
+            {
+                return result == EAGAIN ? 0 : result;
+            }
+            if (actx->recv.offset < total) {
+                continue;
+            }
+        }
+
+        actx->recv.offset = 0;
+        if ((result=deal_response(actx)) != 0) {
+            return result;
+        }
+        if (actx->conn.sock < 0) {  //closed by the callback
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+static int submit_request(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const unsigned char resp_cmd,
+        fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if (actx->conn.sock < 0) {
+        if ((result=make_connection(actx)) != 0) {
+            return result;
+        }
+    }
+    if (!fdir_client_async_busy(actx)) {
+        actx->last_io_time = time(NULL);
+    }
+
+    request->req_id = actx->next_req_id;
+    actx->next_req_id = (actx->next_req_id + 1) & FDIR_PROTO_REQ_ID_MASK;
+    FDIR_PROTO_SET_REQ_ID((FDIRProtoHeader *)request->out.buff,
+            request->req_id);
+    request->resp_cmd = resp_cmd;
+    request->result = EINPROGRESS;
+    request->callback = callback;
+    request->arg = arg;
+    request->out.offset = 0;
+
+    queue_push(&actx->send_queue, request);
+    if (actx->send_queue.head == request) {
+        if ((result=send_requests(actx)) != 0) {
+            close_connection(actx, result);
+        }
+    }
+    return 0;
+}
+
+int fdir_client_async_lookup_inode(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if ((result=fdir_client_pack_path_read_req(actx->client_ctx,
+                    FDIR_SERVICE_PROTO_LOOKUP_INODE_REQ, fullname,
+                    request->out.buff, &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP, callback, arg);
+}
+
+int fdir_client_async_stat_dentry_by_path(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if ((result=fdir_client_pack_path_read_req(actx->client_ctx,
+                    FDIR_SERVICE_PROTO_STAT_BY_PATH_REQ, fullname,
+                    request->out.buff, &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_STAT_BY_PATH_RESP, callback, arg);
+}
+
+int fdir_client_async_stat_dentry_by_inode(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const int64_t inode,
+        fdir_client_async_callback callback, void *arg)
+{
+    fdir_client_pack_stat_by_inode_req(actx->client_ctx, inode,
+            request->out.buff, &request->out.length);
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_STAT_BY_INODE_RESP, callback, arg);
+}
+
+int fdir_client_async_stat_dentry_by_pname(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const int64_t parent_inode,
+        const string_t *name, fdir_client_async_callback callback,
+        void *arg)
+{
+    if (name->len <= 0 || name->len > NAME_MAX) {
+        logError("file: "__FILE__", line: %d, "
+                "invalid name length: %d, which <= 0 or > %d",
+                __LINE__, name->len, NAME_MAX);
+        return EINVAL;
+    }
+
+    fdir_client_pack_stat_by_pname_req(actx->client_ctx, parent_inode,
+            name, request->out.buff, &request->out.length);
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_STAT_BY_PNAME_RESP, callback, arg);
+}
+
+static inline int check_update_target(FDIRClientAsyncContext *actx)
+{
+    if (actx->target != FDIR_CLIENT_ASYNC_TARGET_MASTER) {
+        logError("file: "__FILE__", line: %d, "
+                "the update requests should be submitted to "
+                "the context of the master target", __LINE__);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+int fdir_client_async_create_dentry(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        const mode_t mode, fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if ((result=check_update_target(actx)) != 0) {
+        return result;
+    }
+    if ((result=fdir_client_pack_create_dentry_req(actx->client_ctx,
+                    fullname, mode, request->out.buff,
+                    &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_CREATE_DENTRY_RESP, callback, arg);
+}
+
+int fdir_client_async_create_dentry_by_pname(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const string_t *ns,
+        const int64_t parent_inode, const string_t *name, const mode_t mode,
+        fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if ((result=check_update_target(actx)) != 0) {
+        return result;
+    }
+    if ((result=fdir_client_pack_create_by_pname_req(actx->client_ctx,
+                    ns, parent_inode, name, mode, request->out.buff,
+                    &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_CREATE_BY_PNAME_RESP, callback, arg);
+}
+
+int fdir_client_async_remove_dentry(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if ((result=check_update_target(actx)) != 0) {
+        return result;
+    }
+    if ((result=fdir_client_pack_remove_dentry_req(actx->client_ctx,
+                    fullname, request->out.buff,
+                    &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_REMOVE_DENTRY_RESP, callback, arg);
+}
+
+int fdir_client_async_set_dentry_size(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const string_t *ns,
+        const int64_t inode, const int64_t size, const bool force,
+        fdir_client_async_callback callback, void *arg)
+{
+    int result;
+
+    if ((result=check_update_target(actx)) != 0) {
+        return result;
+    }
+    if ((result=fdir_client_pack_set_dentry_size_req(actx->client_ctx,
+                    ns, inode, size, force, request->out.buff,
+                    &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_SET_DENTRY_SIZE_RESP, callback, arg);
+}
+
+int fdir_client_async_modify_dentry_stat(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const string_t *ns,
+        const int64_t inode, const int64_t flags,
+        const FDIRDEntryStatus *stat, fdir_client_async_callback callback,
+        void *arg)
+{
+    int result;
+
+    if ((result=check_update_target(actx)) != 0) {
+        return result;
+    }
+    if ((result=fdir_client_pack_modify_dentry_stat_req(actx->client_ctx,
+                    ns, inode, flags, stat, request->out.buff,
+                    &request->out.length)) != 0)
+    {
+        return result;
+    }
+
+    return submit_request(actx, request,
+            FDIR_SERVICE_PROTO_MODIFY_DENTRY_STAT_RESP, callback, arg);
+}
+
+int fdir_client_async_deal_events(FDIRClientAsyncContext *actx,
+        const int events)
+{
+    int result;
+
+    if (actx->conn.sock < 0) {
+        return ENOTCONN;
+    }
+
+    result = 0;
+    if ((events & POLLOUT) && actx->send_queue.head != NULL) {
+        result = send_requests(actx);
+    }
+    if (result == 0 && (events & (POLLIN | POLLERR | POLLHUP))) {
+        result = recv_responses(actx);
+    }
+
+    if (result != 0) {
+        close_connection(actx, result);
+    }
+    return result;
+}
+
+int fdir_client_async_check_timeout(FDIRClientAsyncContext *actx)
+{
+    if (actx->conn.sock < 0 || !fdir_client_async_busy(actx)) {
+        return 0;
+    }
+
+    if (time(NULL) - actx->last_io_time <=
+            g_fdir_client_vars.network_timeout)
+    {
+        return 0;
+    }
+
+    logError("file: "__FILE__", line: %d, "
+            "server %s:%d, no response in %d seconds, "
+            "requests in flight: %d", __LINE__, actx->conn.ip_addr,
+            actx->conn.port, g_fdir_client_vars.network_timeout,
+            actx->pending.count);
+    close_connection(actx, ETIMEDOUT);
+    return ETIMEDOUT;
+}
+
+int fdir_client_async_loop_once(FDIRClientAsyncContext *actx,
+        const int timeout_ms)
+{
+    struct pollfd pfd;
+    int count;
+    int result;
+
+    if (actx->conn.sock < 0) {
+        return 0;
+    }
+
+    pfd.fd = actx->conn.sock;
+    pfd.events = fdir_client_async_get_events(actx);
+    pfd.revents = 0;
+    if ((count=poll(&pfd, 1, timeout_ms)) < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "poll fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        close_connection(actx, result);
+        return result;
+    }
+
+    if (count > 0) {
+        if ((result=fdir_client_async_deal_events(actx,
+                        pfd.revents)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return fdir_client_async_check_timeout(actx);
+}
+
+int fdir_client_async_wait_all(FDIRClientAsyncContext *actx)
+{
+    int result;
+
+    result = 0;
+    while (fdir_client_async_busy(actx)) {
+        result = fdir_client_async_loop_once(actx, 1000);
+    }
+    return result;
+}
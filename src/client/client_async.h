@@ -0,0 +1,220 @@
+
+#ifndef _FDIR_CLIENT_ASYNC_H
+#define _FDIR_CLIENT_ASYNC_H
+
+#include <poll.h>
+#include "client_types.h"
+#include "client_proto.h"
+
+#define FDIR_CLIENT_ASYNC_TARGET_READABLE  0  //the slave or the master
+#define FDIR_CLIENT_ASYNC_TARGET_MASTER    1
+
+#define FDIR_CLIENT_ASYNC_PENDING_BUCKETS  1024  //must be power of 2
+
+struct fdir_client_async_request;
+
+typedef void (*fdir_client_async_callback)(
+        struct fdir_client_async_request *request);
+
+/* the request is supplied by the caller and can be embedded in the
+ * object of the caller, it should be kept until completed
+ */
+typedef struct fdir_client_async_request {
+    int req_id;
+    unsigned char resp_cmd;
+    int result;   //the result after completed
+
+    union {
+        int64_t inode;          //for lookup inode
+        FDIRDEntryInfo dentry;  //for stat dentry and the updates
+    } output;
+
+    fdir_client_async_callback callback; //NULL for the completion queue
+    void *arg;    //the argument of the caller
+
+    struct {
+        int offset;  //the sent bytes
+        int length;
+        char buff[FDIR_CLIENT_READ_REQ_MAX_SIZE];
+    } out;
+
+    struct fdir_client_async_request *next;
+} FDIRClientAsyncRequest;
+
+typedef struct fdir_client_async_queue {
+    FDIRClientAsyncRequest *head;
+    FDIRClientAsyncRequest *tail;
+} FDIRClientAsyncQueue;
+
+/* the requests are multiplexed on one nonblocking connection and the
+ * responses are matched by the request id, so thousands of requests can
+ * be in flight with one thread. the server executes the requests of the
+ * connection in order, so a slow request delays the later ones, use more
+ * contexts for the concurrency of the server. the context is driven by one
+ * thread: the submits, the events and the completions are all in this thread.
+ * the connection is owned by the context and is not shared with the other
+ * contexts or the blocking calls, one context per event loop thread and
+ * target is enough for a gateway
+ */
+typedef struct fdir_client_async_context {
+    FDIRClientContext *client_ctx;
+    int target;
+    ConnectionInfo conn;
+    int next_req_id;
+    time_t last_io_time;
+
+    FDIRClientAsyncQueue send_queue;  //the head may be partly sent
+    FDIRClientAsyncQueue done_queue;  //completed without callback
+
+    struct {
+        int count;
+        FDIRClientAsyncRequest **buckets;  //hashed by the request id
+    } pending;
+
+    struct {
+        FDIRProtoHeader header;
+        FDIRHeaderInfo info;
+        int offset;  //the received bytes of the header and the body
+        char body[FDIR_ERROR_INFO_SIZE +
+            sizeof(FDIRProtoStatDEntryResp) + 8];
+    } recv;
+} FDIRClientAsyncContext;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* init the async context
+* params:
+*       actx: the async context
+*       client_ctx: the client context, the context of the cluster
+*                   by fdir_client_route_by_ns or fdir_client_route_by_inode
+*                   when the namespaces sharded
+*       target: FDIR_CLIENT_ASYNC_TARGET_READABLE or
+*               FDIR_CLIENT_ASYNC_TARGET_MASTER, for read your writes,
+*               the request failed with EAGAIN by the slave should be
+*               resubmitted to the context of the master target
+* return: 0 success, !=0 fail, return the error code
+**/
+int fdir_client_async_init(FDIRClientAsyncContext *actx,
+        FDIRClientContext *client_ctx, const int target);
+
+//the requests in flight are completed with ECANCELED
+void fdir_client_async_destroy(FDIRClientAsyncContext *actx);
+
+/* submit the requests without blocking except the connecting, the
+ * connection is made when the first request submitted, the completion
+ * is by the callback or the completion queue when the callback is NULL,
+ * the request completed in the submit is by the callback too
+ */
+int fdir_client_async_lookup_inode(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_stat_dentry_by_path(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_stat_dentry_by_inode(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const int64_t inode,
+        fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_stat_dentry_by_pname(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const int64_t parent_inode,
+        const string_t *name, fdir_client_async_callback callback,
+        void *arg);
+
+/* the update requests should be submitted to the context of the
+ * master target, the output is the dentry after updated
+ */
+int fdir_client_async_create_dentry(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        const mode_t mode, fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_create_dentry_by_pname(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const string_t *ns,
+        const int64_t parent_inode, const string_t *name, const mode_t mode,
+        fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_remove_dentry(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const FDIRDEntryFullName *fullname,
+        fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_set_dentry_size(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const string_t *ns,
+        const int64_t inode, const int64_t size, const bool force,
+        fdir_client_async_callback callback, void *arg);
+
+int fdir_client_async_modify_dentry_stat(FDIRClientAsyncContext *actx,
+        FDIRClientAsyncRequest *request, const string_t *ns,
+        const int64_t inode, const int64_t flags,
+        const FDIRDEntryStatus *stat, fdir_client_async_callback callback,
+        void *arg);
+
+/* for the external event loop such as epoll: watch the fd for the events,
+ * the fd changes after reconnected, -1 for not connected
+ */
+static inline int fdir_client_async_get_fd(FDIRClientAsyncContext *actx)
+{
+    return actx->conn.sock;
+}
+
+//POLLIN and POLLOUT when requests to send, same as EPOLLIN and EPOLLOUT
+static inline int fdir_client_async_get_events(FDIRClientAsyncContext *actx)
+{
+    return actx->send_queue.head != NULL ? (POLLIN | POLLOUT) : POLLIN;
+}
+
+//the requests submitted and not completed
+static inline bool fdir_client_async_busy(FDIRClientAsyncContext *actx)
+{
+    return (actx->pending.count > 0 || actx->send_queue.head != NULL);
+}
+
+/**
+* deal the events of the fd
+* params:
+*       actx: the async context
+*       events: the events of poll or epoll
+* return: 0 success, !=0 for the connection broken, the requests in flight
+*         are completed with the error
+**/
+int fdir_client_async_deal_events(FDIRClientAsyncContext *actx,
+        const int events);
+
+/* complete the requests in flight with ETIMEDOUT when the server has no
+ * response in the network timeout, call it periodically by the external
+ * event loop
+ */
+int fdir_client_async_check_timeout(FDIRClientAsyncContext *actx);
+
+/**
+* run the event loop by poll once
+* params:
+*       actx: the async context
+*       timeout_ms: the poll timeout in milliseconds
+* return: 0 success, !=0 fail, return the error code
+**/
+int fdir_client_async_loop_once(FDIRClientAsyncContext *actx,
+        const int timeout_ms);
+
+//run the event loop until all the requests completed
+int fdir_client_async_wait_all(FDIRClientAsyncContext *actx);
+
+//fetch the completion queue, the requests are linked by the next field
+static inline FDIRClientAsyncRequest *fdir_client_async_fetch_done(
+        FDIRClientAsyncContext *actx)
+{
+    FDIRClientAsyncRequest *head;
+
+    head = actx->done_queue.head;
+    actx->done_queue.head = actx->done_queue.tail = NULL;
+    return head;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
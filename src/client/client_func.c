@@ -3,9 +3,11 @@
 #include "fastcommon/ini_file_reader.h"
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
+#include "fdir_proto.h"
 #include "client_global.h"
 #include "simple_connection_manager.h"
 #include "pooled_connection_manager.h"
+#include "client_router.h"
 #include "client_func.h"
 
 static int copy_dir_servers(FDIRServerGroup *server_group,
@@ -61,18 +63,20 @@ int fdir_alloc_group_servers(FDIRServerGroup *server_group,
 }
 
 int fdir_load_server_group_ex(FDIRServerGroup *server_group,
-        const char *conf_filename, IniContext *pIniContext)
+        const char *conf_filename, const char *section_name,
+        IniContext *pIniContext)
 {
     int result;
     IniItem *dir_servers;
     int count;
 
-    dir_servers = iniGetValuesEx(NULL, "dir_server",
+    dir_servers = iniGetValuesEx(section_name, "dir_server",
             pIniContext, &count);
     if (count == 0) {
         logError("file: "__FILE__", line: %d, "
-            "conf file \"%s\", item \"dir_server\" not exist",
-            __LINE__, conf_filename);
+            "conf file \"%s\", section: %s, item \"dir_server\" "
+            "not exist", __LINE__, conf_filename,
+            section_name != NULL ? section_name : "global");
         return ENOENT;
     }
 
@@ -96,6 +100,7 @@ static int fdir_client_do_init_ex(FDIRClientContext *client_ctx,
         const char *conf_filename, IniContext *iniContext)
 {
     char *pBasePath;
+    char *durability_level;
     int result;
 
     pBasePath = iniGetStrValue(NULL, "base_path", iniContext);
@@ -133,24 +138,56 @@ static int fdir_client_do_init_ex(FDIRClientContext *client_ctx,
         g_fdir_client_vars.network_timeout = DEFAULT_NETWORK_TIMEOUT;
     }
 
-    if ((result=fdir_load_server_group_ex(&client_ctx->server_group,
+    durability_level = iniGetStrValue(NULL, "durability_level", iniContext);
+    client_ctx->durability_level = fdir_get_durability_level_by_caption(
+            durability_level);
+    if (client_ctx->durability_level < 0) {
+        logError("file: "__FILE__", line: %d, "
+                "conf file \"%s\", invalid durability_level: %s",
+                __LINE__, conf_filename, durability_level);
+        return EINVAL;
+    }
+
+    client_ctx->read_your_writes = iniGetBoolValue(NULL,
+            "read_your_writes", iniContext, true);
+    client_ctx->data_version = 0;
+    client_ctx->cluster_id = 0;
+
+    if ((result=fdir_client_router_load(client_ctx,
                     conf_filename, iniContext)) != 0)
     {
         return result;
     }
 
+    //the namespaces sharded across the clusters of the cluster_ids
+    if (client_ctx->router.count == 0) {
+        if ((result=fdir_load_server_group_ex(&client_ctx->server_group,
+                        conf_filename, NULL, iniContext)) != 0)
+        {
+            return result;
+        }
+    }
+
 #ifdef DEBUG_FLAG
     logDebug("FastDIR v%d.%02d, "
             "base_path=%s, "
             "connect_timeout=%d, "
             "network_timeout=%d, "
-            "dir_server_count=%d",
+            "durability_level=%s, "
+            "read_your_writes=%d, "
+            "dir_server_count=%d, "
+            "cluster_count=%d, "
+            "namespace_map_count=%d",
             g_fdir_global_vars.version.major,
             g_fdir_global_vars.version.minor,
             g_fdir_client_vars.base_path,
             g_fdir_client_vars.connect_timeout,
             g_fdir_client_vars.network_timeout,
-            client_ctx->server_group.count);
+            fdir_get_durability_level_caption(client_ctx->durability_level),
+            client_ctx->read_your_writes,
+            client_ctx->server_group.count,
+            client_ctx->router.count,
+            client_ctx->router.ns_map.count);
 #endif
 
     return 0;
@@ -179,8 +216,14 @@ int fdir_client_load_from_file_ex(FDIRClientContext *client_ctx,
 static inline void fdir_client_common_init(FDIRClientContext *client_ctx,
         FDIRClientConnManagerType conn_manager_type)
 {
+    int i;
+
     client_ctx->conn_manager_type = conn_manager_type;
     client_ctx->cloned = false;
+    for (i=0; i<client_ctx->router.count; i++) {
+        client_ctx->router.clusters[i].conn_manager_type = conn_manager_type;
+        client_ctx->router.clusters[i].cloned = false;
+    }
     srand(time(NULL));
 }
 
@@ -188,6 +231,7 @@ int fdir_client_init_ex(FDIRClientContext *client_ctx,
         const char *conf_filename, const FDIRConnectionManager *conn_manager)
 {
     int result;
+    int i;
 
     if ((result=fdir_client_load_from_file_ex(
                     client_ctx, conf_filename)) != 0)
@@ -198,6 +242,9 @@ int fdir_client_init_ex(FDIRClientContext *client_ctx,
     if (conn_manager != &client_ctx->conn_manager) {
         client_ctx->conn_manager = *conn_manager;
     }
+    for (i=0; i<client_ctx->router.count; i++) {
+        client_ctx->router.clusters[i].conn_manager = *conn_manager;
+    }
     fdir_client_common_init(client_ctx, conn_manager_type_other);
     return 0;
 }
@@ -206,6 +253,7 @@ int fdir_client_simple_init_ex(FDIRClientContext *client_ctx,
         const char *conf_filename)
 {
     int result;
+    int i;
 
     if ((result=fdir_client_load_from_file_ex(
                     client_ctx, conf_filename)) != 0)
@@ -218,6 +266,13 @@ int fdir_client_simple_init_ex(FDIRClientContext *client_ctx,
     {
         return result;
     }
+    for (i=0; i<client_ctx->router.count; i++) {
+        if ((result=fdir_simple_connection_manager_init(
+                        &client_ctx->router.clusters[i].conn_manager)) != 0)
+        {
+            return result;
+        }
+    }
 
     fdir_client_common_init(client_ctx, conn_manager_type_simple);
     return 0;
@@ -228,6 +283,7 @@ int fdir_client_pooled_init_ex(FDIRClientContext *client_ctx,
         const int max_idle_time)
 {
     int result;
+    int i;
 
     if ((result=fdir_client_load_from_file_ex(
                     client_ctx, conf_filename)) != 0)
@@ -241,6 +297,14 @@ int fdir_client_pooled_init_ex(FDIRClientContext *client_ctx,
     {
         return result;
     }
+    for (i=0; i<client_ctx->router.count; i++) {
+        if ((result=fdir_pooled_connection_manager_init(
+                        &client_ctx->router.clusters[i].conn_manager,
+                        max_count_per_entry, max_idle_time)) != 0)
+        {
+            return result;
+        }
+    }
 
     fdir_client_common_init(client_ctx, conn_manager_type_pooled);
     return 0;
@@ -251,11 +315,15 @@ void fdir_client_destroy_ex(FDIRClientContext *client_ctx)
     if (client_ctx->cloned) {
         return;
     }
-    if (client_ctx->server_group.servers == NULL) {
+    if (client_ctx->router.count > 0) {
+        fdir_client_router_destroy(client_ctx);
+    } else if (client_ctx->server_group.servers == NULL) {
         return;
     }
 
-    free(client_ctx->server_group.servers);
+    if (client_ctx->server_group.servers != NULL) {
+        free(client_ctx->server_group.servers);
+    }
     if (client_ctx->conn_manager_type == conn_manager_type_simple) {
         fdir_simple_connection_manager_destroy(&client_ctx->conn_manager);
     } else if (client_ctx->conn_manager_type == conn_manager_type_pooled) {
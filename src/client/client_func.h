@@ -2,6 +2,7 @@
 #ifndef _FDIR_CLIENT_FUNC_H
 #define _FDIR_CLIENT_FUNC_H
 
+#include "fastcommon/ini_file_reader.h"
 #include "fdir_global.h"
 #include "client_types.h"
 
@@ -68,6 +69,11 @@ void fdir_client_destroy_ex(FDIRClientContext *client_ctx);
 int fdir_alloc_group_servers(FDIRServerGroup *server_group,
         const int alloc_size);
 
+//section_name: NULL for the global section
+int fdir_load_server_group_ex(FDIRServerGroup *server_group,
+        const char *conf_filename, const char *section_name,
+        IniContext *pIniContext);
+
 #ifdef __cplusplus
 }
 #endif
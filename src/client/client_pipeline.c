@@ -0,0 +1,488 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fdir_proto.h"
+#include "client_global.h"
+#include "client_pipeline.h"
+
+static volatile int next_req_id = 1;
+
+int fdir_client_pipeline_init(FDIRClientPipeline *pipeline,
+        FDIRClientContext *client_ctx, const int window)
+{
+    if (client_ctx->router.count > 0) {
+        logError("file: "__FILE__", line: %d, "
+                "the namespaces are sharded, the pipeline should use "
+                "the context of the cluster", __LINE__);
+        return EINVAL;
+    }
+
+    memset(pipeline, 0, sizeof(FDIRClientPipeline));
+    pipeline->client_ctx = client_ctx;
+    pipeline->window = window > 0 ? window :
+        FDIR_CLIENT_PIPELINE_DEFAULT_WINDOW;
+    return 0;
+}
+
+void fdir_client_pipeline_destroy(FDIRClientPipeline *pipeline)
+{
+    if (pipeline->entries != NULL) {
+        free(pipeline->entries);
+        pipeline->entries = NULL;
+    }
+    if (pipeline->runs != NULL) {
+        free(pipeline->runs);
+        pipeline->runs = NULL;
+    }
+    if (pipeline->out.buff != NULL) {
+        free(pipeline->out.buff);
+        pipeline->out.buff = NULL;
+    }
+    pipeline->alloc = pipeline->count = 0;
+    pipeline->out.alloc = pipeline->out.length = 0;
+}
+
+static int check_realloc_entries(FDIRClientPipeline *pipeline)
+{
+    FDIRClientPipelineEntry *entries;
+    FDIRClientPipelineEntry **runs;
+    int alloc;
+
+    if (pipeline->count < pipeline->alloc) {
+        return 0;
+    }
+    if (pipeline->count >= FDIR_PROTO_REQ_ID_MASK) {  //unique request ids
+        logError("file: "__FILE__", line: %d, "
+                "too many requests: %d, exceeds: %d", __LINE__,
+                pipeline->count, FDIR_PROTO_REQ_ID_MASK);
+        return EOVERFLOW;
+    }
+
+    alloc = pipeline->alloc > 0 ? 2 * pipeline->alloc : 64;
+    entries = (FDIRClientPipelineEntry *)realloc(pipeline->entries,
+            sizeof(FDIRClientPipelineEntry) * alloc);
+    if (entries == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "realloc %d bytes fail", __LINE__, (int)
+                sizeof(FDIRClientPipelineEntry) * alloc);
+        return ENOMEM;
+    }
+    pipeline->entries = entries;
+
+    runs = (FDIRClientPipelineEntry **)realloc(pipeline->runs,
+            sizeof(FDIRClientPipelineEntry *) * alloc);
+    if (runs == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "realloc %d bytes fail", __LINE__, (int)
+                sizeof(FDIRClientPipelineEntry *) * alloc);
+        return ENOMEM;
+    }
+    pipeline->runs = runs;
+    pipeline->alloc = alloc;
+    return 0;
+}
+
+static int check_realloc_out_buffer(FDIRClientPipeline *pipeline)
+{
+    char *buff;
+    int alloc;
+
+    if (pipeline->out.alloc - pipeline->out.length >=
+            FDIR_CLIENT_READ_REQ_MAX_SIZE)
+    {
+        return 0;
+    }
+
+    alloc = pipeline->out.alloc > 0 ? pipeline->out.alloc : 16 * 1024;
+    while (alloc - pipeline->out.length < FDIR_CLIENT_READ_REQ_MAX_SIZE) {
+        alloc *= 2;
+    }
+    buff = (char *)realloc(pipeline->out.buff, alloc);
+    if (buff == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "realloc %d bytes fail", __LINE__, alloc);
+        return ENOMEM;
+    }
+
+    pipeline->out.buff = buff;
+    pipeline->out.alloc = alloc;
+    return 0;
+}
+
+static FDIRClientPipelineEntry *alloc_entry(FDIRClientPipeline *pipeline,
+        const unsigned char resp_cmd, int *err_no)
+{
+    FDIRClientPipelineEntry *entry;
+
+    if ((*err_no=check_realloc_entries(pipeline)) != 0) {
+        return NULL;
+    }
+    if ((*err_no=check_realloc_out_buffer(pipeline)) != 0) {
+        return NULL;
+    }
+
+    entry = pipeline->entries + pipeline->count;
+    entry->resp_cmd = resp_cmd;
+    entry->done = false;
+    entry->offset = pipeline->out.length;
+    entry->length = 0;
+    entry->result = EINPROGRESS;
+    return entry;
+}
+
+static inline void add_entry(FDIRClientPipeline *pipeline,
+        FDIRClientPipelineEntry *entry)
+{
+    FDIRProtoHeader *header;
+
+    header = (FDIRProtoHeader *)(pipeline->out.buff + entry->offset);
+    entry->min_data_version = (buff2short(header->flags) &
+            FDIR_PROTO_FLAGS_MIN_DATA_VERSION) != 0;
+    pipeline->out.length += entry->length;
+    pipeline->count++;
+}
+
+int fdir_client_pipeline_lookup_inode(FDIRClientPipeline *pipeline,
+        const FDIRDEntryFullName *fullname, int64_t *inode)
+{
+    FDIRClientPipelineEntry *entry;
+    int result;
+
+    if ((entry=alloc_entry(pipeline, FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP,
+                    &result)) == NULL)
+    {
+        return result;
+    }
+
+    if ((result=fdir_client_pack_path_read_req(pipeline->client_ctx,
+                    FDIR_SERVICE_PROTO_LOOKUP_INODE_REQ, fullname,
+                    pipeline->out.buff + entry->offset,
+                    &entry->length)) != 0)
+    {
+        return result;
+    }
+
+    entry->output.inode = inode;
+    add_entry(pipeline, entry);
+    return 0;
+}
+
+int fdir_client_pipeline_stat_dentry_by_path(FDIRClientPipeline *pipeline,
+        const FDIRDEntryFullName *fullname, FDIRDEntryInfo *dentry)
+{
+    FDIRClientPipelineEntry *entry;
+    int result;
+
+    if ((entry=alloc_entry(pipeline, FDIR_SERVICE_PROTO_STAT_BY_PATH_RESP,
+                    &result)) == NULL)
+    {
+        return result;
+    }
+
+    if ((result=fdir_client_pack_path_read_req(pipeline->client_ctx,
+                    FDIR_SERVICE_PROTO_STAT_BY_PATH_REQ, fullname,
+                    pipeline->out.buff + entry->offset,
+                    &entry->length)) != 0)
+    {
+        return result;
+    }
+
+    entry->output.dentry = dentry;
+    add_entry(pipeline, entry);
+    return 0;
+}
+
+int fdir_client_pipeline_stat_dentry_by_inode(FDIRClientPipeline *pipeline,
+        const int64_t inode, FDIRDEntryInfo *dentry)
+{
+    FDIRClientPipelineEntry *entry;
+    int result;
+
+    if ((entry=alloc_entry(pipeline, FDIR_SERVICE_PROTO_STAT_BY_INODE_RESP,
+                    &result)) == NULL)
+    {
+        return result;
+    }
+
+    fdir_client_pack_stat_by_inode_req(pipeline->client_ctx, inode,
+            pipeline->out.buff + entry->offset, &entry->length);
+    entry->output.dentry = dentry;
+    add_entry(pipeline, entry);
+    return 0;
+}
+
+int fdir_client_pipeline_stat_dentry_by_pname(FDIRClientPipeline *pipeline,
+        const int64_t parent_inode, const string_t *name,
+        FDIRDEntryInfo *dentry)
+{
+    FDIRClientPipelineEntry *entry;
+    int result;
+
+    if (name->len <= 0 || name->len > NAME_MAX) {
+        logError("file: "__FILE__", line: %d, "
+                "invalid name length: %d, which <= 0 or > %d",
+                __LINE__, name->len, NAME_MAX);
+        return EINVAL;
+    }
+
+    if ((entry=alloc_entry(pipeline, FDIR_SERVICE_PROTO_STAT_BY_PNAME_RESP,
+                    &result)) == NULL)
+    {
+        return result;
+    }
+
+    fdir_client_pack_stat_by_pname_req(pipeline->client_ctx, parent_inode,
+            name, pipeline->out.buff + entry->offset, &entry->length);
+    entry->output.dentry = dentry;
+    add_entry(pipeline, entry);
+    return 0;
+}
+
+//send the entries [start, end), the adjacent requests are sent at once
+static int send_entries(FDIRClientPipeline *pipeline,
+        ConnectionInfo *conn, const int start, const int end)
+{
+    FDIRClientPipelineEntry **run;
+    FDIRClientPipelineEntry **last;
+    char *buff;
+    int length;
+    int result;
+
+    run = pipeline->runs + start;
+    last = pipeline->runs + end;
+    while (run < last) {
+        buff = pipeline->out.buff + (*run)->offset;
+        length = (*run)->length;
+        while (++run < last && (*run)->offset == (*(run - 1))->offset +
+                (*(run - 1))->length)
+        {
+            length += (*run)->length;
+        }
+
+        if ((result=tcpsenddata_nb(conn->sock, buff, length,
+                        g_fdir_client_vars.network_timeout)) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "send data to server %s:%d fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    conn->ip_addr, conn->port, result, STRERROR(result));
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int recv_response_body(ConnectionInfo *conn,
+        FDIRClientPipelineEntry *entry, FDIRResponseInfo *response)
+{
+    union {
+        FDIRProtoLookupInodeResp lookup;
+        FDIRProtoStatDEntryResp stat;
+    } body;
+    int expect_body_len;
+    int result;
+
+    if (entry->resp_cmd == FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP) {
+        expect_body_len = sizeof(body.lookup);
+    } else {
+        expect_body_len = sizeof(body.stat);
+    }
+    if (response->header.body_len != expect_body_len) {
+        response->error.length = sprintf(response->error.message,
+                "response body length: %d != %d",
+                response->header.body_len, expect_body_len);
+        return EINVAL;
+    }
+
+    if ((result=tcprecvdata_nb(conn->sock, &body, expect_body_len,
+                    g_fdir_client_vars.network_timeout)) != 0)
+    {
+        response->error.length = snprintf(response->error.message,
+                sizeof(response->error.message),
+                "recv body fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+        return result;
+    }
+
+    if (entry->resp_cmd == FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP) {
+        *entry->output.inode = buff2long(body.lookup.inode);
+    } else {
+        entry->output.dentry->inode = buff2long(body.stat.inode);
+        fdir_proto_unpack_dentry_stat(&body.stat.stat,
+                &entry->output.dentry->stat);
+    }
+    return 0;
+}
+
+/* receive one response in any order,
+ * return the error of the connection, the error of the request
+ * from the server is set to the result of the entry
+ */
+static int recv_response(FDIRClientPipeline *pipeline, ConnectionInfo *conn)
+{
+    FDIRProtoHeader header_proto;
+    FDIRResponseInfo response;
+    FDIRClientPipelineEntry *entry;
+    int64_t index;
+    int result;
+
+    response.error.length = 0;
+    response.error.message[0] = '\0';
+    if ((result=tcprecvdata_nb(conn->sock, &header_proto,
+                    sizeof(FDIRProtoHeader), g_fdir_client_vars.
+                    network_timeout)) != 0)
+    {
+        fdir_log_network_error(&response, conn, result);
+        return result;
+    }
+
+    fdir_proto_extract_header(&header_proto, &response.header);
+    index = (response.header.req_id - pipeline->base_req_id) &
+        FDIR_PROTO_REQ_ID_MASK;
+    if (index < 0 || index >= pipeline->count ||
+            pipeline->entries[index].done)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, unexpected response req_id: %d",
+                __LINE__, conn->ip_addr, conn->port,
+                response.header.req_id);
+        return EINVAL;
+    }
+
+    entry = pipeline->entries + index;
+    entry->done = true;
+    if ((result=fdir_check_response(conn, &response, g_fdir_client_vars.
+                    network_timeout, entry->resp_cmd)) == 0)
+    {
+        result = recv_response_body(conn, entry, &response);
+    }
+    entry->result = result;
+    if (result == 0) {
+        return 0;
+    }
+
+    if (response.header.status != 0) {
+        //resend to the master later
+        if (!(result == EAGAIN && entry->min_data_version)) {
+            fdir_log_network_error(&response, conn, result);
+        }
+        return 0;
+    }
+
+    fdir_log_network_error(&response, conn, result);
+    return result;
+}
+
+static int pipeline_run(FDIRClientPipeline *pipeline,
+        ConnectionInfo *conn, const int count)
+{
+    int sent;
+    int received;
+    int end;
+    int result;
+
+    sent = received = 0;
+    while (received < count) {
+        //refill the window when half of it replied
+        if (sent < count && sent - received <= pipeline->window / 2) {
+            end = received + pipeline->window;
+            if (end > count) {
+                end = count;
+            }
+            if ((result=send_entries(pipeline, conn, sent, end)) != 0) {
+                return result;
+            }
+            sent = end;
+        }
+
+        if ((result=recv_response(pipeline, conn)) != 0) {
+            return result;
+        }
+        received++;
+    }
+
+    return 0;
+}
+
+static int pipeline_execute(FDIRClientPipeline *pipeline,
+        const int count, const bool master)
+{
+    FDIRClientContext *client_ctx;
+    ConnectionInfo *conn;
+    int result;
+    int i;
+
+    client_ctx = pipeline->client_ctx;
+    if (master) {
+        conn = client_ctx->conn_manager.get_master_connection(
+                client_ctx, &result);
+    } else {
+        conn = client_ctx->conn_manager.get_readable_connection(
+                client_ctx, &result);
+    }
+
+    if (conn != NULL) {
+        result = pipeline_run(pipeline, conn, count);
+        if (result != 0) {
+            //the responses left are unknown, so the connection is closed
+            client_ctx->conn_manager.close_connection(client_ctx, conn);
+        } else if (client_ctx->conn_manager.release_connection != NULL) {
+            client_ctx->conn_manager.release_connection(client_ctx, conn);
+        }
+    }
+
+    if (result != 0) {
+        for (i=0; i<count; i++) {
+            if (!pipeline->runs[i]->done) {
+                pipeline->runs[i]->result = result;
+            }
+        }
+    }
+    return result;
+}
+
+int fdir_client_pipeline_execute(FDIRClientPipeline *pipeline)
+{
+    FDIRClientPipelineEntry *entry;
+    FDIRClientPipelineEntry *end;
+    FDIRProtoHeader *header;
+    int count;
+    int result;
+
+    if (pipeline->count == 0) {
+        return 0;
+    }
+
+    pipeline->base_req_id = __sync_fetch_and_add(&next_req_id,
+            pipeline->count) & FDIR_PROTO_REQ_ID_MASK;
+    count = 0;
+    end = pipeline->entries + pipeline->count;
+    for (entry=pipeline->entries; entry<end; entry++) {
+        header = (FDIRProtoHeader *)(pipeline->out.buff + entry->offset);
+        FDIR_PROTO_SET_REQ_ID(header, (pipeline->base_req_id + count) &
+                FDIR_PROTO_REQ_ID_MASK);
+        entry->done = false;
+        pipeline->runs[count++] = entry;
+    }
+
+    if ((result=pipeline_execute(pipeline, count, false)) != 0) {
+        return result;
+    }
+
+    //resend to the master when the slave has not reached the min data version
+    count = 0;
+    for (entry=pipeline->entries; entry<end; entry++) {
+        if (entry->result == EAGAIN && entry->min_data_version) {
+            entry->done = false;
+            pipeline->runs[count++] = entry;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    return pipeline_execute(pipeline, count, true);
+}
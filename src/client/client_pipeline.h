@@ -0,0 +1,100 @@
+
+#ifndef _FDIR_CLIENT_PIPELINE_H
+#define _FDIR_CLIENT_PIPELINE_H
+
+#include "client_types.h"
+#include "client_proto.h"
+
+#define FDIR_CLIENT_PIPELINE_DEFAULT_WINDOW  64
+
+typedef struct fdir_client_pipeline_entry {
+    unsigned char resp_cmd;
+    bool min_data_version; //if the request with the min data version
+    bool done;
+    int offset;   //the request offset in the out buffer
+    int length;   //the request length
+    int result;   //the result of the request after executed
+    union {
+        int64_t *inode;          //for lookup inode
+        FDIRDEntryInfo *dentry;  //for stat dentry
+    } output;
+} FDIRClientPipelineEntry;
+
+/* the read requests are sent through one connection without waiting
+ * for the responses one by one, and the responses are matched by the
+ * request id, so one round trip is shared by the requests in flight.
+ * the server executes the requests of the connection in order, use more
+ * pipelines (connections) for the concurrency of the server
+ */
+typedef struct fdir_client_pipeline {
+    FDIRClientContext *client_ctx;
+    int window;   //the max requests in flight
+    int alloc;
+    int count;
+    FDIRClientPipelineEntry *entries;
+    FDIRClientPipelineEntry **runs;  //the entries to execute
+    int base_req_id;  //the request id of the first entry
+
+    struct {
+        int alloc;
+        int length;
+        char *buff;
+    } out;
+} FDIRClientPipeline;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* init the pipeline
+* params:
+*       pipeline: the pipeline to init
+*       client_ctx: the client context, the context of the cluster
+*                   by fdir_client_route_by_ns or fdir_client_route_by_inode
+*                   when the namespaces sharded
+*       window: the max requests in flight, <= 0 for the default
+* return: 0 success, !=0 fail, return the error code
+**/
+int fdir_client_pipeline_init(FDIRClientPipeline *pipeline,
+        FDIRClientContext *client_ctx, const int window);
+
+void fdir_client_pipeline_destroy(FDIRClientPipeline *pipeline);
+
+//clear the requests for reuse
+static inline void fdir_client_pipeline_reset(FDIRClientPipeline *pipeline)
+{
+    pipeline->count = 0;
+    pipeline->out.length = 0;
+}
+
+/* add the requests to the pipeline, the outputs are set by
+ * fdir_client_pipeline_execute when the result of the entry is 0
+ */
+int fdir_client_pipeline_lookup_inode(FDIRClientPipeline *pipeline,
+        const FDIRDEntryFullName *fullname, int64_t *inode);
+
+int fdir_client_pipeline_stat_dentry_by_path(FDIRClientPipeline *pipeline,
+        const FDIRDEntryFullName *fullname, FDIRDEntryInfo *dentry);
+
+int fdir_client_pipeline_stat_dentry_by_inode(FDIRClientPipeline *pipeline,
+        const int64_t inode, FDIRDEntryInfo *dentry);
+
+int fdir_client_pipeline_stat_dentry_by_pname(FDIRClientPipeline *pipeline,
+        const int64_t parent_inode, const string_t *name,
+        FDIRDEntryInfo *dentry);
+
+/**
+* send the requests and receive the responses
+* params:
+*       pipeline: the pipeline
+* return: 0 for the network success, the result of each request is
+*         pipeline->entries[i].result in the adding order
+**/
+int fdir_client_pipeline_execute(FDIRClientPipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
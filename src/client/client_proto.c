@@ -7,6 +7,7 @@
 #include "fastcommon/connection_pool.h"
 #include "fdir_proto.h"
 #include "client_global.h"
+#include "client_router.h"
 #include "client_proto.h"
 
 static inline void init_client_buffer(FDIRClientBuffer *buffer)
@@ -79,6 +80,297 @@ static inline void fdir_client_release_connection(
     }
 }
 
+static inline void client_set_update_flags(FDIRClientContext *client_ctx,
+        FDIRProtoHeader *header)
+{
+    FDIR_PROTO_SET_DURABILITY(header, client_ctx->durability_level);
+    if (client_ctx->read_your_writes) {
+        FDIR_PROTO_ADD_FLAGS(header, FDIR_PROTO_FLAGS_DATA_VERSION);
+    }
+}
+
+static inline void client_update_data_version(FDIRClientContext *client_ctx,
+        const FDIRResponseInfo *response)
+{
+    fdir_client_update_data_version(client_ctx, response->data_version);
+}
+
+/* append the min data version to read for read your writes,
+ * the out buffer should have 8 bytes room
+ */
+static inline void client_pack_min_data_version(
+        FDIRClientContext *client_ctx, char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    int64_t data_version;
+
+    if (!client_ctx->read_your_writes) {
+        return;
+    }
+    data_version = __sync_add_and_fetch(&client_ctx->data_version, 0);
+    if (data_version <= 0) {
+        return;
+    }
+
+    header = (FDIRProtoHeader *)out_buff;
+    long2buff(data_version, out_buff + *out_bytes);
+    *out_bytes += 8;
+    int2buff(*out_bytes - sizeof(FDIRProtoHeader), header->body_len);
+    FDIR_PROTO_ADD_FLAGS(header, FDIR_PROTO_FLAGS_MIN_DATA_VERSION);
+}
+
+static inline bool client_need_read_from_master(const int result,
+        const char *out_buff)
+{
+    return result == EAGAIN && (buff2short(((FDIRProtoHeader *)
+                    out_buff)->flags) & FDIR_PROTO_FLAGS_MIN_DATA_VERSION);
+}
+
+int fdir_client_pack_path_read_req(FDIRClientContext *client_ctx,
+        const unsigned char cmd, const FDIRDEntryFullName *fullname,
+        char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoDEntryInfo *proto_dentry;
+    int result;
+
+    header = (FDIRProtoHeader *)out_buff;
+    proto_dentry = (FDIRProtoDEntryInfo *)(header + 1);
+    if ((result=client_check_set_proto_dentry(fullname, proto_dentry)) != 0) {
+        return result;
+    }
+
+    *out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoDEntryInfo)
+        + fullname->ns.len + fullname->path.len;
+    FDIR_PROTO_SET_HEADER(header, cmd, *out_bytes - sizeof(FDIRProtoHeader));
+    client_pack_min_data_version(client_ctx, out_buff, out_bytes);
+    return 0;
+}
+
+void fdir_client_pack_stat_by_inode_req(FDIRClientContext *client_ctx,
+        const int64_t inode, char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+
+    header = (FDIRProtoHeader *)out_buff;
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_STAT_BY_INODE_REQ, 8);
+    long2buff(inode, out_buff + sizeof(FDIRProtoHeader));
+    *out_bytes = sizeof(FDIRProtoHeader) + 8;
+    client_pack_min_data_version(client_ctx, out_buff, out_bytes);
+}
+
+void fdir_client_pack_stat_by_pname_req(FDIRClientContext *client_ctx,
+        const int64_t parent_inode, const string_t *name,
+        char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoStatDEntryByPNameReq *req;
+
+    header = (FDIRProtoHeader *)out_buff;
+    req = (FDIRProtoStatDEntryByPNameReq *)(header + 1);
+    long2buff(parent_inode, req->parent_inode);
+    req->name_len = name->len;
+    memcpy(req->name_str, name->str, name->len);
+    *out_bytes = sizeof(FDIRProtoHeader) +
+        sizeof(FDIRProtoStatDEntryByPNameReq) + name->len;
+
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_STAT_BY_PNAME_REQ,
+            *out_bytes - sizeof(FDIRProtoHeader));
+    client_pack_min_data_version(client_ctx, out_buff, out_bytes);
+}
+
+static inline int client_check_name_length(const char *caption,
+        const string_t *name)
+{
+    if (name->len <= 0 || name->len > NAME_MAX) {
+        logError("file: "__FILE__", line: %d, "
+                "invalid %s length: %d, which <= 0 or > %d",
+                __LINE__, caption, name->len, NAME_MAX);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+int fdir_client_pack_create_dentry_req(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, const mode_t mode,
+        char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoCreateDEntryBody *entry_body;
+    int result;
+
+    header = (FDIRProtoHeader *)out_buff;
+    entry_body = (FDIRProtoCreateDEntryBody *)(header + 1);
+    if ((result=client_check_set_proto_dentry(fullname,
+                    &entry_body->dentry)) != 0)
+    {
+        return result;
+    }
+
+    int2buff(mode, entry_body->front.mode);
+    *out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoCreateDEntryBody)
+        + fullname->ns.len + fullname->path.len;
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_CREATE_DENTRY_REQ,
+            *out_bytes - sizeof(FDIRProtoHeader));
+    client_set_update_flags(client_ctx, header);
+    return 0;
+}
+
+int fdir_client_pack_create_by_pname_req(FDIRClientContext *client_ctx,
+        const string_t *ns, const int64_t parent_inode,
+        const string_t *name, const mode_t mode,
+        char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoCreateDEntryByPNameReq *req;
+    int result;
+
+    if ((result=client_check_name_length("namespace", ns)) != 0) {
+        return result;
+    }
+    if ((result=client_check_name_length("name", name)) != 0) {
+        return result;
+    }
+
+    header = (FDIRProtoHeader *)out_buff;
+    req = (FDIRProtoCreateDEntryByPNameReq *)(header + 1);
+    long2buff(parent_inode, req->parent_inode);
+    int2buff(mode, req->mode);
+    req->ns_len = ns->len;
+    memcpy(req->ns_str, ns->str, ns->len);
+    req->name_len = name->len;
+    memcpy(req->ns_str + ns->len, name->str, name->len);
+    *out_bytes = sizeof(FDIRProtoHeader) +
+        sizeof(FDIRProtoCreateDEntryByPNameReq) + ns->len + name->len;
+
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_CREATE_BY_PNAME_REQ,
+            *out_bytes - sizeof(FDIRProtoHeader));
+    client_set_update_flags(client_ctx, header);
+    return 0;
+}
+
+int fdir_client_pack_remove_dentry_req(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoRemoveDEntry *entry_body;
+    int result;
+
+    header = (FDIRProtoHeader *)out_buff;
+    entry_body = (FDIRProtoRemoveDEntry *)(header + 1);
+    if ((result=client_check_set_proto_dentry(fullname,
+                    &entry_body->dentry)) != 0)
+    {
+        return result;
+    }
+
+    *out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoRemoveDEntry)
+        + fullname->ns.len + fullname->path.len;
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_REMOVE_DENTRY_REQ,
+            *out_bytes - sizeof(FDIRProtoHeader));
+    client_set_update_flags(client_ctx, header);
+    return 0;
+}
+
+int fdir_client_pack_set_dentry_size_req(FDIRClientContext *client_ctx,
+        const string_t *ns, const int64_t inode, const int64_t size,
+        const bool force, char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoSetDentrySizeReq *proto_dentry;
+    int result;
+
+    if ((result=client_check_name_length("namespace", ns)) != 0) {
+        return result;
+    }
+
+    header = (FDIRProtoHeader *)out_buff;
+    proto_dentry = (FDIRProtoSetDentrySizeReq *)(header + 1);
+    long2buff(inode, proto_dentry->inode);
+    long2buff(size, proto_dentry->size);
+    proto_dentry->force = force;
+    proto_dentry->ns_len = ns->len;
+    memcpy(proto_dentry + 1, ns->str, ns->len);
+    *out_bytes = sizeof(FDIRProtoHeader) + sizeof(
+            FDIRProtoSetDentrySizeReq) + ns->len;
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_SET_DENTRY_SIZE_REQ,
+            *out_bytes - sizeof(FDIRProtoHeader));
+    client_set_update_flags(client_ctx, header);
+    return 0;
+}
+
+int fdir_client_pack_modify_dentry_stat_req(FDIRClientContext *client_ctx,
+        const string_t *ns, const int64_t inode, const int64_t flags,
+        const FDIRDEntryStatus *stat, char *out_buff, int *out_bytes)
+{
+    FDIRProtoHeader *header;
+    FDIRProtoModifyDentryStatReq *req;
+    int result;
+
+    if ((result=client_check_name_length("namespace", ns)) != 0) {
+        return result;
+    }
+
+    header = (FDIRProtoHeader *)out_buff;
+    req = (FDIRProtoModifyDentryStatReq *)(header + 1);
+    long2buff(inode, req->inode);
+    long2buff(flags, req->mflags);
+    req->ns_len = ns->len;
+    memcpy(req->ns_str, ns->str, ns->len);
+    fdir_proto_pack_dentry_stat(stat, &req->stat);
+    *out_bytes = sizeof(FDIRProtoHeader) + sizeof(
+            FDIRProtoModifyDentryStatReq) + ns->len;
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_MODIFY_DENTRY_STAT_REQ,
+            *out_bytes - sizeof(FDIRProtoHeader));
+    client_set_update_flags(client_ctx, header);
+    return 0;
+}
+
+/* send the read request to the readable server, and resend it to
+ * the master when the slave has not reached the min data version
+ */
+static int client_send_read_request(FDIRClientContext *client_ctx,
+        char *out_buff, const int out_bytes, FDIRResponseInfo *response,
+        const unsigned char expect_cmd, char *recv_data,
+        const int expect_body_len)
+{
+    ConnectionInfo *conn;
+    int result;
+
+    if ((conn=client_ctx->conn_manager.get_readable_connection(
+                    client_ctx, &result)) == NULL)
+    {
+        return result;
+    }
+
+    response->error.length = 0;
+    response->error.message[0] = '\0';
+    result = fdir_send_and_recv_response(conn, out_buff, out_bytes,
+            response, g_fdir_client_vars.network_timeout,
+            expect_cmd, recv_data, expect_body_len);
+    if (client_need_read_from_master(result, out_buff)) {
+        fdir_client_release_connection(client_ctx, conn, result);
+        if ((conn=client_ctx->conn_manager.get_master_connection(
+                        client_ctx, &result)) == NULL)
+        {
+            return result;
+        }
+
+        response->error.length = 0;
+        response->error.message[0] = '\0';
+        result = fdir_send_and_recv_response(conn, out_buff, out_bytes,
+                response, g_fdir_client_vars.network_timeout,
+                expect_cmd, recv_data, expect_body_len);
+    }
+
+    if (result != 0) {
+        fdir_log_network_error(response, conn, result);
+    }
+    fdir_client_release_connection(client_ctx, conn, result);
+    return result;
+}
+
 static inline void proto_unpack_dentry(FDIRProtoStatDEntryResp *proto_stat,
         FDIRDEntryInfo *dentry)
 {
@@ -86,12 +378,10 @@ static inline void proto_unpack_dentry(FDIRProtoStatDEntryResp *proto_stat,
     fdir_proto_unpack_dentry_stat(&proto_stat->stat, &dentry->stat);
 }
 
-int fdir_client_create_dentry(FDIRClientContext *client_ctx,
+static int do_create_dentry(FDIRClientContext *client_ctx,
         const FDIRDEntryFullName *fullname, const mode_t mode,
         FDIRDEntryInfo *dentry)
 {
-    FDIRProtoHeader *header;
-    FDIRProtoCreateDEntryBody *entry_body;
     int out_bytes;
     ConnectionInfo *conn;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(FDIRProtoCreateDEntryBody)
@@ -100,11 +390,8 @@ int fdir_client_create_dentry(FDIRClientContext *client_ctx,
     FDIRProtoStatDEntryResp proto_stat;
     int result;
 
-    header = (FDIRProtoHeader *)out_buff;
-    entry_body = (FDIRProtoCreateDEntryBody *)(out_buff +
-            sizeof(FDIRProtoHeader));
-    if ((result=client_check_set_proto_dentry(fullname,
-                    &entry_body->dentry)) != 0)
+    if ((result=fdir_client_pack_create_dentry_req(client_ctx, fullname,
+                    mode, out_buff, &out_bytes)) != 0)
     {
         return result;
     }
@@ -115,12 +402,6 @@ int fdir_client_create_dentry(FDIRClientContext *client_ctx,
         return result;
     }
 
-    int2buff(mode, entry_body->front.mode);
-    out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoCreateDEntryBody)
-        + fullname->ns.len + fullname->path.len;
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_CREATE_DENTRY_REQ,
-            out_bytes - sizeof(FDIRProtoHeader));
-
     response.error.length = 0;
     response.error.message[0] = '\0';
     if ((result=fdir_send_and_recv_response(conn, out_buff, out_bytes,
@@ -129,6 +410,7 @@ int fdir_client_create_dentry(FDIRClientContext *client_ctx,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
+        client_update_data_version(client_ctx, &response);
     } else {
         fdir_log_network_error(&response, conn, result);
     }
@@ -137,11 +419,28 @@ int fdir_client_create_dentry(FDIRClientContext *client_ctx,
     return result;
 }
 
-int fdir_client_remove_dentry_ex(FDIRClientContext *client_ctx,
+int fdir_client_create_dentry(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, const mode_t mode,
+        FDIRDEntryInfo *dentry)
+{
+    FDIRClientContext *cluster_ctx;
+    int result;
+
+    cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+    result = do_create_dentry(cluster_ctx, fullname, mode, dentry);
+    if (fdir_client_redirect_moved(client_ctx, cluster_ctx,
+                &fullname->ns, result))
+    {
+        cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+        result = do_create_dentry(cluster_ctx, fullname, mode, dentry);
+    }
+
+    return result;
+}
+
+static int do_remove_dentry(FDIRClientContext *client_ctx,
         const FDIRDEntryFullName *fullname, FDIRDEntryInfo *dentry)
 {
-    FDIRProtoHeader *header;
-    FDIRProtoRemoveDEntry *entry_body;
     int out_bytes;
     ConnectionInfo *conn;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(FDIRProtoRemoveDEntry)
@@ -150,11 +449,8 @@ int fdir_client_remove_dentry_ex(FDIRClientContext *client_ctx,
     FDIRProtoStatDEntryResp proto_stat;
     int result;
 
-    header = (FDIRProtoHeader *)out_buff;
-    entry_body = (FDIRProtoRemoveDEntry *)(out_buff +
-            sizeof(FDIRProtoHeader));
-    if ((result=client_check_set_proto_dentry(fullname,
-                    &entry_body->dentry)) != 0)
+    if ((result=fdir_client_pack_remove_dentry_req(client_ctx,
+                    fullname, out_buff, &out_bytes)) != 0)
     {
         return result;
     }
@@ -165,11 +461,6 @@ int fdir_client_remove_dentry_ex(FDIRClientContext *client_ctx,
         return result;
     }
 
-    out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoRemoveDEntry)
-        + fullname->ns.len + fullname->path.len;
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_REMOVE_DENTRY_REQ,
-            out_bytes - sizeof(FDIRProtoHeader));
-
     response.error.length = 0;
     response.error.message[0] = '\0';
     if ((result=fdir_send_and_recv_response(conn, out_buff, out_bytes,
@@ -178,6 +469,7 @@ int fdir_client_remove_dentry_ex(FDIRClientContext *client_ctx,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
+        client_update_data_version(client_ctx, &response);
     } else {
         fdir_log_network_error(&response, conn, result);
     }
@@ -186,134 +478,135 @@ int fdir_client_remove_dentry_ex(FDIRClientContext *client_ctx,
     return result;
 }
 
-int fdir_client_lookup_inode(FDIRClientContext *client_ctx,
+int fdir_client_remove_dentry_ex(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, FDIRDEntryInfo *dentry)
+{
+    FDIRClientContext *cluster_ctx;
+    int result;
+
+    cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+    result = do_remove_dentry(cluster_ctx, fullname, dentry);
+    if (fdir_client_redirect_moved(client_ctx, cluster_ctx,
+                &fullname->ns, result))
+    {
+        cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+        result = do_remove_dentry(cluster_ctx, fullname, dentry);
+    }
+
+    return result;
+}
+
+static int do_lookup_inode(FDIRClientContext *client_ctx,
         const FDIRDEntryFullName *fullname, int64_t *inode)
 {
-    ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    FDIRProtoDEntryInfo *proto_dentry;
-    char out_buff[sizeof(FDIRProtoHeader) + sizeof(FDIRProtoDEntryInfo)
-        + NAME_MAX + PATH_MAX];
+    char out_buff[FDIR_CLIENT_READ_REQ_MAX_SIZE];
     FDIRResponseInfo response;
     FDIRProtoLookupInodeResp proto_resp;
     int out_bytes;
     int result;
 
-    header = (FDIRProtoHeader *)out_buff;
-    proto_dentry = (FDIRProtoDEntryInfo *)(header + 1);
-    if ((result=client_check_set_proto_dentry(fullname, proto_dentry)) != 0) {
-        *inode = -1;
-        return result;
-    }
-
-    if ((conn=client_ctx->conn_manager.get_readable_connection(
-                    client_ctx, &result)) == NULL)
+    if ((result=fdir_client_pack_path_read_req(client_ctx,
+                    FDIR_SERVICE_PROTO_LOOKUP_INODE_REQ, fullname,
+                    out_buff, &out_bytes)) != 0)
     {
         *inode = -1;
         return result;
     }
 
-    out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoDEntryInfo)
-        + fullname->ns.len + fullname->path.len;
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_LOOKUP_INODE_REQ,
-            out_bytes - sizeof(FDIRProtoHeader));
-
-    response.error.length = 0;
-    response.error.message[0] = '\0';
-    if ((result=fdir_send_and_recv_response(conn, out_buff, out_bytes,
-                    &response, g_fdir_client_vars.network_timeout,
-                    FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP,
+    if ((result=client_send_read_request(client_ctx, out_buff, out_bytes,
+                    &response, FDIR_SERVICE_PROTO_LOOKUP_INODE_RESP,
                     (char *)&proto_resp, sizeof(proto_resp))) == 0)
     {
         *inode = buff2long(proto_resp.inode);
     } else {
         *inode = -1;
-        fdir_log_network_error(&response, conn, result);
     }
 
-    fdir_client_release_connection(client_ctx, conn, result);
     return result;
 }
 
-int fdir_client_stat_dentry_by_path(FDIRClientContext *client_ctx,
+int fdir_client_lookup_inode(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, int64_t *inode)
+{
+    FDIRClientContext *cluster_ctx;
+    int result;
+
+    cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+    result = do_lookup_inode(cluster_ctx, fullname, inode);
+    if (fdir_client_redirect_moved(client_ctx, cluster_ctx,
+                &fullname->ns, result))
+    {
+        cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+        result = do_lookup_inode(cluster_ctx, fullname, inode);
+    }
+
+    return result;
+}
+
+static int do_stat_dentry_by_path(FDIRClientContext *client_ctx,
         const FDIRDEntryFullName *fullname, FDIRDEntryInfo *dentry)
 {
-    ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    FDIRProtoDEntryInfo *proto_dentry;
-    char out_buff[sizeof(FDIRProtoHeader) + sizeof(FDIRProtoDEntryInfo)
-        + NAME_MAX + PATH_MAX];
+    char out_buff[FDIR_CLIENT_READ_REQ_MAX_SIZE];
     FDIRResponseInfo response;
     FDIRProtoStatDEntryResp proto_stat;
     int out_bytes;
     int result;
 
-    header = (FDIRProtoHeader *)out_buff;
-    proto_dentry = (FDIRProtoDEntryInfo *)(header + 1);
-    if ((result=client_check_set_proto_dentry(fullname, proto_dentry)) != 0) {
+    if ((result=fdir_client_pack_path_read_req(client_ctx,
+                    FDIR_SERVICE_PROTO_STAT_BY_PATH_REQ, fullname,
+                    out_buff, &out_bytes)) != 0)
+    {
         return result;
     }
 
-    if ((conn=client_ctx->conn_manager.get_readable_connection(
-                    client_ctx, &result)) == NULL)
+    if ((result=client_send_read_request(client_ctx, out_buff, out_bytes,
+                    &response, FDIR_SERVICE_PROTO_STAT_BY_PATH_RESP,
+                    (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
-        return result;
+        proto_unpack_dentry(&proto_stat, dentry);
     }
 
-    out_bytes = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoDEntryInfo)
-        + fullname->ns.len + fullname->path.len;
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_STAT_BY_PATH_REQ,
-            out_bytes - sizeof(FDIRProtoHeader));
+    return result;
+}
 
-    response.error.length = 0;
-    response.error.message[0] = '\0';
-    if ((result=fdir_send_and_recv_response(conn, out_buff, out_bytes,
-                    &response, g_fdir_client_vars.network_timeout,
-                    FDIR_SERVICE_PROTO_STAT_BY_PATH_RESP,
-                    (char *)&proto_stat, sizeof(proto_stat))) == 0)
+int fdir_client_stat_dentry_by_path(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, FDIRDEntryInfo *dentry)
+{
+    FDIRClientContext *cluster_ctx;
+    int result;
+
+    cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+    result = do_stat_dentry_by_path(cluster_ctx, fullname, dentry);
+    if (fdir_client_redirect_moved(client_ctx, cluster_ctx,
+                &fullname->ns, result))
     {
-        proto_unpack_dentry(&proto_stat, dentry);
-    } else {
-        fdir_log_network_error(&response, conn, result);
+        cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+        result = do_stat_dentry_by_path(cluster_ctx, fullname, dentry);
     }
 
-    fdir_client_release_connection(client_ctx, conn, result);
     return result;
 }
 
 int fdir_client_stat_dentry_by_inode(FDIRClientContext *client_ctx,
         const int64_t inode, FDIRDEntryInfo *dentry)
 {
-    ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    char out_buff[sizeof(FDIRProtoHeader) + 8];
+    char out_buff[sizeof(FDIRProtoHeader) + 8 + 8];
     FDIRResponseInfo response;
     FDIRProtoStatDEntryResp proto_stat;
+    int out_bytes;
     int result;
 
-    header = (FDIRProtoHeader *)out_buff;
-    if ((conn=client_ctx->conn_manager.get_readable_connection(
-                    client_ctx, &result)) == NULL)
-    {
-        return result;
-    }
-
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_STAT_BY_INODE_REQ, 8);
-    long2buff(inode, out_buff + sizeof(FDIRProtoHeader));
+    client_ctx = fdir_client_route_by_inode(client_ctx, inode);
+    fdir_client_pack_stat_by_inode_req(client_ctx, inode,
+            out_buff, &out_bytes);
 
-    response.error.length = 0;
-    response.error.message[0] = '\0';
-    if ((result=fdir_send_and_recv_response(conn, out_buff, sizeof(out_buff),
-                    &response, g_fdir_client_vars.network_timeout,
-                    FDIR_SERVICE_PROTO_STAT_BY_INODE_RESP,
+    if ((result=client_send_read_request(client_ctx, out_buff, out_bytes,
+                    &response, FDIR_SERVICE_PROTO_STAT_BY_INODE_RESP,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
-    } else {
-        fdir_log_network_error(&response, conn, result);
     }
 
-    fdir_client_release_connection(client_ctx, conn, result);
     return result;
 }
 
@@ -321,46 +614,24 @@ int fdir_client_stat_dentry_by_pname(FDIRClientContext *client_ctx,
         const int64_t parent_inode, const string_t *name,
         FDIRDEntryInfo *dentry)
 {
-    ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    FDIRProtoStatDEntryByPNameReq *req;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(
-            FDIRProtoStatDEntryByPNameReq) + NAME_MAX];
+            FDIRProtoStatDEntryByPNameReq) + NAME_MAX + 8];
     FDIRResponseInfo response;
     FDIRProtoStatDEntryResp proto_stat;
     int pkg_len;
     int result;
 
-    if ((conn=client_ctx->conn_manager.get_readable_connection(
-                    client_ctx, &result)) == NULL)
-    {
-        return result;
-    }
-
-    header = (FDIRProtoHeader *)out_buff;
-    req = (FDIRProtoStatDEntryByPNameReq *)(header + 1);
-    long2buff(parent_inode, req->parent_inode);
-    req->name_len = name->len;
-    memcpy(req->name_str, name->str, name->len);
-    pkg_len = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoStatDEntryByPNameReq) +
-        name->len;
+    client_ctx = fdir_client_route_by_inode(client_ctx, parent_inode);
+    fdir_client_pack_stat_by_pname_req(client_ctx, parent_inode,
+            name, out_buff, &pkg_len);
 
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_STAT_BY_PNAME_REQ,
-            pkg_len - sizeof(FDIRProtoHeader));
-
-    response.error.length = 0;
-    response.error.message[0] = '\0';
-    if ((result=fdir_send_and_recv_response(conn, out_buff, pkg_len,
-                    &response, g_fdir_client_vars.network_timeout,
-                    FDIR_SERVICE_PROTO_STAT_BY_PNAME_RESP,
+    if ((result=client_send_read_request(client_ctx, out_buff, pkg_len,
+                    &response, FDIR_SERVICE_PROTO_STAT_BY_PNAME_RESP,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
-    } else {
-        fdir_log_network_error(&response, conn, result);
     }
 
-    fdir_client_release_connection(client_ctx, conn, result);
     return result;
 }
 
@@ -369,8 +640,6 @@ int fdir_client_create_dentry_by_pname(FDIRClientContext *client_ctx,
         const string_t *name, const mode_t mode, FDIRDEntryInfo *dentry)
 {
     ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    FDIRProtoCreateDEntryByPNameReq *req;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(
             FDIRProtoCreateDEntryByPNameReq) + 2 * NAME_MAX];
     FDIRResponseInfo response;
@@ -378,26 +647,20 @@ int fdir_client_create_dentry_by_pname(FDIRClientContext *client_ctx,
     int pkg_len;
     int result;
 
+    client_ctx = fdir_client_route_by_ns(client_ctx, ns);
+
+    if ((result=fdir_client_pack_create_by_pname_req(client_ctx, ns,
+                    parent_inode, name, mode, out_buff, &pkg_len)) != 0)
+    {
+        return result;
+    }
+
     if ((conn=client_ctx->conn_manager.get_master_connection(
                     client_ctx, &result)) == NULL)
     {
         return result;
     }
 
-    header = (FDIRProtoHeader *)out_buff;
-    req = (FDIRProtoCreateDEntryByPNameReq *)(header + 1);
-    long2buff(parent_inode, req->parent_inode);
-    int2buff(mode, req->mode);
-    req->ns_len = ns->len;
-    memcpy(req->ns_str, ns->str, ns->len);
-    req->name_len = name->len;
-    memcpy(req->ns_str + ns->len, name->str, name->len);
-    pkg_len = sizeof(FDIRProtoHeader) + sizeof(FDIRProtoCreateDEntryByPNameReq) +
-        ns->len + name->len;
-
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_CREATE_BY_PNAME_REQ,
-            pkg_len - sizeof(FDIRProtoHeader));
-
     response.error.length = 0;
     response.error.message[0] = '\0';
     if ((result=fdir_send_and_recv_response(conn, out_buff, pkg_len,
@@ -406,6 +669,7 @@ int fdir_client_create_dentry_by_pname(FDIRClientContext *client_ctx,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
+        client_update_data_version(client_ctx, &response);
     } else {
         fdir_log_network_error(&response, conn, result);
     }
@@ -419,8 +683,6 @@ int fdir_client_set_dentry_size(FDIRClientContext *client_ctx,
         const bool force, FDIRDEntryInfo *dentry)
 {
     ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    FDIRProtoSetDentrySizeReq *proto_dentry;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(
             FDIRProtoSetDentrySizeReq) + NAME_MAX];
     FDIRResponseInfo response;
@@ -428,11 +690,12 @@ int fdir_client_set_dentry_size(FDIRClientContext *client_ctx,
     int pkg_len;
     int result;
 
-    if (ns->len <= 0 || ns->len > NAME_MAX) {
-        logError("file: "__FILE__", line: %d, "
-                "invalid namespace length: %d, which <= 0 or > %d",
-                __LINE__, ns->len, NAME_MAX);
-        return EINVAL;
+    client_ctx = fdir_client_route_by_inode(client_ctx, inode);
+
+    if ((result=fdir_client_pack_set_dentry_size_req(client_ctx, ns,
+                    inode, size, force, out_buff, &pkg_len)) != 0)
+    {
+        return result;
     }
 
     if ((conn=client_ctx->conn_manager.get_master_connection(
@@ -441,18 +704,6 @@ int fdir_client_set_dentry_size(FDIRClientContext *client_ctx,
         return result;
     }
 
-    header = (FDIRProtoHeader *)out_buff;
-    proto_dentry = (FDIRProtoSetDentrySizeReq *)(header + 1);
-    long2buff(inode, proto_dentry->inode);
-    long2buff(size, proto_dentry->size);
-    proto_dentry->force = force;
-    proto_dentry->ns_len = ns->len;
-    memcpy(proto_dentry + 1, ns->str, ns->len);
-    pkg_len = sizeof(FDIRProtoHeader) + sizeof(
-            FDIRProtoSetDentrySizeReq) + ns->len;
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_SET_DENTRY_SIZE_REQ,
-            pkg_len - sizeof(FDIRProtoHeader));
-
     response.error.length = 0;
     response.error.message[0] = '\0';
     if ((result=fdir_send_and_recv_response(conn, out_buff, pkg_len,
@@ -461,6 +712,7 @@ int fdir_client_set_dentry_size(FDIRClientContext *client_ctx,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
+        client_update_data_version(client_ctx, &response);
     } else {
         fdir_log_network_error(&response, conn, result);
     }
@@ -474,8 +726,6 @@ int fdir_client_modify_dentry_stat(FDIRClientContext *client_ctx,
         const FDIRDEntryStatus *stat, FDIRDEntryInfo *dentry)
 {
     ConnectionInfo *conn;
-    FDIRProtoHeader *header;
-    FDIRProtoModifyDentryStatReq *req;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(
             FDIRProtoModifyDentryStatReq) + NAME_MAX];
     FDIRResponseInfo response;
@@ -483,11 +733,12 @@ int fdir_client_modify_dentry_stat(FDIRClientContext *client_ctx,
     int pkg_len;
     int result;
 
-    if (ns->len <= 0 || ns->len > NAME_MAX) {
-        logError("file: "__FILE__", line: %d, "
-                "invalid namespace length: %d, which <= 0 or > %d",
-                __LINE__, ns->len, NAME_MAX);
-        return EINVAL;
+    client_ctx = fdir_client_route_by_inode(client_ctx, inode);
+
+    if ((result=fdir_client_pack_modify_dentry_stat_req(client_ctx, ns,
+                    inode, flags, stat, out_buff, &pkg_len)) != 0)
+    {
+        return result;
     }
 
     if ((conn=client_ctx->conn_manager.get_master_connection(
@@ -496,18 +747,6 @@ int fdir_client_modify_dentry_stat(FDIRClientContext *client_ctx,
         return result;
     }
 
-    header = (FDIRProtoHeader *)out_buff;
-    req = (FDIRProtoModifyDentryStatReq *)(header + 1);
-    long2buff(inode, req->inode);
-    long2buff(flags, req->mflags);
-    req->ns_len = ns->len;
-    memcpy(req->ns_str, ns->str, ns->len);
-    fdir_proto_pack_dentry_stat(stat, &req->stat);
-    pkg_len = sizeof(FDIRProtoHeader) + sizeof(
-            FDIRProtoModifyDentryStatReq) + ns->len;
-    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_MODIFY_DENTRY_STAT_REQ,
-            pkg_len - sizeof(FDIRProtoHeader));
-
     response.error.length = 0;
     response.error.message[0] = '\0';
     if ((result=fdir_send_and_recv_response(conn, out_buff, pkg_len,
@@ -516,6 +755,7 @@ int fdir_client_modify_dentry_stat(FDIRClientContext *client_ctx,
                     (char *)&proto_stat, sizeof(proto_stat))) == 0)
     {
         proto_unpack_dentry(&proto_stat, dentry);
+        client_update_data_version(client_ctx, &response);
     } else {
         fdir_log_network_error(&response, conn, result);
     }
@@ -528,6 +768,14 @@ int fdir_client_init_session(FDIRClientContext *client_ctx,
     FDIRClientSession *session)
 {
     int result;
+
+    //bind to the cluster of the inode when the first flock
+    if (client_ctx->router.count > 0) {
+        session->mconn = NULL;
+        session->ctx = client_ctx;
+        return 0;
+    }
+
     if ((session->mconn=client_ctx->conn_manager.get_master_connection(
                     client_ctx, &result)) == NULL)
     {
@@ -566,7 +814,24 @@ int fdir_client_flock_dentry_ex2(FDIRClientSession *session,
     int result;
 
     if (session->mconn == NULL) {
-        return EFAULT;
+        if (session->ctx == NULL || session->ctx->router.count == 0) {
+            return EFAULT;
+        }
+
+        session->ctx = fdir_client_route_by_inode(session->ctx, inode);
+        if ((session->mconn=session->ctx->conn_manager.get_master_connection(
+                        session->ctx, &result)) == NULL)
+        {
+            return result;
+        }
+    } else if (session->ctx->cluster_id > 0 && session->ctx->cluster_id !=
+            FDIR_GET_CLUSTER_ID_BY_INODE(inode))
+    {
+        logError("file: "__FILE__", line: %d, "
+                "the session bound to cluster %d, can't flock the "
+                "inode %"PRId64" of another cluster", __LINE__,
+                session->ctx->cluster_id, inode);
+        return EXDEV;
     }
 
     header = (FDIRProtoHeader *)out_buff;
@@ -606,6 +871,8 @@ int fdir_client_getlk_dentry(FDIRClientContext *client_ctx,
     FDIRResponseInfo response;
     int result;
 
+    client_ctx = fdir_client_route_by_inode(client_ctx, inode);
+
     if ((conn=client_ctx->conn_manager.get_master_connection(
                     client_ctx, &result)) == NULL)
     {
@@ -653,6 +920,8 @@ int fdir_client_dentry_sys_lock(FDIRClientContext *client_ctx,
     FDIRResponseInfo response;
     int result;
 
+    client_ctx = fdir_client_route_by_inode(client_ctx, inode);
+
     if ((conn=client_ctx->conn_manager.get_master_connection(
                     client_ctx, &result)) == NULL)
     {
@@ -697,6 +966,8 @@ int fdir_client_dentry_sys_unlock_ex(FDIRClientContext *client_ctx,
     int pkg_len;
     int result;
 
+    client_ctx = fdir_client_route_by_inode(client_ctx, inode);
+
     if (ns != NULL) {
         if (ns->len <= 0 || ns->len > NAME_MAX) {
             logError("file: "__FILE__", line: %d, "
@@ -732,14 +1003,17 @@ int fdir_client_dentry_sys_unlock_ex(FDIRClientContext *client_ctx,
             FDIRProtoSysUnlockDEntryReq) + req->ns_len;
     FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_SYS_UNLOCK_DENTRY_REQ,
             pkg_len - sizeof(FDIRProtoHeader));
+    client_set_update_flags(client_ctx, header);
 
     response.error.length = 0;
     response.error.message[0] = '\0';
     if ((result=fdir_send_and_recv_response(conn, out_buff, pkg_len,
                     &response, g_fdir_client_vars.network_timeout,
                     FDIR_SERVICE_PROTO_SYS_UNLOCK_DENTRY_RESP,
-                    NULL, 0)) != 0)
+                    NULL, 0)) == 0)
     {
+        client_update_data_version(client_ctx, &response);
+    } else {
         fdir_log_network_error(&response, conn, result);
     }
 
@@ -983,7 +1257,25 @@ static int deal_list_dentry_response(ConnectionInfo *conn,
     return result;
 }
 
-int fdir_client_list_dentry(FDIRClientContext *client_ctx,
+static int do_list_dentry_first(ConnectionInfo *conn, char *out_buff,
+        const int out_bytes, FDIRResponseInfo *response,
+        FDIRClientDentryArray *array)
+{
+    int result;
+
+    response->error.length = 0;
+    response->error.message[0] = '\0';
+    if ((result=fdir_send_and_check_response_header(conn, out_buff,
+                    out_bytes, response, g_fdir_client_vars.
+                    network_timeout, FDIR_SERVICE_PROTO_LIST_DENTRY_RESP)) == 0)
+    {
+        result = deal_list_dentry_response(conn, response, array);
+    }
+
+    return result;
+}
+
+static int do_list_dentry(FDIRClientContext *client_ctx,
         const FDIRDEntryFullName *fullname, FDIRClientDentryArray *array)
 {
     FDIRProtoHeader *header;
@@ -991,7 +1283,7 @@ int fdir_client_list_dentry(FDIRClientContext *client_ctx,
     int out_bytes;
     ConnectionInfo *conn;
     char out_buff[sizeof(FDIRProtoHeader) + sizeof(FDIRProtoListDEntryFirstBody)
-        + NAME_MAX + PATH_MAX];
+        + NAME_MAX + PATH_MAX + 8];
     FDIRResponseInfo response;
     int result;
 
@@ -1015,18 +1307,23 @@ int fdir_client_list_dentry(FDIRClientContext *client_ctx,
         + fullname->ns.len + fullname->path.len;
     FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_LIST_DENTRY_FIRST_REQ,
             out_bytes - sizeof(FDIRProtoHeader));
+    client_pack_min_data_version(client_ctx, out_buff, &out_bytes);
 
     if (array->name_allocator.used) {
         fast_mpool_reset(&array->name_allocator.mpool);  //buffer recycle
         array->name_allocator.used = false;
     }
-    response.error.length = 0;
-    response.error.message[0] = '\0';
-    if ((result=fdir_send_and_check_response_header(conn, out_buff,
-                    out_bytes, &response, g_fdir_client_vars.
-                    network_timeout, FDIR_SERVICE_PROTO_LIST_DENTRY_RESP)) == 0)
-    {
-        result = deal_list_dentry_response(conn, &response, array);
+    result = do_list_dentry_first(conn, out_buff, out_bytes,
+            &response, array);
+    if (client_need_read_from_master(result, out_buff)) {
+        fdir_client_release_connection(client_ctx, conn, result);
+        if ((conn=client_ctx->conn_manager.get_master_connection(
+                        client_ctx, &result)) == NULL)
+        {
+            return result;
+        }
+        result = do_list_dentry_first(conn, out_buff, out_bytes,
+                &response, array);
     }
 
     if (result != 0) {
@@ -1037,6 +1334,24 @@ int fdir_client_list_dentry(FDIRClientContext *client_ctx,
     return result;
 }
 
+int fdir_client_list_dentry(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, FDIRClientDentryArray *array)
+{
+    FDIRClientContext *cluster_ctx;
+    int result;
+
+    cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+    result = do_list_dentry(cluster_ctx, fullname, array);
+    if (fdir_client_redirect_moved(client_ctx, cluster_ctx,
+                &fullname->ns, result))
+    {
+        cluster_ctx = fdir_client_route_by_ns(client_ctx, &fullname->ns);
+        result = do_list_dentry(cluster_ctx, fullname, array);
+    }
+
+    return result;
+}
+
 int fdir_client_service_stat(FDIRClientContext *client_ctx,
         const char *ip_addr, const int port, FDIRClientServiceStat *stat)
 {
@@ -1048,6 +1363,8 @@ int fdir_client_service_stat(FDIRClientContext *client_ctx,
     FDIRProtoServiceStatResp stat_resp;
     int result;
 
+    client_ctx = fdir_client_route_default(client_ctx);
+
     conn_pool_set_server_info(&target_conn, ip_addr, port);
     if ((conn=client_ctx->conn_manager.get_spec_connection(
                     client_ctx, &target_conn, &result)) == NULL)
@@ -1105,6 +1422,8 @@ int fdir_client_cluster_stat(FDIRClientContext *client_ctx,
     int result;
     int calc_size;
 
+    client_ctx = fdir_client_route_default(client_ctx);
+
     if ((conn=client_ctx->conn_manager.get_master_connection(
                     client_ctx, &result)) == NULL)
     {
@@ -1171,6 +1490,10 @@ int fdir_client_cluster_stat(FDIRClientContext *client_ctx,
             memcpy(stat->ip_addr, body_part->ip_addr, IP_ADDRESS_SIZE);
             *(stat->ip_addr + IP_ADDRESS_SIZE - 1) = '\0';
             stat->port = buff2short(body_part->port);
+            stat->replication_lag.data_versions = buff2long(
+                    body_part->replication_lag.data_versions);
+            stat->replication_lag.bytes = buff2long(
+                    body_part->replication_lag.bytes);
         }
     }
 
@@ -1194,6 +1517,8 @@ int fdir_client_get_master(FDIRClientContext *client_ctx,
     FDIRProtoGetServerResp server_resp;
     char out_buff[sizeof(FDIRProtoHeader)];
 
+    client_ctx = fdir_client_route_default(client_ctx);
+
     conn = client_ctx->conn_manager.get_connection(client_ctx, &result);
     if (conn == NULL) {
         return result;
@@ -1229,6 +1554,8 @@ int fdir_client_get_readable_server(FDIRClientContext *client_ctx,
     FDIRProtoGetServerResp server_resp;
     char out_buff[sizeof(FDIRProtoHeader)];
 
+    client_ctx = fdir_client_route_default(client_ctx);
+
     conn = client_ctx->conn_manager.get_connection(client_ctx, &result);
     if (conn == NULL) {
         return result;
@@ -1270,6 +1597,8 @@ int fdir_client_get_slaves(FDIRClientContext *client_ctx,
     int result;
     int calc_size;
 
+    client_ctx = fdir_client_route_default(client_ctx);
+
     if ((conn=client_ctx->conn_manager.get_connection(
                     client_ctx, &result)) == NULL)
     {
@@ -1347,3 +1676,43 @@ int fdir_client_get_slaves(FDIRClientContext *client_ctx,
 
     return result;
 }
+
+int fdir_client_transfer_master(FDIRClientContext *client_ctx,
+        const int server_id)
+{
+    int result;
+    ConnectionInfo *conn;
+    FDIRProtoHeader *header;
+    FDIRProtoTransferMasterReq *req;
+    FDIRResponseInfo response;
+    char out_buff[sizeof(FDIRProtoHeader) +
+        sizeof(FDIRProtoTransferMasterReq)];
+
+    client_ctx = fdir_client_route_default(client_ctx);
+
+    if ((conn=client_ctx->conn_manager.get_master_connection(
+                    client_ctx, &result)) == NULL)
+    {
+        return result;
+    }
+
+    header = (FDIRProtoHeader *)out_buff;
+    req = (FDIRProtoTransferMasterReq *)(out_buff + sizeof(FDIRProtoHeader));
+    FDIR_PROTO_SET_HEADER(header, FDIR_SERVICE_PROTO_TRANSFER_MASTER_REQ,
+            sizeof(out_buff) - sizeof(FDIRProtoHeader));
+    int2buff(server_id, req->server_id);
+
+    //the master waits for the target catching up before responding
+    response.error.length = 0;
+    response.error.message[0] = '\0';
+    if ((result=fdir_send_and_recv_response(conn, out_buff, sizeof(out_buff),
+                    &response, 2 * g_fdir_client_vars.network_timeout,
+                    FDIR_SERVICE_PROTO_TRANSFER_MASTER_RESP,
+                    NULL, 0)) != 0)
+    {
+        fdir_log_network_error(&response, conn, result);
+    }
+
+    fdir_client_release_connection(client_ctx, conn, result);
+    return result;
+}
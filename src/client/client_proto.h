@@ -4,6 +4,14 @@
 
 #include "fastcommon/fast_mpool.h"
 #include "fdir_types.h"
+#include "fdir_proto.h"
+#include "client_types.h"
+
+/* the max package size of the read requests by path,
+ * it is larger than the update requests by path too
+ */
+#define FDIR_CLIENT_READ_REQ_MAX_SIZE  (sizeof(FDIRProtoHeader) + \
+        sizeof(FDIRProtoDEntryInfo) + NAME_MAX + PATH_MAX + 8)
 
 typedef struct fdir_client_dentry {
     string_t name;
@@ -55,6 +63,10 @@ typedef struct fdir_client_cluster_stat_entry {
     char status;
     char ip_addr[IP_ADDRESS_SIZE];
     short port;
+    struct {
+        int64_t data_versions;  //not replied by the slave
+        int64_t bytes;          //queued and in flight to the slave
+    } replication_lag;  //-1 for not syncing
 } FDIRClientClusterStatEntry;
 
 #ifdef __cplusplus
@@ -166,6 +178,69 @@ int fdir_client_get_slaves(FDIRClientContext *client_ctx,
 int fdir_client_get_readable_server(FDIRClientContext *client_ctx,
         FDIRClientServerEntry *server);
 
+/* hand over the master to the slave gracefully,
+ * server_id: the target slave, 0 for the most up-to-date one
+ */
+int fdir_client_transfer_master(FDIRClientContext *client_ctx,
+        const int server_id);
+
+/* pack the read requests for the pipelined and the asynchronous calls,
+ * the min data version for read your writes is appended,
+ * the out buffer should be FDIR_CLIENT_READ_REQ_MAX_SIZE bytes at least
+ *
+ * cmd: FDIR_SERVICE_PROTO_LOOKUP_INODE_REQ or
+ *      FDIR_SERVICE_PROTO_STAT_BY_PATH_REQ
+ */
+int fdir_client_pack_path_read_req(FDIRClientContext *client_ctx,
+        const unsigned char cmd, const FDIRDEntryFullName *fullname,
+        char *out_buff, int *out_bytes);
+
+void fdir_client_pack_stat_by_inode_req(FDIRClientContext *client_ctx,
+        const int64_t inode, char *out_buff, int *out_bytes);
+
+void fdir_client_pack_stat_by_pname_req(FDIRClientContext *client_ctx,
+        const int64_t parent_inode, const string_t *name,
+        char *out_buff, int *out_bytes);
+
+/* pack the update requests for the asynchronous calls, the durability
+ * and the data version flags are set by the client context,
+ * the out buffer should be FDIR_CLIENT_READ_REQ_MAX_SIZE bytes at least
+ */
+int fdir_client_pack_create_dentry_req(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, const mode_t mode,
+        char *out_buff, int *out_bytes);
+
+int fdir_client_pack_create_by_pname_req(FDIRClientContext *client_ctx,
+        const string_t *ns, const int64_t parent_inode,
+        const string_t *name, const mode_t mode,
+        char *out_buff, int *out_bytes);
+
+int fdir_client_pack_remove_dentry_req(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, char *out_buff, int *out_bytes);
+
+int fdir_client_pack_set_dentry_size_req(FDIRClientContext *client_ctx,
+        const string_t *ns, const int64_t inode, const int64_t size,
+        const bool force, char *out_buff, int *out_bytes);
+
+int fdir_client_pack_modify_dentry_stat_req(FDIRClientContext *client_ctx,
+        const string_t *ns, const int64_t inode, const int64_t flags,
+        const FDIRDEntryStatus *stat, char *out_buff, int *out_bytes);
+
+//keep the max data version of the update operations for read your writes
+static inline void fdir_client_update_data_version(
+        FDIRClientContext *client_ctx, const int64_t data_version)
+{
+    int64_t old_version;
+
+    do {
+        old_version = __sync_add_and_fetch(&client_ctx->data_version, 0);
+        if (data_version <= old_version) {
+            break;
+        }
+    } while (!__sync_bool_compare_and_swap(&client_ctx->data_version,
+                old_version, data_version));
+}
+
 
 static inline void fdir_log_network_error_ex(FDIRResponseInfo *response,
         const ConnectionInfo *conn, const int result, const int line)
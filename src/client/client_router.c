@@ -0,0 +1,452 @@
+#include <sys/stat.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/hash.h"
+#include "fastcommon/pthread_func.h"
+#include "client_global.h"
+#include "client_func.h"
+#include "client_proto.h"
+#include "client_router.h"
+
+#define CLUSTER_SECTION_PREFIX  "cluster-"
+#define NAMESPACE_MAP_SECTION   "namespace-map"
+
+static int parse_cluster_ids(const char *conf_filename,
+        const char *value, int *ids, int *count)
+{
+    const char *p;
+    char *end;
+    long id;
+    int i;
+
+    *count = 0;
+    p = value;
+    while (*p != '\0') {
+        if (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+            continue;
+        }
+
+        id = strtol(p, &end, 10);
+        if (end == p || id <= 0 || id > FDIR_CLUSTER_ID_MAX) {
+            logError("file: "__FILE__", line: %d, "
+                    "conf file \"%s\", invalid cluster_ids: %s, "
+                    "the cluster id should be in [1, %d]", __LINE__,
+                    conf_filename, value, FDIR_CLUSTER_ID_MAX);
+            return EINVAL;
+        }
+
+        for (i=0; i<*count; i++) {
+            if (ids[i] == id) {
+                logError("file: "__FILE__", line: %d, "
+                        "conf file \"%s\", duplicate cluster id: %ld",
+                        __LINE__, conf_filename, id);
+                return EEXIST;
+            }
+        }
+
+        ids[(*count)++] = id;
+        p = end;
+    }
+
+    if (*count == 0) {
+        logError("file: "__FILE__", line: %d, "
+                "conf file \"%s\", empty cluster_ids",
+                __LINE__, conf_filename);
+        return EINVAL;
+    }
+    return 0;
+}
+
+static int init_clusters(FDIRClientContext *client_ctx,
+        const char *conf_filename, IniContext *ini_context,
+        const int *ids, const int count)
+{
+    FDIRClientContext *cluster;
+    char section_name[64];
+    int bytes;
+    int result;
+    int i;
+
+    bytes = sizeof(FDIRClientContext) * count;
+    client_ctx->router.clusters = (FDIRClientContext *)malloc(bytes);
+    if (client_ctx->router.clusters == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(client_ctx->router.clusters, 0, bytes);
+    client_ctx->router.count = count;
+
+    for (i=0; i<count; i++) {
+        cluster = client_ctx->router.clusters + i;
+        cluster->cluster_id = ids[i];
+        cluster->durability_level = client_ctx->durability_level;
+        cluster->read_your_writes = client_ctx->read_your_writes;
+
+        snprintf(section_name, sizeof(section_name), "%s%d",
+                CLUSTER_SECTION_PREFIX, ids[i]);
+        if ((result=fdir_load_server_group_ex(&cluster->server_group,
+                        conf_filename, section_name, ini_context)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int compare_route_point(const void *p1, const void *p2)
+{
+    unsigned int hash_code1;
+    unsigned int hash_code2;
+
+    hash_code1 = ((const FDIRClientRoutePoint *)p1)->hash_code;
+    hash_code2 = ((const FDIRClientRoutePoint *)p2)->hash_code;
+    if (hash_code1 < hash_code2) {
+        return -1;
+    } else if (hash_code1 > hash_code2) {
+        return 1;
+    } else {
+        return ((const FDIRClientRoutePoint *)p1)->cluster_index -
+            ((const FDIRClientRoutePoint *)p2)->cluster_index;
+    }
+}
+
+static int init_ring(FDIRClientRouter *router)
+{
+    FDIRClientRoutePoint *point;
+    char buff[64];
+    int bytes;
+    int len;
+    int i;
+    int k;
+
+    router->ring.count = router->count * FDIR_CLIENT_ROUTE_VIRTUAL_NODES;
+    bytes = sizeof(FDIRClientRoutePoint) * router->ring.count;
+    router->ring.points = (FDIRClientRoutePoint *)malloc(bytes);
+    if (router->ring.points == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+
+    point = router->ring.points;
+    for (i=0; i<router->count; i++) {
+        for (k=0; k<FDIR_CLIENT_ROUTE_VIRTUAL_NODES; k++) {
+            len = sprintf(buff, "%s%d#%d", CLUSTER_SECTION_PREFIX,
+                    router->clusters[i].cluster_id, k);
+            point->hash_code = simple_hash(buff, len);
+            point->cluster_index = i;
+            point++;
+        }
+    }
+
+    qsort(router->ring.points, router->ring.count,
+            sizeof(FDIRClientRoutePoint), compare_route_point);
+    return 0;
+}
+
+static int compare_namespace_route(const void *p1, const void *p2)
+{
+    const string_t *ns1;
+    const string_t *ns2;
+
+    ns1 = &((const FDIRClientNamespaceRoute *)p1)->ns;
+    ns2 = &((const FDIRClientNamespaceRoute *)p2)->ns;
+    if (ns1->len != ns2->len) {
+        return ns1->len - ns2->len;
+    }
+    return memcmp(ns1->str, ns2->str, ns1->len);
+}
+
+static int get_cluster_index(FDIRClientRouter *router, const int cluster_id)
+{
+    int i;
+
+    for (i=0; i<router->count; i++) {
+        if (router->clusters[i].cluster_id == cluster_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int load_namespace_map(FDIRClientRouter *router,
+        const char *conf_filename, IniContext *ini_context)
+{
+    IniItem *items;
+    IniItem *item;
+    FDIRClientNamespaceRoute *entry;
+    int count;
+    int cluster_id;
+    int bytes;
+    int i;
+
+    items = iniGetSectionItems(NAMESPACE_MAP_SECTION, ini_context, &count);
+    if (items == NULL || count == 0) {
+        return 0;
+    }
+
+    bytes = sizeof(FDIRClientNamespaceRoute) * count;
+    router->ns_map.entries = (FDIRClientNamespaceRoute *)malloc(bytes);
+    if (router->ns_map.entries == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(router->ns_map.entries, 0, bytes);
+
+    for (i=0; i<count; i++) {
+        item = items + i;
+        entry = router->ns_map.entries + i;
+        cluster_id = strtol(item->value, NULL, 10);
+        if ((entry->cluster_index=get_cluster_index(router,
+                        cluster_id)) < 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "conf file \"%s\", section: %s, namespace: %s, "
+                    "cluster id: %s not in cluster_ids", __LINE__,
+                    conf_filename, NAMESPACE_MAP_SECTION,
+                    item->name, item->value);
+            return ENOENT;
+        }
+
+        entry->ns.len = strlen(item->name);
+        entry->ns.str = strdup(item->name);
+        if (entry->ns.str == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "strdup %d bytes fail", __LINE__, entry->ns.len);
+            return ENOMEM;
+        }
+        router->ns_map.count++;
+    }
+
+    qsort(router->ns_map.entries, router->ns_map.count,
+            sizeof(FDIRClientNamespaceRoute), compare_namespace_route);
+    for (i=1; i<router->ns_map.count; i++) {
+        if (compare_namespace_route(router->ns_map.entries + i - 1,
+                    router->ns_map.entries + i) == 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "conf file \"%s\", section: %s, duplicate "
+                    "namespace: %s", __LINE__, conf_filename,
+                    NAMESPACE_MAP_SECTION, router->ns_map.entries[i].ns.str);
+            return EEXIST;
+        }
+    }
+
+    return 0;
+}
+
+int fdir_client_router_load(FDIRClientContext *client_ctx,
+        const char *conf_filename, IniContext *ini_context)
+{
+    int ids[FDIR_CLUSTER_ID_MAX];
+    int count;
+    char *value;
+    int result;
+
+    memset(&client_ctx->router, 0, sizeof(client_ctx->router));
+    value = iniGetStrValue(NULL, "cluster_ids", ini_context);
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+
+    if ((result=parse_cluster_ids(conf_filename, value, ids, &count)) != 0) {
+        return result;
+    }
+    if ((result=init_pthread_lock(&client_ctx->router.moved.lock)) != 0) {
+        return result;
+    }
+
+    do {
+        if ((result=init_clusters(client_ctx, conf_filename,
+                        ini_context, ids, count)) != 0)
+        {
+            break;
+        }
+        if ((result=init_ring(&client_ctx->router)) != 0) {
+            break;
+        }
+        if ((result=load_namespace_map(&client_ctx->router,
+                        conf_filename, ini_context)) != 0)
+        {
+            break;
+        }
+    } while (0);
+
+    if (result != 0) {
+        fdir_client_router_destroy(client_ctx);
+    }
+    return result;
+}
+
+void fdir_client_router_destroy(FDIRClientContext *client_ctx)
+{
+    FDIRClientRouter *router;
+    int i;
+
+    router = &client_ctx->router;
+    if (router->clusters != NULL) {
+        for (i=0; i<router->count; i++) {
+            fdir_client_destroy_ex(router->clusters + i);
+        }
+        free(router->clusters);
+    }
+
+    if (router->ns_map.entries != NULL) {
+        for (i=0; i<router->ns_map.count; i++) {
+            free(router->ns_map.entries[i].ns.str);
+        }
+        free(router->ns_map.entries);
+    }
+
+    if (router->ring.points != NULL) {
+        free(router->ring.points);
+    }
+
+    for (i=0; i<router->moved.count; i++) {
+        free(router->moved.entries[i].ns.str);
+    }
+    pthread_mutex_destroy(&router->moved.lock);
+    memset(router, 0, sizeof(FDIRClientRouter));
+}
+
+FDIRClientContext *fdir_client_get_cluster_ctx(
+        FDIRClientContext *client_ctx, const int cluster_id)
+{
+    int index;
+
+    if ((index=get_cluster_index(&client_ctx->router, cluster_id)) < 0) {
+        return NULL;
+    }
+    return client_ctx->router.clusters + index;
+}
+
+FDIRClientContext *fdir_client_route_by_ns_ex(
+        FDIRClientContext *client_ctx, const string_t *ns)
+{
+    FDIRClientRouter *router;
+    FDIRClientNamespaceRoute target;
+    FDIRClientNamespaceRoute *found;
+    unsigned int hash_code;
+    int low;
+    int high;
+    int mid;
+    int i;
+
+    router = &client_ctx->router;
+    for (i=0; i<router->moved.count; i++) {
+        if (fc_string_equal(ns, &router->moved.entries[i].ns)) {
+            return router->clusters + router->moved.entries[i].cluster_index;
+        }
+    }
+
+    if (router->ns_map.count > 0) {
+        target.ns = *ns;
+        found = (FDIRClientNamespaceRoute *)bsearch(&target,
+                router->ns_map.entries, router->ns_map.count,
+                sizeof(FDIRClientNamespaceRoute), compare_namespace_route);
+        if (found != NULL) {
+            return router->clusters + found->cluster_index;
+        }
+    }
+
+    //the first point not less than the hash code, clockwise on the ring
+    hash_code = simple_hash(ns->str, ns->len);
+    low = 0;
+    high = router->ring.count - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (router->ring.points[mid].hash_code < hash_code) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    if (low == router->ring.count) {
+        low = 0;
+    }
+
+    return router->clusters + router->ring.points[low].cluster_index;
+}
+
+int fdir_client_router_add_moved(FDIRClientContext *client_ctx,
+        FDIRClientContext *cluster_ctx, const string_t *ns)
+{
+    FDIRClientRouter *router;
+    FDIRClientNamespaceRoute *entry;
+    FDIRDEntryFullName route;
+    FDIRDEntryInfo dentry;
+    char path[NAME_MAX + 2];
+    int cluster_index;
+    int result;
+    int i;
+
+    FC_SET_STRING_EX(route.ns, FDIR_ROUTE_NAMESPACE_STR,
+            FDIR_ROUTE_NAMESPACE_LEN);
+    *path = '/';
+    memcpy(path + 1, ns->str, ns->len);
+    FC_SET_STRING_EX(route.path, path, ns->len + 1);
+    if ((result=fdir_client_stat_dentry_by_path(cluster_ctx,
+                    &route, &dentry)) != 0)
+    {
+        return result;
+    }
+
+    router = &client_ctx->router;
+    if (dentry.stat.size <= 0 || (cluster_index=get_cluster_index(
+                    router, dentry.stat.size)) < 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "namespace: %.*s moved from cluster: %d to cluster: "
+                "%"PRId64" which not in cluster_ids", __LINE__, ns->len,
+                ns->str, cluster_ctx->cluster_id, dentry.stat.size);
+        return ENOENT;
+    }
+    if (router->clusters + cluster_index == cluster_ctx) {
+        return EINVAL;
+    }
+
+    result = 0;
+    PTHREAD_MUTEX_LOCK(&router->moved.lock);
+    for (i=0; i<router->moved.count; i++) {
+        if (fc_string_equal(ns, &router->moved.entries[i].ns)) {
+            router->moved.entries[i].cluster_index = cluster_index;
+            break;
+        }
+    }
+
+    if (i == router->moved.count) {
+        if (router->moved.count == FDIR_CLIENT_ROUTE_MAX_MOVED) {
+            result = ENOSPC;
+        } else {
+            entry = router->moved.entries + router->moved.count;
+            entry->cluster_index = cluster_index;
+            entry->ns.len = ns->len;
+            if ((entry->ns.str=(char *)malloc(ns->len + 1)) == NULL) {
+                result = ENOMEM;
+            } else {
+                memcpy(entry->ns.str, ns->str, ns->len);
+                entry->ns.str[ns->len] = '\0';
+                __sync_add_and_fetch(&router->moved.count, 1);
+            }
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&router->moved.lock);
+
+    if (result == 0) {
+        logInfo("file: "__FILE__", line: %d, "
+                "namespace: %.*s moved from cluster: %d to cluster: %d",
+                __LINE__, ns->len, ns->str, cluster_ctx->cluster_id,
+                router->clusters[cluster_index].cluster_id);
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "add the moved namespace: %.*s fail, errno: %d, "
+                "error info: %s", __LINE__, ns->len, ns->str,
+                result, STRERROR(result));
+    }
+    return result;
+}
@@ -0,0 +1,93 @@
+
+#ifndef _FDIR_CLIENT_ROUTER_H
+#define _FDIR_CLIENT_ROUTER_H
+
+#include "fastcommon/ini_file_reader.h"
+#include "fdir_proto.h"
+#include "client_types.h"
+
+#define FDIR_CLIENT_ROUTE_VIRTUAL_NODES  64  //the ring points per cluster
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* load the clusters and the namespace map for the sharding
+* params:
+*       client_ctx: the client context
+*       conf_filename: the client config filename
+*       ini_context: the ini context of the config file
+* return: 0 success, !=0 fail, return the error code
+**/
+int fdir_client_router_load(FDIRClientContext *client_ctx,
+        const char *conf_filename, IniContext *ini_context);
+
+void fdir_client_router_destroy(FDIRClientContext *client_ctx);
+
+//return NULL when the cluster not exist
+FDIRClientContext *fdir_client_get_cluster_ctx(
+        FDIRClientContext *client_ctx, const int cluster_id);
+
+FDIRClientContext *fdir_client_route_by_ns_ex(
+        FDIRClientContext *client_ctx, const string_t *ns);
+
+/**
+* learn the cluster which the namespace moved to from the route entry
+* of the cluster which responds FDIR_STATUS_NAMESPACE_MOVED
+* params:
+*       client_ctx: the client context
+*       cluster_ctx: the context of the cluster which the namespace moved from
+*       ns: the namespace
+* return: 0 success, !=0 fail, return the error code
+**/
+int fdir_client_router_add_moved(FDIRClientContext *client_ctx,
+        FDIRClientContext *cluster_ctx, const string_t *ns);
+
+//true for resending the request to the cluster which the namespace moved to
+static inline bool fdir_client_redirect_moved(FDIRClientContext *client_ctx,
+        FDIRClientContext *cluster_ctx, const string_t *ns, const int result)
+{
+    return (result == FDIR_STATUS_NAMESPACE_MOVED &&
+            client_ctx->router.count > 0 && fdir_client_router_add_moved(
+                client_ctx, cluster_ctx, ns) == 0);
+}
+
+//the context of the cluster which the namespace belongs to
+static inline FDIRClientContext *fdir_client_route_by_ns(
+        FDIRClientContext *client_ctx, const string_t *ns)
+{
+    if (client_ctx->router.count == 0) {
+        return client_ctx;
+    }
+    return fdir_client_route_by_ns_ex(client_ctx, ns);
+}
+
+//the context of the cluster which the inode created by
+static inline FDIRClientContext *fdir_client_route_by_inode(
+        FDIRClientContext *client_ctx, const int64_t inode)
+{
+    FDIRClientContext *cluster_ctx;
+
+    if (client_ctx->router.count == 0) {
+        return client_ctx;
+    }
+
+    cluster_ctx = fdir_client_get_cluster_ctx(client_ctx,
+            FDIR_GET_CLUSTER_ID_BY_INODE(inode));
+    return cluster_ctx != NULL ? cluster_ctx : client_ctx->router.clusters;
+}
+
+//the first cluster for the cluster level operations
+static inline FDIRClientContext *fdir_client_route_default(
+        FDIRClientContext *client_ctx)
+{
+    return client_ctx->router.count == 0 ? client_ctx :
+        client_ctx->router.clusters;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,10 +1,13 @@
 #ifndef _FDIR_CLIENT_TYPES_H
 #define _FDIR_CLIENT_TYPES_H
 
+#include <pthread.h>
 #include "fastcommon/common_define.h"
 #include "fastcommon/connection_pool.h"
 #include "fdir_types.h"
 
+#define FDIR_CLIENT_ROUTE_MAX_MOVED  64  //the moved namespaces per client
+
 struct fdir_client_context;
 
 typedef ConnectionInfo *(*fdir_get_connection_func)(
@@ -79,11 +82,54 @@ typedef enum {
     conn_manager_type_other
 } FDIRClientConnManagerType;
 
+typedef struct fdir_client_route_point {
+    unsigned int hash_code;
+    int cluster_index;
+} FDIRClientRoutePoint;
+
+typedef struct fdir_client_namespace_route {
+    string_t ns;
+    int cluster_index;
+} FDIRClientNamespaceRoute;
+
+/* the namespace sharding across the clusters, the namespace is mapped
+ * by the explicit map first, then by the consistent hash ring; the inode
+ * is mapped by the cluster id in its highest bits
+ */
+typedef struct fdir_client_router {
+    int count;   //the cluster count, 0 for no sharding
+    struct fdir_client_context *clusters;  //the context per cluster
+
+    struct {
+        int count;
+        FDIRClientNamespaceRoute *entries;  //sorted by the namespace
+    } ns_map;
+
+    struct {
+        int count;
+        FDIRClientRoutePoint *points;  //sorted by the hash code
+    } ring;
+
+    /* the namespaces moved by the migration, learned from the clusters
+     * at runtime and matched before the namespace map
+     */
+    struct {
+        pthread_mutex_t lock;  //for the writers
+        volatile int count;
+        FDIRClientNamespaceRoute entries[FDIR_CLIENT_ROUTE_MAX_MOVED];
+    } moved;
+} FDIRClientRouter;
+
 typedef struct fdir_client_context {
+    int cluster_id;  //0 for not configured
     FDIRServerGroup server_group;
     FDIRConnectionManager conn_manager;
     FDIRClientConnManagerType conn_manager_type;
+    int durability_level;  //for update operations
+    bool read_your_writes; //read the data version written by myself
     bool cloned;
+    volatile int64_t data_version;  //the max one of the update operations
+    FDIRClientRouter router;
 } FDIRClientContext;
 
 #endif
@@ -7,6 +7,9 @@
 #include "client_func.h"
 #include "client_global.h"
 #include "client_proto.h"
+#include "client_router.h"
+#include "client_pipeline.h"
+#include "client_async.h"
 
 #ifdef __cplusplus
 extern "C" {
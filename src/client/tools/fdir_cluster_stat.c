@@ -30,6 +30,11 @@ static void output(FDIRClientClusterStatEntry *stats, const int count)
                 fdir_get_server_status_caption(stat->status),
                 stat->is_master
               );
+        if (stat->replication_lag.data_versions >= 0) {
+            printf("    replication lag: %"PRId64" data versions, "
+                    "%"PRId64" bytes\n", stat->replication_lag.data_versions,
+                    stat->replication_lag.bytes);
+        }
     }
     printf("\nserver count: %d\n\n", count);
 }
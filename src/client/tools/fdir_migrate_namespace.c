@@ -0,0 +1,558 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fastcommon/logger.h"
+#include "fastdir/fdir_client.h"
+
+/* migrate the namespace from the source cluster to the destination
+ * cluster online, the steps are:
+ *   1. sync the namespace while the source cluster serving, the sync pass
+ *      creates and updates the dentries of the destination, and removes
+ *      the ones which not exist in the source, repeat until no change
+ *   2. freeze the namespace on the source cluster by the route entry
+ *      /<namespace> in the route namespace, the updates are refused
+ *   3. sync the namespace until no change
+ *   4. set the size of the route entry to the destination cluster id,
+ *      the source cluster responds FDIR_STATUS_NAMESPACE_MOVED and the
+ *      clients resend the requests to the destination cluster
+ * the dentries get the new inodes of the destination cluster, and the user
+ * data and the extra data are not accessible by the client protocol, so
+ * all the attributes of the protocol are copied
+ */
+
+#define MIGRATE_DEFAULT_MAX_ROUNDS   5
+#define MIGRATE_FINAL_MAX_ROUNDS     5
+#define MIGRATE_FREEZE_WAIT_SECONDS  2  //for the updates passed the check
+
+typedef struct {
+    FDIRClientContext *src_ctx;
+    FDIRClientContext *dst_ctx;
+    string_t ns;
+    FDIRStatModifyFlags mflags;
+    int64_t dir_count;
+    int64_t file_count;
+    int64_t change_count;  //created, modified and removed
+} MigrateContext;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-c config_filename] [-r max_rounds] "
+            "<-n namespace> <-s src_cluster_id> <-d dst_cluster_id>\n"
+            "\tthe dentries of the destination cluster which not exist in "
+            "the source cluster will be removed\n", argv[0]);
+}
+
+static int compare_client_dentry(const void *p1, const void *p2)
+{
+    const string_t *name1;
+    const string_t *name2;
+    int len;
+    int result;
+
+    name1 = &((const FDIRClientDentry *)p1)->name;
+    name2 = &((const FDIRClientDentry *)p2)->name;
+    len = name1->len < name2->len ? name1->len : name2->len;
+    if ((result=memcmp(name1->str, name2->str, len)) != 0) {
+        return result;
+    }
+    return name1->len - name2->len;
+}
+
+static int list_sorted_dentry(FDIRClientContext *client_ctx,
+        const FDIRDEntryFullName *fullname, FDIRClientDentryArray *array)
+{
+    int result;
+
+    if ((result=fdir_client_list_dentry(client_ctx,
+                    fullname, array)) != 0)
+    {
+        return result;
+    }
+
+    qsort(array->entries, array->count, sizeof(FDIRClientDentry),
+            compare_client_dentry);
+    return 0;
+}
+
+static int make_child_path(char *path, const int path_len,
+        const string_t *name, int *len)
+{
+    if (path_len + 1 + name->len >= PATH_MAX) {
+        logError("file: "__FILE__", line: %d, "
+                "the path of %s/%.*s is too long", __LINE__,
+                path, name->len, name->str);
+        return ENAMETOOLONG;
+    }
+
+    *len = path_len;
+    if (path[*len - 1] != '/') {
+        path[(*len)++] = '/';
+    }
+    memcpy(path + *len, name->str, name->len);
+    *len += name->len;
+    path[*len] = '\0';
+    return 0;
+}
+
+static int remove_dst_dentry(MigrateContext *mctx,
+        char *path, const int path_len)
+{
+    FDIRDEntryFullName fullname;
+    FDIRDEntryInfo dentry;
+    FDIRClientDentryArray array;
+    FDIRClientDentry *entry;
+    FDIRClientDentry *end;
+    int len;
+    int result;
+
+    fullname.ns = mctx->ns;
+    FC_SET_STRING_EX(fullname.path, path, path_len);
+    if ((result=fdir_client_stat_dentry_by_path(mctx->dst_ctx,
+                    &fullname, &dentry)) != 0)
+    {
+        return result == ENOENT ? 0 : result;
+    }
+
+    if (S_ISDIR(dentry.stat.mode)) {
+        if ((result=fdir_client_dentry_array_init(&array)) != 0) {
+            return result;
+        }
+        if ((result=fdir_client_list_dentry(mctx->dst_ctx,
+                        &fullname, &array)) == 0)
+        {
+            end = array.entries + array.count;
+            for (entry=array.entries; entry<end; entry++) {
+                if ((result=make_child_path(path, path_len,
+                                &entry->name, &len)) == 0)
+                {
+                    result = remove_dst_dentry(mctx, path, len);
+                    path[path_len] = '\0';
+                }
+                if (result != 0) {
+                    break;
+                }
+            }
+        }
+        fdir_client_dentry_array_free(&array);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    if ((result=fdir_client_remove_dentry(mctx->dst_ctx,
+                    &fullname)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "remove dentry %.*s:%s from cluster %d fail, "
+                "errno: %d, error info: %s", __LINE__, mctx->ns.len,
+                mctx->ns.str, path, mctx->dst_ctx->cluster_id,
+                result, STRERROR(result));
+        return result;
+    }
+
+    mctx->change_count++;
+    return 0;
+}
+
+static int sync_dentry(MigrateContext *mctx, char *path, const int path_len);
+
+//the children of the source are synced, the others of the destination removed
+static int sync_children(MigrateContext *mctx, const FDIRDEntryFullName
+        *fullname, char *path, const int path_len)
+{
+    FDIRClientDentryArray src_array;
+    FDIRClientDentryArray dst_array;
+    FDIRClientDentry *src;
+    FDIRClientDentry *src_end;
+    FDIRClientDentry *dst;
+    FDIRClientDentry *dst_end;
+    const string_t *name;
+    bool synced;
+    int len;
+    int result;
+
+    if ((result=fdir_client_dentry_array_init(&src_array)) != 0) {
+        return result;
+    }
+    if ((result=fdir_client_dentry_array_init(&dst_array)) != 0) {
+        fdir_client_dentry_array_free(&src_array);
+        return result;
+    }
+
+    do {
+        if ((result=list_sorted_dentry(mctx->src_ctx,
+                        fullname, &src_array)) != 0)
+        {
+            break;
+        }
+        if ((result=list_sorted_dentry(mctx->dst_ctx,
+                        fullname, &dst_array)) != 0)
+        {
+            break;
+        }
+
+        src = src_array.entries;
+        src_end = src_array.entries + src_array.count;
+        dst = dst_array.entries;
+        dst_end = dst_array.entries + dst_array.count;
+        while (src < src_end || dst < dst_end) {
+            if (dst == dst_end || (src < src_end &&
+                        compare_client_dentry(src, dst) < 0))
+            {
+                name = &(src++)->name;
+                synced = true;
+            } else if (src == src_end || compare_client_dentry(src, dst) > 0) {
+                name = &(dst++)->name;
+                synced = false;
+            } else {
+                name = &(src++)->name;
+                dst++;
+                synced = true;
+            }
+
+            if ((result=make_child_path(path, path_len, name, &len)) != 0) {
+                break;
+            }
+            if (synced) {
+                result = sync_dentry(mctx, path, len);
+            } else {
+                result = remove_dst_dentry(mctx, path, len);
+            }
+            path[path_len] = '\0';
+            if (result != 0) {
+                break;
+            }
+        }
+    } while (0);
+
+    fdir_client_dentry_array_free(&src_array);
+    fdir_client_dentry_array_free(&dst_array);
+    return result;
+}
+
+static inline bool dentry_stat_equal(const FDIRDEntryStatus *stat1,
+        const FDIRDEntryStatus *stat2)
+{
+    return stat1->mode == stat2->mode && stat1->uid == stat2->uid &&
+        stat1->gid == stat2->gid && stat1->atime == stat2->atime &&
+        stat1->ctime == stat2->ctime && stat1->mtime == stat2->mtime &&
+        stat1->size == stat2->size;
+}
+
+static int sync_dentry(MigrateContext *mctx, char *path, const int path_len)
+{
+    FDIRDEntryFullName fullname;
+    FDIRDEntryInfo src_dentry;
+    FDIRDEntryInfo dst_dentry;
+    int result;
+
+    fullname.ns = mctx->ns;
+    FC_SET_STRING_EX(fullname.path, path, path_len);
+    if ((result=fdir_client_stat_dentry_by_path(mctx->src_ctx,
+                    &fullname, &src_dentry)) != 0)
+    {
+        //removed during the sync
+        if (result == ENOENT) {
+            return remove_dst_dentry(mctx, path, path_len);
+        }
+        return result;
+    }
+
+    result = fdir_client_stat_dentry_by_path(mctx->dst_ctx,
+            &fullname, &dst_dentry);
+    if (result == 0 && (src_dentry.stat.mode & S_IFMT) !=
+            (dst_dentry.stat.mode & S_IFMT))
+    {
+        if ((result=remove_dst_dentry(mctx, path, path_len)) != 0) {
+            return result;
+        }
+        result = ENOENT;
+    }
+    if (result == ENOENT) {
+        if ((result=fdir_client_create_dentry(mctx->dst_ctx, &fullname,
+                        src_dentry.stat.mode, &dst_dentry)) == 0)
+        {
+            mctx->change_count++;
+        }
+    }
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "sync dentry %.*s:%s to cluster %d fail, "
+                "errno: %d, error info: %s", __LINE__, mctx->ns.len,
+                mctx->ns.str, path, mctx->dst_ctx->cluster_id,
+                result, STRERROR(result));
+        return result;
+    }
+
+    if (S_ISDIR(src_dentry.stat.mode)) {
+        mctx->dir_count++;
+        if ((result=sync_children(mctx, &fullname, path, path_len)) != 0) {
+            //removed during the sync
+            return result == ENOENT ? remove_dst_dentry(
+                    mctx, path, path_len) : result;
+        }
+    } else {
+        mctx->file_count++;
+    }
+
+    //after the children for the times of the directory
+    if (dentry_stat_equal(&src_dentry.stat, &dst_dentry.stat)) {
+        return 0;
+    }
+    if ((result=fdir_client_modify_dentry_stat(mctx->dst_ctx, &mctx->ns,
+                    dst_dentry.inode, mctx->mflags.flags,
+                    &src_dentry.stat, &dst_dentry)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "modify dentry %.*s:%s stat fail, errno: %d, "
+                "error info: %s", __LINE__, mctx->ns.len, mctx->ns.str,
+                path, result, STRERROR(result));
+        return result;
+    }
+
+    mctx->change_count++;
+    return 0;
+}
+
+static int sync_namespace(MigrateContext *mctx, const char *caption,
+        const int round)
+{
+    char path[PATH_MAX];
+    int result;
+
+    mctx->dir_count = mctx->file_count = mctx->change_count = 0;
+    strcpy(path, "/");
+    result = sync_dentry(mctx, path, 1);
+    printf("%s round: %d, directory count: %"PRId64", file count: "
+            "%"PRId64", change count: %"PRId64", result: %d\n", caption,
+            round, mctx->dir_count, mctx->file_count,
+            mctx->change_count, result);
+    return result;
+}
+
+static void set_route_fullname(MigrateContext *mctx,
+        FDIRDEntryFullName *fullname, char *path)
+{
+    FC_SET_STRING_EX(fullname->ns, FDIR_ROUTE_NAMESPACE_STR,
+            FDIR_ROUTE_NAMESPACE_LEN);
+    *path = '/';
+    memcpy(path + 1, mctx->ns.str, mctx->ns.len);
+    FC_SET_STRING_EX(fullname->path, path, mctx->ns.len + 1);
+}
+
+//the route entry with the size 0 for frozen
+static int freeze_namespace(MigrateContext *mctx, FDIRDEntryInfo *route)
+{
+    FDIRDEntryFullName fullname;
+    FDIRStatModifyFlags mflags;
+    char path[NAME_MAX + 2];
+    int result;
+
+    set_route_fullname(mctx, &fullname, path);
+    fullname.path.len = 1;  //the root of the route namespace
+    result = fdir_client_create_dentry(mctx->src_ctx, &fullname,
+            S_IFDIR | 0755, route);
+    if (result != 0 && result != EEXIST) {
+        return result;
+    }
+
+    fullname.path.len = mctx->ns.len + 1;
+    result = fdir_client_create_dentry(mctx->src_ctx, &fullname,
+            S_IFREG | 0644, route);
+    if (result == EEXIST) {  //frozen by the last run
+        result = fdir_client_stat_dentry_by_path(mctx->src_ctx,
+                &fullname, route);
+    }
+    if (result != 0) {
+        return result;
+    }
+
+    if (route->stat.size > 0) {
+        logError("file: "__FILE__", line: %d, "
+                "namespace: %.*s already moved to cluster: %"PRId64,
+                __LINE__, mctx->ns.len, mctx->ns.str, route->stat.size);
+        return EEXIST;
+    }
+
+    /* wait for the updates passed the route check before frozen,
+     * then update the route entry for the min data version of the reads
+     */
+    sleep(MIGRATE_FREEZE_WAIT_SECONDS);
+    mflags.flags = 0;
+    mflags.mtime = 1;
+    route->stat.mtime = time(NULL);
+    return fdir_client_modify_dentry_stat(mctx->src_ctx, &fullname.ns,
+            route->inode, mflags.flags, &route->stat, route);
+}
+
+//the route entry with the size of the destination cluster id for moved
+static int move_namespace(MigrateContext *mctx,
+        FDIRDEntryInfo *route, const int dst_cluster_id)
+{
+    FDIRDEntryFullName fullname;
+    char path[NAME_MAX + 2];
+
+    set_route_fullname(mctx, &fullname, path);
+    return fdir_client_set_dentry_size(mctx->src_ctx, &fullname.ns,
+            route->inode, dst_cluster_id, true, route);
+}
+
+static int unfreeze_namespace(MigrateContext *mctx)
+{
+    FDIRDEntryFullName fullname;
+    char path[NAME_MAX + 2];
+
+    set_route_fullname(mctx, &fullname, path);
+    return fdir_client_remove_dentry(mctx->src_ctx, &fullname);
+}
+
+int main(int argc, char *argv[])
+{
+    int ch;
+    const char *config_filename = "/etc/fdir/client.conf";
+    char *ns;
+    int src_cluster_id;
+    int dst_cluster_id;
+    int max_rounds;
+    int round;
+    MigrateContext mctx;
+    FDIRDEntryInfo route;
+    int result;
+
+    if (argc < 2) {
+        usage(argv);
+        return 1;
+    }
+
+    ns = NULL;
+    src_cluster_id = dst_cluster_id = 0;
+    max_rounds = MIGRATE_DEFAULT_MAX_ROUNDS;
+    while ((ch=getopt(argc, argv, "hc:n:s:d:r:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'n':
+                ns = optarg;
+                break;
+            case 'c':
+                config_filename = optarg;
+                break;
+            case 's':
+                src_cluster_id = strtol(optarg, NULL, 10);
+                break;
+            case 'd':
+                dst_cluster_id = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                max_rounds = strtol(optarg, NULL, 10);
+                if (max_rounds <= 0) {
+                    max_rounds = 1;
+                }
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    if (ns == NULL || src_cluster_id <= 0 || dst_cluster_id <= 0 ||
+            src_cluster_id == dst_cluster_id)
+    {
+        usage(argv);
+        return 1;
+    }
+    if (*ns == '\0' || strlen(ns) > NAME_MAX || strchr(ns, '/') != NULL ||
+            strcmp(ns, FDIR_ROUTE_NAMESPACE_STR) == 0)
+    {
+        fprintf(stderr, "invalid namespace: %s\n", ns);
+        return EINVAL;
+    }
+
+    log_init();
+    //g_log_context.log_level = LOG_DEBUG;
+
+    if ((result=fdir_client_simple_init(config_filename)) != 0) {
+        return result;
+    }
+
+    memset(&mctx, 0, sizeof(mctx));
+    mctx.src_ctx = fdir_client_get_cluster_ctx(
+            &g_fdir_client_vars.client_ctx, src_cluster_id);
+    mctx.dst_ctx = fdir_client_get_cluster_ctx(
+            &g_fdir_client_vars.client_ctx, dst_cluster_id);
+    if (mctx.src_ctx == NULL || mctx.dst_ctx == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "cluster %d not in cluster_ids of config file: %s",
+                __LINE__, mctx.src_ctx == NULL ? src_cluster_id :
+                dst_cluster_id, config_filename);
+        return ENOENT;
+    }
+
+    //the reads after the freeze see all the updates before it
+    mctx.src_ctx->read_your_writes = true;
+    FC_SET_STRING(mctx.ns, ns);
+    mctx.mflags.mode = 1;
+    mctx.mflags.uid = 1;
+    mctx.mflags.gid = 1;
+    mctx.mflags.atime = 1;
+    mctx.mflags.ctime = 1;
+    mctx.mflags.mtime = 1;
+    mctx.mflags.size = 1;
+
+    for (round=1; round<=max_rounds; round++) {
+        if ((result=sync_namespace(&mctx, "online sync", round)) != 0) {
+            return result;
+        }
+        if (mctx.change_count == 0) {
+            break;
+        }
+    }
+
+    if ((result=freeze_namespace(&mctx, &route)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "freeze namespace: %s on cluster %d fail, errno: %d, "
+                "error info: %s", __LINE__, ns, src_cluster_id,
+                result, STRERROR(result));
+        return result;
+    }
+
+    for (round=1; round<=MIGRATE_FINAL_MAX_ROUNDS; round++) {
+        if ((result=sync_namespace(&mctx, "frozen sync", round)) != 0 ||
+                mctx.change_count == 0)
+        {
+            break;
+        }
+    }
+    if (result == 0 && mctx.change_count > 0) {
+        logError("file: "__FILE__", line: %d, "
+                "namespace: %s still changed after %d frozen rounds",
+                __LINE__, ns, MIGRATE_FINAL_MAX_ROUNDS);
+        result = EBUSY;
+    }
+
+    if (result == 0) {
+        result = move_namespace(&mctx, &route, dst_cluster_id);
+    }
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "migrate namespace: %s fail, errno: %d, error info: %s, "
+                "unfreeze it on cluster %d", __LINE__, ns, result,
+                STRERROR(result), src_cluster_id);
+        unfreeze_namespace(&mctx);
+        return result;
+    }
+
+    printf("namespace: %s moved from cluster %d to cluster %d, "
+            "please set %s = %d in the [namespace-map] of the client "
+            "config files to save the redirect\n", ns, src_cluster_id,
+            dst_cluster_id, ns, dst_cluster_id);
+    return 0;
+}
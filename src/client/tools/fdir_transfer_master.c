@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fastcommon/logger.h"
+#include "fastdir/fdir_client.h"
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-c config_filename] [server_id]\n"
+            "\tserver_id: the target slave, "
+            "the most up-to-date one when not specified\n", argv[0]);
+}
+
+int main(int argc, char *argv[])
+{
+	int ch;
+    const char *config_filename = "/etc/fdir/client.conf";
+    int server_id;
+    FDIRClientServerEntry master;
+	int result;
+
+    while ((ch=getopt(argc, argv, "hc:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'c':
+                config_filename = optarg;
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    server_id = (optind < argc) ? atoi(argv[optind]) : 0;
+    if (server_id < 0) {
+        usage(argv);
+        return 1;
+    }
+
+    log_init();
+    //g_log_context.log_level = LOG_DEBUG;
+
+    if ((result=fdir_client_simple_init(config_filename)) != 0) {
+        return result;
+    }
+
+    if ((result=fdir_client_transfer_master(&g_fdir_client_vars.client_ctx,
+                    server_id)) != 0)
+    {
+        fprintf(stderr, "fdir_client_transfer_master fail, "
+                "errno: %d, error info: %s\n", result, STRERROR(result));
+        return result;
+    }
+
+    if ((result=fdir_client_get_master(&g_fdir_client_vars.client_ctx,
+                    &master)) == 0)
+    {
+        printf("the new master server_id: %d, host: %s:%d\n",
+                master.server_id, master.conn.ip_addr, master.conn.port);
+    }
+    return 0;
+}
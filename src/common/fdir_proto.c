@@ -1,5 +1,5 @@
-
 #include <errno.h>
+#include <strings.h>
 #include "fastcommon/shared_func.h"
 #include "fastcommon/connection_pool.h"
 #include "fastcommon/ini_file_reader.h"
@@ -30,11 +30,40 @@ int fdir_proto_set_body_length(struct fast_task_info *task)
     return 0;
 }
 
+static int fdir_recv_response_data_version(ConnectionInfo *conn,
+        FDIRResponseInfo *response, const int network_timeout)
+{
+    char buff[8];
+    int result;
+
+    if (response->header.body_len < sizeof(buff)) {
+        response->error.length = sprintf(response->error.message,
+                "response body length: %d < data version size: %d",
+                response->header.body_len, (int)sizeof(buff));
+        return EINVAL;
+    }
+
+    if ((result=tcprecvdata_nb(conn->sock, buff, sizeof(buff),
+                    network_timeout)) != 0)
+    {
+        response->error.length = snprintf(response->error.message,
+                sizeof(response->error.message),
+                "recv data version fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+        return result;
+    }
+
+    response->data_version = buff2long(buff);
+    response->header.body_len -= sizeof(buff);
+    return 0;
+}
+
 int fdir_check_response(ConnectionInfo *conn, FDIRResponseInfo *response,
         const int network_timeout, const unsigned char expect_cmd)
 {
     int result;
 
+    response->data_version = 0;
     if (response->header.status == 0) {
         if (response->header.cmd != expect_cmd) {
             response->error.length = sprintf(
@@ -44,6 +73,10 @@ int fdir_check_response(ConnectionInfo *conn, FDIRResponseInfo *response,
             return EINVAL;
         }
 
+        if ((response->header.flags & FDIR_PROTO_FLAGS_DATA_VERSION)) {
+            return fdir_recv_response_data_version(conn,
+                    response, network_timeout);
+        }
         return 0;
     }
 
@@ -261,6 +294,10 @@ const char *fdir_get_cmd_caption(const int cmd)
             return "GET_READABLE_SERVER_REQ";
         case FDIR_SERVICE_PROTO_GET_READABLE_SERVER_RESP:
             return "GET_READABLE_SERVER_RESP";
+        case FDIR_SERVICE_PROTO_TRANSFER_MASTER_REQ:
+            return "TRANSFER_MASTER_REQ";
+        case FDIR_SERVICE_PROTO_TRANSFER_MASTER_RESP:
+            return "TRANSFER_MASTER_RESP";
         case FDIR_CLUSTER_PROTO_GET_SERVER_STATUS_REQ:
             return "GET_SERVER_STATUS_REQ";
         case FDIR_CLUSTER_PROTO_GET_SERVER_STATUS_RESP:
@@ -283,7 +320,48 @@ const char *fdir_get_cmd_caption(const int cmd)
             return "PUSH_BINLOG_REQ";
         case FDIR_REPLICA_PROTO_PUSH_BINLOG_RESP:
             return "PUSH_BINLOG_RESP";
+        case FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_REQ:
+            return "GET_SNAPSHOT_INFO_REQ";
+        case FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_RESP:
+            return "GET_SNAPSHOT_INFO_RESP";
+        case FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_REQ:
+            return "FETCH_SNAPSHOT_REQ";
+        case FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_RESP:
+            return "FETCH_SNAPSHOT_RESP";
         default:
             return "UNKOWN";
     }
 }
+
+const char *fdir_get_durability_level_caption(const int level)
+{
+    switch (level) {
+        case FDIR_DURABILITY_LEVEL_DEFAULT:
+            return "default";
+        case FDIR_DURABILITY_LEVEL_MEMORY:
+            return "memory";
+        case FDIR_DURABILITY_LEVEL_LOCAL:
+            return "local";
+        case FDIR_DURABILITY_LEVEL_REPLICA:
+            return "replica";
+        default:
+            return "unkown";
+    }
+}
+
+int fdir_get_durability_level_by_caption(const char *caption)
+{
+    if (caption == NULL || *caption == '\0' ||
+            strcasecmp(caption, "default") == 0)
+    {
+        return FDIR_DURABILITY_LEVEL_DEFAULT;
+    } else if (strcasecmp(caption, "memory") == 0) {
+        return FDIR_DURABILITY_LEVEL_MEMORY;
+    } else if (strcasecmp(caption, "local") == 0) {
+        return FDIR_DURABILITY_LEVEL_LOCAL;
+    } else if (strcasecmp(caption, "replica") == 0) {
+        return FDIR_DURABILITY_LEVEL_REPLICA;
+    } else {
+        return -EINVAL;
+    }
+}
@@ -9,6 +9,7 @@
 #include "fdir_types.h"
 
 #define FDIR_STATUS_MASTER_INCONSISTENT     9999
+#define FDIR_STATUS_NAMESPACE_MOVED         9998  //redirect to other cluster
 
 #define FDIR_PROTO_ACK                      6
 
@@ -61,6 +62,8 @@
 #define FDIR_SERVICE_PROTO_GET_SLAVES_RESP          64
 #define FDIR_SERVICE_PROTO_GET_READABLE_SERVER_REQ  65
 #define FDIR_SERVICE_PROTO_GET_READABLE_SERVER_RESP 66
+#define FDIR_SERVICE_PROTO_TRANSFER_MASTER_REQ      67  //admin -> master
+#define FDIR_SERVICE_PROTO_TRANSFER_MASTER_RESP     68
 
 //cluster commands
 #define FDIR_CLUSTER_PROTO_GET_SERVER_STATUS_REQ   71
@@ -77,6 +80,12 @@
 #define FDIR_REPLICA_PROTO_PUSH_BINLOG_REQ         83
 #define FDIR_REPLICA_PROTO_PUSH_BINLOG_RESP        84
 
+//snapshot commands, slave -> master
+#define FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_REQ   85
+#define FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_RESP  86
+#define FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_REQ      87
+#define FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_RESP     88
+
 
 #define FDIR_PROTO_SYS_UNLOCK_FLAGS_SET_SIZE      1
 
@@ -102,9 +111,57 @@
         FDIR_PROTO_SET_MAGIC((header)->magic);   \
         (header)->cmd = _cmd;      \
         (header)->status[0] = (header)->status[1] = 0; \
+        (header)->flags[0] = (header)->flags[1] = 0;   \
         int2buff(_body_len, (header)->body_len); \
+        FDIR_PROTO_SET_REQ_ID(header, 0);        \
+    } while (0)
+
+/* the request id is echoed by the response as is, so the client can send
+ * many requests through one connection without waiting for the responses
+ * (pipelining) and match the responses by the request id.
+ * the request id takes the 3 bytes which were the header padding, the
+ * header keeps 16 bytes and the former servers echo the padding as is,
+ * so the servers and the clients of both versions work together.
+ * the server deals the requests of a connection one by one in the sending
+ * order and responds in the same order: the pipelining saves the round
+ * trips, but the requests of a connection are NOT executed concurrently,
+ * the server concurrency is by the connections
+ */
+#define FDIR_PROTO_REQ_ID_MASK  0xFFFFFF
+
+#define FDIR_PROTO_SET_REQ_ID(header, _req_id) \
+    do {  \
+        (header)->req_id[0] = ((_req_id) >> 16) & 0xFF; \
+        (header)->req_id[1] = ((_req_id) >> 8) & 0xFF;  \
+        (header)->req_id[2] = (_req_id) & 0xFF;         \
     } while (0)
 
+#define FDIR_PROTO_GET_REQ_ID(header) \
+    (((int)(header)->req_id[0] << 16) | ((int)(header)->req_id[1] << 8) | \
+     (int)(header)->req_id[2])
+
+/* the lowest 2 bits of the header flags for the durability level */
+#define FDIR_PROTO_FLAGS_DURABILITY_MASK   0x03
+
+#define FDIR_PROTO_SET_DURABILITY(header, level) \
+    short2buff((level) & FDIR_PROTO_FLAGS_DURABILITY_MASK, (header)->flags)
+
+#define FDIR_PROTO_GET_DURABILITY(flags) \
+    ((flags) & FDIR_PROTO_FLAGS_DURABILITY_MASK)
+
+/* for read your writes:
+ *   the request with FDIR_PROTO_FLAGS_DATA_VERSION asks for the data version,
+ *   the success response body is prefixed by the 8 bytes data version
+ *   with the same flag, the committed one for the update operations;
+ *   the request body with FDIR_PROTO_FLAGS_MIN_DATA_VERSION is suffixed by
+ *   the 8 bytes min data version to read
+ */
+#define FDIR_PROTO_FLAGS_DATA_VERSION      0x04
+#define FDIR_PROTO_FLAGS_MIN_DATA_VERSION  0x08
+
+#define FDIR_PROTO_ADD_FLAGS(header, _flags) \
+    short2buff(buff2short((header)->flags) | (_flags), (header)->flags)
+
 #define FDIR_PROTO_SET_RESPONSE_HEADER(proto_header, resp_header) \
     do {  \
         (proto_header)->cmd = (resp_header).cmd;       \
@@ -118,7 +175,7 @@ typedef struct fdir_proto_header {
     char status[2];         //status to store errno
     char flags[2];
     unsigned char cmd;      //the command code
-    char padding[3];
+    unsigned char req_id[3];  //the request id, echoed by the response
 } FDIRProtoHeader;
 
 typedef struct fdir_proto_dentry_info {
@@ -295,6 +352,10 @@ typedef struct fdir_proto_cluster_stat_resp_body_part {
     char status;
     char ip_addr[IP_ADDRESS_SIZE];
     char port[2];
+    struct {
+        char data_versions[8];
+        char bytes[8];
+    } replication_lag;  //reported by the master, -1 for not syncing
 } FDIRProtoClusterStatRespBodyPart;
 
 /* for FDIR_SERVICE_PROTO_GET_MASTER_RESP and
@@ -306,6 +367,10 @@ typedef struct fdir_proto_get_server_resp {
     char port[2];
 } FDIRProtoGetServerResp;
 
+typedef struct fdir_proto_transfer_master_req {
+    char server_id[4];  //the target slave, 0 for the most up-to-date one
+} FDIRProtoTransferMasterReq;
+
 typedef struct fdir_proto_get_slaves_resp_body_header {
     char count[2];
 } FDIRProtoGetSlavesRespBodyHeader;
@@ -351,6 +416,15 @@ typedef struct fdir_proto_join_slave_resp {
     char last_data_version[8];   //the slave's last data version
 } FDIRProtoJoinSlaveResp;
 
+typedef struct fdir_proto_ping_master_req_header {
+    char server_count[4];  //the servers relayed by me
+} FDIRProtoPingMasterReqHeader;
+
+typedef struct fdir_proto_ping_master_req_body_part {
+    char server_id[4];
+    char status;
+} FDIRProtoPingMasterReqBodyPart;
+
 typedef struct fdir_proto_ping_master_resp_header {
     char inode_sn[8];  //current inode sn of master
     char server_count[4];
@@ -359,8 +433,28 @@ typedef struct fdir_proto_ping_master_resp_header {
 typedef struct fdir_proto_ping_master_resp_body_part {
     char server_id[4];
     char status;
+    char key[FDIR_REPLICA_KEY_SIZE];  //for the server relayed by the slave
 } FDIRProtoPingMasterRespBodyPart;
 
+typedef struct fdir_proto_get_snapshot_info_resp {
+    char data_version[8];
+    char base_version[8];
+    char inode_sn[8];
+    char dentry_count[8];
+    char binlog_start_version[8];  //the binlog of the server from it
+    char delta_count[4];
+} FDIRProtoGetSnapshotInfoResp;
+
+/* the response body is the file content from the offset,
+ * an empty body for the end of the file
+ */
+typedef struct fdir_proto_fetch_snapshot_req {
+    char base_version[8];  //for check the snapshot not changed
+    char file_index[4];    //0 for the full snapshot, 1..n for the deltas
+    char offset[8];
+    char size[4];          //the max bytes to fetch
+} FDIRProtoFetchSnapshotReq;
+
 typedef struct fdir_proto_push_binlog_req_body_header {
     char binlog_length[4];
     char last_data_version[8];
@@ -368,6 +462,7 @@ typedef struct fdir_proto_push_binlog_req_body_header {
 
 typedef struct fdir_proto_push_binlog_resp_body_header {
     char count[4];
+    char credits[4];  //the free buffer count of the slave
 } FDIRProtoPushBinlogRespBodyHeader;
 
 typedef struct fdir_proto_push_binlog_resp_body_part {
@@ -434,6 +529,7 @@ static inline void fdir_proto_extract_header(const FDIRProtoHeader *proto,
     info->body_len = buff2int(proto->body_len);
     info->flags = buff2short(proto->flags);
     info->status = buff2short(proto->status);
+    info->req_id = FDIR_PROTO_GET_REQ_ID(proto);
 }
 
 static inline void fdir_proto_pack_dentry_stat(const FDIRDEntryStatus *stat,
@@ -467,6 +563,10 @@ const char *fdir_get_server_status_caption(const int status);
 
 const char *fdir_get_cmd_caption(const int cmd);
 
+const char *fdir_get_durability_level_caption(const int level);
+
+int fdir_get_durability_level_by_caption(const char *caption);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,17 @@
 
 #define FDIR_MAX_PATH_COUNT       128
 
+//the highest bits of the inode (except the sign bit) for the cluster id
+#define FDIR_CLUSTER_ID_BITS       10
+#define FDIR_CLUSTER_ID_MAX        ((1 << FDIR_CLUSTER_ID_BITS) - 1)
+
+#define FDIR_GET_CLUSTER_ID_BY_INODE(inode) \
+    ((int)(((inode) >> (63 - FDIR_CLUSTER_ID_BITS)) & FDIR_CLUSTER_ID_MAX))
+
+//the reserved namespace for the routes of the migrated namespaces
+#define FDIR_ROUTE_NAMESPACE_STR  "__fdir_route__"
+#define FDIR_ROUTE_NAMESPACE_LEN  (sizeof(FDIR_ROUTE_NAMESPACE_STR) - 1)
+
 #define FDIR_SERVER_STATUS_INIT       0
 #define FDIR_SERVER_STATUS_BUILDING  10
 #define FDIR_SERVER_STATUS_DUMPING   20
@@ -24,11 +35,18 @@
 #define FDIR_SERVER_STATUS_SYNCING   22
 #define FDIR_SERVER_STATUS_ACTIVE    23
 
+//the durability level of the update operations
+#define FDIR_DURABILITY_LEVEL_DEFAULT  0  //decided by the server side
+#define FDIR_DURABILITY_LEVEL_MEMORY   1  //response after applied in memory
+#define FDIR_DURABILITY_LEVEL_LOCAL    2  //response after local binlog fsync
+#define FDIR_DURABILITY_LEVEL_REPLICA  3  //local fsync and all slaves ack
+
 typedef struct {
     int body_len;      //body length
     short flags;
     short status;
     unsigned char cmd; //command
+    int req_id;        //the request id for the pipelining
 } FDIRHeaderInfo;
 
 typedef struct {
@@ -44,6 +62,7 @@ typedef struct {
 typedef struct {
     FDIRHeaderInfo header;
     FDIRErrorInfo error;
+    int64_t data_version;  //the data version of the update operation
 } FDIRResponseInfo;
 
 typedef struct fdir_dentry_full_name {
@@ -86,6 +105,7 @@ typedef union {
         bool gid:   1;
         bool uid:   1;
         bool size : 1;
+        bool pname: 1;  //parent inode and name, for binlog record only
     };
 } FDIRStatModifyFlags;
 
@@ -0,0 +1,519 @@
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "binlog_crc32c.h"
+#include "binlog_pack.h"
+#include "binlog_binary.h"
+
+#define BINLOG_BINARY_VARINT_MAX_BYTES  10
+
+static inline void binary_pack_varint(unsigned char **pp, uint64_t n)
+{
+    unsigned char *p;
+
+    p = *pp;
+    while (n >= 0x80) {
+        *p++ = (unsigned char)(n | 0x80);
+        n >>= 7;
+    }
+    *p++ = (unsigned char)n;
+    *pp = p;
+}
+
+static inline void binary_pack_string(unsigned char **pp,
+        const string_t *s)
+{
+    binary_pack_varint(pp, s->len);
+    memcpy(*pp, s->str, s->len);
+    *pp += s->len;
+}
+
+static inline int binary_unpack_varint(const unsigned char **pp,
+        const unsigned char *end, uint64_t *n)
+{
+    const unsigned char *p;
+    int shift;
+
+    *n = 0;
+    shift = 0;
+    for (p=*pp; p<end; p++) {
+        *n |= (uint64_t)(*p & 0x7F) << shift;
+        if ((*p & 0x80) == 0) {
+            *pp = p + 1;
+            return 0;
+        }
+
+        shift += 7;
+        if (shift >= 7 * BINLOG_BINARY_VARINT_MAX_BYTES) {
+            return EINVAL;
+        }
+    }
+
+    return EINVAL;
+}
+
+static inline int binary_unpack_string(const unsigned char **pp,
+        const unsigned char *end, string_t *s)
+{
+    uint64_t len;
+
+    if (binary_unpack_varint(pp, end, &len) != 0) {
+        return EINVAL;
+    }
+    if (len > end - *pp) {
+        return EINVAL;
+    }
+
+    s->str = (char *)*pp;
+    s->len = len;
+    *pp += len;
+    return 0;
+}
+
+static inline uint32_t binary_record_crc32(const char *str, const int len)
+{
+    uint32_t crc;
+
+    crc = binlog_crc32c_ex(BINLOG_CRC32C_XINIT, str,
+            offsetof(BinlogBinaryRecordHeader, crc32));
+    crc = binlog_crc32c_ex(crc, str + offsetof(BinlogBinaryRecordHeader,
+                data_version), len - offsetof(BinlogBinaryRecordHeader,
+                    data_version));
+    return BINLOG_CRC32C_FINAL(crc);
+}
+
+static inline int binary_get_field_flags(const FDIRBinlogRecord *record)
+{
+    int flags;
+
+    flags = 0;
+    if (record->options.pname) {
+        flags |= BINLOG_BINARY_FIELD_PNAME;
+    } else if (record->options.path_info.flags != 0) {
+        flags |= BINLOG_BINARY_FIELD_PATH;
+    }
+    if (record->options.user_data) {
+        flags |= BINLOG_BINARY_FIELD_USER_DATA;
+    }
+    if (record->options.extra_data) {
+        flags |= BINLOG_BINARY_FIELD_EXTRA_DATA;
+    }
+    if (record->options.mode) {
+        flags |= BINLOG_BINARY_FIELD_MODE;
+    }
+    if (record->options.atime) {
+        flags |= BINLOG_BINARY_FIELD_ATIME;
+    }
+    if (record->options.ctime) {
+        flags |= BINLOG_BINARY_FIELD_CTIME;
+    }
+    if (record->options.mtime) {
+        flags |= BINLOG_BINARY_FIELD_MTIME;
+    }
+    if (record->options.uid) {
+        flags |= BINLOG_BINARY_FIELD_UID;
+    }
+    if (record->options.gid) {
+        flags |= BINLOG_BINARY_FIELD_GID;
+    }
+    if (record->options.size) {
+        flags |= BINLOG_BINARY_FIELD_SIZE;
+    }
+
+    return flags;
+}
+
+int binlog_binary_pack_record(const FDIRBinlogRecord *record,
+        FastBuffer *buffer)
+{
+    BinlogBinaryRecordHeader *header;
+    unsigned char *p;
+    int flags;
+    int expect_len;
+    int record_len;
+    int result;
+
+    flags = binary_get_field_flags(record);
+    expect_len = BINLOG_BINARY_RECORD_HEADER_SIZE + 16 *
+        BINLOG_BINARY_VARINT_MAX_BYTES;
+    if ((flags & BINLOG_BINARY_FIELD_PNAME) != 0) {
+        expect_len += record->fullname.ns.len +
+                record->pname.name.len;
+    } else if ((flags & BINLOG_BINARY_FIELD_PATH) != 0) {
+        expect_len += record->fullname.ns.len +
+                record->fullname.path.len;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_EXTRA_DATA) != 0) {
+        expect_len += record->extra_data.len;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_USER_DATA) != 0) {
+        expect_len += record->user_data.len;
+    }
+    if ((result=fast_buffer_check_capacity(buffer, expect_len)) != 0) {
+        return result;
+    }
+
+    header = (BinlogBinaryRecordHeader *)(buffer->data + buffer->length);
+    p = (unsigned char *)(header + 1);
+    binary_pack_varint(&p, record->inode);
+    *p++ = record->operation;
+    binary_pack_varint(&p, (uint32_t)record->timestamp);
+    binary_pack_varint(&p, record->hash_code);
+    binary_pack_varint(&p, flags);
+
+    if ((flags & BINLOG_BINARY_FIELD_PATH) != 0) {
+        binary_pack_string(&p, &record->fullname.ns);
+        binary_pack_string(&p, &record->fullname.path);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_PNAME) != 0) {
+        binary_pack_string(&p, &record->fullname.ns);
+        binary_pack_varint(&p, record->pname.parent_inode);
+        binary_pack_string(&p, &record->pname.name);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_USER_DATA) != 0) {
+        binary_pack_string(&p, &record->user_data);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_EXTRA_DATA) != 0) {
+        binary_pack_string(&p, &record->extra_data);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_MODE) != 0) {
+        binary_pack_varint(&p, (uint32_t)record->stat.mode);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_ATIME) != 0) {
+        binary_pack_varint(&p, (uint32_t)record->stat.atime);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_CTIME) != 0) {
+        binary_pack_varint(&p, (uint32_t)record->stat.ctime);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_MTIME) != 0) {
+        binary_pack_varint(&p, (uint32_t)record->stat.mtime);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_UID) != 0) {
+        binary_pack_varint(&p, (uint32_t)record->stat.uid);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_GID) != 0) {
+        binary_pack_varint(&p, (uint32_t)record->stat.gid);
+    }
+    if ((flags & BINLOG_BINARY_FIELD_SIZE) != 0) {
+        binary_pack_varint(&p, record->stat.size);
+    }
+
+    record_len = (char *)p - (char *)header;
+    if (record_len > BINLOG_RECORD_MAX_SIZE) {
+        logError("file: "__FILE__", line: %d, "
+                "record length: %d is too large, exceeds %d",
+                __LINE__, record_len, BINLOG_RECORD_MAX_SIZE);
+        return EOVERFLOW;
+    }
+
+    header->magic = BINLOG_BINARY_RECORD_MAGIC;
+    header->version = BINLOG_BINARY_RECORD_VERSION;
+    short2buff(record_len, header->length);
+    long2buff(record->data_version, header->data_version);
+    int2buff(binary_record_crc32((char *)header, record_len), header->crc32);
+    buffer->length += record_len;
+    return 0;
+}
+
+static int binary_check_record(const char *str, const int len,
+        int *record_len, char *error_info, const int error_size)
+{
+    BinlogBinaryRecordHeader *header;
+    uint32_t crc32;
+
+    if (len < BINLOG_BINARY_RECORD_HEADER_SIZE) {
+        sprintf(error_info, "string length: %d is too short", len);
+        return EAGAIN;
+    }
+
+    header = (BinlogBinaryRecordHeader *)str;
+    if (header->magic != BINLOG_BINARY_RECORD_MAGIC) {
+        sprintf(error_info, "unexpect magic: 0x%02X, expect: 0x%02X",
+                header->magic, BINLOG_BINARY_RECORD_MAGIC);
+        return EINVAL;
+    }
+    if (header->version != BINLOG_BINARY_RECORD_VERSION) {
+        sprintf(error_info, "unsupported record version: %d, "
+                "expect: %d", header->version,
+                BINLOG_BINARY_RECORD_VERSION);
+        return EINVAL;
+    }
+
+    *record_len = (unsigned short)buff2short(header->length);
+    if (*record_len < BINLOG_BINARY_RECORD_MIN_SIZE ||
+            *record_len > BINLOG_RECORD_MAX_SIZE)
+    {
+        sprintf(error_info, "invalid record length: %d", *record_len);
+        return EINVAL;
+    }
+    if (*record_len > len) {
+        sprintf(error_info, "record length: %d out of bound", *record_len);
+        return EOVERFLOW;
+    }
+
+    crc32 = binary_record_crc32(str, *record_len);
+    if (crc32 != (uint32_t)buff2int(header->crc32)) {
+        sprintf(error_info, "record checksum: %08X != expected: %08X",
+                crc32, (uint32_t)buff2int(header->crc32));
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static inline bool binary_is_record_start(const char *str, const int len,
+        int *record_len)
+{
+    char error_info[64];
+
+    if (len < BINLOG_BINARY_RECORD_MIN_SIZE) {
+        return false;
+    }
+    return binary_check_record(str, len, record_len,
+            error_info, sizeof(error_info)) == 0;
+}
+
+#define BINARY_UNPACK_VARINT(p, end, n, field_name) \
+    do { \
+        if (binary_unpack_varint(&p, end, &n) != 0) { \
+            snprintf(error_info, error_size, \
+                    "unpack field %s fail", field_name); \
+            return EINVAL; \
+        } \
+    } while (0)
+
+#define BINARY_UNPACK_STRING(p, end, s, field_name) \
+    do { \
+        if (binary_unpack_string(&p, end, &s) != 0) { \
+            snprintf(error_info, error_size, \
+                    "unpack field %s fail", field_name); \
+            return EINVAL; \
+        } \
+    } while (0)
+
+static int binary_unpack_body(const unsigned char *p,
+        const unsigned char *end, FDIRBinlogRecord *record,
+        char *error_info, const int error_size)
+{
+    uint64_t n;
+    int flags;
+
+    BINARY_UNPACK_VARINT(p, end, n, "inode");
+    record->inode = n;
+    if (p >= end) {
+        sprintf(error_info, "expect operation field");
+        return EINVAL;
+    }
+    record->operation = *p++;
+    BINARY_UNPACK_VARINT(p, end, n, "timestamp");
+    record->timestamp = (int)n;
+    BINARY_UNPACK_VARINT(p, end, n, "hash code");
+    record->hash_code = n;
+    record->options.hash_code = 1;
+    BINARY_UNPACK_VARINT(p, end, n, "field flags");
+    flags = n;
+
+    if ((flags & BINLOG_BINARY_FIELD_PATH) != 0) {
+        BINARY_UNPACK_STRING(p, end, record->fullname.ns, "namespace");
+        BINARY_UNPACK_STRING(p, end, record->fullname.path, "path");
+        record->options.path_info.ns = 1;
+        record->options.path_info.pt = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_PNAME) != 0) {
+        BINARY_UNPACK_STRING(p, end, record->fullname.ns, "namespace");
+        BINARY_UNPACK_VARINT(p, end, n, "parent inode");
+        record->pname.parent_inode = n;
+        BINARY_UNPACK_STRING(p, end, record->pname.name, "name");
+        record->options.pname = 1;
+        if (record->pname.parent_inode <= 0) {
+            sprintf(error_info, "invalid parent inode: %"PRId64,
+                    record->pname.parent_inode);
+            return EINVAL;
+        }
+    }
+    if ((flags & BINLOG_BINARY_FIELD_USER_DATA) != 0) {
+        BINARY_UNPACK_STRING(p, end, record->user_data, "user data");
+        record->options.user_data = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_EXTRA_DATA) != 0) {
+        BINARY_UNPACK_STRING(p, end, record->extra_data, "extra data");
+        record->options.extra_data = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_MODE) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "mode");
+        record->stat.mode = (int)n;
+        record->options.mode = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_ATIME) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "atime");
+        record->stat.atime = (int)n;
+        record->options.atime = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_CTIME) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "ctime");
+        record->stat.ctime = (int)n;
+        record->options.ctime = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_MTIME) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "mtime");
+        record->stat.mtime = (int)n;
+        record->options.mtime = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_UID) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "uid");
+        record->stat.uid = (int)n;
+        record->options.uid = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_GID) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "gid");
+        record->stat.gid = (int)n;
+        record->options.gid = 1;
+    }
+    if ((flags & BINLOG_BINARY_FIELD_SIZE) != 0) {
+        BINARY_UNPACK_VARINT(p, end, n, "file size");
+        record->stat.size = n;
+        record->options.size = 1;
+    }
+
+    if (p != end) {
+        sprintf(error_info, "record length mismatch, remain bytes: %d",
+                (int)(end - p));
+        return EINVAL;
+    }
+
+    if (record->inode <= 0) {
+        sprintf(error_info, "invalid inode: %"PRId64, record->inode);
+        return EINVAL;
+    }
+    if (record->data_version <= 0) {
+        sprintf(error_info, "invalid data version: %"PRId64,
+                record->data_version);
+        return EINVAL;
+    }
+    if (record->operation <= BINLOG_OP_NONE_INT ||
+            record->operation > BINLOG_OP_UPDATE_DENTRY_INT)
+    {
+        sprintf(error_info, "invalid operation: %d", record->operation);
+        return EINVAL;
+    }
+    if (record->timestamp <= 0) {
+        sprintf(error_info, "invalid timestamp: %d", record->timestamp);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+int binlog_binary_unpack_record(const char *str, const int len,
+        FDIRBinlogRecord *record, const char **record_end,
+        char *error_info, const int error_size)
+{
+    int result;
+    int record_len;
+
+    memset(record, 0, (long)(&((FDIRBinlogRecord*)0)->notify));
+    *error_info = '\0';
+    if ((result=binary_check_record(str, len, &record_len,
+                    error_info, error_size)) != 0)
+    {
+        *record_end = NULL;
+        return result;
+    }
+
+    *record_end = str + record_len;
+    record->data_version = buff2long(((BinlogBinaryRecordHeader *)
+                str)->data_version);
+    return binary_unpack_body((const unsigned char *)str +
+            BINLOG_BINARY_RECORD_HEADER_SIZE, (const unsigned char *)
+            *record_end, record, error_info, error_size);
+}
+
+int binlog_binary_detect_record(const char *str, const int len,
+        int64_t *data_version, const char **rec_end,
+        char *error_info, const int error_size)
+{
+    int result;
+    int record_len;
+
+    *error_info = '\0';
+    if ((result=binary_check_record(str, len, &record_len,
+                    error_info, error_size)) != 0)
+    {
+        return result;
+    }
+
+    *rec_end = str + record_len;
+    *data_version = buff2long(((BinlogBinaryRecordHeader *)
+                str)->data_version);
+    return 0;
+}
+
+int binlog_binary_detect_record_forward(const char *str, const int len,
+        int64_t *data_version, int *rstart_offset, int *rend_offset,
+        char *error_info, const int error_size)
+{
+    const char *p;
+    const char *end;
+    const char *rec_start;
+    int record_len;
+
+    *error_info = '\0';
+    p = str;
+    end = str + len;
+    while ((end - p >= BINLOG_BINARY_RECORD_MIN_SIZE) && (rec_start=
+                (const char *)memchr(p, BINLOG_BINARY_RECORD_MAGIC,
+                    end - p)) != NULL)
+    {
+        if (binary_is_record_start(rec_start, end - rec_start,
+                    &record_len))
+        {
+            *rstart_offset = rec_start - str;
+            *rend_offset = *rstart_offset + record_len;
+            *data_version = buff2long(((BinlogBinaryRecordHeader *)
+                        rec_start)->data_version);
+            return 0;
+        }
+
+        p = rec_start + 1;
+    }
+
+    *rstart_offset = -1;
+    sprintf(error_info, "can't found record start");
+    return ENOENT;
+}
+
+int binlog_binary_detect_record_reverse(const char *str, const int len,
+        int64_t *data_version, const char **rec_start,
+        const char **rec_end, char *error_info, const int error_size)
+{
+    const char *start;
+    int record_len;
+    int l;
+
+    *error_info = '\0';
+    l = len;
+    while (l > 0 && (start=fc_memrchr(str,
+                    BINLOG_BINARY_RECORD_MAGIC, l)) != NULL)
+    {
+        if (binary_is_record_start(start, len - (start - str),
+                    &record_len))
+        {
+            *rec_start = start;
+            *rec_end = start + record_len;
+            *data_version = buff2long(((BinlogBinaryRecordHeader *)
+                        start)->data_version);
+            return 0;
+        }
+
+        l = start - str;
+    }
+
+    sprintf(error_info, "can't found record start");
+    return ENOENT;
+}
@@ -0,0 +1,78 @@
+//binlog_binary.h
+
+#ifndef _BINLOG_BINARY_H_
+#define _BINLOG_BINARY_H_
+
+#include "binlog_types.h"
+
+/* the binary record format (version 1):
+ *   fixed header (16 bytes): magic (1), version (1), record length (2),
+ *     crc32c (4), data version (8), the integers are big-endian
+ *   body: inode (varint), operation (1), timestamp (varint),
+ *     hash code (varint), field flags (varint) then the present fields
+ *     in the order of the field flags, the string as varint length
+ *     followed by the raw bytes, the integer as varint
+ *
+ * the crc32c covers the whole record except the crc32c field self.
+ * the magic 0xFD never appears at the start of the text format (starts
+ * with digit), so the format of a binlog file is decided by the first byte.
+ */
+
+#define BINLOG_BINARY_RECORD_MAGIC        0xFD
+#define BINLOG_BINARY_RECORD_VERSION      1
+#define BINLOG_BINARY_RECORD_HEADER_SIZE  16
+#define BINLOG_BINARY_RECORD_MIN_SIZE  (BINLOG_BINARY_RECORD_HEADER_SIZE + 5)
+
+#define BINLOG_BINARY_FIELD_PATH        (1 << 0)
+#define BINLOG_BINARY_FIELD_USER_DATA   (1 << 1)
+#define BINLOG_BINARY_FIELD_EXTRA_DATA  (1 << 2)
+#define BINLOG_BINARY_FIELD_MODE        (1 << 3)
+#define BINLOG_BINARY_FIELD_ATIME       (1 << 4)
+#define BINLOG_BINARY_FIELD_CTIME       (1 << 5)
+#define BINLOG_BINARY_FIELD_MTIME       (1 << 6)
+#define BINLOG_BINARY_FIELD_UID         (1 << 7)
+#define BINLOG_BINARY_FIELD_GID         (1 << 8)
+#define BINLOG_BINARY_FIELD_SIZE        (1 << 9)
+#define BINLOG_BINARY_FIELD_PNAME       (1 << 10)  //ns, parent inode & name
+
+typedef struct binlog_binary_record_header {
+    unsigned char magic;
+    unsigned char version;
+    char length[2];
+    char crc32[4];
+    char data_version[8];
+} BinlogBinaryRecordHeader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline bool binlog_binary_is_record(const char *str)
+{
+    return (unsigned char)*str == BINLOG_BINARY_RECORD_MAGIC;
+}
+
+int binlog_binary_pack_record(const FDIRBinlogRecord *record,
+        FastBuffer *buffer);
+
+int binlog_binary_unpack_record(const char *str, const int len,
+        FDIRBinlogRecord *record, const char **record_end,
+        char *error_info, const int error_size);
+
+int binlog_binary_detect_record(const char *str, const int len,
+        int64_t *data_version, const char **rec_end,
+        char *error_info, const int error_size);
+
+int binlog_binary_detect_record_forward(const char *str, const int len,
+        int64_t *data_version, int *rstart_offset, int *rend_offset,
+        char *error_info, const int error_size);
+
+int binlog_binary_detect_record_reverse(const char *str, const int len,
+        int64_t *data_version, const char **rec_start,
+        const char **rec_end, char *error_info, const int error_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
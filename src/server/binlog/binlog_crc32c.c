@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binlog_crc32c.h"
+
+#define CRC32C_POLY_REVERSED  0x82F63B78
+
+static uint32_t crc32c_table[8][256];
+static int crc32c_inited = 0;
+
+void binlog_crc32c_init()
+{
+    uint32_t crc;
+    int i;
+    int k;
+
+    if (crc32c_inited) {
+        return;
+    }
+
+    for (i=0; i<256; i++) {
+        crc = i;
+        for (k=0; k<8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY_REVERSED : crc >> 1;
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    //tables for slicing-by-8
+    for (i=0; i<256; i++) {
+        crc = crc32c_table[0][i];
+        for (k=1; k<8; k++) {
+            crc = (crc >> 8) ^ crc32c_table[0][crc & 0xFF];
+            crc32c_table[k][i] = crc;
+        }
+    }
+
+    crc32c_inited = 1;
+}
+
+uint32_t binlog_crc32c_ex(uint32_t crc, const void *buff, const int len)
+{
+    const unsigned char *p;
+    const unsigned char *end;
+
+    p = (const unsigned char *)buff;
+    end = p + len;
+    while (end - p >= 8) {
+        crc ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+            ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        crc = crc32c_table[7][crc & 0xFF] ^
+            crc32c_table[6][(crc >> 8) & 0xFF] ^
+            crc32c_table[5][(crc >> 16) & 0xFF] ^
+            crc32c_table[4][crc >> 24] ^
+            crc32c_table[3][p[4]] ^
+            crc32c_table[2][p[5]] ^
+            crc32c_table[1][p[6]] ^
+            crc32c_table[0][p[7]];
+        p += 8;
+    }
+
+    while (p < end) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
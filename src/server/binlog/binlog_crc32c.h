@@ -0,0 +1,31 @@
+//binlog_crc32c.h
+
+#ifndef _BINLOG_CRC32C_H_
+#define _BINLOG_CRC32C_H_
+
+#include <stdint.h>
+
+#define BINLOG_CRC32C_XINIT  0xFFFFFFFF
+
+#define BINLOG_CRC32C_FINAL(crc)  ((crc) ^ BINLOG_CRC32C_XINIT)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void binlog_crc32c_init();
+
+//CRC32C (Castagnoli), the crc should init as BINLOG_CRC32C_XINIT
+uint32_t binlog_crc32c_ex(uint32_t crc, const void *buff, const int len);
+
+static inline uint32_t binlog_crc32c(const void *buff, const int len)
+{
+    return BINLOG_CRC32C_FINAL(binlog_crc32c_ex(
+                BINLOG_CRC32C_XINIT, buff, len));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,20 +15,74 @@
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/ioevent_loop.h"
+#include "fastcommon/fast_mblock.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
+#include "../cluster_info.h"
 #include "binlog_write_thread.h"
 #include "binlog_replication.h"
+#include "replica_quorum.h"
 #include "binlog_local_consumer.h"
 
 static FDIRSlaveReplicationArray slave_replication_array;
 
+/* a slave relays the binlog received to the learners whose upstream
+ * is itself, the master replicates to the others (including the learners
+ * whose upstream is not active), see cluster_info_get_source
+ */
+static FDIRSlaveReplicationPtrArray relay_replication_array;
+static int voter_slave_count;  //the slaves waited by the writers
+
+//bind by the cluster thread periodically and when the master changed
+static pthread_mutex_t bind_lock;
+
+static struct fast_mblock_man relay_rb_allocator;  //for relay record buffers
+
+static void relay_release_rbuffer(ServerBinlogRecordBuffer *rbuffer)
+{
+    if (__sync_sub_and_fetch(&rbuffer->reffer_count, 1) == 0) {
+        fast_mblock_free_object(&relay_rb_allocator, rbuffer);
+    }
+}
+
+static int relay_rbuffer_alloc_init_func(void *element, void *args)
+{
+    ServerBinlogRecordBuffer *rbuffer;
+
+    rbuffer = (ServerBinlogRecordBuffer *)element;
+    rbuffer->release_func = relay_release_rbuffer;
+    rbuffer->durability_level = FDIR_DURABILITY_LEVEL_MEMORY;  //no task
+    return fast_buffer_init_ex(&rbuffer->buffer, BINLOG_BUFFER_INIT_SIZE);
+}
+
+static int init_replication_ptr_array(FDIRSlaveReplicationPtrArray *array,
+        const int alloc)
+{
+    int bytes;
+
+    array->count = 0;
+    if (alloc == 0) {
+        return 0;
+    }
+
+    bytes = sizeof(FDIRSlaveReplication *) * alloc;
+    array->replications = (FDIRSlaveReplication **)malloc(bytes);
+    if (array->replications == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+
+    return 0;
+}
+
 static int init_binlog_local_consumer_array()
 {
     static bool inited = false;
     int result;
     int count;
     int bytes;
+    int element_size;
     FDIRClusterServerInfo *server;
     FDIRSlaveReplication *replication;
     FDIRSlaveReplication *end;
@@ -40,7 +94,7 @@ static int init_binlog_local_consumer_array()
     count = CLUSTER_SERVER_ARRAY.count - 1;
     if (count == 0) {
         slave_replication_array.count = count;
-        return 0;
+        return replica_quorum_init(count);
     }
 
     bytes = sizeof(FDIRSlaveReplication) * count;
@@ -53,6 +107,12 @@ static int init_binlog_local_consumer_array()
     }
     memset(slave_replication_array.replications, 0, bytes);
 
+    if ((result=init_replication_ptr_array(&relay_replication_array,
+                    count)) != 0)
+    {
+        return result;
+    }
+
     server = CLUSTER_SERVER_ARRAY.servers;
     end = slave_replication_array.replications + count;
     for (replication=slave_replication_array.replications; replication<end;
@@ -65,12 +125,36 @@ static int init_binlog_local_consumer_array()
         replication->index = replication - slave_replication_array.replications;
         replication->slave = server++;
         replication->connection_info.conn.sock = -1;
+        replication->context.zero_copy.fd = -1;
         if ((result=init_pthread_lock(&replication->context.queue.lock)) != 0) {
             logError("file: "__FILE__", line: %d, "
                     "init_pthread_lock fail, errno: %d, error info: %s",
                     __LINE__, result, STRERROR(result));
             return result;
         }
+
+        if (!replication->slave->is_learner) {
+            voter_slave_count++;  //only the learner has the upstream
+        }
+        if (replication->slave->upstream == CLUSTER_MYSELF_PTR) {
+            relay_replication_array.replications[
+                relay_replication_array.count++] = replication;
+        }
+    }
+
+    //the replica quorum excludes the learners as the master election
+    if ((result=replica_quorum_init(voter_slave_count)) != 0) {
+        return result;
+    }
+
+    element_size = sizeof(ServerBinlogRecordBuffer) +
+        sizeof(struct server_binlog_record_buffer *) * count;
+    if ((result=fast_mblock_init_ex2(&relay_rb_allocator,
+                    "relay_record_buffer", element_size, 256,
+                    relay_rbuffer_alloc_init_func, NULL, true,
+                    NULL, NULL, NULL)) != 0)
+    {
+        return result;
     }
 
     slave_replication_array.count = count;
@@ -86,6 +170,12 @@ int binlog_local_consumer_init()
     if ((result=binlog_write_thread_init()) != 0) {
         return result;
     }
+    if ((result=init_pthread_lock(&bind_lock)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "init_pthread_lock fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
 
     return fc_create_thread(&tid, binlog_write_thread_func, NULL,
             SF_G_THREAD_STACK_SIZE);
@@ -97,20 +187,160 @@ int binlog_local_consumer_replication_start()
     FDIRSlaveReplication *replication;
     FDIRSlaveReplication *end;
 
-    if ((result=init_binlog_local_consumer_array()) != 0) {
-        return result;
+    PTHREAD_MUTEX_LOCK(&bind_lock);
+    if ((result=init_binlog_local_consumer_array()) == 0) {
+        end = slave_replication_array.replications +
+            slave_replication_array.count;
+        for (replication=slave_replication_array.replications;
+                replication<end; replication++)
+        {
+            if (replication->task != NULL || !cluster_info_is_downstream(
+                        replication->slave))
+            {
+                continue;  //already bound or not replicated by me
+            }
+
+            if ((result=binlog_replication_bind_thread(replication)) != 0) {
+                break;
+            }
+        }
     }
+    PTHREAD_MUTEX_UNLOCK(&bind_lock);
+
+    return result;
+}
+
+int64_t binlog_local_consumer_slave_replied_version(
+        FDIRClusterServerInfo *slave)
+{
+    FDIRSlaveReplication *replication;
+    FDIRSlaveReplication *end;
 
     end = slave_replication_array.replications + slave_replication_array.count;
     for (replication=slave_replication_array.replications; replication<end;
             replication++)
     {
-        if ((result=binlog_replication_bind_thread(replication)) != 0) {
-            return result;
+        if (replication->slave == slave) {
+            if (replication->stage < FDIR_REPLICATION_STAGE_SYNC_FROM_DISK) {
+                return -1;
+            }
+            return replication->context.last_data_versions.by_resp;
         }
     }
 
-    return 0;
+    return -1;
+}
+
+static inline void get_replication_lag(FDIRSlaveReplication *replication,
+        FDIRReplicationLag *lag)
+{
+    lag->data_versions = (int64_t)__sync_add_and_fetch(
+            &DATA_CURRENT_VERSION, 0) - replication->
+        context.last_data_versions.by_resp;
+    if (lag->data_versions < 0) {
+        lag->data_versions = 0;
+    }
+    lag->bytes = __sync_add_and_fetch(&replication->context.queue.bytes, 0) +
+        replication->context.window.bytes;
+}
+
+int binlog_local_consumer_slave_lag(FDIRClusterServerInfo *slave,
+        FDIRReplicationLag *lag)
+{
+    FDIRSlaveReplication *replication;
+    FDIRSlaveReplication *end;
+
+    end = slave_replication_array.replications + slave_replication_array.count;
+    for (replication=slave_replication_array.replications; replication<end;
+            replication++)
+    {
+        if (replication->slave == slave) {
+            if (replication->stage < FDIR_REPLICATION_STAGE_SYNC_FROM_DISK) {
+                return ENOENT;
+            }
+            get_replication_lag(replication, lag);
+            return 0;
+        }
+    }
+
+    return ENOENT;
+}
+
+static inline bool replication_lag_exceeds(const FDIRReplicationLag *lag)
+{
+    return ((REPLICATION_MAX_LAG_VERSIONS > 0 && lag->data_versions >
+                REPLICATION_MAX_LAG_VERSIONS) ||
+            (REPLICATION_MAX_LAG_BYTES > 0 && lag->bytes >
+             REPLICATION_MAX_LAG_BYTES));
+}
+
+static inline void replication_fallback_to_disk(
+        FDIRSlaveReplication *replication)
+{
+    __sync_bool_compare_and_swap(&replication->fallback_to_disk, 0, 1);
+}
+
+FDIRClusterServerInfo *binlog_local_consumer_lagging_slave(
+        FDIRReplicationLag *lag)
+{
+    FDIRSlaveReplication *replication;
+    FDIRSlaveReplication *end;
+    FDIRSlaveReplication *lagging;  //the least lagging voter
+    FDIRReplicationLag current;
+    int healthy_count;  //the voters syncing from the queue in the limits
+
+    if (REPLICATION_MAX_LAG_VERSIONS == 0 && REPLICATION_MAX_LAG_BYTES == 0) {
+        return NULL;
+    }
+
+    lagging = NULL;
+    healthy_count = 0;
+    end = slave_replication_array.replications + slave_replication_array.count;
+    for (replication=slave_replication_array.replications;
+            replication<end; replication++)
+    {
+        //the queue is discarded when syncing from the disk
+        if (replication->stage != FDIR_REPLICATION_STAGE_SYNC_FROM_QUEUE) {
+            continue;
+        }
+
+        get_replication_lag(replication, &current);
+        if (!replication_lag_exceeds(&current)) {
+            if (!replication->slave->is_learner) {
+                healthy_count++;
+            }
+        } else if (replication->slave->is_learner) {
+            replication_fallback_to_disk(replication);  //NOT waited
+        } else if (lagging == NULL || current.data_versions <
+                lag->data_versions)
+        {
+            lagging = replication;
+            *lag = current;
+        }
+    }
+
+    if (lagging == NULL) {
+        return NULL;
+    }
+
+    //the writers are throttled only when waiting for the lagging voters
+    if (healthy_count < replica_quorum_get_count()) {
+        return lagging->slave;
+    }
+
+    for (replication=slave_replication_array.replications;
+            replication<end; replication++)
+    {
+        if (replication->stage == FDIR_REPLICATION_STAGE_SYNC_FROM_QUEUE
+                && !replication->slave->is_learner)
+        {
+            get_replication_lag(replication, &current);
+            if (replication_lag_exceeds(&current)) {
+                replication_fallback_to_disk(replication);
+            }
+        }
+    }
+    return NULL;
 }
 
 void binlog_local_consumer_destroy()
@@ -129,6 +359,12 @@ void binlog_local_consumer_destroy()
     }
     free(slave_replication_array.replications);
     slave_replication_array.replications = NULL;
+
+    if (relay_replication_array.replications != NULL) {
+        free(relay_replication_array.replications);
+        relay_replication_array.replications = NULL;
+    }
+    fast_mblock_destroy(&relay_rb_allocator);
 }
 
 void binlog_local_consumer_terminate()
@@ -143,16 +379,21 @@ void binlog_local_consumer_terminate()
     end = slave_replication_array.replications + slave_replication_array.count;
     for (replication=slave_replication_array.replications; replication<end;
             replication++) {
-        iovent_notify_thread(replication->task->thread_data);
+        if (replication->task != NULL) {
+            iovent_notify_thread(replication->task->thread_data);
+        }
     }
 }
 
 static void push_to_slave_replica_queues(FDIRSlaveReplication *replication,
         ServerBinlogRecordBuffer *rbuffer)
 {
+    struct fast_task_info *task;
     bool notify;
 
     rbuffer->nexts[replication->index] = NULL;
+    __sync_add_and_fetch(&replication->context.queue.bytes,
+            rbuffer->buffer.length);
     PTHREAD_MUTEX_LOCK(&replication->context.queue.lock);
     if (replication->context.queue.tail == NULL) {
         replication->context.queue.head = rbuffer;
@@ -165,8 +406,9 @@ static void push_to_slave_replica_queues(FDIRSlaveReplication *replication,
     replication->context.queue.tail = rbuffer;
     PTHREAD_MUTEX_UNLOCK(&replication->context.queue.lock);
 
-    if (notify) {
-        iovent_notify_thread(replication->task->thread_data);
+    task = replication->task;
+    if (notify && task != NULL) {
+        iovent_notify_thread(task->thread_data);
     }
 }
 
@@ -175,11 +417,41 @@ int binlog_local_consumer_push_to_queues(ServerBinlogRecordBuffer *rbuffer)
     FDIRSlaveReplication *replication;
     FDIRSlaveReplication *end;
     struct fast_task_info *task;
+    int waiting_count;
     int result;
 
+    /* the references of the slaves not replicated by me are released
+     * in the pushing loop, the voters are always replicated by the master
+     */
     __sync_add_and_fetch(&rbuffer->reffer_count,
             slave_replication_array.count + 1);
 
+    /* must set the waiting count before the writer and slaves notify */
+    rbuffer->quorum = NULL;
+    task = (struct fast_task_info *)rbuffer->args;
+    switch (rbuffer->durability_level) {
+        case FDIR_DURABILITY_LEVEL_LOCAL:
+            waiting_count = 1;
+            break;
+        case FDIR_DURABILITY_LEVEL_REPLICA:
+            if (voter_slave_count > 0 && (rbuffer->quorum=
+                        replica_quorum_alloc(task, rbuffer->
+                            task_version)) != NULL)
+            {
+                waiting_count = 2;  //the writer and the quorum
+            } else {
+                waiting_count = 1 + voter_slave_count;
+            }
+            break;
+        default:
+            waiting_count = 0;
+            break;
+    }
+    if (waiting_count > 0) {
+        __sync_add_and_fetch(&((FDIRServerTaskArg *)task->arg)->context.
+                service.waiting_rpc_count, waiting_count);
+    }
+
      if ((result=push_to_binlog_write_queue(rbuffer)) != 0) {
         logCrit("file: "__FILE__", line: %d, "
                 "push_to_binlog_write_queue fail, program exit!",
@@ -188,18 +460,63 @@ int binlog_local_consumer_push_to_queues(ServerBinlogRecordBuffer *rbuffer)
         return result;
     }
 
-    if (slave_replication_array.count == 0) {
+    end = slave_replication_array.replications + slave_replication_array.count;
+    for (replication=slave_replication_array.replications;
+            replication<end; replication++)
+    {
+        if (cluster_info_is_downstream(replication->slave)) {
+            push_to_slave_replica_queues(replication, rbuffer);
+        } else {
+            rbuffer->release_func(rbuffer);  //relayed by the upstream
+        }
+    }
+
+    return 0;
+}
+
+int binlog_local_consumer_push_to_relay_queues(
+        const ServerBinlogRecordBuffer *received)
+{
+    ServerBinlogRecordBuffer *rbuffer;
+    FDIRSlaveReplication **replication;
+    FDIRSlaveReplication **end;
+    int result;
+
+    if (relay_replication_array.count == 0) {
         return 0;
     }
 
-    task = (struct fast_task_info *)rbuffer->args;
-    __sync_add_and_fetch(&((FDIRServerTaskArg *)task->arg)->context.
-            service.waiting_rpc_count, slave_replication_array.count);
+    /* copy to a record buffer of my own, the downstream servers should
+     * not hold the receive buffers (the credits to the upstream)
+     */
+    rbuffer = (ServerBinlogRecordBuffer *)fast_mblock_alloc_object(
+            &relay_rb_allocator);
+    if (rbuffer == NULL) {
+        return ENOMEM;
+    }
+    rbuffer->buffer.length = 0;
+    if ((result=fast_buffer_append_buff(&rbuffer->buffer,
+                    received->buffer.data, received->buffer.length)) != 0)
+    {
+        fast_mblock_free_object(&relay_rb_allocator, rbuffer);
+        return result;
+    }
+    rbuffer->data_version = received->data_version;
+    rbuffer->quorum = NULL;
+    rbuffer->args = NULL;
+    rbuffer->reffer_count = relay_replication_array.count;
 
-    end = slave_replication_array.replications + slave_replication_array.count;
-    for (replication=slave_replication_array.replications; replication<end;
-            replication++) {
-        push_to_slave_replica_queues(replication, rbuffer);
+    end = relay_replication_array.replications +
+        relay_replication_array.count;
+    for (replication=relay_replication_array.replications;
+            replication<end; replication++)
+    {
+        if (cluster_info_is_downstream((*replication)->slave)) {
+            push_to_slave_replica_queues(*replication, rbuffer);
+        } else {
+            //the master or replicated by the master (I am not active)
+            rbuffer->release_func(rbuffer);
+        }
     }
 
     return 0;
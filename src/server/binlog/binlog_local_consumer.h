@@ -13,9 +13,37 @@ int binlog_local_consumer_init();
 void binlog_local_consumer_destroy();
 void binlog_local_consumer_terminate();
 
+/* bind the replications to the servers replicated by me (as master or relay),
+ * called again when the source of the servers changed
+ */
 int binlog_local_consumer_replication_start();
 int binlog_local_consumer_push_to_queues(ServerBinlogRecordBuffer *rbuffer);
 
+//relay the binlog received from the upstream to my downstream servers
+int binlog_local_consumer_push_to_relay_queues(
+        const ServerBinlogRecordBuffer *received);
+
+/* the data version replied (applied) by the slave, called by other threads,
+ * return -1 when the replication of the slave is not syncing
+ */
+int64_t binlog_local_consumer_slave_replied_version(
+        FDIRClusterServerInfo *slave);
+
+/* the replication lag of the slave, called by other threads,
+ * return ENOENT when the replication of the slave is not syncing
+ */
+int binlog_local_consumer_slave_lag(FDIRClusterServerInfo *slave,
+        FDIRReplicationLag *lag);
+
+/* for the flow control of the writers, return the slave syncing from
+ * the queue whose lag exceeds the thresholds and waited by the writers
+ * (the replica quorum can't be reached without it), NULL for none.
+ * the lagging learners and the voters beyond the quorum are NOT
+ * returned, their queues are discarded and synced from the disk instead
+ */
+FDIRClusterServerInfo *binlog_local_consumer_lagging_slave(
+        FDIRReplicationLag *lag);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,8 @@
 #include "../server_global.h"
 #include "binlog_func.h"
 #include "binlog_producer.h"
+#include "binlog_crc32c.h"
+#include "binlog_binary.h"
 #include "binlog_pack.h"
 
 #define BINLOG_RECORD_START_TAG_CHAR '<'
@@ -46,6 +48,8 @@
 #define BINLOG_RECORD_FIELD_NAME_GID           "gi"
 #define BINLOG_RECORD_FIELD_NAME_FILE_SIZE     "sz"
 #define BINLOG_RECORD_FIELD_NAME_HASH_CODE     "hc"
+#define BINLOG_RECORD_FIELD_NAME_PARENT_INODE  "pi"
+#define BINLOG_RECORD_FIELD_NAME_NAME          "nm"
 
 #define BINLOG_RECORD_FIELD_INDEX_INODE         ('i' * 256 + 'd')
 #define BINLOG_RECORD_FIELD_INDEX_DATA_VERSION  ('d' * 256 + 'v')
@@ -63,6 +67,8 @@
 #define BINLOG_RECORD_FIELD_INDEX_GID           ('g' * 256 + 'i')
 #define BINLOG_RECORD_FIELD_INDEX_FILE_SIZE     ('s' * 256 + 'z')
 #define BINLOG_RECORD_FIELD_INDEX_HASH_CODE     ('h' * 256 + 'c')
+#define BINLOG_RECORD_FIELD_INDEX_PARENT_INODE  ('p' * 256 + 'i')
+#define BINLOG_RECORD_FIELD_INDEX_NAME          ('n' * 256 + 'm')
 
 #define BINLOG_FIELD_TYPE_INTEGER   'i'
 #define BINLOG_FIELD_TYPE_STRING    's'
@@ -85,6 +91,12 @@ typedef struct {
 } FieldParserContext;
 
 static FastCharConverter char_converter;
+static bool fast_parser = true;
+
+void binlog_pack_set_fast_parser(const bool enabled)
+{
+    fast_parser = enabled;
+}
 
 int binlog_pack_init()
 {
@@ -100,6 +112,7 @@ int binlog_pack_init()
     FAST_CHAR_MAKE_PAIR(pairs[6], '<',  'l');
     FAST_CHAR_MAKE_PAIR(pairs[7], '>',  'g');
 
+    binlog_crc32c_init();
     return char_converter_init_ex(&char_converter, pairs,
             ESCAPE_CHAR_PAIR_COUNT, FAST_CHAR_OP_ADD_BACKSLASH);
 }
@@ -178,7 +191,8 @@ static void binlog_pack_stringl(FastBuffer *buffer, const char *name,
 #define BINLOG_PACK_STRING(buffer, name, value) \
     binlog_pack_stringl(buffer, name, value.str, value.len, true)
 
-int binlog_pack_record(const FDIRBinlogRecord *record, FastBuffer *buffer)
+static int text_pack_record(const FDIRBinlogRecord *record,
+        FastBuffer *buffer)
 {
     string_t op_caption;
     int old_len;
@@ -187,7 +201,10 @@ int binlog_pack_record(const FDIRBinlogRecord *record, FastBuffer *buffer)
     int result;
 
     expect_len = 512;
-    if (record->options.path_info.flags != 0) {
+    if (record->options.pname) {
+        expect_len += record->fullname.ns.len +
+                record->pname.name.len;
+    } else if (record->options.path_info.flags != 0) {
         expect_len += record->fullname.ns.len +
                 record->fullname.path.len;
     }
@@ -223,7 +240,17 @@ int binlog_pack_record(const FDIRBinlogRecord *record, FastBuffer *buffer)
     fast_buffer_append(buffer, " %s=%d",
             BINLOG_RECORD_FIELD_NAME_TIMESTAMP, record->timestamp);
 
-    if (record->options.path_info.flags != 0) {
+    if (record->options.pname) {
+        BINLOG_PACK_STRING(buffer, BINLOG_RECORD_FIELD_NAME_NAMESPACE,
+                record->fullname.ns);
+
+        fast_buffer_append(buffer, " %s=%"PRId64,
+                BINLOG_RECORD_FIELD_NAME_PARENT_INODE,
+                record->pname.parent_inode);
+
+        BINLOG_PACK_STRING(buffer, BINLOG_RECORD_FIELD_NAME_NAME,
+                record->pname.name);
+    } else if (record->options.path_info.flags != 0) {
         BINLOG_PACK_STRING(buffer, BINLOG_RECORD_FIELD_NAME_NAMESPACE,
                 record->fullname.ns);
 
@@ -297,6 +324,97 @@ int binlog_pack_record(const FDIRBinlogRecord *record, FastBuffer *buffer)
     return 0;
 }
 
+/* parse the decimal integer in the form of the packer, return false
+ * for the other forms such as the leading spaces, the plus sign and
+ * more than 18 digits, which are left to strtoll
+ */
+static inline bool binlog_parse_int64(const char *str,
+        int64_t *n, char **endptr)
+{
+    const char *p;
+    const char *start;
+    const char *end;
+    uint64_t v;
+    bool negative;
+
+    p = str;
+    negative = (*p == '-');
+    if (negative) {
+        p++;
+    }
+
+    start = p;
+    end = p + 18;  //18 digits never overflow
+    v = 0;
+    while (p < end && (unsigned char)(*p - '0') <= 9) {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    if (p == start || (unsigned char)(*p - '0') <= 9) {
+        return false;
+    }
+
+    *n = negative ? -(int64_t)v : (int64_t)v;
+    *endptr = (char *)p;
+    return true;
+}
+
+/* parse the fixed 4 digits record size (such as 0123) by one 32 bits
+ * load, return -1 for not all digits
+ */
+static inline int binlog_parse_size4(const char *str)
+{
+    uint32_t v;
+    unsigned char *digits;
+
+    memcpy(&v, str, 4);
+    if (((v & 0xF0F0F0F0) | (((v + 0x06060606) &
+                        0xF0F0F0F0) >> 4)) != 0x33333333)
+    {
+        return -1;
+    }
+
+    v -= 0x30303030;
+    digits = (unsigned char *)&v;
+    return digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+}
+
+static inline int binlog_parse_record_size(const char *str,
+        char **rec_start)
+{
+    int record_len;
+
+    if (fast_parser && (record_len=binlog_parse_size4(str)) >= 0) {
+        *rec_start = (char *)str + BINLOG_RECORD_SIZE_STRLEN;
+        return record_len;
+    }
+
+    *rec_start = NULL;
+    return strtol(str, rec_start, 10);
+}
+
+static inline void binlog_unescape_string(string_t *s)
+{
+    char *escape;
+    int remain;
+
+    if (!fast_parser) {
+        fast_char_unescape(&char_converter, s->str, &s->len);
+        return;
+    }
+
+    /* most values have no escaped char, unescape from the first
+     * backslash found by memchr which is vectorized by libc
+     */
+    if ((escape=(char *)memchr(s->str, '\\', s->len)) == NULL) {
+        return;
+    }
+
+    remain = s->len - (escape - s->str);
+    fast_char_unescape(&char_converter, escape, &remain);
+    s->len = (escape - s->str) + remain;
+}
+
 static int binlog_get_next_field_value(FieldParserContext *pcontext)
 {
     int remain;
@@ -339,8 +457,10 @@ static int binlog_get_next_field_value(FieldParserContext *pcontext)
     }
 
     value = pcontext->fv.name + BINLOG_RECORD_FIELD_NAME_LENGTH + 1;
-    endptr = NULL;
-    n = strtoll(value, &endptr, 10);
+    if (!(fast_parser && binlog_parse_int64(value, &n, &endptr))) {
+        endptr = NULL;
+        n = strtoll(value, &endptr, 10);
+    }
     if (*endptr == ',') {
         pcontext->fv.type = BINLOG_FIELD_TYPE_STRING;
 
@@ -353,8 +473,7 @@ static int binlog_get_next_field_value(FieldParserContext *pcontext)
             return EINVAL;
         }
 
-        fast_char_unescape(&char_converter, pcontext->fv.value.s.str,
-                &pcontext->fv.value.s.len);
+        binlog_unescape_string(&pcontext->fv.value.s);
     } else if ((*endptr == ' ') || (*endptr == '/' && pcontext->rec_end -
                 endptr == BINLOG_RECORD_END_TAG_LEN))
     {
@@ -494,6 +613,19 @@ static int binlog_set_field_value(FieldParserContext *pcontext,
                 record->options.size = 1;
             }
             break;
+        case BINLOG_RECORD_FIELD_INDEX_PARENT_INODE:
+            expect_type = BINLOG_FIELD_TYPE_INTEGER;
+            if (pcontext->fv.type == expect_type) {
+                record->pname.parent_inode = pcontext->fv.value.n;
+            }
+            break;
+        case BINLOG_RECORD_FIELD_INDEX_NAME:
+            expect_type = BINLOG_FIELD_TYPE_STRING;
+            if (pcontext->fv.type == expect_type) {
+                record->pname.name = pcontext->fv.value.s;
+                record->options.pname = 1;
+            }
+            break;
         case BINLOG_RECORD_FIELD_INDEX_HASH_CODE:
             expect_type = BINLOG_FIELD_TYPE_INTEGER;
             if (pcontext->fv.type == expect_type) {
@@ -551,7 +683,19 @@ static int binlog_check_required_fields(FieldParserContext *pcontext,
         return ENOENT;
     }
 
-    if (record->options.path_info.flags != 0) {
+    if (record->options.pname) {
+        if (record->options.path_info.ns == 0) {
+            sprintf(pcontext->error_info, "expect namespace field: %s",
+                    BINLOG_RECORD_FIELD_NAME_NAMESPACE);
+            return ENOENT;
+        }
+        if (record->pname.parent_inode <= 0) {
+            sprintf(pcontext->error_info, "expect parent inode field: %s",
+                    BINLOG_RECORD_FIELD_NAME_PARENT_INODE);
+            return ENOENT;
+        }
+        record->options.path_info.flags = 0;  //the namespace only
+    } else if (record->options.path_info.flags != 0) {
         if (record->options.path_info.ns == 0) {
             sprintf(pcontext->error_info, "expect namespace field: %s",
                     BINLOG_RECORD_FIELD_NAME_NAMESPACE);
@@ -636,8 +780,7 @@ static int binlog_check_record(const char *str, const int len,
         return result;
     }
 
-    rec_start = NULL;
-    record_len  = strtol(str, &rec_start, 10);
+    record_len = binlog_parse_record_size(str, &rec_start);
     if (*rec_start != BINLOG_RECORD_START_TAG_CHAR) {
         sprintf(pcontext->error_info, "unexpect char: %c(0x%02X), "
                 "expect start tag char: %c", *rec_start,
@@ -697,7 +840,7 @@ static int binlog_check_record(const char *str, const int len,
         pcontext.error_size = errsize;  \
     } while (0)
 
-int binlog_unpack_record(const char *str, const int len,
+static int text_unpack_record(const char *str, const int len,
         FDIRBinlogRecord *record, const char **record_end,
         char *error_info, const int error_size)
 {
@@ -715,7 +858,7 @@ int binlog_unpack_record(const char *str, const int len,
     return binlog_parse_fields(&pcontext, record);
 }
 
-int binlog_detect_record(const char *str, const int len,
+static int text_detect_record(const char *str, const int len,
         int64_t *data_version, const char **rec_end,
         char *error_info, const int error_size)
 {
@@ -741,13 +884,13 @@ static bool binlog_is_record_start(const char *str, const int len,
         FieldParserContext *pcontext)
 {
     int record_len;
-    const char *rec_start;
+    char *rec_start;
 
     if (len < BINLOG_RECORD_MIN_SIZE) {
         return false;
     }
 
-    record_len = strtol(str, (char **)&rec_start, 10);
+    record_len = binlog_parse_record_size(str, &rec_start);
     if (*rec_start != BINLOG_RECORD_START_TAG_CHAR) {
        return false;
     }
@@ -776,7 +919,7 @@ static bool binlog_is_record_start(const char *str, const int len,
     return false;
 }
 
-int binlog_detect_record_forward(const char *str, const int len,
+static int text_detect_record_forward(const char *str, const int len,
         int64_t *data_version, int *rstart_offset, int *rend_offset,
         char *error_info, const int error_size)
 {
@@ -821,7 +964,7 @@ int binlog_detect_record_forward(const char *str, const int len,
     return 0;
 }
 
-int binlog_detect_record_reverse(const char *str, const int len,
+static int text_detect_record_reverse(const char *str, const int len,
         int64_t *data_version, const char **rec_end,
         char *error_info, const int error_size)
 {
@@ -871,7 +1014,7 @@ int binlog_detect_record_reverse(const char *str, const int len,
     return 0;
 }
 
-int binlog_detect_last_record_end(const char *str, const int len,
+static int text_detect_last_record_end(const char *str, const int len,
         const char **rec_end)
 {
     int l;
@@ -893,3 +1036,89 @@ int binlog_detect_last_record_end(const char *str, const int len,
 
     return ENOENT;
 }
+
+int binlog_pack_record_ex(const FDIRBinlogRecord *record,
+        const int format, FastBuffer *buffer)
+{
+    if (format == FDIR_BINLOG_RECORD_FORMAT_BINARY) {
+        return binlog_binary_pack_record(record, buffer);
+    } else {
+        return text_pack_record(record, buffer);
+    }
+}
+
+int binlog_unpack_record(const char *str, const int len,
+        FDIRBinlogRecord *record, const char **record_end,
+        char *error_info, const int error_size)
+{
+    if (len > 0 && binlog_binary_is_record(str)) {
+        return binlog_binary_unpack_record(str, len, record,
+                record_end, error_info, error_size);
+    } else {
+        return text_unpack_record(str, len, record,
+                record_end, error_info, error_size);
+    }
+}
+
+int binlog_detect_record(const char *str, const int len,
+        int64_t *data_version, const char **rec_end,
+        char *error_info, const int error_size)
+{
+    if (len > 0 && binlog_binary_is_record(str)) {
+        return binlog_binary_detect_record(str, len, data_version,
+                rec_end, error_info, error_size);
+    } else {
+        return text_detect_record(str, len, data_version,
+                rec_end, error_info, error_size);
+    }
+}
+
+int binlog_detect_record_forward(const char *str, const int len,
+        const int format, int64_t *data_version, int *rstart_offset,
+        int *rend_offset, char *error_info, const int error_size)
+{
+    if (format == FDIR_BINLOG_RECORD_FORMAT_BINARY) {
+        return binlog_binary_detect_record_forward(str, len, data_version,
+                rstart_offset, rend_offset, error_info, error_size);
+    } else {
+        return text_detect_record_forward(str, len, data_version,
+                rstart_offset, rend_offset, error_info, error_size);
+    }
+}
+
+int binlog_detect_record_reverse(const char *str, const int len,
+        const int format, int64_t *data_version, const char **rec_end,
+        char *error_info, const int error_size)
+{
+    const char *rec_start;
+    const char *end;
+    int result;
+
+    if (format == FDIR_BINLOG_RECORD_FORMAT_BINARY) {
+        if ((result=binlog_binary_detect_record_reverse(str, len,
+                        data_version, &rec_start, &end, error_info,
+                        error_size)) == 0 && rec_end != NULL)
+        {
+            *rec_end = end;
+        }
+        return result;
+    } else {
+        return text_detect_record_reverse(str, len, data_version,
+                rec_end, error_info, error_size);
+    }
+}
+
+int binlog_detect_last_record_end(const char *str, const int len,
+        const int format, const char **rec_end)
+{
+    int64_t data_version;
+    const char *rec_start;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+
+    if (format == FDIR_BINLOG_RECORD_FORMAT_BINARY) {
+        return binlog_binary_detect_record_reverse(str, len, &data_version,
+                &rec_start, rec_end, error_info, sizeof(error_info));
+    } else {
+        return text_detect_last_record_end(str, len, rec_end);
+    }
+}
@@ -3,20 +3,52 @@
 #ifndef _BINLOG_PACK_H_
 #define _BINLOG_PACK_H_
 
+#include "../server_global.h"
 #include "binlog_types.h"
+#include "binlog_binary.h"
 
-#define BINLOG_RECORD_MIN_SIZE            64
+#define BINLOG_RECORD_MIN_SIZE            64  //the text record
 #define BINLOG_RECORD_MAX_SIZE          9999
 #define BINLOG_RECORD_SIZE_STRLEN          4
 #define BINLOG_RECORD_SIZE_PRINTF_FMT  "%04d"
 
+#define BINLOG_FORMAT_RECORD_MIN_SIZE(format) \
+    ((format) == FDIR_BINLOG_RECORD_FORMAT_BINARY ? \
+     BINLOG_BINARY_RECORD_MIN_SIZE : BINLOG_RECORD_MIN_SIZE)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int binlog_pack_init();
 
-int binlog_pack_record(const FDIRBinlogRecord *record, FastBuffer *buffer);
+/* the fast parser is the default, false for the original text parser
+ * (strtol, strtoll and the full unescape) as the benchmark baseline
+ */
+void binlog_pack_set_fast_parser(const bool enabled);
+
+int binlog_pack_record_ex(const FDIRBinlogRecord *record,
+        const int format, FastBuffer *buffer);
+
+static inline int binlog_pack_record(const FDIRBinlogRecord *record,
+        FastBuffer *buffer)
+{
+    return binlog_pack_record_ex(record, BINLOG_RECORD_FORMAT, buffer);
+}
+
+/* a binlog file holds the records of one format, so the format of the
+ * file or the buffer starting with a record is decided by the first byte
+ */
+static inline int binlog_get_buffer_format(const char *str, const int len)
+{
+    return (len > 0 && binlog_binary_is_record(str)) ?
+        FDIR_BINLOG_RECORD_FORMAT_BINARY : FDIR_BINLOG_RECORD_FORMAT_TEXT;
+}
+
+/* the unpack and detect functions accept the record of both formats,
+ * the forward and reverse detect functions search the records in the
+ * format of the binlog file
+ */
 
 int binlog_unpack_record(const char *str, const int len,
         FDIRBinlogRecord *record, const char **record_end,
@@ -27,15 +59,15 @@ int binlog_detect_record(const char *str, const int len,
         char *error_info, const int error_size);
 
 int binlog_detect_record_forward(const char *str, const int len,
-        int64_t *data_version, int *rstart_offset, int *rend_offset,
-        char *error_info, const int error_size);
+        const int format, int64_t *data_version, int *rstart_offset,
+        int *rend_offset, char *error_info, const int error_size);
 
 int binlog_detect_record_reverse(const char *str, const int len,
-        int64_t *data_version, const char **rec_end,
+        const int format, int64_t *data_version, const char **rec_end,
         char *error_info, const int error_size);
 
 int binlog_detect_last_record_end(const char *str, const int len,
-        const char **rec_end);
+        const int format, const char **rec_end);
 
 #ifdef __cplusplus
 }
@@ -24,9 +24,9 @@
 
 static void *binlog_read_thread_func(void *arg);
 
-int binlog_read_thread_init(BinlogReadThreadContext *ctx,
+int binlog_read_thread_init_ex(BinlogReadThreadContext *ctx,
         const FDIRBinlogFilePosition *hint_pos, const int64_t
-        last_data_version, const int buffer_size)
+        last_data_version, const int buffer_size, const bool use_mmap)
 {
     int result;
     int i;
@@ -39,6 +39,7 @@ int binlog_read_thread_init(BinlogReadThreadContext *ctx,
 
     ctx->running = false;
     ctx->continue_flag = true;
+    ctx->use_mmap = use_mmap;
     if ((result=common_blocked_queue_init_ex(&ctx->queues.waiting,
                     BINLOG_READ_THREAD_BUFFER_COUNT)) != 0)
     {
@@ -51,7 +52,13 @@ int binlog_read_thread_init(BinlogReadThreadContext *ctx,
     }
 
     for (i=0; i<BINLOG_READ_THREAD_BUFFER_COUNT; i++) {
-        if ((result=fc_init_buffer(&ctx->results[i].buffer,
+        ctx->results[i].window.addr = NULL;
+        ctx->results[i].window.length = 0;
+        if (use_mmap) {
+            ctx->results[i].buffer.buff = NULL;
+            ctx->results[i].buffer.length = 0;
+            ctx->results[i].buffer.alloc_size = buffer_size;
+        } else if ((result=fc_init_buffer(&ctx->results[i].buffer,
                         buffer_size)) != 0)
         {
             return result;
@@ -83,7 +90,11 @@ void binlog_read_thread_terminate(BinlogReadThreadContext *ctx)
                 "wait thread exit timeout", __LINE__);
     }
     for (i=0; i<BINLOG_READ_THREAD_BUFFER_COUNT; i++) {
-        free(ctx->results[i].buffer.buff);
+        if (ctx->use_mmap) {
+            binlog_reader_munmap(&ctx->results[i].window);
+        } else {
+            free(ctx->results[i].buffer.buff);
+        }
         ctx->results[i].buffer.buff = NULL;
     }
 
@@ -107,9 +118,22 @@ static void *binlog_read_thread_func(void *arg)
         }
 
         r->binlog_position = ctx->reader.position;
-        r->err_no = binlog_reader_integral_read(&ctx->reader,
-                r->buffer.buff, r->buffer.alloc_size,
-                &r->buffer.length, &r->last_data_version);
+        if (ctx->use_mmap) {
+            //the returned result is done with the previous window
+            binlog_reader_munmap(&r->window);
+            r->err_no = binlog_reader_integral_mmap(&ctx->reader,
+                    r->buffer.alloc_size, &r->window, &r->buffer.buff,
+                    &r->buffer.length, &r->last_data_version);
+            if (r->err_no == 0) {  //maybe switched to the next file
+                r->binlog_position.index = ctx->reader.position.index;
+                r->binlog_position.offset = ctx->reader.position.offset -
+                    r->buffer.length;
+            }
+        } else {
+            r->err_no = binlog_reader_integral_read(&ctx->reader,
+                    r->buffer.buff, r->buffer.alloc_size,
+                    &r->buffer.length, &r->last_data_version);
+        }
         common_blocked_queue_push(&ctx->queues.done, r);
     }
 
@@ -12,13 +12,15 @@ typedef struct binlog_read_thread_result {
     int err_no;
     FDIRBinlogFilePosition binlog_position;
     int64_t last_data_version;
-    BufferInfo buffer;
+    BufferInfo buffer;  //point to the mapped window for mmap
+    BinlogMMapWindow window;
 } BinlogReadThreadResult;
 
 typedef struct binlog_read_thread_context {
     ServerBinlogReader reader;
     volatile bool continue_flag;
     bool running;
+    bool use_mmap;   //hand out the records in the mapped file pages
     pthread_t tid;
     BinlogReadThreadResult results[BINLOG_READ_THREAD_BUFFER_COUNT];
     struct {
@@ -31,9 +33,14 @@ typedef struct binlog_read_thread_context {
 extern "C" {
 #endif
 
-int binlog_read_thread_init(BinlogReadThreadContext *ctx,
+int binlog_read_thread_init_ex(BinlogReadThreadContext *ctx,
         const FDIRBinlogFilePosition *hint_pos, const int64_t
-        last_data_version, const int buffer_size);
+        last_data_version, const int buffer_size, const bool use_mmap);
+
+#define binlog_read_thread_init(ctx, hint_pos, \
+        last_data_version, buffer_size) \
+    binlog_read_thread_init_ex(ctx, hint_pos, \
+            last_data_version, buffer_size, false)
 
 static inline int binlog_read_thread_return_result_buffer(
         BinlogReadThreadContext *ctx, BinlogReadThreadResult *r)
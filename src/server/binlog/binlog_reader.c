@@ -1,5 +1,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -20,6 +21,7 @@
 #include "binlog_producer.h"
 #include "binlog_write_thread.h"
 #include "binlog_pack.h"
+#include "binlog_vindex.h"
 #include "binlog_reader.h"
 
 static int open_readable_binlog(ServerBinlogReader *reader)
@@ -32,6 +34,7 @@ static int open_readable_binlog(ServerBinlogReader *reader)
 
     GET_BINLOG_FILENAME(reader->filename, sizeof(reader->filename),
             reader->position.index);
+    reader->format = 0;
     reader->fd = open(reader->filename, O_RDONLY);
     if (reader->fd < 0) {
         result = errno != 0 ? errno : EACCES;
@@ -77,6 +80,17 @@ static int open_readable_binlog(ServerBinlogReader *reader)
     return 0;
 }
 
+static int binlog_reader_get_format(ServerBinlogReader *reader)
+{
+    char ch;
+
+    //decided by the first byte after the file written
+    if (reader->format == 0 && pread(reader->fd, &ch, 1, 0) == 1) {
+        reader->format = binlog_get_buffer_format(&ch, 1);
+    }
+    return reader->format != 0 ? reader->format : BINLOG_RECORD_FORMAT;
+}
+
 static int do_read_to_buffer(ServerBinlogReader *reader,
         char *buff, const int size, int *read_bytes)
 {
@@ -191,6 +205,7 @@ int binlog_reader_integral_read(ServerBinlogReader *reader, char *buff,
     }
 
     if ((result=binlog_detect_record_reverse(buff, *read_bytes,
+                    binlog_reader_get_format(reader),
                     data_version, (const char **)&rec_end,
                     error_info, sizeof(error_info))) != 0)
     {
@@ -229,6 +244,106 @@ int binlog_reader_integral_read(ServerBinlogReader *reader, char *buff,
     return 0;
 }
 
+static int do_mmap_read(ServerBinlogReader *reader, const int size,
+        BinlogMMapWindow *window, char **buff, int *read_bytes,
+        int64_t *data_version)
+{
+    struct stat stbuf;
+    int64_t map_offset;
+    int64_t len;
+    int delta;
+    int result;
+    char *rec_end;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+
+    if (fstat(reader->fd, &stbuf) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "stat binlog file: %s fail, errno: %d, error info: %s",
+                __LINE__, reader->filename, result, STRERROR(result));
+        return result;
+    }
+
+    //only map the written part to avoid SIGBUS
+    if (reader->position.offset >= stbuf.st_size) {
+        return ENOENT;
+    }
+    len = stbuf.st_size - reader->position.offset;
+    if (len > size) {
+        len = size;
+    }
+
+    delta = reader->position.offset % sysconf(_SC_PAGESIZE);
+    map_offset = reader->position.offset - delta;
+    window->length = len + delta;
+    window->addr = mmap(NULL, window->length, PROT_READ,
+            MAP_SHARED, reader->fd, map_offset);
+    if (window->addr == MAP_FAILED) {
+        result = errno != 0 ? errno : ENOMEM;
+        window->addr = NULL;
+        window->length = 0;
+        logError("file: "__FILE__", line: %d, "
+                "mmap binlog file: %s fail, offset: %"PRId64", "
+                "length: %"PRId64", errno: %d, error info: %s",
+                __LINE__, reader->filename, map_offset,
+                len + delta, result, STRERROR(result));
+        return result;
+    }
+    madvise(window->addr, window->length, MADV_SEQUENTIAL);
+
+    *buff = (char *)window->addr + delta;
+    if ((result=binlog_detect_record_reverse(*buff, len,
+                    binlog_reader_get_format(reader), data_version,
+                    (const char **)&rec_end, error_info,
+                    sizeof(error_info))) != 0)
+    {
+        if (*error_info == '\0') {
+            snprintf(error_info, sizeof(error_info),
+                    "%s", STRERROR(result));
+        }
+        logError("file: "__FILE__", line: %d, "
+                "binlog_detect_record_reverse fail, binlog file: %s, "
+                "offset: %"PRId64", length: %"PRId64", error info: %s",
+                __LINE__, reader->filename, reader->position.offset,
+                len, error_info);
+        binlog_reader_munmap(window);
+        *data_version = 0;
+        return result == ENOENT ? EFAULT : result;
+    }
+
+    *read_bytes = rec_end - *buff;
+    reader->position.offset += *read_bytes;
+    return 0;
+}
+
+int binlog_reader_integral_mmap(ServerBinlogReader *reader, const int size,
+        BinlogMMapWindow *window, char **buff, int *read_bytes,
+        int64_t *data_version)
+{
+    int result;
+
+    *read_bytes = 0;
+    *data_version = 0;
+    result = do_mmap_read(reader, size, window, buff,
+            read_bytes, data_version);
+    if (result == 0 || result != ENOENT) {
+        return result;
+    }
+
+    if (reader->position.index < binlog_get_current_write_index()) {
+        reader->position.offset = 0;
+        reader->position.index++;
+        if ((result=open_readable_binlog(reader)) != 0) {
+            return result;
+        }
+
+        result = do_mmap_read(reader, size, window, buff,
+                read_bytes, data_version);
+    }
+
+    return result;
+}
+
 int binlog_reader_next_record(ServerBinlogReader *reader,
         FDIRBinlogRecord *record)
 {
@@ -238,7 +353,8 @@ int binlog_reader_next_record(ServerBinlogReader *reader,
     char error_info[FDIR_ERROR_INFO_SIZE];
 
     len = BINLOG_BUFFER_REMAIN(reader->binlog_buffer);
-    if (len < BINLOG_RECORD_MIN_SIZE &&
+    if (len < BINLOG_FORMAT_RECORD_MIN_SIZE(binlog_get_buffer_format(
+                    reader->binlog_buffer.current, len)) &&
             (result=binlog_reader_read(reader)) != 0)
     {
         return result;
@@ -277,8 +393,8 @@ int binlog_reader_next_record(ServerBinlogReader *reader,
     return result;
 }
 
-static int find_data_version(ServerBinlogReader *reader,
-        const int64_t last_data_version)
+static int scan_data_version(ServerBinlogReader *reader,
+        const int64_t last_data_version, const int64_t start_offset)
 {
     int result;
     bool found;
@@ -286,7 +402,7 @@ static int find_data_version(ServerBinlogReader *reader,
     char *rec_end;
     char error_info[FDIR_ERROR_INFO_SIZE];
 
-    reader->position.offset = 0;
+    reader->position.offset = start_offset;
     if ((result=open_readable_binlog(reader)) != 0) {
         return result;
     }
@@ -366,6 +482,33 @@ static int find_data_version(ServerBinlogReader *reader,
     return open_readable_binlog(reader);
 }
 
+static int find_data_version(ServerBinlogReader *reader,
+        const int64_t last_data_version)
+{
+    int64_t start_offset;
+    int result;
+
+    if (binlog_vindex_find(reader->position.index, last_data_version,
+                &start_offset) != 0 || start_offset == 0)
+    {
+        return scan_data_version(reader, last_data_version, 0);
+    }
+
+    if ((result=scan_data_version(reader, last_data_version,
+                    start_offset)) == 0)
+    {
+        return 0;
+    }
+
+    //the index is only a hint, scan the whole file again
+    logWarning("file: "__FILE__", line: %d, "
+            "binlog index: %d, find data version %"PRId64" from the "
+            "indexed offset %"PRId64" fail, scan from the file start",
+            __LINE__, reader->position.index, last_data_version,
+            start_offset);
+    return scan_data_version(reader, last_data_version, 0);
+}
+
 static int binlog_reader_search_data_version(ServerBinlogReader *reader,
         const int64_t last_data_version)
 {
@@ -435,6 +578,7 @@ static int binlog_reader_detect_open(ServerBinlogReader *reader,
     int remain;
     int rstart_offset;
     int rend_offset;
+    int format;
     int64_t data_version;
     char buff[BINLOG_RECORD_MAX_SIZE + 1];
     char error_info[FDIR_ERROR_INFO_SIZE];
@@ -466,9 +610,11 @@ static int binlog_reader_detect_open(ServerBinlogReader *reader,
 
     p = buff;
     remain = bytes;
-    while (remain >= BINLOG_RECORD_MIN_SIZE) {
-        result = binlog_detect_record_forward(p, remain, &data_version,
-                &rstart_offset, &rend_offset, error_info, sizeof(error_info));
+    format = binlog_reader_get_format(reader);
+    while (remain >= BINLOG_FORMAT_RECORD_MIN_SIZE(format)) {
+        result = binlog_detect_record_forward(p, remain, format,
+                &data_version, &rstart_offset, &rend_offset,
+                error_info, sizeof(error_info));
         if (result == 0) {
             if (last_data_version == data_version) {
                 reader->position.offset += (p - buff) + rend_offset;
@@ -512,6 +658,9 @@ int binlog_reader_init(ServerBinlogReader *reader,
         reader->position.index = 0;
         reader->position.offset = 0;
         return open_readable_binlog(reader);
+    } else if (last_data_version == BINLOG_READER_FROM_HINT_POSITION) {
+        reader->position = *hint_pos;
+        return open_readable_binlog(reader);
     }
 
     reader->position = *hint_pos;
@@ -593,6 +742,21 @@ int binlog_get_first_record_version(const int file_index,
     return result;
 }
 
+static int get_file_format(const char *filename, int *format)
+{
+    char buff[2];
+    int64_t bytes;
+    int result;
+
+    bytes = sizeof(buff);  //read the first byte
+    if ((result=getFileContentEx(filename, buff, 0, &bytes)) != 0) {
+        return result;
+    }
+
+    *format = binlog_get_buffer_format(buff, bytes);
+    return 0;
+}
+
 int binlog_get_last_record_version(const int file_index,
         int64_t *data_version)
 {
@@ -600,6 +764,7 @@ int binlog_get_last_record_version(const int file_index,
     char buff[BINLOG_RECORD_MAX_SIZE + 1];
     char error_info[FDIR_ERROR_INFO_SIZE];
     int result;
+    int format;
     int offset;
     int64_t file_size = 0;
     int64_t bytes;
@@ -628,8 +793,12 @@ int binlog_get_last_record_version(const int file_index,
         return result;
     }
 
+    if ((result=get_file_format(filename, &format)) != 0) {
+        return result;
+    }
+
     *error_info = '\0';
-    if ((result=binlog_detect_record_reverse(buff, bytes,
+    if ((result=binlog_detect_record_reverse(buff, bytes, format,
                     data_version, NULL, error_info,
                     sizeof(error_info))) != 0)
     {
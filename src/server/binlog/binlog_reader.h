@@ -3,18 +3,28 @@
 #ifndef _BINLOG_READER_H_
 #define _BINLOG_READER_H_
 
+#include <sys/mman.h>
 #include "binlog_types.h"
 
 #define BINLOG_FILE_PREFIX     "binlog"
 #define BINLOG_FILE_EXT_FMT    ".%06d"
 
+//as the last data version, read from the hint position without searching
+#define BINLOG_READER_FROM_HINT_POSITION  -1
+
 typedef struct {
     char filename[PATH_MAX];
     int fd;
+    int format;  //the record format of the file, 0 for not decided
     FDIRBinlogFilePosition position;
     ServerBinlogBuffer binlog_buffer;
 } ServerBinlogReader;
 
+typedef struct binlog_mmap_window {
+    void *addr;       //NULL for not mapped
+    int64_t length;   //the mapped length
+} BinlogMMapWindow;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -30,6 +40,22 @@ int binlog_reader_read(ServerBinlogReader *reader);
 int binlog_reader_integral_read(ServerBinlogReader *reader, char *buff,
         const int size, int *read_bytes, int64_t *data_version);
 
+/* map the next records of at most size bytes in place without copy,
+ * the window should be unmapped after the records used
+ */
+int binlog_reader_integral_mmap(ServerBinlogReader *reader, const int size,
+        BinlogMMapWindow *window, char **buff, int *read_bytes,
+        int64_t *data_version);
+
+static inline void binlog_reader_munmap(BinlogMMapWindow *window)
+{
+    if (window->addr != NULL) {
+        munmap(window->addr, window->length);
+        window->addr = NULL;
+        window->length = 0;
+    }
+}
+
 int binlog_reader_next_record(ServerBinlogReader *reader,
         FDIRBinlogRecord *record);
 
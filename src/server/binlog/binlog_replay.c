@@ -39,14 +39,26 @@ static void data_thread_deal_done_callback(
             __sync_add_and_fetch(&replay_ctx->warning_count, 1);
         }
 
-        log_it_ex(&g_log_context, log_level,
-                "file: "__FILE__", line: %d, "
-                "%s dentry fail, errno: %d, error info: %s, "
-                "namespace: %.*s, path: %.*s",
-                __LINE__, get_operation_caption(record->operation),
-                result, STRERROR(result),
-                record->fullname.ns.len, record->fullname.ns.str,
-                record->fullname.path.len, record->fullname.path.str);
+        if (record->options.pname) {
+            log_it_ex(&g_log_context, log_level,
+                    "file: "__FILE__", line: %d, "
+                    "%s dentry fail, errno: %d, error info: %s, "
+                    "namespace: %.*s, parent inode: %"PRId64", name: %.*s",
+                    __LINE__, get_operation_caption(record->operation),
+                    result, STRERROR(result),
+                    record->fullname.ns.len, record->fullname.ns.str,
+                    record->pname.parent_inode, record->pname.name.len,
+                    record->pname.name.str);
+        } else {
+            log_it_ex(&g_log_context, log_level,
+                    "file: "__FILE__", line: %d, "
+                    "%s dentry fail, errno: %d, error info: %s, "
+                    "inode: %"PRId64", namespace: %.*s, path: %.*s",
+                    __LINE__, get_operation_caption(record->operation),
+                    result, STRERROR(result), record->inode,
+                    record->fullname.ns.len, record->fullname.ns.str,
+                    record->fullname.path.len, record->fullname.path.str);
+        }
     }
     if (replay_ctx->notify.func != NULL) {
         replay_ctx->notify.func(is_error ? result : 0,
@@ -78,6 +90,7 @@ int binlog_replay_init_ex(BinlogReplayContext *replay_ctx,
     replay_ctx->notify.args  = args;
     replay_ctx->data_current_version = __sync_add_and_fetch(
             &DATA_CURRENT_VERSION, 0);
+    replay_ctx->skip_by_version = true;
     replay_ctx->record_array.size = batch_size * DATA_THREAD_COUNT;
     bytes = sizeof(FDIRBinlogRecord) * replay_ctx->record_array.size;
     replay_ctx->record_array.records = (FDIRBinlogRecord *)malloc(bytes);
@@ -165,7 +178,9 @@ int binlog_replay_deal_buffer(BinlogReplayContext *replay_ctx,
             p = rend;
 
             replay_ctx->record_count++;
-            if (record->data_version <= replay_ctx->data_current_version) {
+            if (replay_ctx->skip_by_version && record->data_version <=
+                    replay_ctx->data_current_version)
+            {
                 replay_ctx->skip_count++;
                 if (replay_ctx->notify.func != NULL) {
                     replay_ctx->notify.func(0, record, replay_ctx->notify.args);
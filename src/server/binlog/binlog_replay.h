@@ -15,6 +15,7 @@ typedef struct binlog_replay_context {
         FDIRBinlogRecord *records;
     } record_array;
     int64_t data_current_version;
+    bool skip_by_version;  //false for loading the snapshot
     volatile int waiting_count;
     int last_errno;
     int64_t record_count;
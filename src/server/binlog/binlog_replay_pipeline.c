@@ -0,0 +1,615 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "../data_thread.h"
+#include "binlog_pack.h"
+#include "binlog_reader.h"
+#include "binlog_replay_pipeline.h"
+
+#define BINLOG_PIPELINE_MIN_CHUNK_SIZE  (16 * 1024)
+
+static void log_record_result(const FDIRBinlogRecord *record,
+        const int result, const int log_level)
+{
+    if (record->options.pname) {
+        log_it_ex(&g_log_context, log_level,
+                "file: "__FILE__", line: %d, "
+                "%s dentry fail, errno: %d, error info: %s, "
+                "namespace: %.*s, parent inode: %"PRId64", name: %.*s",
+                __LINE__, get_operation_caption(record->operation),
+                result, STRERROR(result),
+                record->fullname.ns.len, record->fullname.ns.str,
+                record->pname.parent_inode, record->pname.name.len,
+                record->pname.name.str);
+    } else {
+        log_it_ex(&g_log_context, log_level,
+                "file: "__FILE__", line: %d, "
+                "%s dentry fail, errno: %d, error info: %s, "
+                "inode: %"PRId64", namespace: %.*s, path: %.*s",
+                __LINE__, get_operation_caption(record->operation),
+                result, STRERROR(result), record->inode,
+                record->fullname.ns.len, record->fullname.ns.str,
+                record->fullname.path.len, record->fullname.path.str);
+    }
+}
+
+static void complete_chunk(BinlogPipelineChunk *chunk)
+{
+    BinlogReplayPipeline *pipeline;
+    BinlogPipelineBuffer *buffer;
+    FDIRBinlogRecord *record;
+    FDIRBinlogRecord *end;
+    bool buffer_done;
+
+    pipeline = chunk->pipeline;
+    if (pipeline->notify.func != NULL) {
+        end = chunk->record_array.records + chunk->record_array.count;
+        for (record=chunk->record_array.records; record<end; record++) {
+            pipeline->notify.func(chunk->record_array.results[record -
+                    chunk->record_array.records], record,
+                    pipeline->notify.args);
+        }
+    }
+
+    buffer = chunk->buffer;
+    buffer_done = (__sync_sub_and_fetch(&buffer->reffer_count, 1) == 0);
+    if (buffer_done) {
+        pipeline->release.func(pipeline->release.args, buffer->args);
+    }
+
+    PTHREAD_MUTEX_LOCK(&pipeline->lock);
+    if (buffer_done) {
+        buffer->next = pipeline->free_buffers;
+        pipeline->free_buffers = buffer;
+    }
+    chunk->next = pipeline->free_chunks;
+    pipeline->free_chunks = chunk;
+    pipeline->ring.inflight_count--;
+    pthread_cond_signal(&pipeline->cond);
+    PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+}
+
+/* complete the done chunks in the seq order,
+ * only one completer at the same time
+ */
+static void finish_chunk(BinlogPipelineChunk *chunk)
+{
+    BinlogReplayPipeline *pipeline;
+    BinlogPipelineChunk **slot;
+
+    pipeline = chunk->pipeline;
+    PTHREAD_MUTEX_LOCK(&pipeline->lock);
+    pipeline->done_ring.chunks[chunk->seq %
+        BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS] = chunk;
+    if (!pipeline->done_ring.completing) {
+        pipeline->done_ring.completing = true;
+        while (1) {
+            slot = pipeline->done_ring.chunks + (pipeline->done_ring.
+                    next_seq % BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS);
+            if (*slot == NULL) {
+                break;
+            }
+
+            chunk = *slot;
+            *slot = NULL;
+            pipeline->done_ring.next_seq++;
+            PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+
+            complete_chunk(chunk);
+
+            PTHREAD_MUTEX_LOCK(&pipeline->lock);
+        }
+        pipeline->done_ring.completing = false;
+    }
+    PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+}
+
+static inline void chunk_done_count(BinlogPipelineChunk *chunk,
+        const int count)
+{
+    if (__sync_sub_and_fetch(&chunk->waiting_count, count) == 0) {
+        finish_chunk(chunk);
+    }
+}
+
+static void data_thread_deal_done_callback(
+        struct fdir_binlog_record *record,
+        const int result, const bool is_error)
+{
+    BinlogPipelineChunk *chunk;
+
+    chunk = (BinlogPipelineChunk *)record->notify.args;
+    if (result != 0) {
+        if (is_error) {
+            chunk->pipeline->last_errno = result;
+            __sync_add_and_fetch(&chunk->pipeline->fail_count, 1);
+            log_record_result(record, result, LOG_ERR);
+        } else {
+            __sync_add_and_fetch(&chunk->pipeline->warning_count, 1);
+            log_record_result(record, result, LOG_WARNING);
+        }
+    }
+
+    chunk->record_array.results[record - chunk->record_array.records] =
+        is_error ? result : 0;
+    chunk_done_count(chunk, 1);
+}
+
+static void log_parse_error(BinlogPipelineChunk *chunk,
+        const char *p, const char *error_info)
+{
+    char filename[PATH_MAX];
+    int64_t offset;
+    int64_t line_count;
+
+    if (chunk->buffer->position.index < 0) {
+        logError("file: "__FILE__", line: %d, "
+                "%s", __LINE__, error_info);
+        return;
+    }
+
+    GET_BINLOG_FILENAME(filename, sizeof(filename),
+            chunk->buffer->position.index);
+    offset = chunk->buffer->position.offset + (p - chunk->buffer->buff);
+    if (fc_get_file_line_count_ex(filename, offset, &line_count) == 0) {
+        ++line_count;
+    }
+    logError("file: "__FILE__", line: %d, "
+            "binlog file: %s, offset: %"PRId64", line no: %"PRId64", %s",
+            __LINE__, filename, offset, line_count, error_info);
+}
+
+static int parse_chunk(BinlogPipelineChunk *chunk)
+{
+    BinlogReplayPipeline *pipeline;
+    FDIRBinlogRecord *record;
+    const char *p;
+    const char *rend;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+    int64_t record_count;
+    int64_t skip_count;
+    int result;
+
+    pipeline = chunk->pipeline;
+    result = 0;
+    record_count = skip_count = 0;
+    chunk->record_array.count = 0;
+    *error_info = '\0';
+    p = chunk->start;
+    while (p < chunk->end) {
+        if (chunk->record_array.count == chunk->record_array.alloc) {
+            FDIRBinlogRecord *records;
+            short *results;
+            int alloc;
+
+            alloc = chunk->record_array.alloc * 2;
+            records = (FDIRBinlogRecord *)realloc(chunk->record_array.
+                    records, sizeof(FDIRBinlogRecord) * alloc);
+            if (records == NULL) {
+                logError("file: "__FILE__", line: %d, "
+                        "realloc %d bytes fail", __LINE__,
+                        (int)sizeof(FDIRBinlogRecord) * alloc);
+                result = ENOMEM;
+                break;
+            }
+            chunk->record_array.records = records;
+
+            results = (short *)realloc(chunk->record_array.
+                    results, sizeof(short) * alloc);
+            if (results == NULL) {
+                logError("file: "__FILE__", line: %d, "
+                        "realloc %d bytes fail", __LINE__,
+                        (int)sizeof(short) * alloc);
+                result = ENOMEM;
+                break;
+            }
+            chunk->record_array.results = results;
+            chunk->record_array.alloc = alloc;
+        }
+
+        record = chunk->record_array.records + chunk->record_array.count;
+        if ((result=binlog_unpack_record(p, chunk->end - p, record,
+                        &rend, error_info, sizeof(error_info))) != 0)
+        {
+            log_parse_error(chunk, p, error_info);
+            break;
+        }
+        p = rend;
+
+        //the skipped records are kept for the notify
+        record_count++;
+        if (record->data_version <= pipeline->data_current_version) {
+            skip_count++;
+        }
+
+        record->notify.func = data_thread_deal_done_callback;
+        record->notify.args = chunk;
+        chunk->record_array.results[chunk->record_array.count++] = 0;
+    }
+
+    __sync_add_and_fetch(&pipeline->record_count, record_count);
+    __sync_add_and_fetch(&pipeline->skip_count, skip_count);
+    if (p < chunk->end) {
+        chunk->record_array.count = 0;
+        pipeline->last_errno = result;
+        __sync_add_and_fetch(&pipeline->fail_count, 1);
+        return result;
+    }
+
+    return 0;
+}
+
+static void dispatch_chunk(BinlogPipelineChunk *chunk)
+{
+    FDIRBinlogRecord *record;
+    FDIRBinlogRecord *end;
+    int skip_count;
+    int result;
+
+    //the extra one for the dispatcher to avoid finishing in advance
+    chunk->waiting_count = chunk->record_array.count + 1;
+    skip_count = 0;
+    end = chunk->record_array.records + chunk->record_array.count;
+    for (record=chunk->record_array.records; record<end; record++) {
+        if (record->data_version <= chunk->pipeline->data_current_version) {
+            skip_count++;
+            continue;
+        }
+
+        if ((result=push_to_data_thread_queue(record)) != 0) {
+            chunk->pipeline->last_errno = result;
+            __sync_add_and_fetch(&chunk->pipeline->fail_count, 1);
+            __sync_sub_and_fetch(&chunk->waiting_count, end - record);
+            break;
+        }
+    }
+
+    chunk_done_count(chunk, skip_count + 1);
+}
+
+/* push the parsed chunks to the data threads in the seq order,
+ * only one dispatcher at the same time
+ */
+static void dispatch_parsed_chunk(BinlogPipelineChunk *chunk)
+{
+    BinlogReplayPipeline *pipeline;
+    BinlogPipelineChunk **slot;
+
+    pipeline = chunk->pipeline;
+    PTHREAD_MUTEX_LOCK(&pipeline->lock);
+    pipeline->ring.chunks[chunk->seq %
+        BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS] = chunk;
+    if (!pipeline->ring.dispatching) {
+        pipeline->ring.dispatching = true;
+        while (1) {
+            slot = pipeline->ring.chunks + (pipeline->ring.next_seq %
+                    BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS);
+            if (*slot == NULL) {
+                break;
+            }
+
+            chunk = *slot;
+            *slot = NULL;
+            pipeline->ring.next_seq++;
+            PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+
+            dispatch_chunk(chunk);
+
+            PTHREAD_MUTEX_LOCK(&pipeline->lock);
+        }
+        pipeline->ring.dispatching = false;
+    }
+    PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+}
+
+static void *parse_thread_func(void *arg)
+{
+    BinlogReplayPipeline *pipeline;
+    BinlogPipelineChunk *chunk;
+
+    pipeline = (BinlogReplayPipeline *)arg;
+    while (pipeline->continue_flag) {
+        chunk = (BinlogPipelineChunk *)common_blocked_queue_pop(
+                &pipeline->parse_queue);
+        if (chunk == NULL) {
+            continue;
+        }
+
+        parse_chunk(chunk);
+        dispatch_parsed_chunk(chunk);
+    }
+    __sync_sub_and_fetch(&pipeline->running_count, 1);
+    return NULL;
+}
+
+static int init_chunks(BinlogReplayPipeline *pipeline)
+{
+    BinlogPipelineChunk *chunk;
+    BinlogPipelineChunk *chunk_end;
+    BinlogPipelineBuffer *buffer;
+    BinlogPipelineBuffer *buffer_end;
+    int alloc;
+    int bytes;
+
+    bytes = sizeof(BinlogPipelineChunk) * BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS;
+    pipeline->chunk_array = (BinlogPipelineChunk *)malloc(bytes);
+    if (pipeline->chunk_array == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(pipeline->chunk_array, 0, bytes);
+
+    bytes = sizeof(BinlogPipelineBuffer) * BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS;
+    pipeline->buffer_array = (BinlogPipelineBuffer *)malloc(bytes);
+    if (pipeline->buffer_array == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(pipeline->buffer_array, 0, bytes);
+
+    alloc = 256;
+    bytes = sizeof(FDIRBinlogRecord) * alloc;
+    chunk_end = pipeline->chunk_array + BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS;
+    for (chunk=pipeline->chunk_array; chunk<chunk_end; chunk++) {
+        chunk->record_array.records = (FDIRBinlogRecord *)malloc(bytes);
+        if (chunk->record_array.records == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "malloc %d bytes fail", __LINE__, bytes);
+            return ENOMEM;
+        }
+        chunk->record_array.results = (short *)malloc(sizeof(short) * alloc);
+        if (chunk->record_array.results == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "malloc %d bytes fail", __LINE__,
+                    (int)sizeof(short) * alloc);
+            return ENOMEM;
+        }
+        chunk->record_array.alloc = alloc;
+        chunk->pipeline = pipeline;
+        chunk->next = pipeline->free_chunks;
+        pipeline->free_chunks = chunk;
+    }
+
+    buffer_end = pipeline->buffer_array + BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS;
+    for (buffer=pipeline->buffer_array; buffer<buffer_end; buffer++) {
+        buffer->next = pipeline->free_buffers;
+        pipeline->free_buffers = buffer;
+    }
+
+    return 0;
+}
+
+int binlog_replay_pipeline_init_ex(BinlogReplayPipeline *pipeline,
+        const int parse_threads, binlog_pipeline_release_func release_func,
+        void *release_args, binlog_replay_notify_func notify_func,
+        void *notify_args)
+{
+    pthread_t tid;
+    int result;
+    int i;
+
+    memset(pipeline, 0, sizeof(BinlogReplayPipeline));
+    if (parse_threads <= 0) {
+        pipeline->parse_threads = 1;
+    } else if (parse_threads > BINLOG_PIPELINE_MAX_PARSE_THREADS) {
+        pipeline->parse_threads = BINLOG_PIPELINE_MAX_PARSE_THREADS;
+    } else {
+        pipeline->parse_threads = parse_threads;
+    }
+    pipeline->release.func = release_func;
+    pipeline->release.args = release_args;
+    pipeline->notify.func = notify_func;
+    pipeline->notify.args = notify_args;
+    pipeline->data_current_version = __sync_add_and_fetch(
+            &DATA_CURRENT_VERSION, 0);
+
+    if ((result=init_chunks(pipeline)) != 0) {
+        return result;
+    }
+
+    if ((result=common_blocked_queue_init_ex(&pipeline->parse_queue,
+                    BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=init_pthread_lock(&pipeline->lock)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "init_pthread_lock fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
+    if ((result=pthread_cond_init(&pipeline->cond, NULL)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "pthread_cond_init fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
+
+    pipeline->continue_flag = true;
+    for (i=0; i<pipeline->parse_threads; i++) {
+        /* count the thread before it starts, so the destroy waits
+         * for the threads not yet scheduled too
+         */
+        __sync_add_and_fetch(&pipeline->running_count, 1);
+        if ((result=fc_create_thread(&tid, parse_thread_func,
+                        pipeline, SF_G_THREAD_STACK_SIZE)) != 0)
+        {
+            __sync_sub_and_fetch(&pipeline->running_count, 1);
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+void binlog_replay_pipeline_destroy(BinlogReplayPipeline *pipeline)
+{
+    BinlogPipelineChunk *chunk;
+    BinlogPipelineChunk *end;
+
+    /* the parse threads use the queue and the chunks,
+     * wait for all of them exited before freeing
+     */
+    pipeline->continue_flag = false;
+    common_blocked_queue_terminate(&pipeline->parse_queue);
+    while (__sync_add_and_fetch(&pipeline->running_count, 0) != 0) {
+        usleep(1000);
+    }
+
+    common_blocked_queue_destroy(&pipeline->parse_queue);
+    if (pipeline->chunk_array != NULL) {
+        end = pipeline->chunk_array + BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS;
+        for (chunk=pipeline->chunk_array; chunk<end; chunk++) {
+            if (chunk->record_array.records != NULL) {
+                free(chunk->record_array.records);
+            }
+            if (chunk->record_array.results != NULL) {
+                free(chunk->record_array.results);
+            }
+        }
+        free(pipeline->chunk_array);
+        pipeline->chunk_array = NULL;
+    }
+    if (pipeline->buffer_array != NULL) {
+        free(pipeline->buffer_array);
+        pipeline->buffer_array = NULL;
+    }
+
+    pthread_cond_destroy(&pipeline->cond);
+    pthread_mutex_destroy(&pipeline->lock);
+}
+
+/* split the buffer into chunks at the record boundaries,
+ * return the chunk count, starts[count] is the buffer end
+ */
+static int split_buffer(BinlogReplayPipeline *pipeline,
+        const char *buff, const int len, const char **starts)
+{
+    const char *p;
+    const char *end;
+    const char *rend;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+    int64_t data_version;
+    int chunk_size;
+    int count;
+    int n;
+
+    count = len / BINLOG_PIPELINE_MIN_CHUNK_SIZE;
+    if (count > pipeline->parse_threads) {
+        count = pipeline->parse_threads;
+    }
+
+    n = 1;
+    starts[0] = buff;
+    end = buff + len;
+    if (count > 1) {
+        chunk_size = len / count;
+        p = buff;
+        while (p < end && n < count) {
+            //the parse thread will report the error
+            if (binlog_detect_record(p, end - p, &data_version,
+                        &rend, error_info, sizeof(error_info)) != 0)
+            {
+                break;
+            }
+
+            p = rend;
+            if (p - starts[n - 1] >= chunk_size && p < end) {
+                starts[n++] = p;
+            }
+        }
+    }
+
+    starts[n] = end;
+    return n;
+}
+
+int binlog_replay_pipeline_deal_buffer(BinlogReplayPipeline *pipeline,
+        const char *buff, const int len,
+        const FDIRBinlogFilePosition *binlog_position, void *buffer_args)
+{
+    const char *starts[BINLOG_PIPELINE_MAX_PARSE_THREADS + 1];
+    BinlogPipelineChunk *chunks[BINLOG_PIPELINE_MAX_PARSE_THREADS];
+    BinlogPipelineBuffer *buffer;
+    int count;
+    int result;
+    int i;
+
+    /* the fail count is a statistic, the results of the records are
+     * notified one by one, so a failed record does NOT stop the buffers
+     * after it, the caller stops by the fail count if necessary
+     */
+    count = split_buffer(pipeline, buff, len, starts);
+
+    PTHREAD_MUTEX_LOCK(&pipeline->lock);
+    while (pipeline->ring.inflight_count + count >
+            BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS)
+    {
+        pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+    }
+
+    //the free lists are enough for the inflight limit
+    buffer = pipeline->free_buffers;
+    pipeline->free_buffers = buffer->next;
+    for (i=0; i<count; i++) {
+        chunks[i] = pipeline->free_chunks;
+        pipeline->free_chunks = chunks[i]->next;
+        chunks[i]->seq = pipeline->ring.alloc_seq++;
+    }
+    pipeline->ring.inflight_count += count;
+    PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+
+    buffer->buff = buff;
+    if (binlog_position != NULL) {
+        buffer->position = *binlog_position;
+    } else {
+        buffer->position.index = -1;
+        buffer->position.offset = 0;
+    }
+    buffer->reffer_count = count;
+    buffer->args = buffer_args;
+    for (i=0; i<count; i++) {
+        chunks[i]->start = starts[i];
+        chunks[i]->end = starts[i + 1];
+        chunks[i]->buffer = buffer;
+        if ((result=common_blocked_queue_push(&pipeline->
+                        parse_queue, chunks[i])) != 0)
+        {
+            //the pushed chunks keep the buffer until they done
+            pipeline->last_errno = result;
+            __sync_add_and_fetch(&pipeline->fail_count, 1);
+            for (; i<count; i++) {
+                chunks[i]->record_array.count = 0;
+                dispatch_parsed_chunk(chunks[i]);
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int binlog_replay_pipeline_wait_done(BinlogReplayPipeline *pipeline)
+{
+    PTHREAD_MUTEX_LOCK(&pipeline->lock);
+    while (pipeline->ring.inflight_count > 0) {
+        pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&pipeline->lock);
+
+    return pipeline->fail_count > 0 ? pipeline->last_errno : 0;
+}
@@ -0,0 +1,130 @@
+//binlog_replay_pipeline.h
+
+#ifndef _BINLOG_REPLAY_PIPELINE_H_
+#define _BINLOG_REPLAY_PIPELINE_H_
+
+#include <pthread.h>
+#include "fastcommon/common_blocked_queue.h"
+#include "binlog_types.h"
+#include "binlog_replay.h"
+
+#define BINLOG_PIPELINE_MAX_PARSE_THREADS    32
+#define BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS  (2 * BINLOG_PIPELINE_MAX_PARSE_THREADS)
+
+/* the replay pipeline for loading data:
+ *   the caller splits each read buffer into chunks at the record boundaries,
+ *   the parse threads unpack the chunks in parallel, then the chunks are
+ *   pushed to the data threads in the chunk order, so the records of the
+ *   same namespace (the same data thread) keep the binlog order.
+ *
+ * no barrier between the batches: the read buffer is released (returned
+ * to the reader) when all its records are done, and the caller only waits
+ * when the inflight chunks reach the limit.
+ *
+ * the chunks are completed in the chunk order too: the notify func is
+ * called for every record (including the skipped ones) in the binlog order,
+ * so the replica can respond the data versions in order.
+ */
+
+typedef void (*binlog_pipeline_release_func)(void *args, void *buffer_args);
+
+struct binlog_replay_pipeline;
+
+typedef struct binlog_pipeline_buffer {
+    const char *buff;
+    FDIRBinlogFilePosition position;  //the file position of the buffer start
+    volatile int reffer_count;        //the chunks not done
+    void *args;   //for the release func
+    struct binlog_pipeline_buffer *next;   //for the free list
+} BinlogPipelineBuffer;
+
+typedef struct binlog_pipeline_chunk {
+    int64_t seq;
+    const char *start;
+    const char *end;
+    BinlogPipelineBuffer *buffer;
+    struct {
+        int alloc;
+        int count;
+        FDIRBinlogRecord *records;
+        short *results;   //the deal results for the notify
+    } record_array;
+    volatile int waiting_count;  //the records not done
+    struct binlog_replay_pipeline *pipeline;
+    struct binlog_pipeline_chunk *next;    //for the free list
+} BinlogPipelineChunk;
+
+typedef struct binlog_replay_pipeline {
+    int parse_threads;
+    int64_t data_current_version;  //skip the records <= it
+    volatile int64_t record_count;
+    volatile int64_t skip_count;
+    volatile int64_t warning_count;
+    volatile int64_t fail_count;  //the statistic of the failed records
+    volatile int last_errno;      //the errno of the last failure
+    volatile bool continue_flag;
+    volatile int running_count;
+    struct common_blocked_queue parse_queue;  //the chunks to parse
+
+    struct {
+        BinlogPipelineChunk *chunks[BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS];
+        int64_t alloc_seq;   //the seq of the next chunk to split
+        int64_t next_seq;    //the seq of the next chunk to dispatch
+        int inflight_count;  //the chunks not done
+        bool dispatching;
+    } ring;   //the parsed chunks indexed by the seq
+
+    struct {
+        BinlogPipelineChunk *chunks[BINLOG_PIPELINE_MAX_INFLIGHT_CHUNKS];
+        int64_t next_seq;    //the seq of the next chunk to complete
+        bool completing;
+    } done_ring;   //the done chunks indexed by the seq
+
+    BinlogPipelineChunk *chunk_array;    //the inflight limit count
+    BinlogPipelineBuffer *buffer_array;  //the inflight limit count
+    BinlogPipelineChunk *free_chunks;
+    BinlogPipelineBuffer *free_buffers;
+    struct {
+        binlog_pipeline_release_func func;
+        void *args;
+    } release;
+    struct {
+        binlog_replay_notify_func func;
+        void *args;
+    } notify;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} BinlogReplayPipeline;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int binlog_replay_pipeline_init_ex(BinlogReplayPipeline *pipeline,
+        const int parse_threads, binlog_pipeline_release_func release_func,
+        void *release_args, binlog_replay_notify_func notify_func,
+        void *notify_args);
+
+#define binlog_replay_pipeline_init(pipeline, parse_threads, \
+        release_func, release_args) \
+    binlog_replay_pipeline_init_ex(pipeline, parse_threads, \
+            release_func, release_args, NULL, NULL)
+
+void binlog_replay_pipeline_destroy(BinlogReplayPipeline *pipeline);
+
+/* the buffer is owned by the pipeline until the release func called
+ * when return 0, otherwise the caller should release it.
+ * binlog_position can be NULL when the buffer is NOT from the binlog file
+ */
+int binlog_replay_pipeline_deal_buffer(BinlogReplayPipeline *pipeline,
+        const char *buff, const int len,
+        const FDIRBinlogFilePosition *binlog_position, void *buffer_args);
+
+//wait until all the inflight records done
+int binlog_replay_pipeline_wait_done(BinlogReplayPipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
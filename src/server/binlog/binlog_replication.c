@@ -10,6 +10,10 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include "fastcommon/common_define.h"
+#ifdef OS_LINUX
+#include <sys/sendfile.h>
+#endif
 #include "fastcommon/logger.h"
 #include "fastcommon/sockopt.h"
 #include "fastcommon/shared_func.h"
@@ -24,12 +28,162 @@
 #include "binlog_func.h"
 #include "binlog_pack.h"
 #include "push_result_ring.h"
+#include "replica_quorum.h"
 #include "binlog_producer.h"
+#include "binlog_reader.h"
 #include "binlog_read_thread.h"
 #include "binlog_replication.h"
 
+#define REPLICATION_GATHER_MAX_IOVS     256
+#define REPLICATION_PACKET_HEADER_SIZE  (sizeof(FDIRProtoHeader) + \
+        sizeof(FDIRProtoPushBinlogReqBodyHeader))
+
 static void replication_queue_discard_all(FDIRSlaveReplication *replication);
 
+static void zero_copy_close(FDIRSlaveReplication *replication)
+{
+    if (replication->context.zero_copy.fd >= 0) {
+        close(replication->context.zero_copy.fd);
+        replication->context.zero_copy.fd = -1;
+    }
+    replication->context.zero_copy.header_length = 0;
+    replication->context.zero_copy.header_sent = 0;
+    replication->context.zero_copy.remain = 0;
+}
+
+static inline bool zero_copy_sending(FDIRSlaveReplication *replication)
+{
+    return (replication->context.zero_copy.header_sent <
+            replication->context.zero_copy.header_length) ||
+        (replication->context.zero_copy.remain > 0);
+}
+
+static void gather_release(FDIRSlaveReplication *replication)
+{
+    int i;
+
+    for (i=0; i<replication->context.gather.rb_count; i++) {
+        replication->context.gather.rbs[i]->release_func(
+                replication->context.gather.rbs[i]);
+    }
+    replication->context.gather.rb_count = 0;
+    replication->context.gather.iov_count = 0;
+    replication->context.gather.iov_index = 0;
+}
+
+static inline bool gather_sending(FDIRSlaveReplication *replication)
+{
+    return replication->context.gather.iov_index <
+        replication->context.gather.iov_count;
+}
+
+static int gather_check_alloc(FDIRSlaveReplication *replication)
+{
+    int bytes;
+
+    if (replication->context.gather.iovs != NULL) {
+        return 0;
+    }
+
+    bytes = (sizeof(struct iovec) + sizeof(ServerBinlogRecordBuffer *)) *
+        REPLICATION_GATHER_MAX_IOVS + REPLICATION_PACKET_HEADER_SIZE *
+        REPLICATION_GATHER_MAX_IOVS / 2;
+    replication->context.gather.iovs = (struct iovec *)malloc(bytes);
+    if (replication->context.gather.iovs == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+
+    replication->context.gather.rbs = (ServerBinlogRecordBuffer **)
+        (replication->context.gather.iovs + REPLICATION_GATHER_MAX_IOVS);
+    replication->context.gather.headers = (char *)
+        (replication->context.gather.rbs + REPLICATION_GATHER_MAX_IOVS);
+    return 0;
+}
+
+static int window_check_alloc(FDIRSlaveReplication *replication)
+{
+    int bytes;
+
+    if (replication->context.window.batches != NULL) {
+        return 0;
+    }
+
+    bytes = sizeof(FDIRReplicationWindowBatch) * REPLICATION_WINDOW_BATCHES;
+    replication->context.window.batches = (FDIRReplicationWindowBatch *)
+        malloc(bytes);
+    if (replication->context.window.batches == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    return 0;
+}
+
+static inline void window_reset(FDIRSlaveReplication *replication)
+{
+    replication->context.window.head = 0;
+    replication->context.window.count = 0;
+    replication->context.window.bytes = 0;
+    replication->context.window.credits = -1;
+}
+
+/* the first batch is always allowed, so a batch larger than
+ * the window bytes or zero credit does NOT block the replication
+ */
+static inline bool window_full(FDIRSlaveReplication *replication)
+{
+    int max_batches;
+
+    if (replication->context.window.count == 0) {
+        return false;
+    }
+
+    max_batches = REPLICATION_WINDOW_BATCHES;
+    if (replication->context.window.credits >= 0 &&
+            replication->context.window.credits < max_batches)
+    {
+        max_batches = replication->context.window.credits;
+    }
+    return replication->context.window.count >= max_batches ||
+        replication->context.window.bytes >= REPLICATION_WINDOW_BYTES;
+}
+
+static inline void window_push(FDIRSlaveReplication *replication,
+        const int64_t last_data_version, const int bytes)
+{
+    FDIRReplicationWindowBatch *batch;
+
+    batch = replication->context.window.batches +
+        (replication->context.window.head +
+         replication->context.window.count) % REPLICATION_WINDOW_BATCHES;
+    batch->last_data_version = last_data_version;
+    batch->bytes = bytes;
+    replication->context.window.count++;
+    replication->context.window.bytes += bytes;
+}
+
+static void window_release(FDIRSlaveReplication *replication)
+{
+    FDIRReplicationWindowBatch *batch;
+
+    while (replication->context.window.count > 0) {
+        batch = replication->context.window.batches +
+            replication->context.window.head;
+        if (batch->last_data_version > replication->
+                context.last_data_versions.by_resp)
+        {
+            break;
+        }
+
+        replication->context.window.bytes -= batch->bytes;
+        replication->context.window.head = (replication->context.
+                window.head + 1) % REPLICATION_WINDOW_BATCHES;
+        replication->context.window.count--;
+    }
+}
+
 static int check_alloc_ptr_array(FDIRSlaveReplicationPtrArray *array)
 {
     int bytes;
@@ -132,7 +286,8 @@ int binlog_replication_bind_thread(FDIRSlaveReplication *replication)
         return ENOMEM;
     }
 
-    alloc_size = 4 * task->size / BINLOG_RECORD_MIN_SIZE;
+    //the binary record is the smallest
+    alloc_size = 4 * task->size / BINLOG_BINARY_RECORD_MIN_SIZE;
     if ((result=push_result_ring_check_init(&replication->
                     context.push_result_ctx, alloc_size)) != 0)
     {
@@ -146,7 +301,7 @@ int binlog_replication_bind_thread(FDIRSlaveReplication *replication)
         replication->index % CLUSTER_SF_CTX.work_threads;
 
     set_replication_stage(replication, FDIR_REPLICATION_STAGE_NONE);
-    replication->context.last_data_versions.by_disk.previous = 0;
+    replication->fallback_to_disk = 0;
     replication->context.last_data_versions.by_disk.current = 0;
     replication->context.last_data_versions.by_queue = 0;
     replication->context.last_data_versions.by_resp = 0;
@@ -154,9 +309,19 @@ int binlog_replication_bind_thread(FDIRSlaveReplication *replication)
     replication->context.sync_by_disk_stat.start_time_ms = 0;
     replication->context.sync_by_disk_stat.binlog_size = 0;
     replication->context.sync_by_disk_stat.record_count = 0;
+    zero_copy_close(replication);
+    gather_release(replication);
+    if ((result=gather_check_alloc(replication)) != 0) {
+        return result;
+    }
+    window_reset(replication);
+    if ((result=window_check_alloc(replication)) != 0) {
+        return result;
+    }
 
     CLUSTER_TASK_TYPE = FDIR_CLUSTER_TASK_TYPE_REPLICA_MASTER;
     CLUSTER_REPLICA = replication;
+    replication->relay = !MYSELF_IS_MASTER;
     replication->connection_info.conn.sock = -1;
     replication->task = task;
 
@@ -187,9 +352,12 @@ int binlog_replication_rebind_thread(FDIRSlaveReplication *replication)
                 cluster.connected, replication)) == 0)
     {
         replication_queue_discard_all(replication);
+        gather_release(replication);
         push_result_ring_clear_all(&replication->context.push_result_ctx);
-        if (MYSELF_IS_MASTER) {
+        if (cluster_info_is_downstream(replication->slave)) {
             result = binlog_replication_bind_thread(replication);
+        } else {
+            replication->task = NULL;  //unbound
         }
     }
 
@@ -366,9 +534,21 @@ static int send_join_slave_package(FDIRSlaveReplication *replication)
     return result;
 }
 
-static void decrease_task_waiting_rpc_count(ServerBinlogRecordBuffer *rb)
+//the record is NOT acked by the slave, notify the task with the error
+static void decrease_task_waiting_rpc_count(ServerBinlogRecordBuffer *rb,
+        const int result)
 {
     struct fast_task_info *task;
+
+    if (rb->durability_level != FDIR_DURABILITY_LEVEL_REPLICA) {
+        return;
+    }
+
+    if (rb->quorum != NULL) {
+        replica_quorum_done(rb->quorum, result);
+        return;
+    }
+
     task = (struct fast_task_info *)rb->args;
 
     if (rb->task_version != __sync_add_and_fetch(&((FDIRServerTaskArg *)
@@ -379,6 +559,8 @@ static void decrease_task_waiting_rpc_count(ServerBinlogRecordBuffer *rb)
         return;
     }
 
+    __sync_bool_compare_and_swap(&((FDIRServerTaskArg *)task->arg)->
+            context.service.waiting_rpc_result, 0, result);
     if (__sync_sub_and_fetch(&((FDIRServerTaskArg *)task->arg)->
                 context.service.waiting_rpc_count, 1) == 0)
     {
@@ -395,7 +577,11 @@ static void discard_queue(FDIRSlaveReplication *replication,
         head = head->nexts[replication->index];
 
         replication->context.last_data_versions.by_queue = rb->data_version;
-        decrease_task_waiting_rpc_count(rb);
+        __sync_sub_and_fetch(&replication->context.queue.bytes,
+                rb->buffer.length);
+        if (!replication->slave->is_learner) {
+            decrease_task_waiting_rpc_count(rb, ECONNRESET);
+        }
         rb->release_func(rb);
     }
 }
@@ -461,6 +647,25 @@ static int deal_connecting_replication(FDIRSlaveReplication *replication)
     return result;
 }
 
+/* the server is no longer replicated by me (the master or the relay),
+ * release the task which not in the nio yet
+ */
+static void unbind_connecting_replication(FDIRServerContext *server_ctx,
+        FDIRSlaveReplication *replication)
+{
+    remove_from_replication_ptr_array(&server_ctx->
+            cluster.connectings, replication);
+    replication_queue_discard_all(replication);
+    if (replication->connection_info.conn.sock >= 0) {
+        close(replication->connection_info.conn.sock);
+        replication->connection_info.conn.sock = -1;
+    }
+
+    replication->stage = FDIR_REPLICATION_STAGE_NONE;
+    free_queue_push(replication->task);
+    replication->task = NULL;
+}
+
 static int deal_replication_connectings(FDIRServerContext *server_ctx)
 {
 #define SUCCESS_ARRAY_ELEMENT_MAX  8
@@ -481,6 +686,13 @@ static int deal_replication_connectings(FDIRServerContext *server_ctx)
     success_array.count = 0;
     for (i=0; i<server_ctx->cluster.connectings.count; i++) {
         replication = server_ctx->cluster.connectings.replications[i];
+        if (!cluster_info_is_downstream(replication->slave)) {
+            unbind_connecting_replication(server_ctx, replication);
+            i--;
+            continue;
+        }
+
+        replication->relay = !MYSELF_IS_MASTER;
         result = deal_connecting_replication(replication);
         if (result == 0) {
             if (success_array.count < SUCCESS_ARRAY_ELEMENT_MAX) {
@@ -569,15 +781,84 @@ static void repush_to_replication_queue(FDIRSlaveReplication *replication,
     PTHREAD_MUTEX_UNLOCK(&replication->context.queue.lock);
 }
 
+static int gather_send(FDIRSlaveReplication *replication)
+{
+    struct iovec *iov;
+    struct iovec *end;
+    ssize_t bytes;
+    int result;
+
+    end = replication->context.gather.iovs +
+        replication->context.gather.iov_count;
+    while (replication->context.gather.iov_index <
+            replication->context.gather.iov_count)
+    {
+        iov = replication->context.gather.iovs +
+            replication->context.gather.iov_index;
+        if ((bytes=writev(replication->task->event.fd, iov, end - iov)) < 0) {
+            result = errno != 0 ? errno : EIO;
+            if (result == EINTR) {
+                continue;
+            } else if (result == EAGAIN || result == EWOULDBLOCK) {
+                return EAGAIN;
+            }
+
+            logError("file: "__FILE__", line: %d, "
+                    "send to slave %s:%d fail, errno: %d, error info: %s",
+                    __LINE__, replication->task->client_ip,
+                    replication->task->port, result, STRERROR(result));
+            return result;
+        }
+
+        while (bytes > 0) {
+            if ((size_t)bytes >= iov->iov_len) {
+                bytes -= iov->iov_len;
+                iov++;
+            } else {
+                iov->iov_base = (char *)iov->iov_base + bytes;
+                iov->iov_len -= bytes;
+                bytes = 0;
+            }
+        }
+        replication->context.gather.iov_index = iov -
+            replication->context.gather.iovs;
+    }
+
+    gather_release(replication);
+    return 0;
+}
+
+static void gather_set_packet_header(char *header,
+        const int binlog_length, const int64_t last_data_version)
+{
+    FDIRProtoPushBinlogReqBodyHeader *body_header;
+
+    body_header = (FDIRProtoPushBinlogReqBodyHeader *)
+        (header + sizeof(FDIRProtoHeader));
+    int2buff(binlog_length, body_header->binlog_length);
+    long2buff(last_data_version, body_header->last_data_version);
+    FDIR_PROTO_SET_HEADER((FDIRProtoHeader *)header,
+            FDIR_REPLICA_PROTO_PUSH_BINLOG_REQ, binlog_length +
+            sizeof(FDIRProtoPushBinlogReqBodyHeader));
+}
+
+/* the packets of the record buffers in one writev, every packet
+ * (the header and the records) fits the task buffer of the slave,
+ * the packets are pushed without waiting for the responses until
+ * the window full
+ */
 static int sync_binlog_from_queue(FDIRSlaveReplication *replication)
 {
     ServerBinlogRecordBuffer *rb;
     ServerBinlogRecordBuffer *head;
     ServerBinlogRecordBuffer *tail;
     struct fast_task_info *waiting_task;
-    FDIRProtoPushBinlogReqBodyHeader *body_header;
-    uint64_t last_data_version;
-    int body_len;
+    FDIRReplicaQuorum *quorum;
+    struct iovec *iovs;
+    char *header;
+    int64_t last_data_version;
+    int binlog_length;
+    int header_count;
     int result;
 
     PTHREAD_MUTEX_LOCK(&replication->context.queue.lock);
@@ -592,60 +873,117 @@ static int sync_binlog_from_queue(FDIRSlaveReplication *replication)
         return 0;
     }
 
+    iovs = replication->context.gather.iovs;
+    header = NULL;
+    header_count = 0;
+    binlog_length = 0;
     last_data_version = 0;
-    replication->task->length = sizeof(FDIRProtoHeader) +
-        sizeof(FDIRProtoPushBinlogReqBodyHeader);
     while (head != NULL) {
         rb = head;
 
-        waiting_task = (struct fast_task_info *)rb->args;
-        if (rb->task_version != __sync_add_and_fetch(&((FDIRServerTaskArg *)
+        if (rb->durability_level == FDIR_DURABILITY_LEVEL_REPLICA &&
+                !replication->slave->is_learner)
+        {
+            waiting_task = (struct fast_task_info *)rb->args;
+            quorum = rb->quorum;
+        } else {
+            waiting_task = NULL;  //the task do NOT wait for the slave
+            quorum = NULL;
+        }
+        if (waiting_task != NULL && rb->task_version !=
+                __sync_add_and_fetch(&((FDIRServerTaskArg *)
                         waiting_task->arg)->task_version, 0))
         {
             logWarning("file: "__FILE__", line: %d, "
                     "task %p already cleanup", __LINE__, waiting_task);
-        } else {
-            if (replication->task->length + rb->buffer.length >
-                    replication->task->size)
+            if (quorum != NULL) {
+                replica_quorum_done(quorum, ECANCELED);
+            }
+            head = head->nexts[replication->index];
+            __sync_sub_and_fetch(&replication->context.queue.bytes,
+                    rb->buffer.length);
+            rb->release_func(rb);
+            continue;
+        }
+
+        if (header == NULL || REPLICATION_PACKET_HEADER_SIZE +
+                binlog_length + rb->buffer.length > replication->task->size)
+        {
+            if (header != NULL) {
+                gather_set_packet_header(header, binlog_length,
+                        last_data_version);
+                window_push(replication, last_data_version,
+                        REPLICATION_PACKET_HEADER_SIZE + binlog_length);
+                header = NULL;
+            }
+
+            if (replication->context.gather.iov_count + 2 >
+                    REPLICATION_GATHER_MAX_IOVS || window_full(replication))
             {
                 break;
             }
 
-            last_data_version = rb->data_version;
-            replication->context.last_data_versions.by_queue = rb->data_version;
-            memcpy(replication->task->data + replication->task->length,
-                    rb->buffer.data, rb->buffer.length);
-            replication->task->length += rb->buffer.length;
-
-            //logInfo("call push_result_ring_add data_version: %"PRId64, rb->data_version);
+            header = replication->context.gather.headers +
+                REPLICATION_PACKET_HEADER_SIZE * header_count++;
+            iovs[replication->context.gather.iov_count].iov_base = header;
+            iovs[replication->context.gather.iov_count++].iov_len =
+                REPLICATION_PACKET_HEADER_SIZE;
+            binlog_length = 0;
+        } else if (replication->context.gather.iov_count + 1 >
+                REPLICATION_GATHER_MAX_IOVS)
+        {
+            break;
+        }
 
-            if ((result=push_result_ring_add(&replication->context.
-                            push_result_ctx, rb->data_version,
-                            waiting_task, rb->task_version)) != 0)
-            {
-                return result;
+        last_data_version = rb->data_version;
+        replication->context.last_data_versions.by_queue = rb->data_version;
+        iovs[replication->context.gather.iov_count].iov_base =
+            rb->buffer.data;
+        iovs[replication->context.gather.iov_count++].iov_len =
+            rb->buffer.length;
+        binlog_length += rb->buffer.length;
+        __sync_sub_and_fetch(&replication->context.queue.bytes,
+                rb->buffer.length);
+        replication->context.gather.rbs[replication->
+            context.gather.rb_count++] = rb;
+
+        //logInfo("call push_result_ring_add data_version: %"PRId64, rb->data_version);
+
+        //the relay does NOT wait for the results
+        if (!replication->relay && (result=push_result_ring_add(&replication->context.
+                        push_result_ctx, rb->data_version, waiting_task,
+                        rb->task_version, quorum)) != 0)
+        {
+            if (waiting_task != NULL) {
+                decrease_task_waiting_rpc_count(rb, result);
             }
+            if (head->nexts[replication->index] != NULL) {
+                repush_to_replication_queue(replication,
+                        head->nexts[replication->index], tail);
+            }
+
+            //the packets are not sent, release the gathered record buffers
+            gather_release(replication);
+            return result;
         }
 
         head = head->nexts[replication->index];
-        rb->release_func(rb);
     }
 
-    body_header = (FDIRProtoPushBinlogReqBodyHeader *)
-        (replication->task->data + sizeof(FDIRProtoHeader));
-    body_len = replication->task->length - sizeof(FDIRProtoHeader);
-    int2buff(body_len - sizeof(FDIRProtoPushBinlogReqBodyHeader),
-            body_header->binlog_length);
-    long2buff(last_data_version, body_header->last_data_version);
-
-    FDIR_PROTO_SET_HEADER((FDIRProtoHeader *)replication->task->data,
-            FDIR_REPLICA_PROTO_PUSH_BINLOG_REQ, body_len);
-    sf_send_add_event(replication->task);
-
     if (head != NULL) {
         repush_to_replication_queue(replication, head, tail);
     }
-    return 0;
+    if (header != NULL) {
+        gather_set_packet_header(header, binlog_length, last_data_version);
+        window_push(replication, last_data_version,
+                REPLICATION_PACKET_HEADER_SIZE + binlog_length);
+    }
+    if (replication->context.gather.iov_count == 0) {
+        return 0;
+    }
+
+    result = gather_send(replication);
+    return result == EAGAIN ? 0 : result;
 }
 
 static int start_binlog_read_thread(FDIRSlaveReplication *replication)
@@ -667,11 +1005,11 @@ static int start_binlog_read_thread(FDIRSlaveReplication *replication)
     if ((result=free_queue_realloc_max_buffer(replication->task)) != 0) {
         return result;
     }
-    return binlog_read_thread_init(replication->context.reader_ctx,
+    return binlog_read_thread_init_ex(replication->context.reader_ctx,
             &replication->slave->binlog_pos_hint, 
             replication->slave->last_data_version,
             replication->task->size - (sizeof(FDIRProtoHeader) +
-                sizeof(FDIRProtoPushBinlogReqBodyHeader)));
+                sizeof(FDIRProtoPushBinlogReqBodyHeader)), true);
 }
 
 int binlog_replications_check_response_data_version(
@@ -680,9 +1018,13 @@ int binlog_replications_check_response_data_version(
 {
     if (data_version > replication->context.last_data_versions.by_resp) {
         replication->context.last_data_versions.by_resp = data_version;
+        window_release(replication);
     }
 
     if (replication->stage == FDIR_REPLICATION_STAGE_SYNC_FROM_QUEUE) {
+        if (replication->relay) {
+            return 0;
+        }
         return push_result_ring_remove(&replication->context.
                 push_result_ctx, data_version);
     } else if (replication->stage == FDIR_REPLICATION_STAGE_SYNC_FROM_DISK) {
@@ -692,6 +1034,13 @@ int binlog_replications_check_response_data_version(
     return 0;
 }
 
+void binlog_replications_set_slave_credits(
+        FDIRSlaveReplication *replication, const int credits)
+{
+    replication->context.window.credits = credits;
+}
+
+#ifndef OS_LINUX
 static void sync_binlog_to_slave(FDIRSlaveReplication *replication,
         BinlogReadThreadResult *r)
 {
@@ -712,16 +1061,168 @@ static void sync_binlog_to_slave(FDIRSlaveReplication *replication,
     replication->task->length = sizeof(FDIRProtoHeader) + body_len;
     sf_send_add_event(replication->task);
 }
+#endif
+
+#ifdef OS_LINUX
+static int zero_copy_open(FDIRSlaveReplication *replication,
+        const int file_index)
+{
+    char filename[PATH_MAX];
+    int result;
+
+    if (replication->context.zero_copy.fd >= 0) {
+        if (replication->context.zero_copy.file_index == file_index) {
+            return 0;
+        }
+        zero_copy_close(replication);
+    }
+
+    GET_BINLOG_FILENAME(filename, sizeof(filename), file_index);
+    if ((replication->context.zero_copy.fd=open(filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    posix_fadvise(replication->context.zero_copy.fd,
+            0, 0, POSIX_FADV_SEQUENTIAL);
+    replication->context.zero_copy.file_index = file_index;
+    return 0;
+}
+
+/* send the header with MSG_MORE, then the binlog file range by sendfile,
+ * return EAGAIN when the socket buffer is full
+ */
+static int zero_copy_send(FDIRSlaveReplication *replication)
+{
+    struct iovec iov;
+    struct msghdr msg;
+    off_t offset;
+    ssize_t bytes;
+    int sock;
+    int result;
+
+    sock = replication->task->event.fd;
+    while (replication->context.zero_copy.header_sent <
+            replication->context.zero_copy.header_length)
+    {
+        iov.iov_base = replication->context.zero_copy.header +
+            replication->context.zero_copy.header_sent;
+        iov.iov_len = replication->context.zero_copy.header_length -
+            replication->context.zero_copy.header_sent;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if ((bytes=sendmsg(sock, &msg, MSG_MORE | MSG_NOSIGNAL)) < 0) {
+            result = errno != 0 ? errno : EIO;
+            if (result == EINTR) {
+                continue;
+            } else if (result == EAGAIN || result == EWOULDBLOCK) {
+                return EAGAIN;
+            }
+
+            logError("file: "__FILE__", line: %d, "
+                    "send to slave %s:%d fail, errno: %d, error info: %s",
+                    __LINE__, replication->task->client_ip,
+                    replication->task->port, result, STRERROR(result));
+            return result;
+        }
+        replication->context.zero_copy.header_sent += bytes;
+    }
+
+    while (replication->context.zero_copy.remain > 0) {
+        offset = replication->context.zero_copy.offset;
+        bytes = sendfile(sock, replication->context.zero_copy.fd,
+                &offset, replication->context.zero_copy.remain);
+        if (bytes < 0) {
+            result = errno != 0 ? errno : EIO;
+            if (result == EINTR) {
+                continue;
+            } else if (result == EAGAIN || result == EWOULDBLOCK) {
+                return EAGAIN;
+            }
+
+            logError("file: "__FILE__", line: %d, "
+                    "sendfile to slave %s:%d fail, binlog index: %d, "
+                    "offset: %"PRId64", errno: %d, error info: %s",
+                    __LINE__, replication->task->client_ip,
+                    replication->task->port, replication->context.
+                    zero_copy.file_index, replication->context.
+                    zero_copy.offset, result, STRERROR(result));
+            return result;
+        } else if (bytes == 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "sendfile to slave %s:%d fail, binlog index: %d, "
+                    "offset: %"PRId64", unexpected end of file", __LINE__,
+                    replication->task->client_ip, replication->task->port,
+                    replication->context.zero_copy.file_index,
+                    replication->context.zero_copy.offset);
+            return EIO;
+        }
+        replication->context.zero_copy.offset += bytes;
+        replication->context.zero_copy.remain -= bytes;
+    }
+
+    //do NOT keep the history binlog in the page cache
+    if (replication->context.zero_copy.file_index <
+            binlog_get_current_write_index())
+    {
+        posix_fadvise(replication->context.zero_copy.fd,
+                replication->context.zero_copy.start_offset,
+                replication->context.zero_copy.offset -
+                replication->context.zero_copy.start_offset,
+                POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+static int sync_binlog_to_slave_by_sendfile(FDIRSlaveReplication
+        *replication, BinlogReadThreadResult *r)
+{
+    int body_len;
+    int result;
+    FDIRProtoPushBinlogReqBodyHeader *body_header;
 
+    if ((result=zero_copy_open(replication, r->binlog_position.index)) != 0) {
+        return result;
+    }
+
+    body_header = (FDIRProtoPushBinlogReqBodyHeader *)
+        (replication->context.zero_copy.header + sizeof(FDIRProtoHeader));
+    body_len = sizeof(FDIRProtoPushBinlogReqBodyHeader) + r->buffer.length;
+    FDIR_PROTO_SET_HEADER((FDIRProtoHeader *)replication->context.
+            zero_copy.header, FDIR_REPLICA_PROTO_PUSH_BINLOG_REQ, body_len);
+    int2buff(r->buffer.length, body_header->binlog_length);
+    long2buff(r->last_data_version, body_header->last_data_version);
+
+    replication->context.zero_copy.header_length =
+        sizeof(replication->context.zero_copy.header);
+    replication->context.zero_copy.header_sent = 0;
+    replication->context.zero_copy.start_offset = r->binlog_position.offset;
+    replication->context.zero_copy.offset = r->binlog_position.offset;
+    replication->context.zero_copy.remain = r->buffer.length;
+
+    result = zero_copy_send(replication);
+    return result == EAGAIN ? 0 : result;
+}
+#endif
+
+//return EAGAIN when no more binlog to push for now
 static int sync_binlog_from_disk(FDIRSlaveReplication *replication)
 {
     BinlogReadThreadResult *r;
     const bool block = false;
+    int err_no;
+#ifdef OS_LINUX
+    int result;
+#endif
 
     r = binlog_read_thread_fetch_result_ex(replication->context.
             reader_ctx, block);
     if (r == NULL) {
-        return 0;
+        return EAGAIN;
     }
 
     /*
@@ -735,18 +1236,27 @@ static int sync_binlog_from_disk(FDIRSlaveReplication *replication)
         if (r->last_data_version > replication->context.
                 last_data_versions.by_disk.current)
         {
-            replication->context.last_data_versions.by_disk.previous =
-                replication->context.last_data_versions.by_disk.current;
             replication->context.last_data_versions.by_disk.current =
                 r->last_data_version;
         }
 
         replication->context.sync_by_disk_stat.binlog_size += r->buffer.length;
+        window_push(replication, r->last_data_version,
+                REPLICATION_PACKET_HEADER_SIZE + r->buffer.length);
+#ifdef OS_LINUX
+        if ((result=sync_binlog_to_slave_by_sendfile(replication, r)) != 0) {
+            binlog_read_thread_return_result_buffer(
+                    replication->context.reader_ctx, r);
+            return result;
+        }
+#else
         sync_binlog_to_slave(replication, r);
+#endif
     }
+    err_no = r->err_no;
     binlog_read_thread_return_result_buffer(replication->context.reader_ctx, r);
 
-    if ((r->err_no == ENOENT) && (replication->context.last_data_versions.
+    if ((err_no == ENOENT) && (replication->context.last_data_versions.
             by_queue <= replication->context.last_data_versions.by_disk.current)
             && (replication->context.last_data_versions.by_resp >=
             replication->context.last_data_versions.by_disk.current))
@@ -758,6 +1268,7 @@ static int sync_binlog_from_disk(FDIRSlaveReplication *replication)
         binlog_read_thread_terminate(replication->context.reader_ctx);
         free(replication->context.reader_ctx);
         replication->context.reader_ctx = NULL;
+        zero_copy_close(replication);
 
         if (replication->context.last_data_versions.by_disk.current > 0) {
             replication_queue_discard_synced(replication);
@@ -777,9 +1288,60 @@ static int sync_binlog_from_disk(FDIRSlaveReplication *replication)
                     binlog_size, size_buff),
                 long_to_comma_str(time_used, time_buff));
     }
+    return err_no == 0 ? 0 : EAGAIN;
+}
+
+/* the slave lags behind and is NOT waited by the writers, discard the
+ * queue to release the memory and sync the binlog from the disk again,
+ * from the last data version pushed to the slave
+ */
+static int fallback_to_sync_from_disk(FDIRSlaveReplication *replication)
+{
+    int64_t last_data_version;
+    int result;
+
+    last_data_version = replication->context.last_data_versions.by_queue;
+    if (last_data_version < replication->context.
+            last_data_versions.by_disk.current)
+    {
+        last_data_version = replication->context.
+            last_data_versions.by_disk.current;
+    }
+    replication_queue_discard_all(replication);
+
+    replication->slave->last_data_version = last_data_version;
+    replication->context.last_data_versions.by_disk.current =
+        last_data_version;
+    if ((result=start_binlog_read_thread(replication)) != 0) {
+        return result;
+    }
+
+    set_replication_stage(replication, FDIR_REPLICATION_STAGE_SYNC_FROM_DISK);
+    replication->context.sync_by_disk_stat.start_time_ms =
+        get_current_time_ms();
+    replication->context.sync_by_disk_stat.binlog_size = 0;
+    replication->context.sync_by_disk_stat.record_count = 0;
+
+    logWarning("file: "__FILE__", line: %d, "
+            "the replication lag of slave %s:%d is too large, discard "
+            "the queue and sync from the disk, data version: %"PRId64,
+            __LINE__, CLUSTER_GROUP_ADDRESS_FIRST_IP(replication->slave->
+                server), CLUSTER_GROUP_ADDRESS_FIRST_PORT(replication->
+                    slave->server), last_data_version);
     return 0;
 }
 
+static inline bool replication_sending(FDIRSlaveReplication *replication)
+{
+#ifdef OS_LINUX
+    if (zero_copy_sending(replication)) {
+        return true;
+    }
+#endif
+    return !(replication->task->offset == 0 &&
+            replication->task->length == 0);
+}
+
 static int deal_connected_replication(FDIRSlaveReplication *replication)
 {
     int result;
@@ -807,18 +1369,43 @@ static int deal_connected_replication(FDIRSlaveReplication *replication)
         return result;
     }
 
+    //the pending data should be sent before the next
+#ifdef OS_LINUX
+    if (zero_copy_sending(replication)) {
+        if ((result=zero_copy_send(replication)) != 0) {
+            return result == EAGAIN ? 0 : result;
+        }
+    }
+#endif
+    if (gather_sending(replication)) {
+        if ((result=gather_send(replication)) != 0) {
+            return result == EAGAIN ? 0 : result;
+        }
+    }
+
     if (!(replication->task->offset == 0 && replication->task->length == 0)) {
         return 0;
     }
 
     if (replication->stage == FDIR_REPLICATION_STAGE_SYNC_FROM_DISK) {
-        if (replication->context.last_data_versions.by_resp >=
-                replication->context.last_data_versions.by_disk.previous) //flow control
+        //push the batches without waiting for the responses
+        while (replication->stage == FDIR_REPLICATION_STAGE_SYNC_FROM_DISK
+                && !window_full(replication))
         {
-            return sync_binlog_from_disk(replication);
+            if ((result=sync_binlog_from_disk(replication)) != 0) {
+                return result == EAGAIN ? 0 : result;
+            }
+            if (replication_sending(replication)) {
+                break;
+            }
         }
     } else if (replication->stage == FDIR_REPLICATION_STAGE_SYNC_FROM_QUEUE) {
         push_result_ring_clear_timeouts(&replication->context.push_result_ctx);
+        if (__sync_bool_compare_and_swap(&replication->
+                    fallback_to_disk, 1, 0))
+        {
+            return fallback_to_sync_from_disk(replication);
+        }
         return sync_binlog_from_queue(replication);
     }
 
@@ -844,7 +1431,14 @@ static int deal_replication_connected(FDIRServerContext *server_ctx)
 
     for (i=0; i<server_ctx->cluster.connected.count; i++) {
         replication = server_ctx->cluster.connected.replications[i];
-        if (deal_connected_replication(replication) != 0) {
+        if (!cluster_info_is_downstream(replication->slave)) {
+            //the source of the slave changed, such as the upstream active
+            logInfo("file: "__FILE__", line: %d, "
+                    "slave server id: %d is no longer replicated by me, "
+                    "close the replication", __LINE__,
+                    replication->slave->server->id);
+            iovent_add_to_deleted_list(replication->task);
+        } else if (deal_connected_replication(replication) != 0) {
             iovent_add_to_deleted_list(replication->task);
         }
     }
@@ -20,6 +20,10 @@ int binlog_replications_check_response_data_version(
         FDIRSlaveReplication *replication,
         const int64_t data_version);
 
+//the free buffer count of the slave from the push binlog response
+void binlog_replications_set_slave_credits(
+        FDIRSlaveReplication *replication, const int credits);
+
 #ifdef __cplusplus
 }
 #endif
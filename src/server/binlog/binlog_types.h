@@ -49,6 +49,10 @@ typedef struct fdir_binlog_record {
     int timestamp;
     FDIRStatModifyFlags options;
     FDIRDEntryFullName fullname; //path namespace and path name
+    struct {
+        int64_t parent_inode;
+        string_t name;
+    } pname;  //the target by parent inode and name, with fullname.ns
     FDIRDEntryStatus stat;
     string_t user_data;
     string_t extra_data;
@@ -72,6 +76,8 @@ typedef struct server_binlog_buffer {
 typedef struct server_binlog_record_buffer {
     uint64_t data_version; //for idempotency (slave only)
     int64_t task_version;
+    int durability_level;  //for waiting task notify (master only)
+    FDIRReplicaQuorum *quorum;  //for the replica quorum (master only)
     volatile int reffer_count;
     void *args;  //for notify & release 
     release_binlog_rbuffer_func release_func;
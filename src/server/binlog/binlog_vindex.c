@@ -0,0 +1,236 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "binlog_pack.h"
+#include "binlog_vindex.h"
+
+#define BINLOG_VINDEX_WRITE_BATCH  64
+
+static int read_entry(const int fd, const char *filename,
+        const int64_t index, int64_t *data_version, int64_t *offset)
+{
+    BinlogVIndexEntry entry;
+    int result;
+
+    if (pread(fd, &entry, sizeof(entry), index * BINLOG_VINDEX_ENTRY_SIZE)
+            != sizeof(entry))
+    {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "read index file \"%s\" fail, entry index: %"PRId64", "
+                "errno: %d, error info: %s", __LINE__, filename,
+                index, result, STRERROR(result));
+        return result;
+    }
+
+    *data_version = buff2long(entry.data_version);
+    *offset = buff2long(entry.offset);
+    return 0;
+}
+
+int binlog_vindex_writer_open(BinlogVIndexWriter *writer,
+        const int binlog_index, const bool create_new)
+{
+    int64_t file_size;
+    int64_t data_version;
+    int64_t offset;
+    int result;
+
+    binlog_vindex_writer_close(writer);
+    GET_BINLOG_VINDEX_FILENAME(writer->filename,
+            sizeof(writer->filename), binlog_index);
+    if (create_new && unlink(writer->filename) != 0 && errno != ENOENT) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "unlink file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, writer->filename, result, STRERROR(result));
+        return result;
+    }
+
+    writer->fd = open(writer->filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (writer->fd < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, writer->filename, result, STRERROR(result));
+        return result;
+    }
+
+    if ((file_size=lseek(writer->fd, 0, SEEK_END)) < 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "lseek file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, writer->filename, result, STRERROR(result));
+        binlog_vindex_writer_close(writer);
+        return result;
+    }
+
+    //discard the partial entry written before crash
+    if (file_size % BINLOG_VINDEX_ENTRY_SIZE != 0) {
+        file_size -= file_size % BINLOG_VINDEX_ENTRY_SIZE;
+        if (ftruncate(writer->fd, file_size) != 0) {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "truncate file \"%s\" fail, errno: %d, error info: %s",
+                    __LINE__, writer->filename, result, STRERROR(result));
+            binlog_vindex_writer_close(writer);
+            return result;
+        }
+    }
+
+    if (file_size == 0) {
+        writer->next_offset = 0;
+        return 0;
+    }
+
+    if ((result=read_entry(writer->fd, writer->filename, file_size /
+                    BINLOG_VINDEX_ENTRY_SIZE - 1, &data_version,
+                    &offset)) != 0)
+    {
+        binlog_vindex_writer_close(writer);
+        return result;
+    }
+
+    writer->next_offset = offset + BINLOG_VINDEX_INTERVAL;
+    return 0;
+}
+
+void binlog_vindex_writer_close(BinlogVIndexWriter *writer)
+{
+    if (writer->fd >= 0) {
+        close(writer->fd);
+        writer->fd = -1;
+    }
+}
+
+static int write_entries(BinlogVIndexWriter *writer,
+        const BinlogVIndexEntry *entries, const int count)
+{
+    int bytes;
+    int result;
+
+    bytes = sizeof(BinlogVIndexEntry) * count;
+    if (fc_safe_write(writer->fd, (char *)entries, bytes) != bytes) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "write to index file \"%s\" fail, "
+                "errno: %d, error info: %s", __LINE__,
+                writer->filename, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+void binlog_vindex_writer_deal(BinlogVIndexWriter *writer,
+        const char *buff, const int len, const int64_t start_offset)
+{
+    BinlogVIndexEntry entries[BINLOG_VINDEX_WRITE_BATCH];
+    const char *p;
+    const char *end;
+    const char *rec_end;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+    int64_t data_version;
+    int64_t offset;
+    int count;
+
+    if (writer->fd < 0 || start_offset + len <= writer->next_offset) {
+        return;
+    }
+
+    count = 0;
+    p = buff;
+    end = buff + len;
+    while (p < end && binlog_detect_record(p, end - p, &data_version,
+                &rec_end, error_info, sizeof(error_info)) == 0)
+    {
+        offset = start_offset + (p - buff);
+        if (offset >= writer->next_offset) {
+            long2buff(data_version, entries[count].data_version);
+            long2buff(offset, entries[count].offset);
+            writer->next_offset = offset + BINLOG_VINDEX_INTERVAL;
+            if (++count == BINLOG_VINDEX_WRITE_BATCH) {
+                if (write_entries(writer, entries, count) != 0) {
+                    //the entries written are still valid, stop indexing
+                    binlog_vindex_writer_close(writer);
+                    return;
+                }
+                count = 0;
+            }
+        }
+
+        p = rec_end;
+    }
+
+    if (count > 0 && write_entries(writer, entries, count) != 0) {
+        binlog_vindex_writer_close(writer);
+    }
+}
+
+int binlog_vindex_find(const int binlog_index,
+        const int64_t data_version, int64_t *offset)
+{
+    char filename[PATH_MAX];
+    int64_t file_size;
+    int64_t low;
+    int64_t high;
+    int64_t mid;
+    int64_t entry_version;
+    int64_t entry_offset;
+    int fd;
+    int result;
+
+    *offset = 0;
+    GET_BINLOG_VINDEX_FILENAME(filename, sizeof(filename), binlog_index);
+    if ((fd=open(filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        if (result != ENOENT) {
+            logError("file: "__FILE__", line: %d, "
+                    "open file \"%s\" fail, errno: %d, error info: %s",
+                    __LINE__, filename, result, STRERROR(result));
+        }
+        return result;
+    }
+
+    if ((file_size=lseek(fd, 0, SEEK_END)) < 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "lseek file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        close(fd);
+        return result;
+    }
+
+    result = 0;
+    low = 0;
+    high = file_size / BINLOG_VINDEX_ENTRY_SIZE - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if ((result=read_entry(fd, filename, mid, &entry_version,
+                        &entry_offset)) != 0)
+        {
+            *offset = 0;
+            break;
+        }
+
+        if (entry_version <= data_version) {
+            *offset = entry_offset;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    close(fd);
+    return result;
+}
@@ -0,0 +1,60 @@
+//binlog_vindex.h
+
+#ifndef _BINLOG_VINDEX_H_
+#define _BINLOG_VINDEX_H_
+
+#include "binlog_types.h"
+#include "binlog_reader.h"
+
+#define BINLOG_VINDEX_FILE_EXT     ".vidx"
+#define BINLOG_VINDEX_INTERVAL     (64 * 1024)
+#define BINLOG_VINDEX_ENTRY_SIZE   16
+
+#define GET_BINLOG_VINDEX_FILENAME(filename, size, binlog_index) \
+    snprintf(filename, size, "%s/%s"BINLOG_FILE_EXT_FMT           \
+            BINLOG_VINDEX_FILE_EXT, DATA_PATH_STR,                \
+            BINLOG_FILE_PREFIX, binlog_index)
+
+/* the sparse data version index of a binlog file, one entry per
+ * BINLOG_VINDEX_INTERVAL bytes at least, the entry points to the
+ * first record start after the interval boundary.
+ *
+ * the index is only a hint for seeking: it is written after the binlog
+ * without fsync, the entries are sorted by both the data version and
+ * the offset, so a missing or short index only makes the seek slower.
+ */
+typedef struct binlog_vindex_entry {
+    char data_version[8];   //big-endian
+    char offset[8];         //big-endian
+} BinlogVIndexEntry;
+
+typedef struct binlog_vindex_writer {
+    char filename[PATH_MAX];
+    int fd;
+    int64_t next_offset;   //the binlog offset for the next entry
+} BinlogVIndexWriter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int binlog_vindex_writer_open(BinlogVIndexWriter *writer,
+        const int binlog_index, const bool create_new);
+
+void binlog_vindex_writer_close(BinlogVIndexWriter *writer);
+
+//called after the buffer written to the binlog at the start offset
+void binlog_vindex_writer_deal(BinlogVIndexWriter *writer,
+        const char *buff, const int len, const int64_t start_offset);
+
+/* get the offset of the last indexed record with version <= data_version,
+ * 0 for none, return ENOENT when the index file not exist
+ */
+int binlog_vindex_find(const int binlog_index,
+        const int64_t data_version, int64_t *offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
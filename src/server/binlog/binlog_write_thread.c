@@ -15,12 +15,14 @@
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/sched_thread.h"
+#include "sf/sf_nio.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
 #include "binlog_func.h"
 #include "binlog_pack.h"
 #include "binlog_reader.h"
 #include "binlog_producer.h"
+#include "binlog_vindex.h"
 #include "binlog_write_thread.h"
 
 #define BINLOG_FILE_MAX_SIZE   (1024 * 1024 * 1024)
@@ -34,12 +36,14 @@ typedef struct {
     int binlog_index;
     int binlog_compress_index;
     int file_size;
+    int file_format;  //the record format of the file, 0 for empty
     int fd;
     ServerBinlogBuffer binlog_buffer;
     struct common_blocked_queue queue;
+    BinlogVIndexWriter vindex;
 } BinlogWriterContext;
 
-static BinlogWriterContext writer_context = {{'\0'}, -1, 0, 0, -1};
+static BinlogWriterContext writer_context = {{'\0'}, -1, 0, 0, 0, -1};
 static volatile bool write_thread_running = false;
 struct common_blocked_queue *g_writer_queue = NULL;
 
@@ -101,7 +105,7 @@ static int get_binlog_index_from_file()
     return 0;
 }
 
-static int open_writable_binlog()
+static int open_writable_binlog(const bool create_new)
 {
     if (writer_context.fd >= 0) {
         close(writer_context.fd);
@@ -130,6 +134,23 @@ static int open_writable_binlog()
         return errno != 0 ? errno : EIO;
     }
 
+    writer_context.file_format = 0;
+    if (writer_context.file_size > 0) {
+        char ch;
+        if (pread(writer_context.fd, &ch, 1, 0) == 1) {
+            writer_context.file_format = binlog_get_buffer_format(&ch, 1);
+        }
+    }
+
+    //the binlog is available without the index, only the seeking slower
+    if (binlog_vindex_writer_open(&writer_context.vindex,
+                writer_context.binlog_index, create_new) != 0)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "binlog file \"%s\" without the data version index",
+                __LINE__, writer_context.filename);
+    }
+
     return 0;
 }
 
@@ -158,7 +179,7 @@ static int open_next_binlog()
         }
     }
 
-    return open_writable_binlog();
+    return open_writable_binlog(true);
 }
 
 static int do_write_to_file(char *buff, const int len)
@@ -184,9 +205,28 @@ static int do_write_to_file(char *buff, const int len)
     }
 
     writer_context.file_size += len;
+    binlog_vindex_writer_deal(&writer_context.vindex, buff, len,
+            writer_context.file_size - len);
     return 0;
 }
 
+static int rotate_binlog()
+{
+    int result;
+
+    writer_context.binlog_index++;  //binlog rotate
+    if ((result=write_to_binlog_index_file()) == 0) {
+        result = open_next_binlog();
+    }
+
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "open binlog file \"%s\" fail",
+                __LINE__, writer_context.filename);
+    }
+    return result;
+}
+
 static int check_write_to_file(char *buff, const int len)
 {
     int result;
@@ -224,15 +264,7 @@ static int check_write_to_file(char *buff, const int len)
         }
     }
 
-    writer_context.binlog_index++;  //binlog rotate
-    if ((result=write_to_binlog_index_file()) == 0) {
-        result = open_next_binlog();
-    }
-
-    if (result != 0) {
-        logError("file: "__FILE__", line: %d, "
-                "open binlog file \"%s\" fail",
-                __LINE__, writer_context.filename);
+    if ((result=rotate_binlog()) != 0) {
         return result;
     }
 
@@ -269,7 +301,8 @@ int binlog_write_thread_init()
         return result;
     }
 
-    return open_writable_binlog();
+    writer_context.vindex.fd = -1;
+    return open_writable_binlog(false);
 }
 
 int binlog_get_current_write_index()
@@ -290,6 +323,23 @@ void binlog_get_current_write_position(FDIRBinlogFilePosition *position)
 static inline int deal_binlog_one_record(ServerBinlogRecordBuffer *rb)
 {
     int result;
+    int format;
+
+    /* one binlog file holds the records of one format, the format
+     * changes by the config or the records from the master
+     */
+    format = binlog_get_buffer_format(rb->buffer.data, rb->buffer.length);
+    if (writer_context.file_format != 0 &&
+            writer_context.file_format != format)
+    {
+        if ((result=binlog_write_to_file()) != 0) {
+            return result;
+        }
+        if ((result=rotate_binlog()) != 0) {
+            return result;
+        }
+    }
+    writer_context.file_format = format;
 
     if (rb->buffer.length >= writer_context.binlog_buffer.size / 4) {
         if (BINLOG_BUFFER_LENGTH(writer_context.binlog_buffer) > 0) {
@@ -321,13 +371,40 @@ static inline int deal_binlog_one_record(ServerBinlogRecordBuffer *rb)
     return 0;
 }
 
+static void notify_waiting_task(ServerBinlogRecordBuffer *rb,
+        const int result)
+{
+    struct fast_task_info *task;
+
+    task = (struct fast_task_info *)rb->args;
+    if (rb->task_version != __sync_add_and_fetch(&((FDIRServerTaskArg *)
+                    task->arg)->task_version, 0))
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "task %p already cleanup", __LINE__, task);
+        return;
+    }
+
+    if (result != 0) {
+        __sync_bool_compare_and_swap(&((FDIRServerTaskArg *)task->arg)->
+                context.service.waiting_rpc_result, 0, result);
+    }
+    if (__sync_sub_and_fetch(&((FDIRServerTaskArg *)task->arg)->
+                context.service.waiting_rpc_count, 1) == 0)
+    {
+        sf_nio_notify(task, SF_NIO_STAGE_CONTINUE);
+    }
+}
+
 static int deal_binlog_records(struct common_blocked_node *node)
 {
+    struct common_blocked_node *head;
     ServerBinlogRecordBuffer *rb;
     int result;
     static int max_wait_count = 0;
     int wait_count;
 
+    head = node;
     do {
         rb = (ServerBinlogRecordBuffer *)node->data;
 
@@ -354,14 +431,32 @@ static int deal_binlog_records(struct common_blocked_node *node)
         }
 
         if ((result=deal_binlog_one_record(rb)) != 0) {
-            return result;
+            break;
+        }
+
+        node = node->next;
+    } while (node != NULL);
+
+    if (result == 0) {
+        result = binlog_write_to_file();
+    }
+
+    /* the records are written and fsynced, notify the waiting tasks,
+     * the tasks are notified with the error and the records are released
+     * too when the write fail
+     */
+    node = head;
+    do {
+        rb = (ServerBinlogRecordBuffer *)node->data;
+        if (rb->durability_level >= FDIR_DURABILITY_LEVEL_LOCAL) {
+            notify_waiting_task(rb, result);
         }
 
         rb->release_func(rb);
         node = node->next;
     } while (node != NULL);
 
-    return binlog_write_to_file();
+    return result;
 }
 
 void binlog_write_thread_finish()
@@ -393,6 +488,7 @@ void binlog_write_thread_finish()
         close(writer_context.fd);
         writer_context.fd = -1;
     }
+    binlog_vindex_writer_close(&writer_context.vindex);
 }
 
 void *binlog_write_thread_func(void *arg)
@@ -15,40 +15,66 @@
 #include "fastcommon/sched_thread.h"
 #include "sf/sf_nio.h"
 #include "sf/sf_global.h"
+#include "replica_quorum.h"
 #include "push_result_ring.h"
 
+#define PUSH_RESULT_RING_ENTRY(ctx, data_version) \
+    ((ctx)->ring.entries + ((data_version) & ((ctx)->ring.size - 1)))
+
+static int alloc_ring_entries(FDIRBinlogPushResultEntry **entries,
+        const int size)
+{
+    int64_t bytes;
+
+    bytes = sizeof(FDIRBinlogPushResultEntry) * (int64_t)size;
+    *entries = (FDIRBinlogPushResultEntry *)malloc(bytes);
+    if (*entries == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %"PRId64" bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(*entries, 0, bytes);
+    return 0;
+}
+
 int push_result_ring_check_init(FDIRBinlogPushResultContext *ctx,
         const int alloc_size)
 {
-    int bytes;
+    int result;
+    int size;
 
     if (ctx->ring.entries != NULL) {
         return 0;
     }
 
-    bytes = sizeof(FDIRBinlogPushResultEntry) * alloc_size;
-    ctx->ring.entries = (FDIRBinlogPushResultEntry *)malloc(bytes);
-    if (ctx->ring.entries == NULL) {
-        logError("file: "__FILE__", line: %d, "
-                "malloc %d bytes fail", __LINE__, bytes);
-        return ENOMEM;
+    size = 64;
+    while (size < alloc_size) {
+        size *= 2;
+    }
+    if ((result=alloc_ring_entries(&ctx->ring.entries, size)) != 0) {
+        return result;
     }
-    memset(ctx->ring.entries, 0, bytes);
-
-    ctx->ring.start = ctx->ring.end = ctx->ring.entries;
-    ctx->ring.size = alloc_size;
 
-    ctx->queue.head = ctx->queue.tail = NULL;
-    return fast_mblock_init_ex2(&ctx->queue.rentry_allocator,
-        "push_result", sizeof(FDIRBinlogPushResultEntry), 4096,
-        NULL, NULL, false, NULL, NULL, NULL);
+    ctx->ring.size = size;
+    ctx->ring.count = 0;
+    ctx->ring.start_version = ctx->ring.end_version = 0;
+    return fast_timer_init(&ctx->timer, 2 * SF_G_NETWORK_TIMEOUT + 1,
+            g_current_time);
 }
 
+/* result 0 for the slave acked, the timeout or the discarded one
+ * is NOT counted as an ack
+ */
 static inline void desc_task_waiting_rpc_count(
-        FDIRBinlogPushResultEntry *entry)
+        FDIRBinlogPushResultEntry *entry, const int result)
 {
     FDIRServerTaskArg *task_arg;
 
+    if (entry->quorum != NULL) {
+        replica_quorum_done(entry->quorum, result);
+        return;
+    }
+
     if (entry->waiting_task == NULL) {
         return;
     }
@@ -63,278 +89,209 @@ static inline void desc_task_waiting_rpc_count(
         return;
     }
 
-    if (__sync_sub_and_fetch(&((FDIRServerTaskArg *)
-                    entry->waiting_task->arg)->context.
+    if (result != 0) {
+        __sync_bool_compare_and_swap(&task_arg->context.
+                service.waiting_rpc_result, 0, result);
+    }
+    if (__sync_sub_and_fetch(&task_arg->context.
                 service.waiting_rpc_count, 1) == 0)
     {
         sf_nio_notify(entry->waiting_task, SF_NIO_STAGE_CONTINUE);
     }
 }
 
-static void push_result_ring_clear_queue_all(FDIRBinlogPushResultContext *ctx)
+//skip the free slots after the entry removed
+static void free_ring_entry(FDIRBinlogPushResultContext *ctx,
+        FDIRBinlogPushResultEntry *entry)
 {
-    FDIRBinlogPushResultEntry *current;
-    FDIRBinlogPushResultEntry *deleted;
-
-    if (ctx->queue.head == NULL) {
+    entry->data_version = 0;
+    entry->waiting_task = NULL;
+    entry->quorum = NULL;
+    if (--ctx->ring.count == 0) {
+        ctx->ring.start_version = ctx->ring.end_version = 0;
         return;
     }
 
-    current = ctx->queue.head;
-    while (current != NULL) {
-        deleted = current;
-        current = current->next;
-
-        desc_task_waiting_rpc_count(deleted);
-        fast_mblock_free_object(&ctx->queue.rentry_allocator, deleted);
+    while (PUSH_RESULT_RING_ENTRY(ctx, ctx->ring.start_version)->
+            data_version != ctx->ring.start_version)
+    {
+        ctx->ring.start_version++;
     }
-
-    ctx->queue.head = ctx->queue.tail = NULL;
 }
 
 void push_result_ring_clear_all(FDIRBinlogPushResultContext *ctx)
 {
-    int index;
-
-    if (ctx->ring.start == ctx->ring.end) {
-        push_result_ring_clear_queue_all(ctx);
-        return;
-    }
-
-    index = ctx->ring.start - ctx->ring.entries;
-    while (ctx->ring.start != ctx->ring.end) {
-        desc_task_waiting_rpc_count(ctx->ring.start);
-        ctx->ring.start->data_version = 0;
-        ctx->ring.start->waiting_task = NULL;
-
-        ctx->ring.start = ctx->ring.entries +
-            (++index % ctx->ring.size);
-    }
-
-    push_result_ring_clear_queue_all(ctx);
-}
-
-static int  push_result_ring_clear_queue_timeouts(
-        FDIRBinlogPushResultContext *ctx)
-{
-    FDIRBinlogPushResultEntry *current;
-    FDIRBinlogPushResultEntry *deleted;
-    int count;
-
-    if (ctx->queue.head == NULL) {
-        return 0;
-    }
-
-    if (ctx->queue.head->expires >= g_current_time) {
-        return 0;
-    }
-
-    count = 0;
-    current = ctx->queue.head;
-    while (current != NULL && current->expires < g_current_time) {
-        deleted = current;
-        current = current->next;
+    FDIRBinlogPushResultEntry *entry;
+    uint64_t data_version;
 
-        logWarning("file: "__FILE__", line: %d, "
-                "waiting push response timeout, "
-                "data_version: %"PRId64", task: %p",
-                __LINE__, deleted->data_version,
-                deleted->waiting_task);
-        desc_task_waiting_rpc_count(deleted);
-        fast_mblock_free_object(&ctx->queue.rentry_allocator, deleted);
-        ++count;
-    }
+    for (data_version=ctx->ring.start_version; ctx->ring.count > 0 &&
+            data_version<ctx->ring.end_version; data_version++)
+    {
+        entry = PUSH_RESULT_RING_ENTRY(ctx, data_version);
+        if (entry->data_version != data_version) {
+            continue;
+        }
 
-    ctx->queue.head = current;
-    if (current == NULL) {
-        ctx->queue.tail = NULL;
+        fast_timer_remove(&ctx->timer, &entry->timer);
+        desc_task_waiting_rpc_count(entry, ECONNRESET);
+        entry->data_version = 0;
+        entry->waiting_task = NULL;
+        entry->quorum = NULL;
+        ctx->ring.count--;
     }
 
-    return count;
+    ctx->ring.count = 0;
+    ctx->ring.start_version = ctx->ring.end_version = 0;
 }
 
 void push_result_ring_clear_timeouts(FDIRBinlogPushResultContext *ctx)
 {
-    int index;
+    FastTimerEntry head;
+    FastTimerEntry *current;
+    FDIRBinlogPushResultEntry *entry;
     int clear_count;
 
     if (ctx->last_check_timeout_time == g_current_time) {
         return;
     }
 
-    clear_count = 0;
     ctx->last_check_timeout_time = g_current_time;
-    if (ctx->ring.start != ctx->ring.end) {
-        index = ctx->ring.start - ctx->ring.entries;
-        while (ctx->ring.start != ctx->ring.end &&
-                ctx->ring.start->expires < g_current_time)
-        {
-            logWarning("file: "__FILE__", line: %d, "
-                    "waiting push response timeout, "
-                    "data_version: %"PRId64", task: %p",
-                    __LINE__, ctx->ring.start->data_version,
-                    ctx->ring.start->waiting_task);
-
-            desc_task_waiting_rpc_count(ctx->ring.start);
-            ctx->ring.start->data_version = 0;
-            ctx->ring.start->waiting_task = NULL;
-
-            ctx->ring.start = ctx->ring.entries +
-                (++index % ctx->ring.size);
-            ++clear_count;
-        }
+    if (fast_timer_timeouts_get(&ctx->timer, g_current_time, &head) == 0) {
+        return;
     }
 
-    clear_count += push_result_ring_clear_queue_timeouts(ctx);
-    if (clear_count > 0) {
+    clear_count = 0;
+    current = head.next;
+    while (current != NULL) {
+        entry = (FDIRBinlogPushResultEntry *)current;
+        current = current->next;
+
         logWarning("file: "__FILE__", line: %d, "
-                "clear timeout push response waiting entries count: %d",
-                __LINE__, clear_count);
+                "waiting push response timeout, "
+                "data_version: %"PRId64", task: %p",
+                __LINE__, entry->data_version,
+                entry->waiting_task);
+        desc_task_waiting_rpc_count(entry, ETIMEDOUT);
+        free_ring_entry(ctx, entry);
+        ++clear_count;
     }
+
+    logWarning("file: "__FILE__", line: %d, "
+            "clear timeout push response waiting entries count: %d",
+            __LINE__, clear_count);
 }
 
 void push_result_ring_destroy(FDIRBinlogPushResultContext *ctx)
 {
     if (ctx->ring.entries != NULL) {
         free(ctx->ring.entries);
-        ctx->ring.start = ctx->ring.end = ctx->ring.entries = NULL;
+        ctx->ring.entries = NULL;
         ctx->ring.size = 0;
+        ctx->ring.count = 0;
+        ctx->ring.start_version = ctx->ring.end_version = 0;
+        fast_timer_destroy(&ctx->timer);
     }
-
-    fast_mblock_destroy(&ctx->queue.rentry_allocator);
 }
 
-static int add_to_queue(FDIRBinlogPushResultContext *ctx,
-            const uint64_t data_version, struct fast_task_info *waiting_task,
-            const int64_t task_version)
+/* grow the ring for the version span, the waiting entries are moved
+ * to the new ring and re-added to the timer because of the address change
+ */
+static int grow_ring(FDIRBinlogPushResultContext *ctx,
+        const uint64_t span)
 {
+    FDIRBinlogPushResultEntry *entries;
+    FDIRBinlogPushResultEntry *old;
     FDIRBinlogPushResultEntry *entry;
-    FDIRBinlogPushResultEntry *previous;
-    FDIRBinlogPushResultEntry *current;
-
-    entry = (FDIRBinlogPushResultEntry *)fast_mblock_alloc_object(
-            &ctx->queue.rentry_allocator);
-    if (entry == NULL) {
-        return ENOMEM;
-    }
-
-    entry->data_version = data_version;
-    entry->waiting_task = waiting_task;
-    entry->task_version = task_version;
-    entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
-
-    if (ctx->queue.tail == NULL) {  //empty queue
-        entry->next = NULL;
-        ctx->queue.head = ctx->queue.tail = entry;
-        return 0;
+    FDIRBinlogPushResultEntry *end;
+    int result;
+    int size;
+
+    size = ctx->ring.size;
+    while ((uint64_t)size < span) {
+        if (size >= INT_MAX / 2) {
+            logError("file: "__FILE__", line: %d, "
+                    "the version span: %"PRId64" is too large",
+                    __LINE__, (int64_t)span);
+            return EOVERFLOW;
+        }
+        size *= 2;
     }
-
-    if (data_version > ctx->queue.tail->data_version) {
-        entry->next = NULL;
-        ctx->queue.tail->next = entry;
-        ctx->queue.tail = entry;
-        return 0;
+    if ((result=alloc_ring_entries(&entries, size)) != 0) {
+        return result;
     }
 
-    if (data_version < ctx->queue.head->data_version) {
-        entry->next = ctx->queue.head;
-        ctx->queue.head = entry;
-        return 0;
-    }
+    logWarning("file: "__FILE__", line: %d, "
+            "the version span: %"PRId64" exceeds the ring size: %d, "
+            "grow the ring size to %d", __LINE__, (int64_t)span,
+            ctx->ring.size, size);
+
+    old = ctx->ring.entries;
+    end = old + ctx->ring.size;
+    ctx->ring.entries = entries;
+    ctx->ring.size = size;
+    for (entry=old; entry<end; entry++) {
+        if (entry->data_version == 0) {
+            continue;
+        }
 
-    previous = ctx->queue.head;
-    current = ctx->queue.head->next;
-    while (current != NULL && data_version > current->data_version) {
-        previous = current;
-        current = current->next;
+        fast_timer_remove(&ctx->timer, &entry->timer);
+        *PUSH_RESULT_RING_ENTRY(ctx, entry->data_version) = *entry;
+        fast_timer_add(&ctx->timer, &PUSH_RESULT_RING_ENTRY(ctx,
+                    entry->data_version)->timer);
     }
 
-    entry->next = previous->next;
-    previous->next = entry;
+    free(old);
     return 0;
 }
 
 int push_result_ring_add(FDIRBinlogPushResultContext *ctx,
         const uint64_t data_version, struct fast_task_info *waiting_task,
-        const int64_t task_version)
-{
-    FDIRBinlogPushResultEntry *entry;
-    FDIRBinlogPushResultEntry *previous;
-    FDIRBinlogPushResultEntry *next;
-    int index;
-    bool matched;
-
-    matched = false;
-    index = data_version % ctx->ring.size;
-    entry = ctx->ring.entries + index;
-    if (ctx->ring.end == ctx->ring.start) {  //empty
-        ctx->ring.start = entry;
-        ctx->ring.end = ctx->ring.entries + (index + 1) % ctx->ring.size;
-        matched = true;
-    } else if (entry == ctx->ring.end) {
-        previous = ctx->ring.entries + (index + ctx->ring.size - 1) %
-            ctx->ring.size;
-        next = ctx->ring.entries + (index + 1) % ctx->ring.size;
-        if ((next != ctx->ring.start) &&
-                data_version == previous->data_version + 1)
-        {
-            ctx->ring.end = next;
-            matched = true;
-        }
-    }
-
-    if (matched) {
-        entry->data_version = data_version;
-        entry->waiting_task = waiting_task;
-        entry->task_version = task_version;
-        entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
-        return 0;
-    }
-
-    logWarning("file: "__FILE__", line: %d, "
-            "can't found data version %"PRId64", in the ring",
-            __LINE__, data_version);
-    return add_to_queue(ctx, data_version, waiting_task, task_version);
-}
-
-static int remove_from_queue(FDIRBinlogPushResultContext *ctx,
-        const uint64_t data_version)
+        const int64_t task_version, FDIRReplicaQuorum *quorum)
 {
     FDIRBinlogPushResultEntry *entry;
-    FDIRBinlogPushResultEntry *previous;
-    FDIRBinlogPushResultEntry *current;
+    uint64_t start_version;
+    uint64_t end_version;
+    int result;
 
-    if (ctx->queue.head == NULL) {  //empty queue
-        return ENOENT;
+    if (ctx->ring.count == 0) {
+        start_version = data_version;
+        end_version = data_version + 1;
+    } else {
+        start_version = (data_version < ctx->ring.start_version) ?
+            data_version : ctx->ring.start_version;
+        end_version = (data_version >= ctx->ring.end_version) ?
+            data_version + 1 : ctx->ring.end_version;
     }
 
-    if (data_version == ctx->queue.head->data_version) {
-        entry = ctx->queue.head;
-        ctx->queue.head = entry->next;
-        if (ctx->queue.head == NULL) {
-            ctx->queue.tail = NULL;
-        }
-    } else {
-        previous = ctx->queue.head;
-        current = ctx->queue.head->next;
-        while (current != NULL && data_version > current->data_version) {
-            previous = current;
-            current = current->next;
+    if (end_version - start_version > (uint64_t)ctx->ring.size) {
+        if ((result=grow_ring(ctx, end_version - start_version)) != 0) {
+            return result;
         }
+    }
 
-        if (current == NULL || data_version != current->data_version) {
-            return ENOENT;
-        }
+    entry = PUSH_RESULT_RING_ENTRY(ctx, data_version);
+    if (entry->data_version != 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data version %"PRId64" already exist",
+                __LINE__, data_version);
+        return EEXIST;
+    }
 
-        entry = current;
-        previous->next = current->next;
-        if (ctx->queue.tail == current) {
-            ctx->queue.tail = previous;
-        }
+    entry->data_version = data_version;
+    entry->waiting_task = waiting_task;
+    entry->task_version = task_version;
+    entry->quorum = quorum;
+    entry->timer.expires = g_current_time + SF_G_NETWORK_TIMEOUT;
+    if ((result=fast_timer_add(&ctx->timer, &entry->timer)) != 0) {
+        entry->data_version = 0;
+        entry->waiting_task = NULL;
+        entry->quorum = NULL;
+        return result;
     }
 
-    desc_task_waiting_rpc_count(entry);
-    fast_mblock_free_object(&ctx->queue.rentry_allocator, entry);
+    ctx->ring.start_version = start_version;
+    ctx->ring.end_version = end_version;
+    ctx->ring.count++;
     return 0;
 }
 
@@ -342,30 +299,20 @@ int push_result_ring_remove(FDIRBinlogPushResultContext *ctx,
         const uint64_t data_version)
 {
     FDIRBinlogPushResultEntry *entry;
-    int index;
-
-    if (ctx->ring.end != ctx->ring.start) {
-        index = data_version % ctx->ring.size;
-        entry = ctx->ring.entries + index;
-
-        if (entry->data_version == data_version) {
-            if (ctx->ring.start == entry) {
-                ctx->ring.start = ctx->ring.entries +
-                    (++index % ctx->ring.size);
-                while (ctx->ring.start != ctx->ring.end &&
-                        ctx->ring.start->data_version == 0)
-                {
-                    ctx->ring.start = ctx->ring.entries +
-                        (++index % ctx->ring.size);
-                }
-            }
-
-            desc_task_waiting_rpc_count(entry);
-            entry->data_version = 0;
-            entry->waiting_task = NULL;
-            return 0;
-        }
+
+    if (ctx->ring.count == 0 || data_version < ctx->ring.start_version ||
+            data_version >= ctx->ring.end_version)
+    {
+        return ENOENT;
     }
 
-    return remove_from_queue(ctx, data_version);
+    entry = PUSH_RESULT_RING_ENTRY(ctx, data_version);
+    if (entry->data_version != data_version) {
+        return ENOENT;
+    }
+
+    fast_timer_remove(&ctx->timer, &entry->timer);
+    desc_task_waiting_rpc_count(entry, 0);
+    free_ring_entry(ctx, entry);
+    return 0;
 }
@@ -16,7 +16,7 @@ void push_result_ring_destroy(FDIRBinlogPushResultContext *ctx);
 
 int push_result_ring_add(FDIRBinlogPushResultContext *ctx,
         const uint64_t data_version, struct fast_task_info *waiting_task,
-        const int64_t task_version);
+        const int64_t task_version, FDIRReplicaQuorum *quorum);
 
 int push_result_ring_remove(FDIRBinlogPushResultContext *ctx,
         const uint64_t data_version);
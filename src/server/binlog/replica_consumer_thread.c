@@ -19,10 +19,12 @@
 #include "sf/sf_nio.h"
 #include "common/fdir_proto.h"
 #include "../server_global.h"
+#include "../service_handler.h"
 #include "binlog_func.h"
 #include "binlog_reader.h"
 #include "binlog_producer.h"
 #include "binlog_write_thread.h"
+#include "binlog_local_consumer.h"
 #include "replica_consumer_thread.h"
 
 static void *deal_binlog_thread_func(void *arg);
@@ -39,6 +41,7 @@ static void release_record_buffer(ServerBinlogRecordBuffer *rbuffer)
                 */
 
         ctx = (ReplicaConsumerThreadContext *)rbuffer->args;
+        __sync_add_and_fetch(&ctx->free_count, 1);
         common_blocked_queue_push_ex(&ctx->queues.free, rbuffer, &notify);
         if (notify) {
             iovent_notify_thread(ctx->task->thread_data);
@@ -46,13 +49,23 @@ static void release_record_buffer(ServerBinlogRecordBuffer *rbuffer)
     }
 }
 
+static void release_replayed_buffer(void *args, void *buffer_args)
+{
+    ServerBinlogRecordBuffer *rb;
+
+    rb = (ServerBinlogRecordBuffer *)buffer_args;
+    rb->release_func(rb);
+}
+
 static int alloc_record_buffer(ServerBinlogRecordBuffer *rb,
         const int buffer_size)
 {
     rb->release_func = release_record_buffer;
+    rb->durability_level = FDIR_DURABILITY_LEVEL_MEMORY;  //no task to notify
     return fast_buffer_init_ex(&rb->buffer, buffer_size);
 }
 
+//called in the binlog order, so the results are responded in order
 static void replay_done_callback(const int result,
         FDIRBinlogRecord *record, void *args)
 {
@@ -61,6 +74,12 @@ static void replay_done_callback(const int result,
     bool notify;
 
     ctx = (ReplicaConsumerThreadContext *)args;
+    //the records before are all applied for the slave reads
+    if (record->data_version > DATA_APPLIED_VERSION) {
+        DATA_APPLIED_VERSION = record->data_version;
+        service_read_waiting_notify(false);
+    }
+
     r = fast_mblock_alloc_object(&ctx->result_allocater);
     if (r != NULL) {
         r->err_no = result;
@@ -75,8 +94,6 @@ static void replay_done_callback(const int result,
 ReplicaConsumerThreadContext *replica_consumer_thread_init(
         struct fast_task_info *task, const int buffer_size, int *err_no)
 {
-#define BINLOG_REPLAY_BATCH_SIZE  32
-
     ReplicaConsumerThreadContext *ctx;
     ServerBinlogRecordBuffer *rbuffer;
     int i;
@@ -93,6 +110,7 @@ ReplicaConsumerThreadContext *replica_consumer_thread_init(
     }
 
     memset(ctx, 0, sizeof(ReplicaConsumerThreadContext));
+    DATA_APPLIED_VERSION = DATA_CURRENT_VERSION;
     if ((*err_no=fast_mblock_init_ex2(&ctx->result_allocater,
                     "process_result", sizeof(RecordProcessResult), 8192,
                     NULL, NULL, true, NULL, NULL, NULL)) != 0)
@@ -104,9 +122,9 @@ ReplicaConsumerThreadContext *replica_consumer_thread_init(
     ctx->continue_flag = true;
     ctx->task = task;
 
-    if ((*err_no=binlog_replay_init_ex(&ctx->replay_ctx,
-                    replay_done_callback, ctx,
-                    BINLOG_REPLAY_BATCH_SIZE)) != 0)
+    if ((*err_no=binlog_replay_pipeline_init_ex(&ctx->pipeline,
+                    BINLOG_PARSE_THREADS, release_replayed_buffer, ctx,
+                    replay_done_callback, ctx)) != 0)
     {
         return NULL;
     }
@@ -139,6 +157,7 @@ ReplicaConsumerThreadContext *replica_consumer_thread_init(
 
     ctx->recv_rbuffer = (ServerBinlogRecordBuffer *)common_blocked_queue_pop(
                 &ctx->queues.free);
+    ctx->free_count = REPLICA_CONSUMER_THREAD_INPUT_BUFFER_COUNT - 1;
 
     if ((*err_no=fc_create_thread(&ctx->tids[0], deal_binlog_thread_func,
         ctx, SF_G_THREAD_STACK_SIZE)) != 0)
@@ -168,6 +187,9 @@ void replica_consumer_thread_terminate(ReplicaConsumerThreadContext *ctx)
         logWarning("file: "__FILE__", line: %d, "
                 "wait thread exit timeout", __LINE__);
     }
+
+    //the records in the data threads refer to the pipeline and the buffers
+    binlog_replay_pipeline_wait_done(&ctx->pipeline);
     for (i=0; i<REPLICA_CONSUMER_THREAD_BUFFER_COUNT; i++) {
         fast_buffer_destroy(&ctx->binlog_buffers[i].buffer);
     }
@@ -176,7 +198,7 @@ void replica_consumer_thread_terminate(ReplicaConsumerThreadContext *ctx)
     common_blocked_queue_destroy(&ctx->queues.input);
     common_blocked_queue_destroy(&ctx->queues.result);
 
-    binlog_replay_destroy(&ctx->replay_ctx);
+    binlog_replay_pipeline_destroy(&ctx->pipeline);
     fast_mblock_destroy(&ctx->result_allocater);
 
     free(ctx);
@@ -184,6 +206,19 @@ void replica_consumer_thread_terminate(ReplicaConsumerThreadContext *ctx)
             "replica_consumer_thread_terminated", __LINE__);
 }
 
+static inline ServerBinlogRecordBuffer *pop_free_record_buffer(
+        ReplicaConsumerThreadContext *ctx)
+{
+    ServerBinlogRecordBuffer *rb;
+
+    rb = (ServerBinlogRecordBuffer *)common_blocked_queue_pop_ex(
+            &ctx->queues.free, false);
+    if (rb != NULL) {
+        __sync_sub_and_fetch(&ctx->free_count, 1);
+    }
+    return rb;
+}
+
 static inline int push_to_replica_consumer_queues(
         ReplicaConsumerThreadContext *ctx,
         ServerBinlogRecordBuffer *rbuffer)
@@ -199,6 +234,14 @@ static inline int push_to_replica_consumer_queues(
         return result;
     }
 
+    if ((result=binlog_local_consumer_push_to_relay_queues(rbuffer)) != 0) {
+        logCrit("file: "__FILE__", line: %d, "
+                "push to relay queues fail, program exit!",
+                __LINE__);
+        SF_G_CONTINUE_FLAG = false;
+        return result;
+    }
+
     return common_blocked_queue_push(&ctx->queues.input, rbuffer);
 }
 
@@ -213,6 +256,7 @@ static inline int push_and_set_next_recv_buffer(
     if ((result=push_to_replica_consumer_queues(ctx,
                     ctx->recv_rbuffer)) != 0)
     {
+        __sync_add_and_fetch(&ctx->free_count, 1);
         common_blocked_queue_push(&ctx->queues.free, rb);
         return result;
     }
@@ -256,8 +300,7 @@ int deal_replica_push_request(ReplicaConsumerThreadContext *ctx,
             binlog_buff, length);
     ctx->recv_rbuffer->buffer.length += length;
 
-    rb = (ServerBinlogRecordBuffer *)common_blocked_queue_pop_ex(
-                &ctx->queues.free, false);
+    rb = pop_free_record_buffer(ctx);
     if (rb != NULL) {
         return push_and_set_next_recv_buffer(ctx, rb);
     }
@@ -268,8 +311,7 @@ int deal_replica_push_request(ReplicaConsumerThreadContext *ctx,
 
     waiting_count = 0;
     while (ctx->continue_flag) {
-        rb = (ServerBinlogRecordBuffer *)common_blocked_queue_pop_ex(
-                &ctx->queues.free, false);
+        rb = pop_free_record_buffer(ctx);
         if (rb != NULL) {
             break;
         }
@@ -296,8 +338,7 @@ static inline int check_retry_push_request(ReplicaConsumerThreadContext *ctx)
     ServerBinlogRecordBuffer *rb;
 
     if (ctx->recv_rbuffer->buffer.length > 0) {
-        rb = (ServerBinlogRecordBuffer *)common_blocked_queue_pop_ex(
-                &ctx->queues.free, false);
+        rb = pop_free_record_buffer(ctx);
         if (rb != NULL) {
             return push_and_set_next_recv_buffer(ctx, rb);
         }
@@ -362,6 +403,9 @@ static int deal_replica_push_result(ReplicaConsumerThreadContext *ctx)
 
     int2buff(count, ((FDIRProtoPushBinlogRespBodyHeader *)
                 (ctx->task->data + sizeof(FDIRProtoHeader)))->count);
+    int2buff(__sync_add_and_fetch(&ctx->free_count, 0),
+            ((FDIRProtoPushBinlogRespBodyHeader *)(ctx->task->data +
+                sizeof(FDIRProtoHeader)))->credits);
 
     ctx->task->length = p - ctx->task->data;
     FDIR_PROTO_SET_HEADER((FDIRProtoHeader *)ctx->task->data,
@@ -387,6 +431,7 @@ static void *deal_binlog_thread_func(void *arg)
     struct common_blocked_node *node;
     struct common_blocked_node *current;
     ServerBinlogRecordBuffer *rb;
+    int result;
 
     logInfo("file: "__FILE__", line: %d, "
             "deal_binlog_thread_func start", __LINE__);
@@ -407,10 +452,16 @@ static void *deal_binlog_thread_func(void *arg)
              */
 
             rb = (ServerBinlogRecordBuffer *)current->data;
-            binlog_replay_deal_buffer(&ctx->replay_ctx,
-                    rb->buffer.data, rb->buffer.length, NULL);
-
-            rb->release_func(rb);
+            if ((result=binlog_replay_pipeline_deal_buffer(&ctx->pipeline,
+                            rb->buffer.data, rb->buffer.length,
+                            NULL, rb)) != 0)
+            {
+                logError("file: "__FILE__", line: %d, "
+                        "replay binlog fail, buffer length: %d, "
+                        "errno: %d, error info: %s", __LINE__,
+                        rb->buffer.length, result, STRERROR(result));
+                rb->release_func(rb);
+            }
             current = current->next;
         } while (current != NULL);
         common_blocked_queue_free_all_nodes(&ctx->queues.input, node);
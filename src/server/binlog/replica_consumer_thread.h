@@ -5,7 +5,7 @@
 
 #include "fastcommon/fast_mblock.h"
 #include "binlog_types.h"
-#include "binlog_replay.h"
+#include "binlog_replay_pipeline.h"
 
 #define REPLICA_CONSUMER_THREAD_INPUT_BUFFER_COUNT   64
 #define REPLICA_CONSUMER_THREAD_BUFFER_COUNT      \
@@ -30,8 +30,9 @@ typedef struct replica_consumer_thread_context {
 
     struct fast_task_info *task;
     ServerBinlogRecordBuffer *recv_rbuffer;
+    volatile int free_count;  //as the credits to the master
 
-    BinlogReplayContext replay_ctx;
+    BinlogReplayPipeline pipeline;  //parse and apply in parallel
 } ReplicaConsumerThreadContext;
 
 #ifdef __cplusplus
@@ -0,0 +1,135 @@
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/fast_mblock.h"
+#include "sf/sf_nio.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "replica_quorum.h"
+
+static struct {
+    int slave_count;
+    int quorum;   //the slave count to ack
+    struct fast_mblock_man allocator;
+} replica_quorum_ctx = {0, 0};
+
+int replica_quorum_calc(const int slave_count)
+{
+    int quorum;
+
+    switch (DURABILITY_REPLICA_QUORUM) {
+        case FDIR_REPLICA_QUORUM_ALL:
+            quorum = slave_count;
+            break;
+        case FDIR_REPLICA_QUORUM_MAJORITY:
+            //the master and the acked slaves are the majority
+            quorum = (slave_count + 1) / 2;
+            break;
+        default:
+            quorum = DURABILITY_REPLICA_QUORUM;
+            break;
+    }
+
+    return quorum > slave_count ? slave_count : quorum;
+}
+
+int replica_quorum_init(const int slave_count)
+{
+    replica_quorum_ctx.slave_count = slave_count;
+    replica_quorum_ctx.quorum = replica_quorum_calc(slave_count);
+
+    logInfo("file: "__FILE__", line: %d, "
+            "slave count: %d, replica quorum: %d", __LINE__,
+            slave_count, replica_quorum_ctx.quorum);
+    if (replica_quorum_ctx.quorum == slave_count) {
+        return 0;
+    }
+
+    return fast_mblock_init_ex2(&replica_quorum_ctx.allocator,
+            "replica_quorum", sizeof(FDIRReplicaQuorum), 4096,
+            NULL, NULL, true, NULL, NULL, NULL);
+}
+
+int replica_quorum_get_count()
+{
+    return replica_quorum_ctx.quorum;
+}
+
+FDIRReplicaQuorum *replica_quorum_alloc(struct fast_task_info *task,
+        const int64_t task_version)
+{
+    FDIRReplicaQuorum *quorum;
+
+    if (replica_quorum_ctx.quorum == replica_quorum_ctx.slave_count) {
+        return NULL;
+    }
+
+    quorum = (FDIRReplicaQuorum *)fast_mblock_alloc_object(
+            &replica_quorum_ctx.allocator);
+    if (quorum == NULL) {
+        logWarning("file: "__FILE__", line: %d, "
+                "alloc replica quorum fail, wait for all slaves",
+                __LINE__);
+        return NULL;
+    }
+
+    quorum->done_count = 0;
+    quorum->fail_count = 0;
+    quorum->reffer_count = replica_quorum_ctx.slave_count;
+    quorum->waiting_task = task;
+    quorum->task_version = task_version;
+    return quorum;
+}
+
+static void notify_waiting_task(FDIRReplicaQuorum *quorum,
+        const int result)
+{
+    FDIRServerTaskArg *task_arg;
+
+    task_arg = (FDIRServerTaskArg *)quorum->waiting_task->arg;
+    if (quorum->task_version != __sync_add_and_fetch(
+                &task_arg->task_version, 0))
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "task %p already cleanup",
+                __LINE__, quorum->waiting_task);
+        return;
+    }
+
+    if (result != 0) {
+        __sync_bool_compare_and_swap(&task_arg->context.
+                service.waiting_rpc_result, 0, result);
+    }
+    if (__sync_sub_and_fetch(&task_arg->context.
+                service.waiting_rpc_count, 1) == 0)
+    {
+        sf_nio_notify(quorum->waiting_task, SF_NIO_STAGE_CONTINUE);
+    }
+}
+
+void replica_quorum_done(FDIRReplicaQuorum *quorum, const int result)
+{
+    if (result == 0) {
+        //only the one reaching the quorum notifies the task
+        if (__sync_add_and_fetch(&quorum->done_count, 1) ==
+                replica_quorum_ctx.quorum)
+        {
+            notify_waiting_task(quorum, 0);
+        }
+    } else {
+        //only the one making the quorum unreachable notifies the task
+        if (__sync_add_and_fetch(&quorum->fail_count, 1) ==
+                replica_quorum_ctx.slave_count -
+                replica_quorum_ctx.quorum + 1)
+        {
+            notify_waiting_task(quorum, result);
+        }
+    }
+
+    if (__sync_sub_and_fetch(&quorum->reffer_count, 1) == 0) {
+        fast_mblock_free_object(&replica_quorum_ctx.allocator, quorum);
+    }
+}
@@ -0,0 +1,39 @@
+//replica_quorum.h
+
+#ifndef _REPLICA_QUORUM_H_
+#define _REPLICA_QUORUM_H_
+
+#include "binlog_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the slave count to ack of the slave count by the config, every server
+ * gets the same one, so it is used by the election too
+ */
+int replica_quorum_calc(const int slave_count);
+
+//the slave count to ack, init before the replications start
+int replica_quorum_init(const int slave_count);
+
+//the slave count to ack
+int replica_quorum_get_count();
+
+/* alloc the quorum for the write of the waiting task,
+ * return NULL when waiting all slaves
+ */
+FDIRReplicaQuorum *replica_quorum_alloc(struct fast_task_info *task,
+        const int64_t task_version);
+
+/* called once by every slave replication, result 0 for the write acked,
+ * != 0 for timeout or discarded, the task is notified when the quorum
+ * reached, or with the error when the quorum can NOT be reached
+ */
+void replica_quorum_done(FDIRReplicaQuorum *quorum, const int result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
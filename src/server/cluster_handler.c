@@ -30,7 +30,10 @@
 #include "server_func.h"
 #include "dentry.h"
 #include "server_binlog.h"
+#include "cluster_info.h"
 #include "cluster_relationship.h"
+#include "data_dumper.h"
+#include "data_fetcher.h"
 #include "cluster_handler.h"
 
 int cluster_handler_init()
@@ -43,11 +46,31 @@ int cluster_handler_destroy()
     return 0;
 }
 
+//the servers relayed by the peer can't be reported anymore
+static void set_relayed_servers_offline(FDIRClusterServerInfo *relay)
+{
+    FDIRClusterServerInfo *cs;
+    FDIRClusterServerInfo *end;
+
+    end = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
+    for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++) {
+        if (cs->upstream == relay && cluster_info_get_source(cs) == relay &&
+                (cs->status == FDIR_SERVER_STATUS_SYNCING ||
+                 cs->status == FDIR_SERVER_STATUS_ACTIVE))
+        {
+            cluster_info_set_status(cs, FDIR_SERVER_STATUS_OFFLINE);
+        }
+    }
+}
+
 void cluster_task_finish_cleanup(struct fast_task_info *task)
 {
     switch (CLUSTER_TASK_TYPE) {
         case FDIR_CLUSTER_TASK_TYPE_RELATIONSHIP:
             if (CLUSTER_PEER != NULL) {
+                if (MYSELF_IS_MASTER) {
+                    set_relayed_servers_offline(CLUSTER_PEER);
+                }
                 CLUSTER_PEER = NULL;
             }
             CLUSTER_TASK_TYPE = FDIR_CLUSTER_TASK_TYPE_NONE;
@@ -192,20 +215,76 @@ static int cluster_deal_join_master(struct fast_task_info *task)
     }
 
     memcpy(peer->key, req->key, FDIR_REPLICA_KEY_SIZE);
+    if (cluster_info_get_source(peer) != CLUSTER_MYSELF_PTR) {
+        //push the new key to the relay by the ping
+        __sync_add_and_fetch(&CLUSTER_SERVER_ARRAY.change_version, 1);
+    }
     CLUSTER_TASK_TYPE = FDIR_CLUSTER_TASK_TYPE_RELATIONSHIP;
     CLUSTER_PEER = peer;
     return 0;
 }
 
+static int check_ping_master_req_body(struct fast_task_info *task,
+        int *server_count)
+{
+    FDIRProtoPingMasterReqHeader *req_header;
+    int expect_len;
+
+    if (REQUEST.header.body_len == 0) {
+        *server_count = 0;
+        return 0;
+    }
+
+    req_header = (FDIRProtoPingMasterReqHeader *)REQUEST.body;
+    if (REQUEST.header.body_len < sizeof(FDIRProtoPingMasterReqHeader)) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "request body length: %d is too short",
+                REQUEST.header.body_len);
+        return EINVAL;
+    }
+
+    *server_count = buff2int(req_header->server_count);
+    expect_len = sizeof(FDIRProtoPingMasterReqHeader) + *server_count *
+        sizeof(FDIRProtoPingMasterReqBodyPart);
+    if (REQUEST.header.body_len != expect_len) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "request body length: %d != expect: %d, server count: %d",
+                REQUEST.header.body_len, expect_len, *server_count);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+//the statuses of the servers relayed by the peer
+static void ping_master_set_relayed_status(struct fast_task_info *task,
+        const int server_count)
+{
+    FDIRProtoPingMasterReqBodyPart *body_part;
+    FDIRProtoPingMasterReqBodyPart *body_end;
+    FDIRClusterServerInfo *cs;
+
+    body_part = (FDIRProtoPingMasterReqBodyPart *)(REQUEST.body +
+            sizeof(FDIRProtoPingMasterReqHeader));
+    body_end = body_part + server_count;
+    for (; body_part < body_end; body_part++) {
+        cs = fdir_get_server_by_id(buff2int(body_part->server_id));
+        if (cs != NULL && cluster_info_get_source(cs) == CLUSTER_PEER) {
+            cluster_info_set_status(cs, body_part->status);
+        }
+    }
+}
+
 static int cluster_deal_ping_master(struct fast_task_info *task)
 {
     int result;
+    int server_count;
     FDIRProtoPingMasterRespHeader *resp_header;
     FDIRProtoPingMasterRespBodyPart *body_part;
     FDIRClusterServerInfo *cs;
     FDIRClusterServerInfo *end;
 
-    if ((result=server_expect_body_length(task, 0)) != 0) {
+    if ((result=check_ping_master_req_body(task, &server_count)) != 0) {
         return result;
     }
 
@@ -223,6 +302,11 @@ static int cluster_deal_ping_master(struct fast_task_info *task)
         return EINVAL;
     }
 
+    //before the request body overwritten by the response
+    if (server_count > 0) {
+        ping_master_set_relayed_status(task, server_count);
+    }
+
     resp_header = (FDIRProtoPingMasterRespHeader *)REQUEST.body;
     body_part = (FDIRProtoPingMasterRespBodyPart *)(REQUEST.body +
             sizeof(FDIRProtoPingMasterRespHeader));
@@ -235,6 +319,13 @@ static int cluster_deal_ping_master(struct fast_task_info *task)
         for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++, body_part++) {
             int2buff(cs->server->id, body_part->server_id);
             body_part->status = cs->status;
+            if (cs != CLUSTER_PEER && cluster_info_get_source(cs) ==
+                    CLUSTER_PEER)
+            {
+                memcpy(body_part->key, cs->key, FDIR_REPLICA_KEY_SIZE);
+            } else {
+                memset(body_part->key, 0, FDIR_REPLICA_KEY_SIZE);
+            }
         }
     } else {
         int2buff(0, resp_header->server_count);
@@ -271,6 +362,12 @@ static int cluster_deal_next_master(struct fast_task_info *task)
                 "master server id: %d not exist", master_id);
         return ENOENT;
     }
+    if (master->is_learner) {
+        RESPONSE.error.length = sprintf(
+                RESPONSE.error.message,
+                "server id: %d is a learner", master_id);
+        return EINVAL;
+    }
 
     if (REQUEST.header.cmd == FDIR_CLUSTER_PROTO_PRE_SET_NEXT_MASTER) {
         return cluster_relationship_pre_set_master(master);
@@ -279,6 +376,127 @@ static int cluster_deal_next_master(struct fast_task_info *task)
     }
 }
 
+static int cluster_deal_get_snapshot_info(struct fast_task_info *task)
+{
+    int result;
+    FDIRSnapshotInfo info;
+    FDIRProtoGetSnapshotInfoResp *resp;
+    int64_t first_version;
+
+    if ((result=server_expect_body_length(task, 0)) != 0) {
+        return result;
+    }
+
+    if ((result=data_dumper_load_info(&info)) != 0) {
+        TASK_ARG->context.log_error = (result != ENOENT);
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "load snapshot info fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+        return result;
+    }
+
+    /* the binlog files are never removed, the first one starts after
+     * the snapshot when I was bootstrapped from it
+     */
+    if (binlog_get_first_record_version(0, &first_version) == 0 &&
+            first_version > info.binlog_start_version)
+    {
+        info.binlog_start_version = first_version;
+    }
+
+    resp = (FDIRProtoGetSnapshotInfoResp *)REQUEST.body;
+    long2buff(info.data_version, resp->data_version);
+    long2buff(info.base_version, resp->base_version);
+    long2buff(info.inode_sn, resp->inode_sn);
+    long2buff(info.dentry_count, resp->dentry_count);
+    long2buff(info.binlog_start_version, resp->binlog_start_version);
+    int2buff(info.delta_count, resp->delta_count);
+
+    RESPONSE.header.body_len = sizeof(FDIRProtoGetSnapshotInfoResp);
+    RESPONSE.header.cmd = FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_RESP;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
+static int cluster_deal_fetch_snapshot(struct fast_task_info *task)
+{
+    int result;
+    int file_index;
+    int size;
+    int fd;
+    int64_t base_version;
+    int64_t offset;
+    ssize_t bytes;
+    FDIRSnapshotInfo info;
+    FDIRProtoFetchSnapshotReq *req;
+    char filename[PATH_MAX];
+
+    if ((result=server_expect_body_length(task,
+                    sizeof(FDIRProtoFetchSnapshotReq))) != 0)
+    {
+        return result;
+    }
+
+    req = (FDIRProtoFetchSnapshotReq *)REQUEST.body;
+    base_version = buff2long(req->base_version);
+    file_index = buff2int(req->file_index);
+    offset = buff2long(req->offset);
+    size = buff2int(req->size);
+
+    //the old files are removed after a full snapshot dumped
+    if (data_dumper_load_info(&info) != 0 ||
+            info.base_version != base_version)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "snapshot of base version: %"PRId64" changed",
+                base_version);
+        return EAGAIN;
+    }
+
+    if (file_index < 0 || file_index > info.delta_count ||
+            offset < 0 || size <= 0)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "invalid file index: %d, offset: %"PRId64" or size: %d",
+                file_index, offset, size);
+        return EINVAL;
+    }
+    if (size > task->size - sizeof(FDIRProtoHeader)) {
+        size = task->size - sizeof(FDIRProtoHeader);
+    }
+
+    if (file_index == 0) {
+        GET_SNAPSHOT_FILENAME(filename, sizeof(filename), base_version);
+    } else {
+        GET_SNAPSHOT_DELTA_FILENAME(filename, sizeof(filename),
+                base_version, file_index);
+    }
+    if ((fd=open(filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                filename, result, STRERROR(result));
+        return result == ENOENT ? EAGAIN : result;
+    }
+
+    bytes = pread(fd, REQUEST.body, size, offset);
+    if (bytes < 0) {
+        result = errno != 0 ? errno : EIO;
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "read file \"%s\" fail, errno: %d, error info: %s",
+                filename, result, STRERROR(result));
+    }
+    close(fd);
+    if (bytes < 0) {
+        return result;
+    }
+
+    RESPONSE.header.body_len = bytes;
+    RESPONSE.header.cmd = FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_RESP;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
 static int cluster_deal_push_binlog_req(struct fast_task_info *task)
 {
     int result;
@@ -288,7 +506,7 @@ static int cluster_deal_push_binlog_req(struct fast_task_info *task)
 
     if ((result=server_check_min_body_length(task,
                     sizeof(FDIRProtoPushBinlogReqBodyHeader) +
-                    BINLOG_RECORD_MIN_SIZE)) != 0)
+                    BINLOG_BINARY_RECORD_MIN_SIZE)) != 0)
     {
         return result;
     }
@@ -370,6 +588,8 @@ static int cluster_deal_push_binlog_resp(struct fast_task_info *task)
 
     body_header = (FDIRProtoPushBinlogRespBodyHeader *)REQUEST.body;
     count = buff2int(body_header->count);
+    binlog_replications_set_slave_credits(CLUSTER_REPLICA,
+            buff2int(body_header->credits));
 
     expect_body_len = sizeof(FDIRProtoPushBinlogRespBodyHeader) +
         sizeof(FDIRProtoPushBinlogRespBodyPart) * count;
@@ -424,6 +644,7 @@ static int cluster_deal_join_slave_req(struct fast_task_info *task)
     FDIRProtoJoinSlaveReq *req;
     FDIRClusterServerInfo *peer;
     FDIRClusterServerInfo *master;
+    FDIRClusterServerInfo *source;
     FDIRClusterServerInfo *next_master;
     FDIRProtoJoinSlaveResp *resp;
 
@@ -473,22 +694,35 @@ static int cluster_deal_join_slave_req(struct fast_task_info *task)
     }
 
     master = CLUSTER_MASTER_PTR;
-    if (peer != master) {
+    source = cluster_info_get_source(CLUSTER_MYSELF_PTR);
+    if (peer != source) {
         RESPONSE.error.length = sprintf(
                 RESPONSE.error.message,
                 "master NOT consistent, peer server id: %d, "
-                "local master id: %d", server_id, master != NULL ?
-                master->server->id : 0);
+                "local master id: %d, upstream id: %d", server_id,
+                master != NULL ? master->server->id : 0,
+                source != NULL ? source->server->id : 0);
         return master != NULL ? FDIR_STATUS_MASTER_INCONSISTENT : EFAULT;
     }
 
-    if (memcmp(req->key, REPLICA_KEY_BUFF, FDIR_REPLICA_KEY_SIZE) != 0) {
+    //the relay gets my key from the master by the ping
+    if (memcmp(req->key, REPLICA_KEY_BUFF,
+                FDIR_REPLICA_KEY_SIZE) != 0)
+    {
         RESPONSE.error.length = sprintf(
                 RESPONSE.error.message,
                 "check key fail");
         return EPERM;
     }
 
+    //the binlog replication starts from the data version of the snapshot
+    if (data_fetcher_is_running()) {
+        RESPONSE.error.length = sprintf(
+                RESPONSE.error.message,
+                "bootstrapping from the snapshot");
+        return EBUSY;
+    }
+
     if (CLUSTER_CONSUMER_CTX != NULL) {
         RESPONSE.error.length = sprintf(
                 RESPONSE.error.message,
@@ -727,6 +961,12 @@ int cluster_deal_task(struct fast_task_info *task)
             case FDIR_CLUSTER_PROTO_PING_MASTER_REQ:
                 result = cluster_deal_ping_master(task);
                 break;
+            case FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_REQ:
+                result = cluster_deal_get_snapshot_info(task);
+                break;
+            case FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_REQ:
+                result = cluster_deal_fetch_snapshot(task);
+                break;
             case FDIR_REPLICA_PROTO_JOIN_SLAVE_REQ:
                 result = cluster_deal_join_slave_req(task);
                 break;
@@ -797,22 +1037,27 @@ int cluster_thread_loop_callback(struct nio_thread_data *thread_data)
                 */
     }
 
+    if (server_ctx->cluster.clean_connected_replicas) {
+        logInfo("file: "__FILE__", line: %d, "
+                "cluster thread #%d, will clean %d connected "
+                "replications because my role changed",
+                __LINE__, SF_THREAD_INDEX(CLUSTER_SF_CTX, thread_data),
+                server_ctx->cluster.connected.count);
+        server_ctx->cluster.clean_connected_replicas = false;
+        clean_connected_replications(server_ctx);
+    }
+
     if (CLUSTER_MYSELF_PTR == CLUSTER_MASTER_PTR) {
         return binlog_replication_process(server_ctx);
-    } else {
-        if (server_ctx->cluster.consumer_ctx != NULL) {
-            result = deal_replica_push_task(server_ctx->cluster.consumer_ctx);
-            return result == EAGAIN ? 0 : result;
-        } else if (server_ctx->cluster.clean_connected_replicas) {
-            logInfo("file: "__FILE__", line: %d, "
-                    "cluster thread #%d, will clean %d connected "
-                    "replications because i am no longer master",
-                    __LINE__, SF_THREAD_INDEX(CLUSTER_SF_CTX, thread_data),
-                    server_ctx->cluster.connected.count);
-            server_ctx->cluster.clean_connected_replicas = false;
-            clean_connected_replications(server_ctx);
-        }
+    }
 
-        return 0;
+    if (server_ctx->cluster.consumer_ctx != NULL) {
+        result = deal_replica_push_task(server_ctx->cluster.consumer_ctx);
+        if (!(result == 0 || result == EAGAIN)) {
+            return result;
+        }
     }
+
+    //relay the binlog to the downstream servers
+    return binlog_replication_process(server_ctx);
 }
@@ -20,6 +20,9 @@
 #define CLUSTER_INFO_ITEM_STATUS             "status"
 #define CLUSTER_INFO_ITEM_LAST_DATA_VERSION  "last_data_version"
 
+#define CLUSTER_CONFIG_ITEM_UPSTREAM         "upstream"
+#define CLUSTER_CONFIG_ITEM_LEARNER          "learner"
+
 static int cluster_info_write_to_file();
 
 static int init_cluster_server_array()
@@ -177,6 +180,109 @@ static int load_cluster_info_from_file()
     return result;
 }
 
+static int check_upstream_cycle(FDIRClusterServerInfo *cs,
+        const char *filename)
+{
+    FDIRClusterServerInfo *upstream;
+    int count;
+
+    count = 0;
+    upstream = cs->upstream;
+    while (upstream != NULL) {
+        if (upstream == cs || ++count > CLUSTER_SERVER_ARRAY.count) {
+            logError("file: "__FILE__", line: %d, "
+                    "cluster config file: %s, the upstream of "
+                    "server id %d forms a cycle", __LINE__,
+                    filename, cs->server->id);
+            return ELOOP;
+        }
+        upstream = upstream->upstream;
+    }
+
+    return 0;
+}
+
+static int load_roles_from_cluster_config(const char *filename)
+{
+    IniContext ini_context;
+    FDIRClusterServerInfo *cs;
+    FDIRClusterServerInfo *end;
+    char section_name[64];
+    int upstream_id;
+    int result;
+
+    if ((result=iniLoadFromFile(filename, &ini_context)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "load from file \"%s\" fail, error code: %d",
+                __LINE__, filename, result);
+        return result;
+    }
+
+    CLUSTER_SERVER_ARRAY.voter_count = 0;
+    end = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
+    for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++) {
+        sprintf(section_name, "%s%d",
+                SERVER_SECTION_PREFIX_STR,
+                cs->server->id);
+        cs->is_learner = iniGetBoolValue(section_name,
+                CLUSTER_CONFIG_ITEM_LEARNER, &ini_context, false);
+        if (!cs->is_learner) {
+            CLUSTER_SERVER_ARRAY.voter_count++;
+        }
+
+        upstream_id = iniGetIntValue(section_name,
+                CLUSTER_CONFIG_ITEM_UPSTREAM, &ini_context, 0);
+        if (upstream_id == 0) {
+            continue;
+        }
+
+        if ((cs->upstream=fdir_get_server_by_id(upstream_id)) == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "cluster config file: %s, the upstream server id: %d "
+                    "of server id %d not exist", __LINE__, filename,
+                    upstream_id, cs->server->id);
+            result = ENOENT;
+            break;
+        }
+        if (cs->upstream == cs) {
+            logError("file: "__FILE__", line: %d, "
+                    "cluster config file: %s, the upstream of server "
+                    "id %d is itself", __LINE__, filename, upstream_id);
+            result = EINVAL;
+            break;
+        }
+        if (!cs->is_learner) {
+            logError("file: "__FILE__", line: %d, "
+                    "cluster config file: %s, server id %d is a voter, "
+                    "only the learner can replicate from the upstream",
+                    __LINE__, filename, cs->server->id);
+            result = EINVAL;
+            break;
+        }
+    }
+
+    iniFreeContext(&ini_context);
+    if (result != 0) {
+        return result;
+    }
+
+    if (CLUSTER_SERVER_ARRAY.voter_count == 0) {
+        logError("file: "__FILE__", line: %d, "
+                "cluster config file: %s, all servers are learners, "
+                "at least one server can be elected as master",
+                __LINE__, filename);
+        return EINVAL;
+    }
+
+    for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++) {
+        if ((result=check_upstream_cycle(cs, filename)) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
 int cluster_info_init(const char *cluster_config_filename)
 {
     int result;
@@ -184,6 +290,11 @@ int cluster_info_init(const char *cluster_config_filename)
     if ((result=init_cluster_server_array()) != 0) {
         return result;
     }
+    if ((result=load_roles_from_cluster_config(
+                    cluster_config_filename)) != 0)
+    {
+        return result;
+    }
     if ((result=load_cluster_info_from_file()) != 0) {
         return result;
     }
@@ -27,6 +27,30 @@ static inline void cluster_info_set_status(FDIRClusterServerInfo *cs,
     }
 }
 
+/* the server to replicate the binlog from, NULL when the master unknown.
+ * fall back to the master when the upstream is not active
+ */
+static inline FDIRClusterServerInfo *cluster_info_get_source(
+        FDIRClusterServerInfo *cs)
+{
+    FDIRClusterServerInfo *master;
+
+    master = CLUSTER_MASTER_PTR;
+    if (cs->upstream != NULL && cs->upstream != master &&
+            cs->upstream->status == FDIR_SERVER_STATUS_ACTIVE)
+    {
+        return cs->upstream;  //relay by a slave
+    }
+    return master;
+}
+
+//if I should replicate the binlog to the server (as master or relay)
+static inline bool cluster_info_is_downstream(FDIRClusterServerInfo *cs)
+{
+    return (cs != CLUSTER_MYSELF_PTR && cs != CLUSTER_MASTER_PTR &&
+            cluster_info_get_source(cs) == CLUSTER_MYSELF_PTR);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,8 +7,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include <time.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include "fastcommon/logger.h"
 #include "fastcommon/sockopt.h"
@@ -16,11 +18,14 @@
 #include "fastcommon/pthread_func.h"
 #include "fastcommon/sched_thread.h"
 #include "sf/sf_global.h"
+#include "sf/sf_nio.h"
 #include "common/fdir_proto.h"
 #include "server_global.h"
 #include "server_binlog.h"
+#include "binlog/replica_quorum.h"
 #include "data_thread.h"
 #include "inode_generator.h"
+#include "data_fetcher.h"
 #include "cluster_relationship.h"
 
 FDIRClusterServerInfo *g_next_master = NULL;
@@ -33,6 +38,16 @@ typedef struct fdir_cluster_server_status {
     int64_t data_version;
 } FDIRClusterServerStatus;
 
+//the master transfer requested by the admin, done by the cluster thread
+typedef struct fdir_master_transfer_context {
+    pthread_mutex_t lock;
+    struct fast_task_info *task;  //the waiting task, NULL for none
+    int64_t task_version;
+    FDIRClusterServerInfo *target;  //NULL for the most up-to-date slave
+} FDIRMasterTransferContext;
+
+static FDIRMasterTransferContext transfer_ctx;
+
 static void fdir_log_network_error_ex(const ConnectionInfo *conn,
         const FDIRResponseInfo *response, const int line,
         const char *func, const int result)
@@ -54,8 +69,242 @@ static void fdir_log_network_error_ex(const ConnectionInfo *conn,
 #define fdir_log_network_error(conn, response, result) \
     fdir_log_network_error_ex(conn, response, __LINE__, __FUNCTION__, result)
 
+/* the network timeout in milliseconds for the heartbeat and the election,
+ * the half of the suspect timeout, so a dead peer is detected in time
+ * instead of blocking the cluster thread for whole seconds
+ */
+/* elect with fewer alive voters than the one round rule after the time,
+ * the same as the 2 + 4 + 8 seconds waiting of the old rounds
+ */
+#define CLUSTER_ELECT_FALLBACK_MS  (14 * 1000)
+
+#define HEARTBEAT_NETWORK_TIMEOUT_MS  (CLUSTER_MASTER_SUSPECT_TIMEOUT_MS / 2)
+
+#define HEARTBEAT_DEADLINE_MS()  \
+    (get_current_time_ms() + HEARTBEAT_NETWORK_TIMEOUT_MS)
+
+static int heartbeat_wait_fd(const int sock, const short events,
+        const int64_t deadline_ms)
+{
+    struct pollfd pollfds;
+    int timeout_ms;
+    int polled;
+
+    pollfds.fd = sock;
+    pollfds.events = events;
+    while (1) {
+        timeout_ms = deadline_ms - get_current_time_ms();
+        if (timeout_ms <= 0) {
+            return ETIMEDOUT;
+        }
+
+        polled = poll(&pollfds, 1, timeout_ms);
+        if (polled > 0) {
+            return 0;
+        } else if (polled == 0) {
+            return ETIMEDOUT;
+        } else if (errno != EINTR) {
+            return errno != 0 ? errno : EIO;
+        }
+    }
+}
+
+static int heartbeat_connect(ConnectionInfo *conn, const int64_t deadline_ms)
+{
+    int result;
+    int domain;
+    socklen_t len;
+    sockaddr_convert_t convert;
+
+    if (conn->socket_domain == AF_INET || conn->socket_domain == AF_INET6) {
+        domain = conn->socket_domain;
+    } else {
+        domain = is_ipv6_addr(conn->ip_addr) ? AF_INET6 : AF_INET;
+    }
+    conn->sock = socket(domain, SOCK_STREAM, 0);
+    if (conn->sock < 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "socket create fail, errno: %d, "
+                "error info: %s", __LINE__, result, STRERROR(result));
+        return result;
+    }
+
+    SET_SOCKOPT_NOSIGPIPE(conn->sock);
+    if ((result=tcpsetnonblockopt(conn->sock)) == 0 &&
+            (result=setsockaddrbyip(conn->ip_addr, conn->port,
+                                    &convert)) == 0)
+    {
+        if (connect(conn->sock, &convert.sa.addr, convert.len) < 0) {
+            result = errno != 0 ? errno : EINPROGRESS;
+            if (result == EINPROGRESS && (result=heartbeat_wait_fd(
+                            conn->sock, POLLOUT, deadline_ms)) == 0)
+            {
+                len = sizeof(result);
+                if (getsockopt(conn->sock, SOL_SOCKET, SO_ERROR,
+                            &result, &len) < 0)
+                {
+                    result = errno != 0 ? errno : EACCES;
+                }
+            }
+        }
+    }
+
+    if (result != 0) {
+        close(conn->sock);
+        conn->sock = -1;
+    }
+    return result;
+}
+
+//connect to the addresses of the server in turn before the deadline
+static int heartbeat_make_connection(FCAddressPtrArray *addr_array,
+        ConnectionInfo *conn, const int64_t deadline_ms)
+{
+    int result;
+    int i;
+
+    result = ENOENT;
+    for (i=0; i<addr_array->count; i++) {
+        *conn = addr_array->addrs[addr_array->index]->conn;
+        if ((result=heartbeat_connect(conn, deadline_ms)) == 0) {
+            return 0;
+        }
+
+        logError("file: "__FILE__", line: %d, "
+                "connect to server %s:%d fail, errno: %d, "
+                "error info: %s", __LINE__, conn->ip_addr,
+                conn->port, result, STRERROR(result));
+        if (++addr_array->index >= addr_array->count) {
+            addr_array->index = 0;
+        }
+        if (result == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+static int heartbeat_send(ConnectionInfo *conn, const char *data,
+        const int len, const int64_t deadline_ms)
+{
+    int sent;
+    int bytes;
+    int result;
+
+    sent = 0;
+    while (sent < len) {
+        bytes = send(conn->sock, data + sent, len - sent, 0);
+        if (bytes > 0) {
+            sent += bytes;
+            continue;
+        }
+
+        result = errno != 0 ? errno : EIO;
+        if (!(result == EAGAIN || result == EWOULDBLOCK || result == EINTR)) {
+            return result;
+        }
+        if ((result=heartbeat_wait_fd(conn->sock,
+                        POLLOUT, deadline_ms)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int heartbeat_recv(ConnectionInfo *conn, char *buff,
+        const int len, const int64_t deadline_ms)
+{
+    int received;
+    int bytes;
+    int result;
+
+    received = 0;
+    while (received < len) {
+        bytes = recv(conn->sock, buff + received, len - received, 0);
+        if (bytes > 0) {
+            received += bytes;
+            continue;
+        } else if (bytes == 0) {
+            return ECONNRESET;
+        }
+
+        result = errno != 0 ? errno : EIO;
+        if (!(result == EAGAIN || result == EWOULDBLOCK || result == EINTR)) {
+            return result;
+        }
+        if ((result=heartbeat_wait_fd(conn->sock,
+                        POLLIN, deadline_ms)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+/* send the request and receive the response before the deadline,
+ * the response body is stored in the body buffer
+ */
+static int heartbeat_send_and_recv(ConnectionInfo *conn, const char *data,
+        const int len, FDIRResponseInfo *response,
+        const unsigned char expect_cmd, char *body, const int body_size,
+        const int64_t deadline_ms)
+{
+    FDIRProtoHeader header_proto;
+    int result;
+
+    response->error.length = 0;
+    response->error.message[0] = '\0';
+    if ((result=heartbeat_send(conn, data, len, deadline_ms)) != 0) {
+        return result;
+    }
+    if ((result=heartbeat_recv(conn, (char *)&header_proto,
+                    sizeof(FDIRProtoHeader), deadline_ms)) != 0)
+    {
+        return result;
+    }
+    fdir_proto_extract_header(&header_proto, &response->header);
+
+    if (response->header.status != 0) {
+        if (response->header.body_len >= sizeof(response->error.message)) {
+            response->error.length = sizeof(response->error.message) - 1;
+        } else {
+            response->error.length = response->header.body_len;
+        }
+        if (heartbeat_recv(conn, response->error.message,
+                    response->error.length, deadline_ms) == 0)
+        {
+            response->error.message[response->error.length] = '\0';
+        } else {
+            response->error.length = 0;
+            response->error.message[0] = '\0';
+        }
+        return response->header.status;
+    }
+
+    if (response->header.cmd != expect_cmd) {
+        response->error.length = sprintf(response->error.message,
+                "response cmd: %d != expect: %d",
+                response->header.cmd, expect_cmd);
+        return EINVAL;
+    }
+    if (response->header.body_len > body_size) {
+        response->error.length = sprintf(response->error.message,
+                "response body length: %d is too large",
+                response->header.body_len);
+        return EOVERFLOW;
+    }
+
+    return heartbeat_recv(conn, body, response->header.body_len,
+            deadline_ms);
+}
+
 static int proto_get_server_status(ConnectionInfo *conn,
-        FDIRClusterServerStatus *server_status)
+        FDIRClusterServerStatus *server_status, const int64_t deadline_ms)
 {
 	int result;
 	FDIRProtoHeader *header;
@@ -73,9 +322,9 @@ static int proto_get_server_status(ConnectionInfo *conn,
     int2buff(CLUSTER_MY_SERVER_ID, req->server_id);
     memcpy(req->config_sign, CLUSTER_CONFIG_SIGN_BUF, CLUSTER_CONFIG_SIGN_LEN);
 
-	if ((result=fdir_send_and_check_response_header(conn, out_buff,
-			sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
-            FDIR_CLUSTER_PROTO_GET_SERVER_STATUS_RESP)) != 0)
+	if ((result=heartbeat_send_and_recv(conn, out_buff, sizeof(out_buff),
+                    &response, FDIR_CLUSTER_PROTO_GET_SERVER_STATUS_RESP,
+                    in_body, sizeof(in_body), deadline_ms)) != 0)
     {
         fdir_log_network_error(conn, &response, result);
         return result;
@@ -90,17 +339,6 @@ static int proto_get_server_status(ConnectionInfo *conn,
         return EINVAL;
     }
 
-    if ((result=tcprecvdata_nb(conn->sock, in_body, response.header.body_len,
-                    SF_G_NETWORK_TIMEOUT)) != 0)
-    {
-        logError("file: "__FILE__", line: %d, "
-                "recv from server %s:%d fail, "
-                "errno: %d, error info: %s",
-                __LINE__, conn->ip_addr, conn->port,
-                result, STRERROR(result));
-        return result;
-    }
-
     resp = (FDIRProtoGetServerStatusResp *)in_body;
 
     server_status->is_master = resp->is_master;
@@ -121,7 +359,8 @@ static inline void generate_replica_key()
     long2buff(n1 ^ n2, REPLICA_KEY_BUFF);
 }
 
-static int proto_join_master(ConnectionInfo *conn)
+static int proto_join_master(ConnectionInfo *conn,
+        const int64_t deadline_ms)
 {
 	int result;
 	FDIRProtoHeader *header;
@@ -139,9 +378,8 @@ static int proto_join_master(ConnectionInfo *conn)
     int2buff(CLUSTER_MY_SERVER_ID, req->server_id);
     memcpy(req->key, REPLICA_KEY_BUFF, FDIR_REPLICA_KEY_SIZE);
     memcpy(req->config_sign, CLUSTER_CONFIG_SIGN_BUF, CLUSTER_CONFIG_SIGN_LEN);
-    if ((result=fdir_send_and_recv_none_body_response(conn, out_buff,
-                    sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
-                    FDIR_PROTO_ACK)) != 0)
+    if ((result=heartbeat_send_and_recv(conn, out_buff, sizeof(out_buff),
+                    &response, FDIR_PROTO_ACK, NULL, 0, deadline_ms)) != 0)
     {
         fdir_log_network_error(conn, &response, result);
     }
@@ -149,10 +387,43 @@ static int proto_join_master(ConnectionInfo *conn)
     return result;
 }
 
-static int proto_ping_master(ConnectionInfo *conn)
+//report the statuses of the servers relayed by me
+static int pack_ping_master_req_body(char *body)
 {
-    FDIRProtoHeader header;
+    FDIRProtoPingMasterReqHeader *req_header;
+    FDIRProtoPingMasterReqBodyPart *body_part;
+    FDIRClusterServerInfo *cs;
+    FDIRClusterServerInfo *end;
+    int server_count;
+
+    req_header = (FDIRProtoPingMasterReqHeader *)body;
+    body_part = (FDIRProtoPingMasterReqBodyPart *)(body +
+            sizeof(FDIRProtoPingMasterReqHeader));
+    server_count = 0;
+    end = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
+    for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++) {
+        if (cluster_info_is_downstream(cs)) {
+            int2buff(cs->server->id, body_part->server_id);
+            body_part->status = cs->status;
+            body_part++;
+            server_count++;
+        }
+    }
+
+    if (server_count == 0) {
+        return 0;
+    }
+
+    int2buff(server_count, req_header->server_count);
+    return (char *)body_part - body;
+}
+
+static int proto_ping_master(ConnectionInfo *conn,
+        const int64_t deadline_ms)
+{
+    FDIRProtoHeader *header;
     FDIRResponseInfo response;
+    char out_buff[sizeof(FDIRProtoHeader) + 8 * 1024];
     char in_buff[8 * 1024];
     FDIRProtoPingMasterRespHeader *body_header;
     FDIRProtoPingMasterRespBodyPart *body_part;
@@ -161,24 +432,17 @@ static int proto_ping_master(ConnectionInfo *conn)
     int64_t inode_sn;
     int server_count;
     int server_id;
+    int body_len;
     int result;
 
-    FDIR_PROTO_SET_HEADER(&header, FDIR_CLUSTER_PROTO_PING_MASTER_REQ, 0);
+    header = (FDIRProtoHeader *)out_buff;
+    body_len = pack_ping_master_req_body(out_buff + sizeof(FDIRProtoHeader));
+    FDIR_PROTO_SET_HEADER(header, FDIR_CLUSTER_PROTO_PING_MASTER_REQ,
+            body_len);
 
-    if ((result=fdir_send_and_check_response_header(conn, (char *)&header,
-                    sizeof(header), &response, SF_G_NETWORK_TIMEOUT,
-                    FDIR_CLUSTER_PROTO_PING_MASTER_RESP)) == 0)
-    {
-        if (response.header.body_len > sizeof(in_buff)) {
-            response.error.length = sprintf(response.error.message,
-                    "response body length: %d is too large",
-                    response.header.body_len);
-            result = EOVERFLOW;
-        } else {
-            result = tcprecvdata_nb(conn->sock, in_buff,
-                    response.header.body_len, SF_G_NETWORK_TIMEOUT);
-        }
-    }
+    result = heartbeat_send_and_recv(conn, out_buff, sizeof(FDIRProtoHeader)
+            + body_len, &response, FDIR_CLUSTER_PROTO_PING_MASTER_RESP,
+            in_buff, sizeof(in_buff), deadline_ms);
 
     body_header = (FDIRProtoPingMasterRespHeader *)in_buff;
     if (result == 0) {
@@ -215,11 +479,17 @@ static int proto_ping_master(ConnectionInfo *conn)
     body_end = body_part + server_count;
     for (; body_part < body_end; body_part++) {
         server_id = buff2int(body_part->server_id);
-        if ((cs=fdir_get_server_by_id(server_id)) != NULL) {
-            if (cs->status != body_part->status) {
-                cluster_info_set_status(cs, body_part->status);
-                //logInfo("server_id: %d, status: %d", server_id, body_part->status);
-            }
+        if ((cs=fdir_get_server_by_id(server_id)) == NULL) {
+            continue;
+        }
+
+        if (cluster_info_is_downstream(cs)) {
+            //the key to join the server as its relay
+            memcpy(cs->key, body_part->key, FDIR_REPLICA_KEY_SIZE);
+        } else if (cs->status != body_part->status) {
+            //the status of the downstream server is reported by myself
+            cluster_info_set_status(cs, body_part->status);
+            //logInfo("server_id: %d, status: %d", server_id, body_part->status);
         }
     }
 
@@ -255,6 +525,7 @@ static int cluster_cmp_server_status(const void *p1, const void *p2)
 static int cluster_get_server_status(FDIRClusterServerStatus *server_status)
 {
     ConnectionInfo conn;
+    int64_t deadline_ms;
     int result;
 
     if (server_status->cs == CLUSTER_MYSELF_PTR) {
@@ -264,14 +535,15 @@ static int cluster_get_server_status(FDIRClusterServerStatus *server_status)
         server_status->data_version = DATA_CURRENT_VERSION;
         return 0;
     } else {
-        if ((result=fc_server_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
+        deadline_ms = HEARTBEAT_DEADLINE_MS();
+        if ((result=heartbeat_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
                             server_status->cs->server), &conn,
-                        SF_G_CONNECT_TIMEOUT)) != 0)
+                        deadline_ms)) != 0)
         {
             return result;
         }
 
-        result = proto_get_server_status(&conn, server_status);
+        result = proto_get_server_status(&conn, server_status, deadline_ms);
         conn_pool_disconnect_server(&conn);
         return result;
     }
@@ -308,6 +580,10 @@ static int cluster_get_master(FDIRClusterServerStatus *server_status,
 	result = 0;
 	end = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
 	for (server=CLUSTER_SERVER_ARRAY.servers; server<end; server++) {
+        if (server->is_learner) {
+            continue;  //the learners never vote nor be elected
+        }
+
 		current_status->cs = server;
         r = cluster_get_server_status(current_status);
 		if (r == 0) {
@@ -321,8 +597,8 @@ static int cluster_get_master(FDIRClusterServerStatus *server_status,
     if (*active_count == 0) {
         logError("file: "__FILE__", line: %d, "
                 "get server status fail, "
-                "server count: %d", __LINE__,
-                CLUSTER_SERVER_ARRAY.count);
+                "voter count: %d", __LINE__,
+                CLUSTER_SERVER_ARRAY.voter_count);
         return result == 0 ? ENOENT : result;
     }
 
@@ -356,10 +632,12 @@ static int do_notify_master_changed(FDIRClusterServerInfo *cs,
     ConnectionInfo conn;
     FDIRProtoHeader *header;
     FDIRResponseInfo response;
+    int64_t deadline_ms;
     int result;
 
-    if ((result=fc_server_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
-                        cs->server), &conn, SF_G_CONNECT_TIMEOUT)) != 0)
+    deadline_ms = HEARTBEAT_DEADLINE_MS();
+    if ((result=heartbeat_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
+                        cs->server), &conn, deadline_ms)) != 0)
     {
         *bConnectFail = true;
         return result;
@@ -370,9 +648,8 @@ static int do_notify_master_changed(FDIRClusterServerInfo *cs,
     FDIR_PROTO_SET_HEADER(header, cmd, sizeof(out_buff) -
             sizeof(FDIRProtoHeader));
     int2buff(master->server->id, out_buff + sizeof(FDIRProtoHeader));
-    if ((result=fdir_send_and_recv_none_body_response(&conn, out_buff,
-                    sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
-                    FDIR_PROTO_ACK)) != 0)
+    if ((result=heartbeat_send_and_recv(&conn, out_buff, sizeof(out_buff),
+                    &response, FDIR_PROTO_ACK, NULL, 0, deadline_ms)) != 0)
     {
         fdir_log_network_error(&conn, &response, result);
     }
@@ -411,6 +688,27 @@ static inline void cluster_unset_master()
     }
 }
 
+static void cluster_clean_connected_replications()
+{
+    struct nio_thread_data *thread_data;
+    struct nio_thread_data *data_end;
+
+    data_end = CLUSTER_SF_CTX.thread_data + CLUSTER_SF_CTX.work_threads;
+    for (thread_data=CLUSTER_SF_CTX.thread_data;
+            thread_data<data_end; thread_data++)
+    {
+        ((FDIRServerContext *)thread_data->arg)->
+            cluster.clean_connected_replicas = true;
+    }
+}
+
+static void cluster_release_master_resources()
+{
+    g_data_thread_vars.error_mode = FDIR_DATA_ERROR_MODE_LOOSE;
+    cluster_clean_connected_replications();
+    binlog_producer_destroy();
+}
+
 static int cluster_relationship_set_master(FDIRClusterServerInfo *master)
 {
     int result;
@@ -427,6 +725,8 @@ static int cluster_relationship_set_master(FDIRClusterServerInfo *master)
             return result;
         }
 
+        //the relay replications reconnect as the master replications
+        cluster_clean_connected_replications();
         binlog_local_consumer_replication_start();
         g_data_thread_vars.error_mode = FDIR_DATA_ERROR_MODE_STRICT;
         CLUSTER_MASTER_PTR->status = FDIR_SERVER_STATUS_ACTIVE;
@@ -435,8 +735,13 @@ static int cluster_relationship_set_master(FDIRClusterServerInfo *master)
         if (MYSELF_IS_MASTER) {
             MYSELF_IS_MASTER = false;
             __sync_add_and_fetch(&CLUSTER_SERVER_ARRAY.change_version, 1);
+            cluster_release_master_resources();  //handed over
         }
 
+        //relay the binlog to the servers whose upstream is myself
+        binlog_local_consumer_replication_start();
+        data_fetcher_start();
+
         logInfo("file: "__FILE__", line: %d, "
                 "the master server id: %d, ip %s:%d",
                 __LINE__, master->server->id,
@@ -473,21 +778,9 @@ int cluster_relationship_commit_master(FDIRClusterServerInfo *master)
 
 void cluster_relationship_trigger_reselect_master()
 {
-    struct nio_thread_data *thread_data;
-    struct nio_thread_data *data_end;
-
     cluster_unset_master();
     __sync_add_and_fetch(&CLUSTER_SERVER_ARRAY.change_version, 1);
-    g_data_thread_vars.error_mode = FDIR_DATA_ERROR_MODE_LOOSE;
-
-    data_end = CLUSTER_SF_CTX.thread_data + CLUSTER_SF_CTX.work_threads;
-    for (thread_data=CLUSTER_SF_CTX.thread_data;
-            thread_data<data_end; thread_data++)
-    {
-        ((FDIRServerContext *)thread_data->arg)->
-            cluster.clean_connected_replicas = true;
-    }
-    binlog_producer_destroy();
+    cluster_release_master_resources();
 }
 
 static int cluster_notify_next_master(FDIRClusterServerInfo *cs,
@@ -566,12 +859,203 @@ static int cluster_notify_master_changed(FDIRClusterServerStatus *server_status)
 	return 0;
 }
 
+int cluster_relationship_transfer_master(struct fast_task_info *task,
+        FDIRClusterServerInfo *target)
+{
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&transfer_ctx.lock);
+    if (transfer_ctx.task != NULL) {
+        result = EBUSY;
+    } else {
+        transfer_ctx.task = task;
+        transfer_ctx.task_version = __sync_add_and_fetch(
+                &((FDIRServerTaskArg *)task->arg)->task_version, 0);
+        transfer_ctx.target = target;
+        result = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&transfer_ctx.lock);
+    return result;
+}
+
+static FDIRClusterServerInfo *cluster_select_transfer_target()
+{
+    FDIRClusterServerInfo *cs;
+    FDIRClusterServerInfo *send;
+    FDIRClusterServerInfo *target;
+    int64_t replied_version;
+    int64_t max_version;
+
+    target = NULL;
+    max_version = -1;
+    send = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
+    for (cs=CLUSTER_SERVER_ARRAY.servers; cs<send; cs++) {
+        if (cs == CLUSTER_MYSELF_PTR || cs->is_learner || cs->status !=
+                FDIR_SERVER_STATUS_ACTIVE || !cluster_info_is_downstream(cs))
+        {
+            continue;
+        }
+
+        replied_version = binlog_local_consumer_slave_replied_version(cs);
+        if (replied_version > max_version) {
+            max_version = replied_version;
+            target = cs;
+        }
+    }
+
+    return target;
+}
+
+/* stop accepting the mutations, wait for the inflight ones done and
+ * the target applied the last data version, then commit the target
+ * as the new master
+ */
+static int cluster_do_transfer_master(FDIRClusterServerInfo *target)
+{
+    FDIRClusterServerStatus server_status;
+    int64_t start_time;
+    int64_t last_data_version;
+    int64_t replied_version;
+    int result;
+
+    /* the replied version is only known for the server replicated by
+     * me, waiting for the relayed one would hold the writes until timeout
+     */
+    if (!cluster_info_is_downstream(target)) {
+        logError("file: "__FILE__", line: %d, "
+                "the target server id: %d is not replicated by me directly, "
+                "its binlog source is server id: %d", __LINE__,
+                target->server->id, cluster_info_get_source(
+                    target)->server->id);
+        return EINVAL;
+    }
+
+    if (target->status != FDIR_SERVER_STATUS_ACTIVE) {
+        logError("file: "__FILE__", line: %d, "
+                "the target server id: %d is not active, status: %d (%s)",
+                __LINE__, target->server->id, target->status,
+                fdir_get_server_status_caption(target->status));
+        return EAGAIN;
+    }
+
+    __sync_bool_compare_and_swap(&MASTER_TRANSFER_IN_PROGRESS, 0, 1);
+    start_time = get_current_time_ms();
+    last_data_version = replied_version = -1;
+    result = ETIMEDOUT;
+    while (SF_G_CONTINUE_FLAG && get_current_time_ms() - start_time <
+            1000 * SF_G_NETWORK_TIMEOUT)
+    {
+        if (__sync_add_and_fetch(&INFLIGHT_MUTATION_COUNT, 0) == 0) {
+            last_data_version = __sync_add_and_fetch(
+                    &DATA_CURRENT_VERSION, 0);
+            replied_version = binlog_local_consumer_slave_replied_version(
+                    target);
+
+            //the version may increase by the task cleaned up before done
+            if (replied_version >= last_data_version && last_data_version
+                    == __sync_add_and_fetch(&DATA_CURRENT_VERSION, 0))
+            {
+                result = 0;
+                break;
+            }
+        }
+
+        usleep(1000);
+    }
+
+    if (result == 0) {
+        logInfo("file: "__FILE__", line: %d, "
+                "transfer master to server id: %d, ip %s:%d, "
+                "last data version: %"PRId64", write paused: %"PRId64" ms",
+                __LINE__, target->server->id,
+                CLUSTER_GROUP_ADDRESS_FIRST_IP(target->server),
+                CLUSTER_GROUP_ADDRESS_FIRST_PORT(target->server),
+                last_data_version, get_current_time_ms() - start_time);
+
+        memset(&server_status, 0, sizeof(server_status));
+        server_status.cs = target;
+        server_status.server_id = target->server->id;
+        server_status.data_version = last_data_version;
+        result = cluster_notify_master_changed(&server_status);
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "transfer master to server id: %d timeout, "
+                "inflight mutations: %d, last data version: %"PRId64", "
+                "replied data version: %"PRId64, __LINE__,
+                target->server->id, __sync_add_and_fetch(
+                    &INFLIGHT_MUTATION_COUNT, 0),
+                last_data_version, replied_version);
+    }
+
+    __sync_bool_compare_and_swap(&MASTER_TRANSFER_IN_PROGRESS, 1, 0);
+    return result;
+}
+
+static void cluster_deal_transfer_master(FDIRClusterServerInfo *master)
+{
+    struct fast_task_info *task;
+    FDIRClusterServerInfo *target;
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&transfer_ctx.lock);
+    target = transfer_ctx.target;
+    PTHREAD_MUTEX_UNLOCK(&transfer_ctx.lock);
+
+    if (master != CLUSTER_MYSELF_PTR) {
+        result = EINVAL;
+    } else if (target == NULL && (target=
+                cluster_select_transfer_target()) == NULL)
+    {
+        result = ENOENT;
+    } else {
+        result = cluster_do_transfer_master(target);
+    }
+
+    PTHREAD_MUTEX_LOCK(&transfer_ctx.lock);
+    task = transfer_ctx.task;
+    if (transfer_ctx.task_version == __sync_add_and_fetch(
+                &((FDIRServerTaskArg *)task->arg)->task_version, 0))
+    {
+        if (result != 0) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "transfer master fail, errno: %d, error info: %s",
+                    result, STRERROR(result));
+        }
+        RESPONSE_STATUS = result;
+        sf_nio_notify(task, SF_NIO_STAGE_CONTINUE);
+    }
+    transfer_ctx.task = NULL;
+    PTHREAD_MUTEX_UNLOCK(&transfer_ctx.lock);
+}
+
+/* the min alive voters to elect in one round: the majority against
+ * the split brain, and more than the voters without an acked write.
+ * an acked write is held by the master and the quorum slaves,
+ * so any (voter_count - holders + 1) alive voters include a holder
+ */
+static int cluster_get_elect_min_count()
+{
+    int voter_count;
+    int holders;
+    int min_count;
+
+    voter_count = CLUSTER_SERVER_ARRAY.voter_count;
+    holders = 1 + replica_quorum_calc(voter_count - 1);
+    min_count = voter_count - holders + 1;
+    if (min_count <= voter_count / 2) {
+        min_count = voter_count / 2 + 1;
+    }
+    return min_count;
+}
+
 static int cluster_select_master()
 {
 	int result;
     int active_count;
+    int elect_min_count;
+    int64_t start_time;
     int i;
-    int sleep_secs;
+    int sleep_ms;
     char status_prompt[512];
 	FDIRClusterServerStatus server_status;
     FDIRClusterServerInfo *next_master;
@@ -579,18 +1063,28 @@ static int cluster_select_master()
 	logInfo("file: "__FILE__", line: %d, "
 		"selecting master...", __LINE__);
 
-    sleep_secs = 2;
+    elect_min_count = cluster_get_elect_min_count();
+    start_time = get_current_time_ms();
     i = 0;
     while (1) {
         if ((result=cluster_get_master(&server_status, &active_count)) != 0) {
             return result;
         }
-        if ((active_count == CLUSTER_SERVER_ARRAY.count) ||
+        if ((active_count == CLUSTER_SERVER_ARRAY.voter_count) ||
                 (active_count >= 2 && server_status.is_master))
         {
             break;
         }
 
+        /* the candidate with the max data version of the alive voters
+         * is elected in one round when it has all the acked writes
+         */
+        if (server_status.status >= FDIR_SERVER_STATUS_OFFLINE &&
+                active_count >= elect_min_count)
+        {
+            break;
+        }
+
         ++i;
         if (server_status.status < FDIR_SERVER_STATUS_OFFLINE) {
             sprintf(status_prompt, "the candidate server status: %d (%s) "
@@ -601,20 +1095,27 @@ static int cluster_select_master()
                     fdir_get_server_status_caption(server_status.status));
         } else {
             *status_prompt = '\0';
-            if (i == 3) {
+            if (get_current_time_ms() - start_time >=
+                    CLUSTER_ELECT_FALLBACK_MS)
+            {
+                logWarning("file: "__FILE__", line: %d, "
+                        "alive voter count: %d < %d for %d ms, elect "
+                        "the candidate which may miss the acked writes",
+                        __LINE__, active_count, elect_min_count,
+                        CLUSTER_ELECT_FALLBACK_MS);
                 break;
             }
         }
 
+        //randomized to avoid the servers selecting in lockstep
+        sleep_ms = CLUSTER_HEARTBEAT_INTERVAL_MS +
+            rand() % CLUSTER_HEARTBEAT_INTERVAL_MS;
         logInfo("file: "__FILE__", line: %d, "
-                "round %dth select master, alive server count: %d "
-                "< server count: %d, %stry again after %d seconds.",
-                __LINE__, i, active_count, CLUSTER_SERVER_ARRAY.count,
-                status_prompt, sleep_secs);
-        sleep(sleep_secs);
-        if (sleep_secs < 32) {
-            sleep_secs *= 2;
-        }
+                "round %dth select master, alive voter count: %d "
+                "< voter count: %d, %stry again after %d ms.",
+                __LINE__, i, active_count, CLUSTER_SERVER_ARRAY.voter_count,
+                status_prompt, sleep_ms);
+        usleep(sleep_ms * 1000);
     }
 
     next_master = server_status.cs;
@@ -650,6 +1151,7 @@ static int cluster_select_master()
 
 static int cluster_ping_master(ConnectionInfo *conn)
 {
+    int64_t deadline_ms;
     int result;
     FDIRClusterServerInfo *master;
 
@@ -662,73 +1164,93 @@ static int cluster_ping_master(ConnectionInfo *conn)
         return ENOENT;
     }
 
+    deadline_ms = HEARTBEAT_DEADLINE_MS();
     if (conn->sock < 0) {
-        if ((result=fc_server_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
-                            master->server), conn,
-                        SF_G_CONNECT_TIMEOUT)) != 0)
+        if ((result=heartbeat_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
+                            master->server), conn, deadline_ms)) != 0)
         {
             return result;
         }
 
-        if ((result=proto_join_master(conn)) != 0) {
+        if ((result=proto_join_master(conn, deadline_ms)) != 0) {
             conn_pool_disconnect_server(conn);
             return result;
         }
     }
 
-    if ((result=proto_ping_master(conn)) != 0) {
+    if ((result=proto_ping_master(conn, deadline_ms)) != 0) {
         conn_pool_disconnect_server(conn);
     }
 
-    return 0;
+    return result;
 }
 
 static void *cluster_thread_entrance(void* arg)
 {
-#define MAX_SLEEP_SECONDS  10
-
     int fail_count;
-    int sleep_seconds;
+    int sleep_ms;
+    int64_t last_success_time;  //in milliseconds
+    int64_t elapsed_ms;
     FDIRClusterServerInfo *master;
+    FDIRClusterServerInfo *last_master;
     ConnectionInfo mconn;  //master connection
 
     memset(&mconn, 0, sizeof(mconn));
     mconn.sock = -1;
 
     fail_count = 0;
-    sleep_seconds = 1;
+    last_master = NULL;
+    last_success_time = get_current_time_ms();
     while (SF_G_CONTINUE_FLAG) {
+        sleep_ms = CLUSTER_HEARTBEAT_INTERVAL_MS;
         master = CLUSTER_MASTER_PTR;
+        if (master != last_master) {
+            //the master changed by the election or the notify
+            if (mconn.sock >= 0) {
+                conn_pool_disconnect_server(&mconn);
+            }
+            last_master = master;
+            last_success_time = get_current_time_ms();
+            fail_count = 0;
+        }
+
+        if (transfer_ctx.task != NULL) {
+            cluster_deal_transfer_master(master);
+            continue;
+        }
+
         if (master == NULL) {
             if (cluster_select_master() != 0) {
-                sleep_seconds = 1 + (int)((double)rand()
-                        * (double)MAX_SLEEP_SECONDS / RAND_MAX);
-            } else {
-                sleep_seconds = 1;
+                sleep_ms += rand() % CLUSTER_MASTER_SUSPECT_TIMEOUT_MS;
             }
+        } else if (cluster_ping_master(&mconn) == 0) {
+            last_success_time = get_current_time_ms();
+            fail_count = 0;
         } else {
-            if (cluster_ping_master(&mconn) == 0) {
-                fail_count = 0;
-                sleep_seconds = 1;
-            } else {
-                ++fail_count;
-                logError("file: "__FILE__", line: %d, "
-                        "%dth ping master id: %d, ip %s:%d fail",
-                        __LINE__, fail_count, master->server->id,
-                        CLUSTER_GROUP_ADDRESS_FIRST_IP(master->server),
-                        CLUSTER_GROUP_ADDRESS_FIRST_PORT(master->server));
-
-                sleep_seconds *= 2;
-                if (fail_count >= 4) {
-                    cluster_unset_master();
-
-                    fail_count = 0;
-                    sleep_seconds = 1;
-                }
+            ++fail_count;
+            elapsed_ms = get_current_time_ms() - last_success_time;
+            logError("file: "__FILE__", line: %d, "
+                    "%dth ping master id: %d, ip %s:%d fail, "
+                    "no heartbeat for %"PRId64" ms", __LINE__,
+                    fail_count, master->server->id,
+                    CLUSTER_GROUP_ADDRESS_FIRST_IP(master->server),
+                    CLUSTER_GROUP_ADDRESS_FIRST_PORT(master->server),
+                    elapsed_ms);
+
+            if (elapsed_ms >= CLUSTER_MASTER_SUSPECT_TIMEOUT_MS) {
+                cluster_unset_master();
+                continue;  //select the new master at once
             }
         }
 
-        sleep(sleep_seconds);
+        /* the learner replicates from the master when its upstream is
+         * not active, bind the servers which turn to replicate from me
+         */
+        if (CLUSTER_MASTER_PTR != NULL) {
+            binlog_local_consumer_replication_start();
+        }
+
+        usleep(sleep_ms * 1000);
     }
 
     return NULL;
@@ -737,6 +1259,12 @@ static void *cluster_thread_entrance(void* arg)
 int cluster_relationship_init()
 {
 	pthread_t tid;
+    int result;
+
+    memset(&transfer_ctx, 0, sizeof(transfer_ctx));
+    if ((result=init_pthread_lock(&transfer_ctx.lock)) != 0) {
+        return result;
+    }
 
 	return fc_create_thread(&tid, cluster_thread_entrance, NULL,
             SF_G_THREAD_STACK_SIZE);
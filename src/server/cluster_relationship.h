@@ -23,6 +23,14 @@ int cluster_relationship_commit_master(FDIRClusterServerInfo *master);
 
 void cluster_relationship_trigger_reselect_master();
 
+/* request the graceful master handover, called by the service thread,
+ * the task is notified by the cluster thread when done,
+ * target: NULL for the most up-to-date active slave
+ * return EBUSY when another transfer in progress
+ */
+int cluster_relationship_transfer_master(struct fast_task_info *task,
+        FDIRClusterServerInfo *target);
+
 #ifdef __cplusplus
 }
 #endif
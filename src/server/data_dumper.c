@@ -0,0 +1,724 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/sched_thread.h"
+#include "fastcommon/ini_file_reader.h"
+#include "fastcommon/hash.h"
+#include "sf/sf_global.h"
+#include "server_global.h"
+#include "server_binlog.h"
+#include "inode_index.h"
+#include "dentry.h"
+#include "data_dumper.h"
+
+#define SNAPSHOT_ITEM_DATA_VERSION  "data_version"
+#define SNAPSHOT_ITEM_BINLOG_INDEX  "binlog_index"
+#define SNAPSHOT_ITEM_INODE_SN      "inode_sn"
+#define SNAPSHOT_ITEM_DENTRY_COUNT  "dentry_count"
+#define SNAPSHOT_ITEM_BASE_VERSION  "base_version"
+#define SNAPSHOT_ITEM_DELTA_COUNT   "delta_count"
+#define SNAPSHOT_ITEM_BINLOG_START_VERSION  "binlog_start_version"
+
+#define SNAPSHOT_FLUSH_BUFFER_SIZE  (256 * 1024)
+
+typedef struct {
+    int64_t *inodes;
+    int alloc;
+    int count;
+} InodeStack;
+
+typedef struct {
+    int64_t inode;
+    int depth;
+    int ns_index;
+} DirtyDirEntry;
+
+typedef struct {
+    char filename[PATH_MAX];
+    int fd;
+    FastBuffer buffer;
+    FDIRBinlogRecord record;
+    InodeStack stack;
+    FDIRSnapshotInfo info;
+    int64_t record_count;
+} DataDumperContext;
+
+static struct {
+    volatile bool dumping;
+    bool force_full;  //the dirty directories lost by failure
+    FDIRSnapshotInfo last;  //data_version 0 for no snapshot
+} dumper_vars = {false, false};
+
+static inline void get_snapshot_info_filename(char *filename, const int size)
+{
+    snprintf(filename, size, "%s/%s", DATA_PATH_STR, SNAPSHOT_INFO_FILENAME);
+}
+
+int data_dumper_load_info(FDIRSnapshotInfo *info)
+{
+    char filename[PATH_MAX];
+    IniContext ini_context;
+    int result;
+
+    get_snapshot_info_filename(filename, sizeof(filename));
+    if (access(filename, F_OK) != 0) {
+        return errno != 0 ? errno : ENOENT;
+    }
+
+    if ((result=iniLoadFromFile(filename, &ini_context)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "load from file \"%s\" fail, error code: %d",
+                __LINE__, filename, result);
+        return result;
+    }
+
+    info->data_version = iniGetInt64Value(NULL,
+            SNAPSHOT_ITEM_DATA_VERSION, &ini_context, 0);
+    info->binlog_index = iniGetIntValue(NULL,
+            SNAPSHOT_ITEM_BINLOG_INDEX, &ini_context, 0);
+    info->inode_sn = iniGetInt64Value(NULL,
+            SNAPSHOT_ITEM_INODE_SN, &ini_context, 0);
+    info->dentry_count = iniGetInt64Value(NULL,
+            SNAPSHOT_ITEM_DENTRY_COUNT, &ini_context, 0);
+    info->base_version = iniGetInt64Value(NULL,
+            SNAPSHOT_ITEM_BASE_VERSION, &ini_context, info->data_version);
+    info->delta_count = iniGetIntValue(NULL,
+            SNAPSHOT_ITEM_DELTA_COUNT, &ini_context, 0);
+    info->binlog_start_version = iniGetInt64Value(NULL,
+            SNAPSHOT_ITEM_BINLOG_START_VERSION, &ini_context, 1);
+    iniFreeContext(&ini_context);
+
+    if (info->data_version <= 0 || info->base_version <= 0 ||
+            info->base_version > info->data_version ||
+            info->delta_count < 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "snapshot info file: %s, invalid %s: %"PRId64", "
+                "%s: %"PRId64" or %s: %d", __LINE__, filename,
+                SNAPSHOT_ITEM_DATA_VERSION, info->data_version,
+                SNAPSHOT_ITEM_BASE_VERSION, info->base_version,
+                SNAPSHOT_ITEM_DELTA_COUNT, info->delta_count);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int write_snapshot_info(const FDIRSnapshotInfo *info)
+{
+    char filename[PATH_MAX];
+    char buff[256];
+    int len;
+    int result;
+
+    len = sprintf(buff, "%s=%"PRId64"\n"
+            "%s=%d\n"
+            "%s=%"PRId64"\n"
+            "%s=%"PRId64"\n"
+            "%s=%"PRId64"\n"
+            "%s=%d\n"
+            "%s=%"PRId64"\n",
+            SNAPSHOT_ITEM_DATA_VERSION, info->data_version,
+            SNAPSHOT_ITEM_BINLOG_INDEX, info->binlog_index,
+            SNAPSHOT_ITEM_INODE_SN, info->inode_sn,
+            SNAPSHOT_ITEM_DENTRY_COUNT, info->dentry_count,
+            SNAPSHOT_ITEM_BASE_VERSION, info->base_version,
+            SNAPSHOT_ITEM_DELTA_COUNT, info->delta_count,
+            SNAPSHOT_ITEM_BINLOG_START_VERSION, info->binlog_start_version);
+
+    get_snapshot_info_filename(filename, sizeof(filename));
+    if ((result=safeWriteToFile(filename, buff, len)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+            "write to file \"%s\" fail, "
+            "errno: %d, error info: %s",
+            __LINE__, filename, result, STRERROR(result));
+    }
+
+    return result;
+}
+
+static int flush_buffer(DataDumperContext *ctx)
+{
+    int result;
+
+    if (ctx->buffer.length == 0) {
+        return 0;
+    }
+
+    if (fc_safe_write(ctx->fd, ctx->buffer.data,
+                ctx->buffer.length) != ctx->buffer.length)
+    {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "write to file \"%s\" fail, "
+                "errno: %d, error info: %s",
+                __LINE__, ctx->filename, result, STRERROR(result));
+        return result;
+    }
+
+    ctx->buffer.length = 0;
+    return 0;
+}
+
+static int push_inode(InodeStack *stack, const int64_t inode)
+{
+    int64_t *inodes;
+    int alloc;
+    int bytes;
+
+    if (stack->count == stack->alloc) {
+        alloc = (stack->alloc > 0) ? 2 * stack->alloc : 4 * 1024;
+        bytes = sizeof(int64_t) * alloc;
+        inodes = (int64_t *)realloc(stack->inodes, bytes);
+        if (inodes == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "realloc %d bytes fail", __LINE__, bytes);
+            return ENOMEM;
+        }
+        stack->inodes = inodes;
+        stack->alloc = alloc;
+    }
+
+    stack->inodes[stack->count++] = inode;
+    return 0;
+}
+
+/* the dentry as a create record (the directory header of the delta
+ * as an update record), the namespace root by path, the others by
+ * parent inode and name */
+static int dump_dentry(DataDumperContext *ctx, const int operation,
+        const string_t *ns, const FDIRServerDentry *parent,
+        const FDIRServerDentry *dentry)
+{
+    FDIRBinlogRecord *record;
+    int result;
+
+    record = &ctx->record;
+    record->operation = operation;
+    record->inode = dentry->inode;
+    record->options.flags = 0;
+    if (parent == NULL) {
+        record->options.path_info.flags = BINLOG_OPTIONS_PATH_ENABLED;
+        record->fullname.path.str = "/";
+        record->fullname.path.len = 1;
+    } else {
+        record->options.pname = 1;
+        record->pname.parent_inode = parent->inode;
+        record->pname.name = dentry->name;
+    }
+    record->fullname.ns = *ns;
+    record->options.mode = record->options.atime = 1;
+    record->options.ctime = record->options.mtime = 1;
+    record->options.uid = record->options.gid = 1;
+    record->options.size = 1;
+    record->stat = dentry->stat;
+
+    if ((result=binlog_pack_record_ex(record, FDIR_BINLOG_RECORD_FORMAT_BINARY,
+                    &ctx->buffer)) != 0)
+    {
+        return result;
+    }
+    ctx->record_count++;
+
+    if (ctx->buffer.length >= SNAPSHOT_FLUSH_BUFFER_SIZE) {
+        return flush_buffer(ctx);
+    }
+    return 0;
+}
+
+/* the data thread changes the tree concurrently, the same as the readers
+ * of the service, the dentries are freed delay so the children iteration
+ * is safe. the directory is found again by inode when popped from the stack
+ * because it may be removed after pushed.
+ */
+static int dump_namespace(DataDumperContext *ctx, const FDIRNamespaceDentry *nd)
+{
+    FDIRServerDentry *dir;
+    FDIRServerDentry *child;
+    UniqSkiplistIterator iterator;
+    int result;
+
+    ctx->record.hash_code = simple_hash(nd->ns.str, nd->ns.len);
+    if ((result=dump_dentry(ctx, BINLOG_OP_CREATE_DENTRY_INT,
+                    &nd->ns, NULL, nd->root)) != 0)
+    {
+        return result;
+    }
+    if (!S_ISDIR(nd->root->stat.mode)) {
+        return 0;
+    }
+
+    ctx->stack.count = 0;
+    if ((result=push_inode(&ctx->stack, nd->root->inode)) != 0) {
+        return result;
+    }
+
+    while (ctx->stack.count > 0 && SF_G_CONTINUE_FLAG) {
+        dir = inode_index_get_dentry(ctx->stack.inodes[--ctx->stack.count]);
+        if (dir == NULL || !S_ISDIR(dir->stat.mode)) {
+            continue;
+        }
+
+        uniq_skiplist_iterator(dir->children, &iterator);
+        while ((child=(FDIRServerDentry *)uniq_skiplist_next(
+                        &iterator)) != NULL)
+        {
+            if ((result=dump_dentry(ctx, BINLOG_OP_CREATE_DENTRY_INT,
+                            &nd->ns, dir, child)) != 0)
+            {
+                return result;
+            }
+
+            if (S_ISDIR(child->stat.mode)) {
+                if ((result=push_inode(&ctx->stack, child->inode)) != 0) {
+                    return result;
+                }
+            }
+        }
+    }
+
+    return SF_G_CONTINUE_FLAG ? 0 : EINTR;
+}
+
+static int dump_all_namespaces(DataDumperContext *ctx)
+{
+    FDIRNamespaceDentryArray ns_array;
+    FDIRNamespaceDentry *nd;
+    FDIRNamespaceDentry *end;
+    int result;
+
+    memset(&ns_array, 0, sizeof(ns_array));
+    if ((result=dentry_get_namespaces(&ns_array)) != 0) {
+        return result;
+    }
+
+    end = ns_array.entries + ns_array.count;
+    for (nd=ns_array.entries; nd<end; nd++) {
+        if ((result=dump_namespace(ctx, nd)) != 0) {
+            break;
+        }
+    }
+
+    dentry_namespace_array_free(&ns_array);
+    return result;
+}
+
+static int compare_namespace_by_root(const void *p1, const void *p2)
+{
+    const FDIRServerDentry *r1;
+    const FDIRServerDentry *r2;
+
+    r1 = ((const FDIRNamespaceDentry *)p1)->root;
+    r2 = ((const FDIRNamespaceDentry *)p2)->root;
+    return (r1 < r2) ? -1 : ((r1 > r2) ? 1 : 0);
+}
+
+static int compare_inode(const void *p1, const void *p2)
+{
+    int64_t n1;
+    int64_t n2;
+
+    n1 = *((const int64_t *)p1);
+    n2 = *((const int64_t *)p2);
+    return (n1 < n2) ? -1 : ((n1 > n2) ? 1 : 0);
+}
+
+static int compare_dirty_dir(const void *p1, const void *p2)
+{
+    const DirtyDirEntry *e1;
+    const DirtyDirEntry *e2;
+
+    e1 = (const DirtyDirEntry *)p1;
+    e2 = (const DirtyDirEntry *)p2;
+    if (e1->depth != e2->depth) {
+        return e1->depth - e2->depth;
+    }
+    return compare_inode(&e1->inode, &e2->inode);
+}
+
+static int find_namespace_index(const FDIRNamespaceDentryArray *ns_array,
+        const FDIRServerDentry *dentry, int *depth)
+{
+    FDIRNamespaceDentry target;
+    FDIRNamespaceDentry *found;
+
+    *depth = 0;
+    while (dentry->parent != NULL) {
+        dentry = dentry->parent;
+        ++(*depth);
+    }
+
+    target.root = (FDIRServerDentry *)dentry;
+    found = (FDIRNamespaceDentry *)bsearch(&target, ns_array->entries,
+            ns_array->count, sizeof(FDIRNamespaceDentry),
+            compare_namespace_by_root);
+    return found != NULL ? found - ns_array->entries : -1;
+}
+
+/* collect the dirty directories which still exist, sorted by depth
+ * so the parent directory is loaded before the children */
+static int collect_dirty_dirs(const FDIRNamespaceDentryArray *ns_array,
+        FDIRInodeArray *dirty, DirtyDirEntry **entries, int *count)
+{
+    const int64_t *inode;
+    const int64_t *end;
+    FDIRServerDentry *dir;
+    DirtyDirEntry *entry;
+    int bytes;
+
+    *count = 0;
+    if (dirty->count == 0) {
+        *entries = NULL;
+        return 0;
+    }
+
+    bytes = sizeof(DirtyDirEntry) * dirty->count;
+    if ((*entries=(DirtyDirEntry *)malloc(bytes)) == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+
+    qsort(dirty->inodes, dirty->count, sizeof(int64_t), compare_inode);
+    entry = *entries;
+    end = dirty->inodes + dirty->count;
+    for (inode=dirty->inodes; inode<end; inode++) {
+        if (inode > dirty->inodes && *inode == *(inode - 1)) {
+            continue;
+        }
+
+        dir = inode_index_get_dentry(*inode);
+        if (dir == NULL || !S_ISDIR(dir->stat.mode)) {
+            continue;
+        }
+
+        entry->inode = *inode;
+        if ((entry->ns_index=find_namespace_index(ns_array,
+                        dir, &entry->depth)) < 0)
+        {
+            continue;
+        }
+        entry++;
+    }
+
+    *count = entry - *entries;
+    qsort(*entries, *count, sizeof(DirtyDirEntry), compare_dirty_dir);
+    return 0;
+}
+
+/* every dirty directory as a section: the directory self as an update
+ * record then all of the children as create records. the loader makes
+ * the children the same as the section, removes the others */
+static int dump_dirty_dirs(DataDumperContext *ctx, FDIRInodeArray *dirty)
+{
+    FDIRNamespaceDentryArray ns_array;
+    DirtyDirEntry *entries;
+    DirtyDirEntry *entry;
+    DirtyDirEntry *end;
+    FDIRNamespaceDentry *nd;
+    FDIRServerDentry *dir;
+    FDIRServerDentry *child;
+    UniqSkiplistIterator iterator;
+    int count;
+    int result;
+
+    memset(&ns_array, 0, sizeof(ns_array));
+    if ((result=dentry_get_namespaces(&ns_array)) != 0) {
+        return result;
+    }
+    qsort(ns_array.entries, ns_array.count, sizeof(FDIRNamespaceDentry),
+            compare_namespace_by_root);
+
+    if ((result=collect_dirty_dirs(&ns_array, dirty,
+                    &entries, &count)) != 0)
+    {
+        dentry_namespace_array_free(&ns_array);
+        return result;
+    }
+
+    end = entries + count;
+    for (entry=entries; entry<end && SF_G_CONTINUE_FLAG; entry++) {
+        if ((dir=inode_index_get_dentry(entry->inode)) == NULL) {
+            continue;
+        }
+
+        nd = ns_array.entries + entry->ns_index;
+        ctx->record.hash_code = simple_hash(nd->ns.str, nd->ns.len);
+        if ((result=dump_dentry(ctx, BINLOG_OP_UPDATE_DENTRY_INT,
+                        &nd->ns, dir->parent, dir)) != 0)
+        {
+            break;
+        }
+
+        uniq_skiplist_iterator(dir->children, &iterator);
+        while ((child=(FDIRServerDentry *)uniq_skiplist_next(
+                        &iterator)) != NULL)
+        {
+            if ((result=dump_dentry(ctx, BINLOG_OP_CREATE_DENTRY_INT,
+                            &nd->ns, dir, child)) != 0)
+            {
+                break;
+            }
+        }
+        if (result != 0) {
+            break;
+        }
+    }
+
+    if (entries != NULL) {
+        free(entries);
+    }
+    dentry_namespace_array_free(&ns_array);
+    if (result == 0 && !SF_G_CONTINUE_FLAG) {
+        result = EINTR;
+    }
+    return result;
+}
+
+static int dump_to_file(DataDumperContext *ctx, FDIRInodeArray *dirty)
+{
+    char tmp_filename[PATH_MAX];
+    int result;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", ctx->filename);
+    if ((ctx->fd=open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC,
+                    0644)) < 0)
+    {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, result, STRERROR(result));
+        return result;
+    }
+
+    if (dirty == NULL) {
+        result = dump_all_namespaces(ctx);
+    } else {
+        result = dump_dirty_dirs(ctx, dirty);
+    }
+    if (result == 0) {
+        result = flush_buffer(ctx);
+    }
+    if (result == 0 && fsync(ctx->fd) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "fsync file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, result, STRERROR(result));
+    }
+    close(ctx->fd);
+    ctx->fd = -1;
+
+    if (result == 0 && rename(tmp_filename, ctx->filename) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "rename file \"%s\" to \"%s\" fail, "
+                "errno: %d, error info: %s", __LINE__, tmp_filename,
+                ctx->filename, result, STRERROR(result));
+    }
+    if (result != 0) {
+        unlink(tmp_filename);
+    }
+    return result;
+}
+
+static void remove_snapshot_files(const FDIRSnapshotInfo *info)
+{
+    char filename[PATH_MAX];
+    int i;
+
+    for (i=1; i<=info->delta_count; i++) {
+        GET_SNAPSHOT_DELTA_FILENAME(filename, sizeof(filename),
+                info->base_version, i);
+        unlink(filename);
+    }
+
+    GET_SNAPSHOT_FILENAME(filename, sizeof(filename), info->base_version);
+    unlink(filename);
+}
+
+static int do_dump(DataDumperContext *ctx, bool *is_full)
+{
+    FDIRInodeArray dirty;
+    int result;
+
+    /* get the binlog index before the data version, so the binlog
+     * records of the previous files are all included */
+    ctx->info.binlog_index = binlog_get_current_write_index();
+    if (MYSELF_IS_MASTER) {
+        ctx->info.data_version = __sync_add_and_fetch(
+                &DATA_CURRENT_VERSION, 0);
+    } else {
+        /* the current data version of the slave is the max version of
+         * the records applied out of order by the data threads, the
+         * applied version is in the binlog order, 0 before replicating
+         */
+        ctx->info.data_version = __sync_add_and_fetch(
+                &DATA_APPLIED_VERSION, 0);
+    }
+    if (ctx->info.data_version <= dumper_vars.last.data_version) {
+        return 0;
+    }
+    ctx->record.data_version = ctx->info.data_version;
+
+    //changed only by installing the snapshot fetched from the other server
+    ctx->info.binlog_start_version = (dumper_vars.last.data_version > 0 ?
+            dumper_vars.last.binlog_start_version : 1);
+
+    /* fetch the dirty directories after the data version, so the changes
+     * not greater than the data version are all marked */
+    memset(&dirty, 0, sizeof(dirty));
+    if (g_data_thread_vars.dirty.enabled) {
+        if ((result=data_thread_fetch_dirty_dirs(&dirty)) != 0) {
+            dumper_vars.force_full = true;
+        }
+    }
+
+    *is_full = (dumper_vars.last.data_version == 0 ||
+            dumper_vars.force_full || !g_data_thread_vars.dirty.enabled ||
+            dumper_vars.last.delta_count >= SNAPSHOT_MAX_DELTA_COUNT);
+    if (*is_full) {
+        ctx->info.base_version = ctx->info.data_version;
+        ctx->info.delta_count = 0;
+        GET_SNAPSHOT_FILENAME(ctx->filename, sizeof(ctx->filename),
+                ctx->info.base_version);
+        result = dump_to_file(ctx, NULL);
+        ctx->info.dentry_count = ctx->record_count;
+    } else {
+        ctx->info.base_version = dumper_vars.last.base_version;
+        ctx->info.delta_count = dumper_vars.last.delta_count + 1;
+        ctx->info.dentry_count = dumper_vars.last.dentry_count;
+        GET_SNAPSHOT_DELTA_FILENAME(ctx->filename, sizeof(ctx->filename),
+                ctx->info.base_version, ctx->info.delta_count);
+        result = dump_to_file(ctx, &dirty);
+    }
+    data_thread_inode_array_free(&dirty);
+
+    if (result == 0) {
+        ctx->info.inode_sn = __sync_add_and_fetch(&CURRENT_INODE_SN, 0);
+        result = write_snapshot_info(&ctx->info);
+    }
+    if (result != 0) {
+        //the dirty directories are lost
+        dumper_vars.force_full = true;
+        return result;
+    }
+
+    if (*is_full && dumper_vars.last.data_version > 0) {
+        remove_snapshot_files(&dumper_vars.last);
+    }
+    dumper_vars.last = ctx->info;
+    dumper_vars.force_full = false;
+    return 0;
+}
+
+int data_dumper_dump()
+{
+    DataDumperContext ctx;
+    int64_t start_time;
+    char time_buff[32];
+    bool is_full;
+    int result;
+
+    if (!__sync_bool_compare_and_swap(&dumper_vars.dumping, false, true)) {
+        return EINPROGRESS;
+    }
+
+    start_time = get_current_time_ms();
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.fd = -1;
+    ctx.record.timestamp = g_current_time;
+    is_full = false;
+    if ((result=fast_buffer_init_ex(&ctx.buffer,
+                    2 * SNAPSHOT_FLUSH_BUFFER_SIZE)) == 0)
+    {
+        result = do_dump(&ctx, &is_full);
+        fast_buffer_destroy(&ctx.buffer);
+    }
+    if (ctx.stack.inodes != NULL) {
+        free(ctx.stack.inodes);
+    }
+
+    if (result == 0 && ctx.record_count > 0) {
+        logInfo("file: "__FILE__", line: %d, "
+                "dump %s snapshot %s done, data version: %"PRId64", "
+                "record count: %"PRId64", time used: %s ms", __LINE__,
+                is_full ? "full" : "delta", ctx.filename,
+                ctx.info.data_version, ctx.record_count,
+                long_to_comma_str(get_current_time_ms() -
+                    start_time, time_buff));
+    } else if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "dump snapshot fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+    }
+
+    __sync_bool_compare_and_swap(&dumper_vars.dumping, true, false);
+    return result;
+}
+
+void data_dumper_suspend()
+{
+    while (!__sync_bool_compare_and_swap(&dumper_vars.dumping, false, true)) {
+        usleep(100 * 1000);
+    }
+}
+
+void data_dumper_resume()
+{
+    __sync_bool_compare_and_swap(&dumper_vars.dumping, true, false);
+}
+
+int data_dumper_commit_info(const FDIRSnapshotInfo *info)
+{
+    int result;
+
+    if ((result=write_snapshot_info(info)) != 0) {
+        return result;
+    }
+
+    if (dumper_vars.last.data_version > 0 &&
+            dumper_vars.last.base_version != info->base_version)
+    {
+        remove_snapshot_files(&dumper_vars.last);
+    }
+    dumper_vars.last = *info;
+    dumper_vars.force_full = false;
+    return 0;
+}
+
+static int dump_snapshot_func(void *args)
+{
+    data_dumper_dump();
+    return 0;
+}
+
+int data_dumper_init()
+{
+    FDIRSnapshotInfo info;
+    ScheduleEntry schedule_entry;
+    ScheduleArray schedule_array;
+
+    if (data_dumper_load_info(&info) == 0) {
+        dumper_vars.last = info;
+    }
+
+    if (SNAPSHOT_INTERVAL == 0) {
+        return 0;
+    }
+
+    INIT_SCHEDULE_ENTRY(schedule_entry, sched_generate_next_id(),
+            0, 0, 0, SNAPSHOT_INTERVAL, dump_snapshot_func, NULL);
+    schedule_entry.new_thread = true;
+
+    schedule_array.count = 1;
+    schedule_array.entries = &schedule_entry;
+    return sched_add_entries(&schedule_array);
+}
@@ -0,0 +1,59 @@
+//data_dumper.h
+
+#ifndef _DATA_DUMPER_H_
+#define _DATA_DUMPER_H_
+
+#include "server_types.h"
+
+#define SNAPSHOT_INFO_FILENAME  "snapshot.info"
+#define SNAPSHOT_FILE_PREFIX    "snapshot"
+
+#define GET_SNAPSHOT_FILENAME(filename, size, data_version) \
+    snprintf(filename, size, "%s/%s.%"PRId64, DATA_PATH_STR, \
+            SNAPSHOT_FILE_PREFIX, (int64_t)(data_version))
+
+#define GET_SNAPSHOT_DELTA_FILENAME(filename, size, base_version, index) \
+    snprintf(filename, size, "%s/%s.%"PRId64".%d", DATA_PATH_STR, \
+            SNAPSHOT_FILE_PREFIX, (int64_t)(base_version), index)
+
+/* the snapshot is a fuzzy dump without stopping the writes: all changes
+ * with data version <= data_version are included, the later ones may be.
+ * the binlog replay after it is idempotent under the loose error mode.
+ *
+ * a full snapshot dumps all namespaces, the following delta snapshots
+ * only dump the directories changed since the previous one and are
+ * loaded in order after the full one (the base).
+ */
+typedef struct fdir_snapshot_info {
+    int64_t data_version;  //the data version when the last dump starts
+    int64_t base_version;  //the data version of the full snapshot
+    int64_t inode_sn;      //the inode sn when the last dump ends
+    int64_t dentry_count;  //the dentry count of the full snapshot
+    int64_t binlog_start_version; //the local binlog is complete from it
+    int binlog_index;      //the binlog write index when the last dump starts
+    int delta_count;       //the delta snapshot count after the full one
+} FDIRSnapshotInfo;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int data_dumper_init();
+
+//return ENOENT when no snapshot
+int data_dumper_load_info(FDIRSnapshotInfo *info);
+
+int data_dumper_dump();
+
+//wait the dumping done and stop the following dumps until resume
+void data_dumper_suspend();
+void data_dumper_resume();
+
+//install the snapshot fetched from the other server, called when suspended
+int data_dumper_commit_info(const FDIRSnapshotInfo *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,483 @@
+//data_fetcher.c
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "common/fdir_proto.h"
+#include "server_global.h"
+#include "server_binlog.h"
+#include "cluster_info.h"
+#include "data_dumper.h"
+#include "data_loader.h"
+#include "data_fetcher.h"
+
+#define FETCH_SNAPSHOT_CHUNK_SIZE  (256 * 1024)
+#define FETCH_SNAPSHOT_RETRY_INTERVAL  1   //in seconds
+
+static struct {
+    volatile bool running;
+} fetcher_vars = {false};
+
+bool data_fetcher_is_running()
+{
+    return __sync_add_and_fetch(&fetcher_vars.running, 0);
+}
+
+static void fdir_log_network_error_ex(const ConnectionInfo *conn,
+        const FDIRResponseInfo *response, const int line, const int result)
+{
+    if (response->error.length > 0) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, %s", line, conn->ip_addr,
+                conn->port, response->error.message);
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "communicate with server %s:%d fail, "
+                "errno: %d, error info: %s", line,
+                conn->ip_addr, conn->port, result, STRERROR(result));
+    }
+}
+
+#define fdir_log_network_error(conn, response, result) \
+    fdir_log_network_error_ex(conn, response, __LINE__, result)
+
+static int proto_get_snapshot_info(ConnectionInfo *conn,
+        FDIRSnapshotInfo *info)
+{
+    int result;
+    FDIRProtoHeader *header;
+    FDIRProtoGetSnapshotInfoResp *resp;
+    FDIRResponseInfo response;
+    char out_buff[sizeof(FDIRProtoHeader)];
+    char in_body[sizeof(FDIRProtoGetSnapshotInfoResp)];
+
+    header = (FDIRProtoHeader *)out_buff;
+    FDIR_PROTO_SET_HEADER(header, FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_REQ, 0);
+    if ((result=fdir_send_and_check_response_header(conn, out_buff,
+                    sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
+                    FDIR_CLUSTER_PROTO_GET_SNAPSHOT_INFO_RESP)) != 0)
+    {
+        if (result != ENOENT) {
+            fdir_log_network_error(conn, &response, result);
+        }
+        return result;
+    }
+
+    if (response.header.body_len != sizeof(FDIRProtoGetSnapshotInfoResp)) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, recv body length: %d != %d",
+                __LINE__, conn->ip_addr, conn->port,
+                response.header.body_len,
+                (int)sizeof(FDIRProtoGetSnapshotInfoResp));
+        return EINVAL;
+    }
+
+    if ((result=tcprecvdata_nb(conn->sock, in_body, response.header.body_len,
+                    SF_G_NETWORK_TIMEOUT)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "recv from server %s:%d fail, "
+                "errno: %d, error info: %s",
+                __LINE__, conn->ip_addr, conn->port,
+                result, STRERROR(result));
+        return result;
+    }
+
+    resp = (FDIRProtoGetSnapshotInfoResp *)in_body;
+    info->data_version = buff2long(resp->data_version);
+    info->base_version = buff2long(resp->base_version);
+    info->inode_sn = buff2long(resp->inode_sn);
+    info->dentry_count = buff2long(resp->dentry_count);
+    info->binlog_start_version = buff2long(resp->binlog_start_version);
+    info->delta_count = buff2int(resp->delta_count);
+    if (info->data_version <= 0 || info->base_version <= 0 ||
+            info->base_version > info->data_version ||
+            info->delta_count < 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, invalid snapshot data version: %"PRId64", "
+                "base version: %"PRId64" or delta count: %d", __LINE__,
+                conn->ip_addr, conn->port, info->data_version,
+                info->base_version, info->delta_count);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int proto_fetch_snapshot(ConnectionInfo *conn,
+        const int64_t base_version, const int file_index,
+        const int64_t offset, char *buff, int *bytes)
+{
+    int result;
+    FDIRProtoHeader *header;
+    FDIRProtoFetchSnapshotReq *req;
+    FDIRResponseInfo response;
+    char out_buff[sizeof(FDIRProtoHeader) + sizeof(FDIRProtoFetchSnapshotReq)];
+
+    header = (FDIRProtoHeader *)out_buff;
+    FDIR_PROTO_SET_HEADER(header, FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_REQ,
+            sizeof(out_buff) - sizeof(FDIRProtoHeader));
+
+    req = (FDIRProtoFetchSnapshotReq *)(out_buff + sizeof(FDIRProtoHeader));
+    long2buff(base_version, req->base_version);
+    int2buff(file_index, req->file_index);
+    long2buff(offset, req->offset);
+    int2buff(FETCH_SNAPSHOT_CHUNK_SIZE, req->size);
+
+    if ((result=fdir_send_and_check_response_header(conn, out_buff,
+                    sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
+                    FDIR_CLUSTER_PROTO_FETCH_SNAPSHOT_RESP)) != 0)
+    {
+        fdir_log_network_error(conn, &response, result);
+        return result;
+    }
+
+    if (response.header.body_len > FETCH_SNAPSHOT_CHUNK_SIZE) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%d, recv body length: %d > %d",
+                __LINE__, conn->ip_addr, conn->port,
+                response.header.body_len, FETCH_SNAPSHOT_CHUNK_SIZE);
+        return EINVAL;
+    }
+
+    *bytes = response.header.body_len;
+    if (*bytes == 0) {
+        return 0;
+    }
+
+    if ((result=tcprecvdata_nb(conn->sock, buff, *bytes,
+                    SF_G_NETWORK_TIMEOUT)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "recv from server %s:%d fail, "
+                "errno: %d, error info: %s",
+                __LINE__, conn->ip_addr, conn->port,
+                result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+static inline void get_snapshot_filename(const FDIRSnapshotInfo *info,
+        const int file_index, char *filename, const int size)
+{
+    if (file_index == 0) {
+        GET_SNAPSHOT_FILENAME(filename, size, info->base_version);
+    } else {
+        GET_SNAPSHOT_DELTA_FILENAME(filename, size,
+                info->base_version, file_index);
+    }
+}
+
+static inline void get_tmp_filename(const FDIRSnapshotInfo *info,
+        const int file_index, char *tmp_filename, const int size)
+{
+    char filename[PATH_MAX];
+
+    get_snapshot_filename(info, file_index, filename, sizeof(filename));
+    snprintf(tmp_filename, size, "%s.tmp", filename);
+}
+
+static int fetch_snapshot_file(ConnectionInfo *conn,
+        const FDIRSnapshotInfo *info, const int file_index,
+        char *buff, int64_t *total_bytes)
+{
+    char tmp_filename[PATH_MAX];
+    int64_t offset;
+    int bytes;
+    int fd;
+    int result;
+
+    get_tmp_filename(info, file_index, tmp_filename, sizeof(tmp_filename));
+    if ((fd=open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, result, STRERROR(result));
+        return result;
+    }
+
+    result = 0;
+    offset = 0;
+    while (SF_G_CONTINUE_FLAG) {
+        if ((result=proto_fetch_snapshot(conn, info->base_version,
+                        file_index, offset, buff, &bytes)) != 0)
+        {
+            break;
+        }
+        if (bytes == 0) {
+            break;
+        }
+
+        if (fc_safe_write(fd, buff, bytes) != bytes) {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "write to file \"%s\" fail, errno: %d, error info: %s",
+                    __LINE__, tmp_filename, result, STRERROR(result));
+            break;
+        }
+        offset += bytes;
+    }
+    if (result == 0 && !SF_G_CONTINUE_FLAG) {
+        result = EINTR;
+    }
+
+    if (result == 0 && fsync(fd) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "fsync file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, result, STRERROR(result));
+    }
+    close(fd);
+
+    if (result == 0) {
+        *total_bytes += offset;
+    } else {
+        unlink(tmp_filename);
+    }
+    return result;
+}
+
+static int rename_snapshot_files(const FDIRSnapshotInfo *info)
+{
+    char tmp_filename[PATH_MAX];
+    char filename[PATH_MAX];
+    int result;
+    int i;
+
+    for (i=0; i<=info->delta_count; i++) {
+        get_tmp_filename(info, i, tmp_filename, sizeof(tmp_filename));
+        get_snapshot_filename(info, i, filename, sizeof(filename));
+        if (rename(tmp_filename, filename) != 0) {
+            result = errno != 0 ? errno : EPERM;
+            logError("file: "__FILE__", line: %d, "
+                    "rename file \"%s\" to \"%s\" fail, "
+                    "errno: %d, error info: %s", __LINE__, tmp_filename,
+                    filename, result, STRERROR(result));
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static void remove_tmp_files(const FDIRSnapshotInfo *info, const int count)
+{
+    char tmp_filename[PATH_MAX];
+    int i;
+
+    for (i=0; i<count; i++) {
+        get_tmp_filename(info, i, tmp_filename, sizeof(tmp_filename));
+        unlink(tmp_filename);
+    }
+}
+
+static int fetch_snapshot(ConnectionInfo *conn, FDIRSnapshotInfo *info)
+{
+    char *buff;
+    int64_t start_time;
+    int64_t total_bytes;
+    char time_buff[32];
+    int result;
+    int i;
+
+    buff = (char *)malloc(FETCH_SNAPSHOT_CHUNK_SIZE);
+    if (buff == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__,
+                FETCH_SNAPSHOT_CHUNK_SIZE);
+        return ENOMEM;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "fetching snapshot from server %s:%d, base version: %"PRId64", "
+            "delta count: %d, data version: %"PRId64" ...", __LINE__,
+            conn->ip_addr, conn->port, info->base_version,
+            info->delta_count, info->data_version);
+
+    start_time = get_current_time_ms();
+    total_bytes = 0;
+    for (i=0; i<=info->delta_count; i++) {
+        if ((result=fetch_snapshot_file(conn, info, i, buff,
+                        &total_bytes)) != 0)
+        {
+            break;
+        }
+    }
+    free(buff);
+
+    if (result == 0) {
+        result = rename_snapshot_files(info);
+    }
+    if (result != 0) {
+        remove_tmp_files(info, i);
+        return result;
+    }
+
+    //the binlog records replicated after the snapshot are all local
+    info->binlog_index = binlog_get_current_write_index();
+    info->binlog_start_version = info->data_version + 1;
+
+    logInfo("file: "__FILE__", line: %d, "
+            "fetch snapshot from server %s:%d done, file count: %d, "
+            "bytes: %"PRId64", time used: %s ms", __LINE__,
+            conn->ip_addr, conn->port, info->delta_count + 1, total_bytes,
+            long_to_comma_str(get_current_time_ms() - start_time,
+                time_buff));
+    return 0;
+}
+
+/* the slave with data syncs the binlog when the source has the binlog
+ * from its data version, unless it lags too far behind the snapshot
+ */
+static bool check_reseed(FDIRClusterServerInfo *source,
+        const FDIRSnapshotInfo *info, const int64_t current_version)
+{
+    int64_t lag_versions;
+
+    if (current_version + 1 < info->binlog_start_version) {
+        logWarning("file: "__FILE__", line: %d, "
+                "my data version: %"PRId64", the binlog of server id: %d "
+                "starts from data version: %"PRId64", reset my data to "
+                "the snapshot of data version: %"PRId64, __LINE__,
+                current_version, source->server->id,
+                info->binlog_start_version, info->data_version);
+        return true;
+    }
+
+    lag_versions = info->data_version - current_version;
+    if (RESEED_LAG_VERSIONS > 0 && lag_versions > RESEED_LAG_VERSIONS) {
+        logWarning("file: "__FILE__", line: %d, "
+                "my data version: %"PRId64" lags behind the snapshot "
+                "data version: %"PRId64" of server id: %d by %"PRId64" "
+                "> reseed_lag_versions: %"PRId64", reset my data to "
+                "the snapshot", __LINE__, current_version,
+                info->data_version, source->server->id,
+                lag_versions, RESEED_LAG_VERSIONS);
+        return true;
+    }
+
+    return false;
+}
+
+static int bootstrap_from_server(FDIRClusterServerInfo *source)
+{
+    ConnectionInfo conn;
+    FDIRSnapshotInfo info;
+    int64_t current_version;
+    bool reseed;
+    int result;
+
+    if ((result=fc_server_make_connection(&CLUSTER_GROUP_ADDRESS_ARRAY(
+                        source->server), &conn, SF_G_CONNECT_TIMEOUT)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=proto_get_snapshot_info(&conn, &info)) != 0) {
+        conn_pool_disconnect_server(&conn);
+        return result;
+    }
+
+    current_version = __sync_add_and_fetch(&DATA_CURRENT_VERSION, 0);
+    if (current_version >= info.data_version) {
+        conn_pool_disconnect_server(&conn);
+        return 0;
+    }
+
+    reseed = (current_version > 0);
+    if (reseed && !check_reseed(source, &info, current_version)) {
+        conn_pool_disconnect_server(&conn);
+        return 0;
+    }
+
+    result = fetch_snapshot(&conn, &info);
+    conn_pool_disconnect_server(&conn);
+    if (result != 0) {
+        return result;
+    }
+
+    data_dumper_suspend();
+    if ((result=data_dumper_commit_info(&info)) == 0) {
+        if (reseed) {
+            result = data_loader_reseed_snapshot(&info);
+        } else {
+            result = data_loader_load_snapshot(&info);
+        }
+        if (result != 0) {
+            //the partly loaded data can't be rolled back
+            logCrit("file: "__FILE__", line: %d, "
+                    "load the fetched snapshot fail, errno: %d, "
+                    "error info: %s, program exit!", __LINE__,
+                    result, STRERROR(result));
+            SF_G_CONTINUE_FLAG = false;
+        }
+    }
+    data_dumper_resume();
+    return result;
+}
+
+static void *data_fetcher_thread_func(void *arg)
+{
+    FDIRClusterServerInfo *source;
+    int result;
+
+    while (SF_G_CONTINUE_FLAG) {
+        source = cluster_info_get_source(CLUSTER_MYSELF_PTR);
+        if (source == NULL || source == CLUSTER_MYSELF_PTR) {
+            break;  //restart when the master set
+        }
+
+        if ((result=bootstrap_from_server(source)) == 0) {
+            break;
+        } else if (result == ENOENT) {
+            logInfo("file: "__FILE__", line: %d, "
+                    "server id: %d has no snapshot, sync the binlog",
+                    __LINE__, source->server->id);
+            break;
+        } else if (result != EAGAIN) {  //EAGAIN for the snapshot changed
+            sleep(FETCH_SNAPSHOT_RETRY_INTERVAL);
+        }
+    }
+
+    __sync_bool_compare_and_swap(&fetcher_vars.running, true, false);
+    return NULL;
+}
+
+int data_fetcher_start()
+{
+    pthread_t tid;
+    int result;
+
+    if (!BOOTSTRAP_FROM_SNAPSHOT) {
+        return 0;
+    }
+
+    if (!__sync_bool_compare_and_swap(&fetcher_vars.running, false, true)) {
+        return 0;
+    }
+
+    if ((result=fc_create_thread(&tid, data_fetcher_thread_func,
+                    NULL, SF_G_THREAD_STACK_SIZE)) != 0)
+    {
+        __sync_bool_compare_and_swap(&fetcher_vars.running, true, false);
+    }
+    return result;
+}
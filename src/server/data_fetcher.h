@@ -0,0 +1,27 @@
+//data_fetcher.h
+
+#ifndef _DATA_FETCHER_H_
+#define _DATA_FETCHER_H_
+
+#include "server_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the empty slave, or the slave whose data version is older than the
+ * latest snapshot of the server to sync the binlog from, fetches the
+ * snapshot and loads it (the slave with data is reset to the snapshot),
+ * then the binlog replication starts from the data version of the snapshot
+ * instead of the data version of the slave
+ */
+int data_fetcher_start();
+
+//the binlog replication should wait until the snapshot loaded
+bool data_fetcher_is_running();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -9,41 +9,752 @@
 #include <errno.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <pthread.h>
 #include "fastcommon/logger.h"
 #include "fastcommon/sockopt.h"
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "fastcommon/hash.h"
 #include "sf/sf_global.h"
 #include "server_global.h"
 #include "server_binlog.h"
 #include "data_thread.h"
+#include "inode_index.h"
+#include "dentry.h"
+#include "data_dumper.h"
 #include "data_loader.h"
 
-int server_load_data()
+#define DELTA_FLUSH_BUFFER_SIZE   (4 * 1024 * 1024)
+#define DELTA_PENDING_SET_BITS    16
+
+typedef int (*snapshot_deal_buffer_func)(void *args,
+        const char *buff, const int len);
+
+typedef struct {
+    int64_t *inodes;   //open addressing, 0 for the empty slot
+    int bits;
+    int count;
+} PendingInodeSet;
+
+typedef struct {
+    BinlogReplayContext *replay_ctx;
+    FastBuffer buffer;         //the records to apply
+    PendingInodeSet pending;   //the directories of the records to apply
+    FDIRBinlogRecord record;   //the unpacked record
+    FDIRBinlogRecord removal;  //the remove record generated
+    struct {
+        int64_t inode;
+        bool skip;
+        FDIRServerDentryArray children;  //the children before loading
+        int index;   //the merge position of the children
+        char ns_buff[256];
+    } section;
+} DeltaLoaderContext;
+
+static int load_snapshot_file(const char *filename,
+        snapshot_deal_buffer_func deal_func, void *args)
+{
+    char *buff;
+    const char *rec_end;
+    int fd;
+    int remain;
+    int bytes;
+    int result;
+
+    if ((fd=open(filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    if ((buff=(char *)malloc(BINLOG_BUFFER_SIZE)) == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, BINLOG_BUFFER_SIZE);
+        close(fd);
+        return ENOMEM;
+    }
+
+    result = 0;
+    remain = 0;
+    while (SF_G_CONTINUE_FLAG) {
+        if ((bytes=read(fd, buff + remain, BINLOG_BUFFER_SIZE - remain)) < 0) {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "read from file \"%s\" fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    filename, result, STRERROR(result));
+            break;
+        }
+
+        remain += bytes;
+        if (remain == 0) {
+            break;
+        }
+
+        if (binlog_detect_last_record_end(buff, remain,
+                    binlog_get_buffer_format(buff, remain), &rec_end) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "snapshot file: %s, no complete record in "
+                    "%d bytes", __LINE__, filename, remain);
+            result = EINVAL;
+            break;
+        }
+
+        if ((result=deal_func(args, buff, rec_end - buff)) != 0) {
+            break;
+        }
+
+        remain -= rec_end - buff;
+        if (remain > 0) {
+            if (bytes == 0) {
+                logError("file: "__FILE__", line: %d, "
+                        "snapshot file: %s, the last record is "
+                        "incomplete", __LINE__, filename);
+                result = EINVAL;
+                break;
+            }
+            memmove(buff, rec_end, remain);
+        }
+    }
+
+    free(buff);
+    close(fd);
+    return SF_G_CONTINUE_FLAG ? result : EINTR;
+}
+
+static int replay_snapshot_buffer(void *args, const char *buff, const int len)
+{
+    return binlog_replay_deal_buffer((BinlogReplayContext *)args,
+            buff, len, NULL);
+}
+
+static inline int pending_set_slot(const PendingInodeSet *set,
+        const int64_t inode)
+{
+    return (int)(((uint64_t)inode * 0x9E3779B97F4A7C15ULL) >>
+            (64 - set->bits));
+}
+
+static void pending_set_add(PendingInodeSet *set, const int64_t inode)
+{
+    int mask;
+    int slot;
+
+    mask = (1 << set->bits) - 1;
+    slot = pending_set_slot(set, inode);
+    while (set->inodes[slot] != 0) {
+        if (set->inodes[slot] == inode) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    set->inodes[slot] = inode;
+    set->count++;
+}
+
+static bool pending_set_contains(const PendingInodeSet *set,
+        const int64_t inode)
+{
+    int mask;
+    int slot;
+
+    mask = (1 << set->bits) - 1;
+    slot = pending_set_slot(set, inode);
+    while (set->inodes[slot] != 0) {
+        if (set->inodes[slot] == inode) {
+            return true;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return false;
+}
+
+static int delta_flush(DeltaLoaderContext *ctx)
+{
+    int result;
+
+    if (ctx->buffer.length == 0) {
+        return 0;
+    }
+
+    result = binlog_replay_deal_buffer(ctx->replay_ctx,
+            ctx->buffer.data, ctx->buffer.length, NULL);
+    ctx->buffer.length = 0;
+    if (ctx->pending.count > 0) {
+        memset(ctx->pending.inodes, 0, sizeof(int64_t) *
+                (1 << ctx->pending.bits));
+        ctx->pending.count = 0;
+    }
+    return result;
+}
+
+static inline int delta_emit(DeltaLoaderContext *ctx,
+        const FDIRBinlogRecord *record)
+{
+    return binlog_pack_record_ex(record, FDIR_BINLOG_RECORD_FORMAT_BINARY,
+            &ctx->buffer);
+}
+
+//remove the dentry and all of it's descendants, the children first
+static int delta_remove_dentry(DeltaLoaderContext *ctx,
+        const int64_t parent_inode, FDIRServerDentry *dentry)
+{
+    FDIRServerDentry *child;
+    UniqSkiplistIterator iterator;
+    int result;
+
+    if (S_ISDIR(dentry->stat.mode)) {
+        uniq_skiplist_iterator(dentry->children, &iterator);
+        while ((child=(FDIRServerDentry *)uniq_skiplist_next(
+                        &iterator)) != NULL)
+        {
+            if ((result=delta_remove_dentry(ctx,
+                            dentry->inode, child)) != 0)
+            {
+                return result;
+            }
+        }
+    }
+
+    ctx->removal.inode = dentry->inode;
+    ctx->removal.pname.parent_inode = parent_inode;
+    ctx->removal.pname.name = dentry->name;
+    return delta_emit(ctx, &ctx->removal);
+}
+
+static int delta_get_children(FDIRServerDentry *dir,
+        FDIRServerDentryArray *array)
+{
+    FDIRServerDentry **entries;
+    FDIRServerDentry *child;
+    UniqSkiplistIterator iterator;
+    int count;
+    int alloc;
+    int bytes;
+
+    array->count = 0;
+    count = uniq_skiplist_count(dir->children);
+    if (count > array->alloc) {
+        alloc = (array->alloc > 0) ? array->alloc : 1024;
+        while (alloc < count) {
+            alloc *= 2;
+        }
+
+        bytes = sizeof(FDIRServerDentry *) * alloc;
+        entries = (FDIRServerDentry **)realloc(array->entries, bytes);
+        if (entries == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "realloc %d bytes fail", __LINE__, bytes);
+            return ENOMEM;
+        }
+        array->entries = entries;
+        array->alloc = alloc;
+    }
+
+    uniq_skiplist_iterator(dir->children, &iterator);
+    while (array->count < count && (child=(FDIRServerDentry *)
+                uniq_skiplist_next(&iterator)) != NULL)
+    {
+        array->entries[array->count++] = child;
+    }
+    return 0;
+}
+
+static int delta_end_section(DeltaLoaderContext *ctx)
+{
+    int result;
+
+    if (ctx->section.skip) {
+        return 0;
+    }
+
+    while (ctx->section.index < ctx->section.children.count) {
+        if ((result=delta_remove_dentry(ctx, ctx->section.inode,
+                        ctx->section.children.entries[
+                        ctx->section.index++])) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+/* the section header is the update record of the directory, apply the
+ * pending records first when they create or remove the directory */
+static int delta_start_section(DeltaLoaderContext *ctx)
+{
+    FDIRBinlogRecord *record;
+    FDIRServerDentry *dir;
+    int result;
+
+    if ((result=delta_end_section(ctx)) != 0) {
+        return result;
+    }
+
+    record = &ctx->record;
+    if (ctx->buffer.length >= DELTA_FLUSH_BUFFER_SIZE ||
+            ctx->pending.count >= (1 << (ctx->pending.bits - 1)) ||
+            pending_set_contains(&ctx->pending, record->inode) ||
+            (record->options.pname && pending_set_contains(
+                &ctx->pending, record->pname.parent_inode)))
+    {
+        if ((result=delta_flush(ctx)) != 0) {
+            return result;
+        }
+    }
+
+    if (record->fullname.ns.len >= sizeof(ctx->section.ns_buff)) {
+        logError("file: "__FILE__", line: %d, "
+                "namespace length: %d is too long", __LINE__,
+                record->fullname.ns.len);
+        return EINVAL;
+    }
+    memcpy(ctx->section.ns_buff, record->fullname.ns.str,
+            record->fullname.ns.len);
+    ctx->removal.fullname.ns.str = ctx->section.ns_buff;
+    ctx->removal.fullname.ns.len = record->fullname.ns.len;
+    ctx->removal.hash_code = record->hash_code;
+    ctx->removal.data_version = record->data_version;
+    ctx->removal.timestamp = record->timestamp;
+
+    ctx->section.inode = record->inode;
+    ctx->section.children.count = 0;
+    ctx->section.index = 0;
+    ctx->section.skip = false;
+    if ((dir=inode_index_get_dentry(record->inode)) == NULL) {
+        if (record->options.pname) {
+            //removed later, the binlog replay will do
+            ctx->section.skip = true;
+            return 0;
+        }
+
+        //the root of the new namespace
+        record->operation = BINLOG_OP_CREATE_DENTRY_INT;
+        pending_set_add(&ctx->pending, record->inode);
+        return delta_emit(ctx, record);
+    }
+
+    if (!S_ISDIR(dir->stat.mode)) {
+        ctx->section.skip = true;
+        return 0;
+    }
+
+    if ((result=delta_get_children(dir, &ctx->section.children)) != 0) {
+        return result;
+    }
+
+    pending_set_add(&ctx->pending, record->inode);
+    if (memcmp(&dir->stat, &record->stat, sizeof(FDIRDEntryStatus)) == 0) {
+        return 0;
+    }
+    return delta_emit(ctx, record);
+}
+
+/* merge the children of the section and the current ones, both are
+ * in the order of the name */
+static int delta_deal_child(DeltaLoaderContext *ctx)
+{
+    FDIRBinlogRecord *record;
+    FDIRServerDentry *child;
+    int cmp;
+    int result;
+
+    if (ctx->section.skip) {
+        return 0;
+    }
+
+    record = &ctx->record;
+    if (!record->options.pname || record->pname.parent_inode !=
+            ctx->section.inode)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "inode: %"PRId64", the parent inode: %"PRId64" != "
+                "the section inode: %"PRId64, __LINE__, record->inode,
+                record->pname.parent_inode, ctx->section.inode);
+        return EINVAL;
+    }
+
+    while (ctx->section.index < ctx->section.children.count) {
+        child = ctx->section.children.entries[ctx->section.index];
+        cmp = fc_string_compare(&child->name, &record->pname.name);
+        if (cmp > 0) {
+            break;
+        }
+
+        ctx->section.index++;
+        if (cmp < 0) {
+            if ((result=delta_remove_dentry(ctx,
+                            ctx->section.inode, child)) != 0)
+            {
+                return result;
+            }
+            continue;
+        }
+
+        if (child->inode == record->inode) {
+            if (memcmp(&child->stat, &record->stat,
+                        sizeof(FDIRDEntryStatus)) == 0)
+            {
+                return 0;
+            }
+            record->operation = BINLOG_OP_UPDATE_DENTRY_INT;
+            return delta_emit(ctx, record);
+        }
+
+        //the same name with another inode
+        if ((result=delta_remove_dentry(ctx,
+                        ctx->section.inode, child)) != 0)
+        {
+            return result;
+        }
+        break;
+    }
+
+    return delta_emit(ctx, record);
+}
+
+static int delta_deal_buffer(void *args, const char *buff, const int len)
+{
+    DeltaLoaderContext *ctx;
+    const char *p;
+    const char *end;
+    const char *rec_end;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+    int result;
+
+    ctx = (DeltaLoaderContext *)args;
+    p = buff;
+    end = buff + len;
+    while (p < end) {
+        if ((result=binlog_unpack_record(p, end - p, &ctx->record,
+                        &rec_end, error_info, sizeof(error_info))) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "%s", __LINE__, error_info);
+            return result;
+        }
+        p = rec_end;
+
+        if (ctx->record.operation == BINLOG_OP_UPDATE_DENTRY_INT) {
+            result = delta_start_section(ctx);
+        } else if (ctx->record.operation == BINLOG_OP_CREATE_DENTRY_INT) {
+            result = delta_deal_child(ctx);
+        } else {
+            logError("file: "__FILE__", line: %d, "
+                    "unexpected operation: %d", __LINE__,
+                    ctx->record.operation);
+            result = EINVAL;
+        }
+
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int load_delta_snapshot(BinlogReplayContext *replay_ctx,
+        const char *filename)
+{
+    DeltaLoaderContext ctx;
+    int bytes;
+    int result;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.replay_ctx = replay_ctx;
+    ctx.section.skip = true;
+    ctx.removal.operation = BINLOG_OP_REMOVE_DENTRY_INT;
+    ctx.removal.options.pname = 1;
+    ctx.pending.bits = DELTA_PENDING_SET_BITS;
+    bytes = sizeof(int64_t) * (1 << ctx.pending.bits);
+    if ((ctx.pending.inodes=(int64_t *)malloc(bytes)) == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+    memset(ctx.pending.inodes, 0, bytes);
+
+    if ((result=fast_buffer_init_ex(&ctx.buffer, 2 *
+                    DELTA_FLUSH_BUFFER_SIZE)) == 0)
+    {
+        result = load_snapshot_file(filename, delta_deal_buffer, &ctx);
+        if (result == 0) {
+            result = delta_end_section(&ctx);
+        }
+        if (result == 0) {
+            result = delta_flush(&ctx);
+        }
+        fast_buffer_destroy(&ctx.buffer);
+    }
+
+    dentry_array_free(&ctx.section.children);
+    free(ctx.pending.inodes);
+    return result;
+}
+
+/* remove the dentries except the namespace roots, the children first.
+ * the dentries are freed delay, so the iteration of the root children
+ * is safe when the removals of the former children flushed */
+static int reseed_clear_namespaces(DeltaLoaderContext *ctx)
+{
+    FDIRNamespaceDentryArray ns_array;
+    FDIRNamespaceDentry *nd;
+    FDIRNamespaceDentry *end;
+    FDIRServerDentry *child;
+    UniqSkiplistIterator iterator;
+    int result;
+
+    memset(&ns_array, 0, sizeof(ns_array));
+    if ((result=dentry_get_namespaces(&ns_array)) != 0) {
+        return result;
+    }
+
+    end = ns_array.entries + ns_array.count;
+    for (nd=ns_array.entries; nd<end && result == 0; nd++) {
+        if (!S_ISDIR(nd->root->stat.mode)) {
+            continue;
+        }
+
+        ctx->removal.fullname.ns = nd->ns;
+        ctx->removal.hash_code = simple_hash(nd->ns.str, nd->ns.len);
+        uniq_skiplist_iterator(nd->root->children, &iterator);
+        while ((child=(FDIRServerDentry *)uniq_skiplist_next(
+                        &iterator)) != NULL)
+        {
+            if ((result=delta_remove_dentry(ctx, nd->root->inode,
+                            child)) != 0)
+            {
+                break;
+            }
+            if (ctx->buffer.length >= DELTA_FLUSH_BUFFER_SIZE &&
+                    (result=delta_flush(ctx)) != 0)
+            {
+                break;
+            }
+        }
+
+        if (result == 0) {
+            result = delta_flush(ctx);
+        }
+    }
+
+    dentry_namespace_array_free(&ns_array);
+    return result;
+}
+
+/* the root of the namespace is kept by the clearing, so it is updated
+ * instead of created, the inode of the root should be the same */
+static int reseed_deal_root(DeltaLoaderContext *ctx)
+{
+    FDIRServerDentry *root;
+
+    if (dentry_find(&ctx->record.fullname, &root) != 0) {
+        return delta_emit(ctx, &ctx->record);  //the new namespace
+    }
+
+    if (root->inode != ctx->record.inode) {
+        logError("file: "__FILE__", line: %d, "
+                "namespace: %.*s, the root inode: %"PRId64" != "
+                "the inode of the snapshot: %"PRId64, __LINE__,
+                ctx->record.fullname.ns.len, ctx->record.fullname.ns.str,
+                root->inode, ctx->record.inode);
+        return EINVAL;
+    }
+
+    ctx->record.operation = BINLOG_OP_UPDATE_DENTRY_INT;
+    return delta_emit(ctx, &ctx->record);
+}
+
+static int reseed_deal_buffer(void *args, const char *buff, const int len)
+{
+    DeltaLoaderContext *ctx;
+    const char *p;
+    const char *end;
+    const char *rec_end;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+    int result;
+
+    ctx = (DeltaLoaderContext *)args;
+    p = buff;
+    end = buff + len;
+    while (p < end) {
+        if ((result=binlog_unpack_record(p, end - p, &ctx->record,
+                        &rec_end, error_info, sizeof(error_info))) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "%s", __LINE__, error_info);
+            return result;
+        }
+
+        if (ctx->record.options.pname) {
+            result = fast_buffer_append_buff(&ctx->buffer, p, rec_end - p);
+        } else {
+            result = reseed_deal_root(ctx);
+        }
+        if (result != 0) {
+            return result;
+        }
+        p = rec_end;
+    }
+
+    if (ctx->buffer.length >= DELTA_FLUSH_BUFFER_SIZE) {
+        return delta_flush(ctx);
+    }
+    return 0;
+}
+
+//clear the loaded data then load the base snapshot over the roots
+static int reseed_load_base(BinlogReplayContext *replay_ctx,
+        const char *filename)
+{
+    DeltaLoaderContext ctx;
+    int result;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.replay_ctx = replay_ctx;
+    ctx.removal.operation = BINLOG_OP_REMOVE_DENTRY_INT;
+    ctx.removal.options.pname = 1;
+    ctx.removal.data_version = __sync_add_and_fetch(&DATA_CURRENT_VERSION, 0);
+    ctx.removal.timestamp = g_current_time;
+    if ((result=fast_buffer_init_ex(&ctx.buffer, 2 *
+                    DELTA_FLUSH_BUFFER_SIZE)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=reseed_clear_namespaces(&ctx)) == 0) {
+        logInfo("file: "__FILE__", line: %d, "
+                "the loaded data cleared, load the snapshot %s",
+                __LINE__, filename);
+        if ((result=load_snapshot_file(filename, reseed_deal_buffer,
+                        &ctx)) == 0)
+        {
+            result = delta_flush(&ctx);
+        }
+    }
+
+    fast_buffer_destroy(&ctx.buffer);
+    return result;
+}
+
+static int load_snapshot(FDIRSnapshotInfo *info, const bool reseed)
 {
     BinlogReplayContext replay_ctx;
+    char filename[PATH_MAX];
+    int i;
+    int result;
+
+    if ((result=data_dumper_load_info(info)) != 0) {
+        return result;
+    }
+
+    if ((result=binlog_replay_init(&replay_ctx, 64)) != 0) {
+        return result;
+    }
+
+    //the records of a snapshot are stamped with the same data version
+    replay_ctx.skip_by_version = false;
+    GET_SNAPSHOT_FILENAME(filename, sizeof(filename), info->base_version);
+    if (reseed) {
+        result = reseed_load_base(&replay_ctx, filename);
+    } else {
+        result = load_snapshot_file(filename, replay_snapshot_buffer,
+                &replay_ctx);
+    }
+    for (i=1; result == 0 && i<=info->delta_count; i++) {
+        GET_SNAPSHOT_DELTA_FILENAME(filename, sizeof(filename),
+                info->base_version, i);
+        if ((result=load_delta_snapshot(&replay_ctx, filename)) == ENOENT) {
+            result = EIO;  //can't fall back to replay the whole binlog
+        }
+    }
+    binlog_replay_destroy(&replay_ctx);
+    if (result != 0) {
+        return result;
+    }
+
+    //the loaded directories are not the changes for the next delta
+    data_thread_fetch_dirty_dirs(NULL);
+
+    if ((int64_t)DATA_CURRENT_VERSION < info->data_version) {
+        DATA_CURRENT_VERSION = info->data_version;
+    }
+    if (CURRENT_INODE_SN < info->inode_sn) {
+        CURRENT_INODE_SN = info->inode_sn;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "load snapshot done, base version: %"PRId64", "
+            "delta count: %d, data version: %"PRId64", "
+            "warning count: %"PRId64", replay the binlog from index: %d",
+            __LINE__, info->base_version, info->delta_count,
+            info->data_version, replay_ctx.warning_count,
+            info->binlog_index);
+    return 0;
+}
+
+int data_loader_load_snapshot(FDIRSnapshotInfo *info)
+{
+    return load_snapshot(info, false);
+}
+
+int data_loader_reseed_snapshot(FDIRSnapshotInfo *info)
+{
+    return load_snapshot(info, true);
+}
+
+static void release_read_buffer(void *args, void *buffer_args)
+{
+    binlog_read_thread_return_result_buffer((BinlogReadThreadContext *)
+            args, (BinlogReadThreadResult *)buffer_args);
+}
+
+int server_load_data()
+{
+    BinlogReplayPipeline pipeline;
     BinlogReadThreadContext reader_ctx;
     BinlogReadThreadResult *r;
+    FDIRSnapshotInfo snapshot;
+    FDIRBinlogFilePosition hint_pos;
     int64_t start_time;
     int64_t end_time;
     char time_buff[32];
     int result;
+    int wait_result;
 
     start_time = get_current_time_ms();
 
-    if ((result=binlog_read_thread_init(&reader_ctx, NULL, 0,
-                    BINLOG_BUFFER_SIZE)) != 0)
-    {
+    if ((result=data_loader_load_snapshot(&snapshot)) == 0) {
+        hint_pos.index = snapshot.binlog_index;
+        hint_pos.offset = 0;
+        result = binlog_read_thread_init_ex(&reader_ctx, &hint_pos,
+                BINLOG_READER_FROM_HINT_POSITION, BINLOG_BUFFER_SIZE, true);
+    } else if (result == ENOENT) {
+        result = binlog_read_thread_init_ex(&reader_ctx, NULL, 0,
+                BINLOG_BUFFER_SIZE, true);
+    }
+    if (result != 0) {
         return result;
     }
 
-    if ((result=binlog_replay_init(&replay_ctx, 64)) != 0) {
+    if ((result=binlog_replay_pipeline_init(&pipeline, BINLOG_PARSE_THREADS,
+                    release_read_buffer, &reader_ctx)) != 0)
+    {
         return result;
     }
 
     logInfo("file: "__FILE__", line: %d, "
-            "loading data ...", __LINE__);
+            "loading data with %d parse threads ...",
+            __LINE__, pipeline.parse_threads);
 
     result = 0;
     while (SF_G_CONTINUE_FLAG) {
@@ -60,16 +771,25 @@ int server_load_data()
             break;
         }
 
-        if ((result=binlog_replay_deal_buffer(&replay_ctx, r->buffer.buff,
-                        r->buffer.length, &r->binlog_position)) != 0)
+        if ((result=binlog_replay_pipeline_deal_buffer(&pipeline,
+                        r->buffer.buff, r->buffer.length,
+                        &r->binlog_position, r)) != 0)
         {
             break;
         }
 
-        binlog_read_thread_return_result_buffer(&reader_ctx, r);
+        //the loading stops at the first failure
+        if (__sync_add_and_fetch(&pipeline.fail_count, 0) > 0) {
+            break;
+        }
     }
 
-    binlog_replay_destroy(&replay_ctx);
+    //the inflight records reference the read buffers
+    wait_result = binlog_replay_pipeline_wait_done(&pipeline);
+    if (result == 0) {
+        result = wait_result;
+    }
+    binlog_replay_pipeline_destroy(&pipeline);
     binlog_read_thread_terminate(&reader_ctx);
 
     if (result == 0) {
@@ -78,9 +798,9 @@ int server_load_data()
                 "load data done. record count: %"PRId64", "
                 "skip count: %"PRId64", warning count: %"PRId64
                 ", fail count: %"PRId64", time used: %s ms",
-                __LINE__, replay_ctx.record_count,
-                replay_ctx.skip_count, replay_ctx.warning_count,
-                replay_ctx.fail_count, long_to_comma_str(
+                __LINE__, pipeline.record_count,
+                pipeline.skip_count, pipeline.warning_count,
+                pipeline.fail_count, long_to_comma_str(
                     end_time - start_time, time_buff));
     }
     return result;
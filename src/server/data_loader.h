@@ -3,12 +3,23 @@
 #ifndef _DATA_LOADER_H_
 #define _DATA_LOADER_H_
 
+#include "data_dumper.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int server_load_data();
 
+//load the snapshot of the snapshot info file, return ENOENT when no snapshot
+int data_loader_load_snapshot(FDIRSnapshotInfo *info);
+
+/* reset the loaded data to the snapshot: remove the dentries except the
+ * namespace roots, then load the snapshot, for the slave whose data is
+ * older than the snapshot of the server to sync the binlog from
+ */
+int data_loader_reseed_snapshot(FDIRSnapshotInfo *info);
+
 #ifdef __cplusplus
 }
 #endif
@@ -44,6 +44,95 @@ void data_thread_sum_counters(FDIRDentryCounters *counters)
     }
 }
 
+static int inode_array_check_alloc(FDIRInodeArray *array,
+        const int target_count)
+{
+    int64_t *inodes;
+    int alloc;
+    int bytes;
+
+    if (array->alloc >= target_count) {
+        return 0;
+    }
+
+    alloc = (array->alloc > 0) ? array->alloc : 1024;
+    while (alloc < target_count) {
+        alloc *= 2;
+    }
+
+    bytes = sizeof(int64_t) * alloc;
+    inodes = (int64_t *)realloc(array->inodes, bytes);
+    if (inodes == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "realloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+
+    array->inodes = inodes;
+    array->alloc = alloc;
+    return 0;
+}
+
+int data_thread_do_mark_dirty_dir(FDIRServerDentry *dir)
+{
+    FDIRDataThreadContext *context;
+    FDIRInodeArray *array;
+    int result;
+
+    context = dir->context->db_context;
+    array = &context->dirty.array;
+    PTHREAD_MUTEX_LOCK(&context->dirty.lock);
+    if (dir->dirty_seq == g_data_thread_vars.dirty.seq) {
+        result = 0;
+    } else if ((result=inode_array_check_alloc(array,
+                    array->count + 1)) == 0)
+    {
+        array->inodes[array->count++] = dir->inode;
+        dir->dirty_seq = g_data_thread_vars.dirty.seq;
+    }
+    PTHREAD_MUTEX_UNLOCK(&context->dirty.lock);
+
+    return result;
+}
+
+int data_thread_fetch_dirty_dirs(FDIRInodeArray *array)
+{
+    FDIRDataThreadContext *context;
+    FDIRDataThreadContext *end;
+    int result;
+
+    /* the new seq must be visible before fetching, the directory changed
+     * later is marked again for the next checkpoint */
+    __sync_add_and_fetch(&g_data_thread_vars.dirty.seq, 1);
+
+    result = 0;
+    end = g_data_thread_vars.thread_array.contexts +
+        g_data_thread_vars.thread_array.count;
+    for (context=g_data_thread_vars.thread_array.contexts;
+            context<end; context++)
+    {
+        PTHREAD_MUTEX_LOCK(&context->dirty.lock);
+        if (array != NULL && context->dirty.array.count > 0) {
+            if ((result=inode_array_check_alloc(array, array->count +
+                            context->dirty.array.count)) == 0)
+            {
+                memcpy(array->inodes + array->count,
+                        context->dirty.array.inodes, sizeof(int64_t) *
+                        context->dirty.array.count);
+                array->count += context->dirty.array.count;
+            }
+        }
+        context->dirty.array.count = 0;
+        PTHREAD_MUTEX_UNLOCK(&context->dirty.lock);
+
+        if (result != 0) {
+            break;
+        }
+    }
+
+    return result;
+}
+
 static inline void add_to_delay_free_queue(ServerDelayFreeContext *pContext,
         ServerDelayFreeNode *node, void *ptr, const int delay_seconds)
 {
@@ -152,6 +241,13 @@ static int init_thread_ctx(FDIRDataThreadContext *context)
     if ((result=common_blocked_queue_init_ex(&context->queue, 4096)) != 0) {
         return result;
     }
+
+    if ((result=init_pthread_lock(&context->dirty.lock)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "init_pthread_lock fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
     return 0;
 }
 
@@ -194,6 +290,9 @@ int data_thread_init()
     }
 
     g_data_thread_vars.error_mode = FDIR_DATA_ERROR_MODE_LOOSE;
+    g_data_thread_vars.dirty.enabled = (SNAPSHOT_INTERVAL > 0 &&
+            SNAPSHOT_MAX_DELTA_COUNT > 0);
+    g_data_thread_vars.dirty.seq = 1;
     count = g_data_thread_vars.thread_array.count;
     if ((result=create_work_threads_ex(&count, data_thread_func,
             g_data_thread_vars.thread_array.contexts,
@@ -290,11 +389,13 @@ static int deal_binlog_one_record(FDIRDataThreadContext *thread_ctx,
                     &DATA_CURRENT_VERSION, 1);
         } else {
             int64_t old_version;
-            old_version = __sync_add_and_fetch(&DATA_CURRENT_VERSION, 0);
-            if (record->data_version > old_version) {
-                __sync_bool_compare_and_swap(&DATA_CURRENT_VERSION,
-                        old_version, record->data_version);
-            }
+            do {
+                old_version = __sync_add_and_fetch(&DATA_CURRENT_VERSION, 0);
+                if (record->data_version <= old_version) {
+                    break;
+                }
+            } while (!__sync_bool_compare_and_swap(&DATA_CURRENT_VERSION,
+                        old_version, record->data_version));
         }
         is_error = false;
     } else {
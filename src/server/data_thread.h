@@ -45,10 +45,20 @@ typedef struct server_delay_free_context {
     struct fast_mblock_man allocator;
 } ServerDelayFreeContext;
 
+typedef struct fdir_inode_array {
+    int64_t *inodes;
+    int alloc;
+    int count;
+} FDIRInodeArray;
+
 typedef struct fdir_data_thread_context {
     struct common_blocked_queue queue;
     FDIRDentryContext dentry_context;
     ServerDelayFreeContext delay_free_context;
+    struct {
+        pthread_mutex_t lock;
+        FDIRInodeArray array;
+    } dirty;  //the changed directories since the last checkpoint
 } FDIRDataThreadContext;
 
 typedef struct fdir_data_thread_array {
@@ -59,6 +69,10 @@ typedef struct fdir_data_thread_array {
 typedef struct fdir_data_thread_variables {
     FDIRDataThreadArray thread_array;
     int error_mode;
+    struct {
+        bool enabled;
+        volatile int seq;  //increase by every checkpoint
+    } dirty;
 } FDIRDataThreadVariables;
 
 #ifdef __cplusplus
@@ -73,6 +87,33 @@ extern "C" {
 
     void data_thread_sum_counters(FDIRDentryCounters *counters);
 
+    int data_thread_do_mark_dirty_dir(FDIRServerDentry *dir);
+
+    /* mark the directory changed (the children or the stat of them) after
+     * the change applied, the stat of the namespace root marks itself,
+     * can be called by any thread such as the nio thread */
+    static inline void data_thread_mark_dirty_dir(FDIRServerDentry *dir)
+    {
+        if (g_data_thread_vars.dirty.enabled &&
+                dir->dirty_seq != g_data_thread_vars.dirty.seq)
+        {
+            data_thread_do_mark_dirty_dir(dir);
+        }
+    }
+
+    /* start a new checkpoint seq then move the dirty directories
+     * of all data threads to the array */
+    int data_thread_fetch_dirty_dirs(FDIRInodeArray *array);
+
+    static inline void data_thread_inode_array_free(FDIRInodeArray *array)
+    {
+        if (array->inodes != NULL) {
+            free(array->inodes);
+            array->inodes = NULL;
+            array->alloc = array->count = 0;
+        }
+    }
+
     int server_add_to_delay_free_queue(ServerDelayFreeContext *pContext,
             void *ptr, server_free_func free_func, const int delay_seconds);
 
@@ -348,6 +348,44 @@ static int dentry_find_parent_and_me(FDIRDentryContext *context,
     return 0;
 }
 
+static int dentry_find_parent_and_me_by_pname(const FDIRBinlogRecord *record,
+        string_t *my_name, FDIRServerDentry **parent, FDIRServerDentry **me)
+{
+    FDIRServerDentry target;
+
+    *my_name = record->pname.name;
+    if (my_name->len <= 0 || my_name->len > NAME_MAX ||
+            memchr(my_name->str, '/', my_name->len) != NULL)
+    {
+        *parent = *me = NULL;
+        return EINVAL;
+    }
+
+    *parent = inode_index_get_dentry(record->pname.parent_inode);
+    if (*parent == NULL || !S_ISDIR((*parent)->stat.mode)) {
+        *parent = *me = NULL;
+        return ENOENT;
+    }
+
+    target.name = *my_name;
+    *me = (FDIRServerDentry *)uniq_skiplist_find((*parent)->children, &target);
+    return 0;
+}
+
+/* log the record by parent inode and name instead of the full path */
+static inline void dentry_set_record_pname(FDIRBinlogRecord *record,
+        const FDIRServerDentry *parent, const string_t *my_name)
+{
+    if (parent == NULL || record->options.pname) {
+        return;
+    }
+
+    record->pname.parent_inode = parent->inode;
+    record->pname.name = *my_name;
+    record->options.path_info.flags = 0;
+    record->options.pname = 1;
+}
+
 int dentry_create(FDIRDataThreadContext *db_context, FDIRBinlogRecord *record)
 {
     FDIRPathInfo path_info;
@@ -364,7 +402,14 @@ int dentry_create(FDIRDataThreadContext *db_context, FDIRBinlogRecord *record)
         return EINVAL;
     }
 
-    if ((result=dentry_find_parent_and_me(&db_context->dentry_context,
+    if (record->options.pname) {
+        ns_entry = NULL;
+        if ((result=dentry_find_parent_and_me_by_pname(record,
+                        &my_name, &parent, &current)) != 0)
+        {
+            return result;
+        }
+    } else if ((result=dentry_find_parent_and_me(&db_context->dentry_context,
                     &record->fullname, &path_info, &my_name, &ns_entry,
                     &parent, &current, true)) != 0)
     {
@@ -398,6 +443,7 @@ int dentry_create(FDIRDataThreadContext *db_context, FDIRBinlogRecord *record)
     }
 
     current->parent = parent;
+    current->dirty_seq = 0;
     if ((result=dentry_strdup(&db_context->dentry_context,
                     &current->name, &my_name)) != 0)
     {
@@ -413,6 +459,9 @@ int dentry_create(FDIRDataThreadContext *db_context, FDIRBinlogRecord *record)
     current->stat.ctime = record->stat.ctime;
     current->stat.mtime = record->stat.mtime;
     current->stat.size = record->stat.size;
+    current->stat.atime = record->options.atime ? record->stat.atime : 0;
+    current->stat.uid = record->options.uid ? record->stat.uid : 0;
+    current->stat.gid = record->options.gid ? record->stat.gid : 0;
     if (parent == NULL) {
         ns_entry->dentry_root = current;
     } else if ((result=uniq_skiplist_insert(parent->children, current)) != 0) {
@@ -423,6 +472,8 @@ int dentry_create(FDIRDataThreadContext *db_context, FDIRBinlogRecord *record)
     if (record->inode == 0) {
         record->inode = current->inode;
     }
+    dentry_set_record_pname(record, parent, &my_name);
+    data_thread_mark_dirty_dir(parent != NULL ? parent : current);
 
     if (is_dir) {
         db_context->dentry_context.counters.dir++;
@@ -444,14 +495,20 @@ int dentry_remove(FDIRDataThreadContext *db_context,
     bool is_dir;
     int result;
 
-    if ((result=dentry_find_parent_and_me(&db_context->dentry_context,
+    if (record->options.pname) {
+        if ((result=dentry_find_parent_and_me_by_pname(record,
+                        &my_name, &parent, &current)) != 0)
+        {
+            return result;
+        }
+    } else if ((result=dentry_find_parent_and_me(&db_context->dentry_context,
                     &record->fullname, &path_info, &my_name, &ns_entry,
                     &parent, &current, false)) != 0)
     {
         return result;
     }
 
-    if (current == NULL) {
+    if (current == NULL || parent == NULL) {
         return ENOENT;
     }
 
@@ -470,6 +527,8 @@ int dentry_remove(FDIRDataThreadContext *db_context,
     }
 
     record->dentry = current;
+    dentry_set_record_pname(record, parent, &my_name);
+    data_thread_mark_dirty_dir(parent);
     if (is_dir) {
         db_context->dentry_context.counters.dir--;
     } else {
@@ -499,6 +558,22 @@ int dentry_find(const FDIRDEntryFullName *fullname, FDIRServerDentry **dentry)
     return 0;
 }
 
+bool dentry_belongs_to_namespace(const FDIRServerDentry *dentry,
+        const string_t *ns)
+{
+    FDIRNamespaceEntry *ns_entry;
+    int result;
+
+    if ((ns_entry=get_namespace(NULL, ns, false, &result)) == NULL) {
+        return false;
+    }
+
+    while (dentry->parent != NULL) {
+        dentry = dentry->parent;
+    }
+    return dentry == ns_entry->dentry_root;
+}
+
 int dentry_find_by_pname(FDIRServerDentry *parent, const string_t *name,
         FDIRServerDentry **dentry)
 {
@@ -519,6 +594,54 @@ int dentry_find_by_pname(FDIRServerDentry *parent, const string_t *name,
     }
 }
 
+int dentry_get_namespaces(FDIRNamespaceDentryArray *array)
+{
+    FDIRNamespaceEntry **bucket;
+    FDIRNamespaceEntry **end;
+    FDIRNamespaceEntry *entry;
+    FDIRNamespaceDentry *entries;
+    int bytes;
+    int result;
+
+    result = 0;
+    array->count = 0;
+    PTHREAD_MUTEX_LOCK(&fdir_manager.hashtable.lock);
+    end = fdir_manager.hashtable.buckets +
+        g_server_global_vars.namespace_hashtable_capacity;
+    for (bucket=fdir_manager.hashtable.buckets; bucket<end; bucket++) {
+        for (entry=*bucket; entry!=NULL; entry=entry->next) {
+            if (entry->dentry_root == NULL) {
+                continue;
+            }
+
+            if (array->count == array->alloc) {
+                array->alloc = (array->alloc > 0) ? 2 * array->alloc : 64;
+                bytes = sizeof(FDIRNamespaceDentry) * array->alloc;
+                entries = (FDIRNamespaceDentry *)realloc(
+                        array->entries, bytes);
+                if (entries == NULL) {
+                    logError("file: "__FILE__", line: %d, "
+                            "realloc %d bytes fail", __LINE__, bytes);
+                    result = ENOMEM;
+                    break;
+                }
+                array->entries = entries;
+            }
+
+            array->entries[array->count].ns = entry->name;
+            array->entries[array->count].root = entry->dentry_root;
+            array->count++;
+        }
+
+        if (result != 0) {
+            break;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&fdir_manager.hashtable.lock);
+
+    return result;
+}
+
 static int check_alloc_dentry_array(FDIRServerDentryArray *array, const int target_count)
 {
     FDIRServerDentry **entries;
@@ -5,6 +5,17 @@
 #include "server_types.h"
 #include "data_thread.h"
 
+typedef struct fdir_namespace_dentry {
+    string_t ns;
+    FDIRServerDentry *root;
+} FDIRNamespaceDentry;
+
+typedef struct fdir_namespace_dentry_array {
+    int alloc;
+    int count;
+    FDIRNamespaceDentry *entries;
+} FDIRNamespaceDentryArray;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,9 +34,26 @@ extern "C" {
     int dentry_find(const FDIRDEntryFullName *fullname,
             FDIRServerDentry **dentry);
 
+    bool dentry_belongs_to_namespace(const FDIRServerDentry *dentry,
+            const string_t *ns);
+
     int dentry_find_by_pname(FDIRServerDentry *parent,
             const string_t *name, FDIRServerDentry **dentry);
 
+    /* the namespaces which have the root dentry,
+     * the namespace entries never be freed */
+    int dentry_get_namespaces(FDIRNamespaceDentryArray *array);
+
+    static inline void dentry_namespace_array_free(
+            FDIRNamespaceDentryArray *array)
+    {
+        if (array->entries != NULL) {
+            free(array->entries);
+            array->entries = NULL;
+            array->alloc = array->count = 0;
+        }
+    }
+
     int dentry_get_full_path(const FDIRServerDentry *dentry,
             BufferInfo *full_path, FDIRErrorInfo *error_info);
 
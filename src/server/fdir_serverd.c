@@ -31,6 +31,7 @@
 #include "inode_generator.h"
 #include "server_binlog.h"
 #include "data_thread.h"
+#include "data_dumper.h"
 #include "data_loader.h"
 #include "cluster_info.h"
 #include "service_handler.h"
@@ -139,6 +140,10 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if ((result=data_dumper_init()) != 0) {
+            break;
+        }
+
         fdir_proto_init();
         //sched_print_all_entries();
 
@@ -159,7 +164,8 @@ int main(int argc, char *argv[])
         sf_set_remove_from_ready_list_ex(&CLUSTER_SF_CTX, false);
 
         result = sf_service_init_ex(&g_sf_context,
-                service_alloc_thread_extra_data, NULL,
+                service_alloc_thread_extra_data,
+                service_thread_loop_callback,
                 service_accep_done_callback,
                 fdir_proto_set_body_length, service_deal_task,
                 service_task_finish_cleanup, NULL, 1000,
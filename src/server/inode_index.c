@@ -274,6 +274,13 @@ FDIRServerDentry *inode_index_check_set_dentry_size(const int64_t inode,
                 dentry->stat.size, new_size, dentry->stat.mtime,
                 (int)g_current_time, *modified_flags);
                 */
+
+        /* applied by the nio thread of the master, the marking is
+         * thread safe by the dirty lock of the data thread */
+        if (*modified_flags != 0) {
+            data_thread_mark_dirty_dir(dentry->parent != NULL ?
+                    dentry->parent : dentry);
+        }
     }
     PTHREAD_MUTEX_UNLOCK(&ctx->lock);
 
@@ -316,6 +323,8 @@ FDIRServerDentry *inode_index_update_dentry(
     dentry = find_inode_entry(bucket, record->inode);
     if (dentry != NULL) {
         update_dentry(dentry, record);
+        data_thread_mark_dirty_dir(dentry->parent != NULL ?
+                dentry->parent : dentry);
     }
     PTHREAD_MUTEX_UNLOCK(&ctx->lock);
 
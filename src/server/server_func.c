@@ -1,6 +1,7 @@
 
 #include <sys/stat.h>
 #include <limits.h>
+#include <strings.h>
 #include "fastcommon/ini_file_reader.h"
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
@@ -11,6 +12,7 @@
 #include "sf/sf_service.h"
 #include "common/fdir_proto.h"
 #include "server_global.h"
+#include "binlog/binlog_replay_pipeline.h"
 #include "cluster_info.h"
 #include "server_func.h"
 
@@ -106,12 +108,35 @@ static void log_cluster_server_config()
 static int calc_cluster_config_sign()
 {
     FastBuffer buffer;
+    FDIRClusterServerInfo *cs;
+    FDIRClusterServerInfo *end;
     int result;
 
     if ((result=fast_buffer_init_ex(&buffer, 1024)) != 0) {
         return result;
     }
     fc_server_to_config_string(&CLUSTER_CONFIG_CTX, &buffer);
+
+    //the replication topology and the learners must be consistent too
+    end = CLUSTER_SERVER_ARRAY.servers + CLUSTER_SERVER_ARRAY.count;
+    for (cs=CLUSTER_SERVER_ARRAY.servers; cs<end; cs++) {
+        if (cs->is_learner) {
+            if ((result=fast_buffer_append(&buffer, "learner-%d = 1\n",
+                            cs->server->id)) != 0)
+            {
+                fast_buffer_destroy(&buffer);
+                return result;
+            }
+        }
+        if (cs->upstream != NULL) {
+            if ((result=fast_buffer_append(&buffer, "upstream-%d = %d\n",
+                            cs->server->id, cs->upstream->server->id)) != 0)
+            {
+                fast_buffer_destroy(&buffer);
+                return result;
+            }
+        }
+    }
     my_md5_buffer(buffer.data, buffer.length, CLUSTER_CONFIG_SIGN_BUF);
 
     {
@@ -210,7 +235,7 @@ static int load_cluster_config(IniContext *ini_context, const char *filename)
         return result;
     }
 
-    if ((result=cluster_info_init(cluster_config_filename)) != 0) {
+    if ((result=cluster_info_init(full_cluster_filename)) != 0) {
         return result;
     }
     if ((result=find_group_indexes_in_cluster_config(filename)) != 0) {
@@ -310,9 +335,23 @@ static int load_dentry_max_data_size(IniContext *ini_context,
     return 0;
 }
 
+static const char *get_replica_quorum_caption(char *buff, const int size)
+{
+    switch (DURABILITY_REPLICA_QUORUM) {
+        case FDIR_REPLICA_QUORUM_ALL:
+            return "all";
+        case FDIR_REPLICA_QUORUM_MAJORITY:
+            return "majority";
+        default:
+            snprintf(buff, size, "%d", DURABILITY_REPLICA_QUORUM);
+            return buff;
+    }
+}
+
 static void server_log_configs()
 {
-    char sz_server_config[512];
+    char sz_quorum[16];
+    char sz_server_config[1024];
     char sz_global_config[512];
     char sz_service_config[128];
     char sz_cluster_config[128];
@@ -327,9 +366,25 @@ static void server_log_configs()
             "cluster_id = %d, my server id = %d, data_path = %s, "
             "data_threads = %d, dentry_max_data_size = %d, "
             "binlog_buffer_size = %d KB, "
+            "binlog_record_format = %s, "
+            "binlog_parse_threads = %d, "
+            "replication_window_bytes = %d KB, "
+            "replication_window_batches = %d, "
+            "replication_max_lag_versions = %"PRId64", "
+            "replication_max_lag_bytes = %"PRId64" MB, "
+            "snapshot_interval = %d s, "
+            "snapshot_max_delta_count = %d, "
+            "bootstrap_from_snapshot = %d, "
+            "reseed_lag_versions = %"PRId64", "
+            "durability_level = %s, "
+            "replica_quorum = %s, "
+            "namespace durability count = %d, "
             "admin config {username: %s, secret_key: %s}, "
             "reload_interval_ms = %d ms, "
             "check_alive_interval = %d s, "
+            "heartbeat_interval_ms = %d ms, "
+            "master_suspect_timeout_ms = %d ms, "
+            "read_wait_timeout_ms = %d ms, "
             "namespace_hashtable_capacity = %d, "
             "inode_hashtable_capacity = %"PRId64", "
             "inode_shared_locks_count = %d, "
@@ -337,10 +392,24 @@ static void server_log_configs()
             CLUSTER_ID, CLUSTER_MY_SERVER_ID,
             DATA_PATH_STR, DATA_THREAD_COUNT,
             DENTRY_MAX_DATA_SIZE, BINLOG_BUFFER_SIZE / 1024,
+            BINLOG_RECORD_FORMAT == FDIR_BINLOG_RECORD_FORMAT_BINARY ?
+            "binary" : "text", BINLOG_PARSE_THREADS,
+            REPLICATION_WINDOW_BYTES / 1024, REPLICATION_WINDOW_BATCHES,
+            REPLICATION_MAX_LAG_VERSIONS,
+            REPLICATION_MAX_LAG_BYTES / (1024 * 1024),
+            SNAPSHOT_INTERVAL,
+            SNAPSHOT_MAX_DELTA_COUNT, BOOTSTRAP_FROM_SNAPSHOT,
+            RESEED_LAG_VERSIONS,
+            fdir_get_durability_level_caption(DURABILITY_DEFAULT_LEVEL),
+            get_replica_quorum_caption(sz_quorum, sizeof(sz_quorum)),
+            DURABILITY_NS_ARRAY.count,
             g_server_global_vars.admin.username.str,
             g_server_global_vars.admin.secret_key.str,
             g_server_global_vars.reload_interval_ms,
             g_server_global_vars.check_alive_interval,
+            CLUSTER_HEARTBEAT_INTERVAL_MS,
+            CLUSTER_MASTER_SUSPECT_TIMEOUT_MS,
+            READ_WAIT_TIMEOUT_MS,
             g_server_global_vars.namespace_hashtable_capacity,
             INODE_HASHTABLE_CAPACITY, INODE_SHARED_LOCKS_COUNT,
             FC_SID_SERVER_COUNT(CLUSTER_CONFIG_CTX));
@@ -377,6 +446,185 @@ static int load_binlog_buffer_size(IniContext *ini_context,
     return 0;
 }
 
+static int load_replication_window(IniContext *ini_context,
+        const char *filename)
+{
+    int64_t bytes;
+    int result;
+
+    if ((result=get_bytes_item_config(ini_context, filename,
+                    "replication_window_bytes",
+                    FDIR_DEFAULT_REPLICATION_WINDOW_BYTES, &bytes)) != 0)
+    {
+        return result;
+    }
+    if (bytes <= 0) {
+        REPLICATION_WINDOW_BYTES = FDIR_DEFAULT_REPLICATION_WINDOW_BYTES;
+    } else {
+        REPLICATION_WINDOW_BYTES = bytes;
+    }
+
+    REPLICATION_WINDOW_BATCHES = iniGetIntValue(NULL,
+            "replication_window_batches", ini_context,
+            FDIR_DEFAULT_REPLICATION_WINDOW_BATCHES);
+    if (REPLICATION_WINDOW_BATCHES <= 0) {
+        REPLICATION_WINDOW_BATCHES = FDIR_DEFAULT_REPLICATION_WINDOW_BATCHES;
+    } else if (REPLICATION_WINDOW_BATCHES >
+            FDIR_MAX_REPLICATION_WINDOW_BATCHES)
+    {
+        REPLICATION_WINDOW_BATCHES = FDIR_MAX_REPLICATION_WINDOW_BATCHES;
+    }
+
+    REPLICATION_MAX_LAG_VERSIONS = iniGetInt64Value(NULL,
+            "replication_max_lag_versions", ini_context,
+            FDIR_DEFAULT_REPLICATION_MAX_LAG_VERSIONS);
+    if (REPLICATION_MAX_LAG_VERSIONS < 0) {
+        REPLICATION_MAX_LAG_VERSIONS =
+            FDIR_DEFAULT_REPLICATION_MAX_LAG_VERSIONS;
+    }
+
+    if ((result=get_bytes_item_config(ini_context, filename,
+                    "replication_max_lag_bytes",
+                    FDIR_DEFAULT_REPLICATION_MAX_LAG_BYTES, &bytes)) != 0)
+    {
+        return result;
+    }
+    REPLICATION_MAX_LAG_BYTES = (bytes < 0 ?
+            FDIR_DEFAULT_REPLICATION_MAX_LAG_BYTES : bytes);
+
+    return 0;
+}
+
+static int load_binlog_record_format(IniContext *ini_context,
+        const char *filename)
+{
+    char *format;
+
+    format = iniGetStrValue(NULL, "binlog_record_format", ini_context);
+    if (format == NULL || *format == '\0') {
+        BINLOG_RECORD_FORMAT = FDIR_DEFAULT_BINLOG_RECORD_FORMAT;
+    } else if (strcasecmp(format, "text") == 0) {
+        BINLOG_RECORD_FORMAT = FDIR_BINLOG_RECORD_FORMAT_TEXT;
+    } else if (strcasecmp(format, "binary") == 0) {
+        BINLOG_RECORD_FORMAT = FDIR_BINLOG_RECORD_FORMAT_BINARY;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, invalid binlog_record_format: %s, "
+                "expect text or binary", __LINE__, filename, format);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int load_durability_config(IniContext *ini_context,
+        const char *filename)
+{
+#define NS_DURABILITY_SECTION_NAME "namespace-durability"
+
+    char *level;
+    char *quorum;
+    char *endptr;
+    IniItem *items;
+    IniItem *item;
+    IniItem *end;
+    FDIRNamespaceDurability *entry;
+    int count;
+    int bytes;
+
+    level = iniGetStrValue(NULL, "durability_level", ini_context);
+    DURABILITY_DEFAULT_LEVEL = fdir_get_durability_level_by_caption(level);
+    if (DURABILITY_DEFAULT_LEVEL < 0) {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, invalid durability_level: %s",
+                __LINE__, filename, level);
+        return EINVAL;
+    }
+    if (DURABILITY_DEFAULT_LEVEL == FDIR_DURABILITY_LEVEL_DEFAULT) {
+        DURABILITY_DEFAULT_LEVEL = FDIR_DEFAULT_DURABILITY_LEVEL;
+    }
+
+    quorum = iniGetStrValue(NULL, "replica_quorum", ini_context);
+    if (quorum == NULL || *quorum == '\0' ||
+            strcasecmp(quorum, "all") == 0)
+    {
+        DURABILITY_REPLICA_QUORUM = FDIR_REPLICA_QUORUM_ALL;
+    } else if (strcasecmp(quorum, "majority") == 0) {
+        DURABILITY_REPLICA_QUORUM = FDIR_REPLICA_QUORUM_MAJORITY;
+    } else {
+        DURABILITY_REPLICA_QUORUM = strtol(quorum, &endptr, 10);
+        if (*endptr != '\0' || DURABILITY_REPLICA_QUORUM <= 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, invalid replica_quorum: %s, "
+                    "expect all, majority or a positive number",
+                    __LINE__, filename, quorum);
+            return EINVAL;
+        }
+    }
+
+    DURABILITY_NS_ARRAY.entries = NULL;
+    DURABILITY_NS_ARRAY.count = 0;
+    items = iniGetSectionItems(NS_DURABILITY_SECTION_NAME,
+            ini_context, &count);
+    if (items == NULL || count == 0) {
+        return 0;
+    }
+
+    bytes = sizeof(FDIRNamespaceDurability) * count;
+    DURABILITY_NS_ARRAY.entries = (FDIRNamespaceDurability *)malloc(bytes);
+    if (DURABILITY_NS_ARRAY.entries == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, bytes);
+        return ENOMEM;
+    }
+
+    entry = DURABILITY_NS_ARRAY.entries;
+    end = items + count;
+    for (item=items; item<end; item++, entry++) {
+        entry->level = fdir_get_durability_level_by_caption(item->value);
+        if (entry->level < 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "config file: %s, section: %s, namespace: %s, "
+                    "invalid durability level: %s", __LINE__, filename,
+                    NS_DURABILITY_SECTION_NAME, item->name, item->value);
+            return EINVAL;
+        }
+        if (entry->level == FDIR_DURABILITY_LEVEL_DEFAULT) {
+            entry->level = DURABILITY_DEFAULT_LEVEL;
+        }
+
+        entry->ns.len = strlen(item->name);
+        entry->ns.str = strdup(item->name);
+        if (entry->ns.str == NULL) {
+            logError("file: "__FILE__", line: %d, "
+                    "malloc %d bytes fail", __LINE__, entry->ns.len + 1);
+            return ENOMEM;
+        }
+    }
+    DURABILITY_NS_ARRAY.count = count;
+
+    return 0;
+}
+
+int server_get_durability_level(const string_t *ns, const int req_level)
+{
+    FDIRNamespaceDurability *entry;
+    FDIRNamespaceDurability *end;
+    int level;
+
+    level = DURABILITY_DEFAULT_LEVEL;
+    end = DURABILITY_NS_ARRAY.entries + DURABILITY_NS_ARRAY.count;
+    for (entry=DURABILITY_NS_ARRAY.entries; entry<end; entry++) {
+        if (fc_string_equal(ns, &entry->ns)) {
+            level = entry->level;
+            break;
+        }
+    }
+
+    //the client can only ask for a stronger level
+    return req_level > level ? req_level : level;
+}
+
 int server_load_config(const char *filename)
 {
     IniContext ini_context;
@@ -426,6 +674,46 @@ int server_load_config(const char *filename)
         return result;
     }
 
+    if ((result=load_binlog_record_format(&ini_context, filename)) != 0) {
+        return result;
+    }
+
+    BINLOG_PARSE_THREADS = iniGetIntValue(NULL, "binlog_parse_threads",
+            &ini_context, FDIR_DEFAULT_BINLOG_PARSE_THREADS);
+    if (BINLOG_PARSE_THREADS <= 0) {
+        BINLOG_PARSE_THREADS = FDIR_DEFAULT_BINLOG_PARSE_THREADS;
+    } else if (BINLOG_PARSE_THREADS > BINLOG_PIPELINE_MAX_PARSE_THREADS) {
+        BINLOG_PARSE_THREADS = BINLOG_PIPELINE_MAX_PARSE_THREADS;
+    }
+
+    if ((result=load_replication_window(&ini_context, filename)) != 0) {
+        return result;
+    }
+
+    SNAPSHOT_INTERVAL = iniGetIntValue(NULL, "snapshot_interval",
+            &ini_context, FDIR_DEFAULT_SNAPSHOT_INTERVAL);
+    if (SNAPSHOT_INTERVAL < 0) {
+        SNAPSHOT_INTERVAL = FDIR_DEFAULT_SNAPSHOT_INTERVAL;
+    }
+    SNAPSHOT_MAX_DELTA_COUNT = iniGetIntValue(NULL,
+            "snapshot_max_delta_count", &ini_context,
+            FDIR_DEFAULT_SNAPSHOT_MAX_DELTA_COUNT);
+    if (SNAPSHOT_MAX_DELTA_COUNT < 0) {
+        SNAPSHOT_MAX_DELTA_COUNT = FDIR_DEFAULT_SNAPSHOT_MAX_DELTA_COUNT;
+    }
+    BOOTSTRAP_FROM_SNAPSHOT = iniGetBoolValue(NULL,
+            "bootstrap_from_snapshot", &ini_context, true);
+    RESEED_LAG_VERSIONS = iniGetInt64Value(NULL,
+            "reseed_lag_versions", &ini_context,
+            FDIR_DEFAULT_RESEED_LAG_VERSIONS);
+    if (RESEED_LAG_VERSIONS < 0) {
+        RESEED_LAG_VERSIONS = FDIR_DEFAULT_RESEED_LAG_VERSIONS;
+    }
+
+    if ((result=load_durability_config(&ini_context, filename)) != 0) {
+        return result;
+    }
+
     g_server_global_vars.reload_interval_ms = iniGetIntValue(NULL,
             "reload_interval_ms", &ini_context,
             FDIR_SERVER_DEFAULT_RELOAD_INTERVAL);
@@ -442,6 +730,32 @@ int server_load_config(const char *filename)
             FDIR_SERVER_DEFAULT_CHECK_ALIVE_INTERVAL;
     }
 
+    CLUSTER_HEARTBEAT_INTERVAL_MS = iniGetIntValue(NULL,
+            "heartbeat_interval_ms", &ini_context,
+            FDIR_DEFAULT_HEARTBEAT_INTERVAL_MS);
+    if (CLUSTER_HEARTBEAT_INTERVAL_MS <= 0) {
+        CLUSTER_HEARTBEAT_INTERVAL_MS = FDIR_DEFAULT_HEARTBEAT_INTERVAL_MS;
+    }
+
+    CLUSTER_MASTER_SUSPECT_TIMEOUT_MS = iniGetIntValue(NULL,
+            "master_suspect_timeout_ms", &ini_context,
+            FDIR_DEFAULT_MASTER_SUSPECT_TIMEOUT_MS);
+    if (CLUSTER_MASTER_SUSPECT_TIMEOUT_MS < 2 * CLUSTER_HEARTBEAT_INTERVAL_MS) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, master_suspect_timeout_ms: %d "
+                "< 2 * heartbeat_interval_ms: %d, set it to %d ms",
+                __LINE__, filename, CLUSTER_MASTER_SUSPECT_TIMEOUT_MS,
+                CLUSTER_HEARTBEAT_INTERVAL_MS,
+                2 * CLUSTER_HEARTBEAT_INTERVAL_MS);
+        CLUSTER_MASTER_SUSPECT_TIMEOUT_MS = 2 * CLUSTER_HEARTBEAT_INTERVAL_MS;
+    }
+
+    READ_WAIT_TIMEOUT_MS = iniGetIntValue(NULL, "read_wait_timeout_ms",
+            &ini_context, FDIR_DEFAULT_READ_WAIT_TIMEOUT_MS);
+    if (READ_WAIT_TIMEOUT_MS < 0) {
+        READ_WAIT_TIMEOUT_MS = 0;
+    }
+
     g_server_global_vars.namespace_hashtable_capacity = iniGetIntValue(NULL,
             "namespace_hashtable_capacity", &ini_context,
             FDIR_NAMESPACE_HASHTABLE_DEFAULT_CAPACITY);
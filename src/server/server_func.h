@@ -10,6 +10,9 @@ extern "C" {
 
 int server_load_config(const char *filename);
 
+/* the durability level of the update operation of the namespace */
+int server_get_durability_level(const string_t *ns, const int req_level);
+
 static inline int server_expect_body_length(
         struct fast_task_info *task,
         const int expect_body_length)
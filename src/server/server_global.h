@@ -21,6 +21,14 @@ typedef struct server_global_vars {
 
     int check_alive_interval;
 
+    int read_wait_timeout_ms;  //the slave waits the min data version to read
+
+    struct {
+        int default_level;
+        int replica_quorum;  //the slave count to ack, 0 for all
+        FDIRNamespaceDurabilityArray namespaces;
+    } durability;
+
     struct {
         short id;  //cluster id for generate inode
         FDIRClusterServerInfo *master;
@@ -34,6 +42,14 @@ typedef struct server_global_vars {
 
         FDIRClusterServerArray server_array;
 
+        int heartbeat_interval_ms;     //the interval to ping the master
+        int master_suspect_timeout_ms; //unset the master after no heartbeat
+
+        struct {
+            volatile int in_progress;   //reject the new mutations when set
+            volatile int inflight_mutations; //the mutations accepted not done
+        } master_transfer;
+
         SFContext sf_context;  //for cluster communication
     } cluster;
 
@@ -51,11 +67,25 @@ typedef struct server_global_vars {
 
     struct {
         volatile uint64_t current_version; //binlog version
+        volatile int64_t applied_version;  //applied in order on the slave
         string_t path;   //data path
         int binlog_buffer_size;
+        int binlog_record_format;  //text or binary for write
+        int binlog_parse_threads;  //for loading data and replica
+        int snapshot_interval;     //in seconds, 0 for disabled
+        int snapshot_max_delta_count;  //the delta count before a full dump
+        bool bootstrap_from_snapshot;  //the empty slave fetches the snapshot
+        int64_t reseed_lag_versions;   //reseed the lagging slave, 0 for never
         int thread_count;
     } data;
 
+    struct {
+        int window_bytes;    //the max bytes in flight per slave
+        int window_batches;  //the max batches in flight per slave
+        int64_t max_lag_versions; //for flow control, 0 for no limit
+        int64_t max_lag_bytes;    //for flow control, 0 for no limit
+    } replication;
+
     /*
     struct {
         char key[FDIR_REPLICA_KEY_SIZE];   //slave distribute to master
@@ -72,22 +102,49 @@ typedef struct server_global_vars {
 #define CLUSTER_SERVER_ARRAY    g_server_global_vars.cluster.server_array
 
 #define CLUSTER_ID              g_server_global_vars.cluster.id
+#define CLUSTER_HEARTBEAT_INTERVAL_MS  \
+    g_server_global_vars.cluster.heartbeat_interval_ms
+#define CLUSTER_MASTER_SUSPECT_TIMEOUT_MS  \
+    g_server_global_vars.cluster.master_suspect_timeout_ms
+#define MASTER_TRANSFER_IN_PROGRESS  \
+    g_server_global_vars.cluster.master_transfer.in_progress
+#define INFLIGHT_MUTATION_COUNT  \
+    g_server_global_vars.cluster.master_transfer.inflight_mutations
 #define CLUSTER_MY_SERVER_ID    CLUSTER_MYSELF_PTR->server->id
 
 #define CLUSTER_SF_CTX          g_server_global_vars.cluster.sf_context
 
+#define READ_WAIT_TIMEOUT_MS    g_server_global_vars.read_wait_timeout_ms
+
 #define DENTRY_MAX_DATA_SIZE    g_server_global_vars.dentry_max_data_size
 #define BINLOG_BUFFER_SIZE      g_server_global_vars.data.binlog_buffer_size
+#define BINLOG_RECORD_FORMAT    g_server_global_vars.data.binlog_record_format
+#define BINLOG_PARSE_THREADS    g_server_global_vars.data.binlog_parse_threads
+#define SNAPSHOT_INTERVAL       g_server_global_vars.data.snapshot_interval
+#define REPLICATION_WINDOW_BYTES   g_server_global_vars.replication.window_bytes
+#define REPLICATION_WINDOW_BATCHES g_server_global_vars.replication.window_batches
+#define REPLICATION_MAX_LAG_VERSIONS  \
+    g_server_global_vars.replication.max_lag_versions
+#define REPLICATION_MAX_LAG_BYTES  \
+    g_server_global_vars.replication.max_lag_bytes
+#define SNAPSHOT_MAX_DELTA_COUNT g_server_global_vars.data.snapshot_max_delta_count
+#define BOOTSTRAP_FROM_SNAPSHOT g_server_global_vars.data.bootstrap_from_snapshot
+#define RESEED_LAG_VERSIONS     g_server_global_vars.data.reseed_lag_versions
 #define CURRENT_INODE_SN        g_server_global_vars.inode.generator.sn
 #define INODE_CLUSTER_PART      g_server_global_vars.inode.generator.cluster
 #define INODE_SHARED_LOCKS_COUNT g_server_global_vars.inode.entries.shared_locks_count
 #define INODE_HASHTABLE_CAPACITY g_server_global_vars.inode.entries.hashtable_capacity
 #define DATA_CURRENT_VERSION    g_server_global_vars.data.current_version
+#define DATA_APPLIED_VERSION    g_server_global_vars.data.applied_version
 #define DATA_THREAD_COUNT       g_server_global_vars.data.thread_count
 #define DATA_PATH               g_server_global_vars.data.path
 #define DATA_PATH_STR           DATA_PATH.str
 #define DATA_PATH_LEN           DATA_PATH.len
 
+#define DURABILITY_DEFAULT_LEVEL g_server_global_vars.durability.default_level
+#define DURABILITY_NS_ARRAY      g_server_global_vars.durability.namespaces
+#define DURABILITY_REPLICA_QUORUM g_server_global_vars.durability.replica_quorum
+
 #define SLAVE_SERVER_COUNT      (FC_SID_SERVER_COUNT(CLUSTER_CONFIG_CTX) - 1)
 
 #define REPLICA_KEY_BUFF        CLUSTER_MYSELF_PTR->key
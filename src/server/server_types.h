@@ -3,24 +3,47 @@
 
 #include <time.h>
 #include <pthread.h>
+#include <sys/uio.h>
 #include "fastcommon/common_define.h"
 #include "fastcommon/fast_task_queue.h"
 #include "fastcommon/fast_mblock.h"
+#include "fastcommon/fast_timer.h"
 #include "fastcommon/fast_allocator.h"
 #include "fastcommon/uniq_skiplist.h"
 #include "fastcommon/server_id_func.h"
 #include "fastcommon/fc_list.h"
 #include "common/fdir_types.h"
-
-#define FDIR_CLUSTER_ID_BITS                 10
-#define FDIR_CLUSTER_ID_MAX                  ((1 << FDIR_CLUSTER_ID_BITS) - 1)
+#include "common/fdir_proto.h"
 
 #define FDIR_SERVER_DEFAULT_RELOAD_INTERVAL       500
 #define FDIR_SERVER_DEFAULT_CHECK_ALIVE_INTERVAL  300
+#define FDIR_DEFAULT_HEARTBEAT_INTERVAL_MS        200
+#define FDIR_DEFAULT_MASTER_SUSPECT_TIMEOUT_MS   1000
+#define FDIR_DEFAULT_READ_WAIT_TIMEOUT_MS         100
 #define FDIR_NAMESPACE_HASHTABLE_DEFAULT_CAPACITY 1361
 #define FDIR_INODE_HASHTABLE_DEFAULT_CAPACITY     1403641
 #define FDIR_INODE_SHARED_LOCKS_DEFAULT_COUNT     163
 #define FDIR_DEFAULT_DATA_THREAD_COUNT              1
+#define FDIR_DEFAULT_DURABILITY_LEVEL  FDIR_DURABILITY_LEVEL_REPLICA
+
+#define FDIR_REPLICA_QUORUM_ALL        0
+#define FDIR_REPLICA_QUORUM_MAJORITY  -1
+
+#define FDIR_BINLOG_RECORD_FORMAT_TEXT      1
+#define FDIR_BINLOG_RECORD_FORMAT_BINARY    2
+#define FDIR_DEFAULT_BINLOG_RECORD_FORMAT   FDIR_BINLOG_RECORD_FORMAT_TEXT
+
+#define FDIR_DEFAULT_BINLOG_PARSE_THREADS   4
+
+#define FDIR_DEFAULT_REPLICATION_WINDOW_BYTES   (4 * 1024 * 1024)
+#define FDIR_DEFAULT_REPLICATION_WINDOW_BATCHES 16
+#define FDIR_MAX_REPLICATION_WINDOW_BATCHES     256
+#define FDIR_DEFAULT_REPLICATION_MAX_LAG_VERSIONS  1000000
+#define FDIR_DEFAULT_REPLICATION_MAX_LAG_BYTES     (256 * 1024 * 1024)
+
+#define FDIR_DEFAULT_SNAPSHOT_INTERVAL      3600
+#define FDIR_DEFAULT_SNAPSHOT_MAX_DELTA_COUNT  24
+#define FDIR_DEFAULT_RESEED_LAG_VERSIONS       0
 
 #define FDIR_CLUSTER_TASK_TYPE_NONE               0
 #define FDIR_CLUSTER_TASK_TYPE_RELATIONSHIP       1   //slave  -> master
@@ -44,7 +67,10 @@
 #define FTASK_HEAD_PTR    &TASK_ARG->context.service.ftasks
 #define SYS_LOCK_TASK     TASK_ARG->context.service.sys_lock_task
 #define WAITING_RPC_COUNT TASK_ARG->context.service.waiting_rpc_count
+#define WAITING_RPC_RESULT TASK_ARG->context.service.waiting_rpc_result
 #define DENTRY_LIST_CACHE TASK_ARG->context.service.dentry_list_cache
+#define TASK_DATA_VERSION TASK_ARG->context.service.data_version
+#define READ_WAIT_CTX     TASK_ARG->context.service.read_wait
 #define CLUSTER_PEER      TASK_ARG->context.cluster.peer
 #define CLUSTER_REPLICA   TASK_ARG->context.cluster.replica
 #define CLUSTER_CONSUMER_CTX  TASK_ARG->context.cluster.consumer_ctx
@@ -53,6 +79,16 @@
 typedef void (*server_free_func)(void *ptr);
 typedef void (*server_free_func_ex)(void *ctx, void *ptr);
 
+typedef struct fdir_namespace_durability {
+    string_t ns;
+    int level;
+} FDIRNamespaceDurability;
+
+typedef struct fdir_namespace_durability_array {
+    FDIRNamespaceDurability *entries;
+    int count;
+} FDIRNamespaceDurabilityArray;
+
 typedef struct fdir_path_info {
     string_t paths[FDIR_MAX_PATH_COUNT];   //splited path parts
     int count;
@@ -63,6 +99,7 @@ struct flock_entry;
 typedef struct fdir_server_dentry {
     int64_t inode;
     unsigned int hash_code;   //data thread dispach & mutex lock
+    int dirty_seq;            //the checkpoint seq when marked dirty
     string_t name;
     FDIRDEntryStatus stat;
     string_t user_data;      //user defined data
@@ -92,11 +129,19 @@ typedef struct fdir_cluster_server_info {
     FDIRBinlogFilePosition binlog_pos_hint;  //for replication
     int64_t last_data_version;  //for replication
     int last_change_version;    //for push server status to the slave
+
+    /* the configured replication source, NULL or the master for
+     * replicating from the master directly
+     */
+    struct fdir_cluster_server_info *upstream;
+
+    bool is_learner;  //non-voting, never elected and NOT waited by writers
 } FDIRClusterServerInfo;
 
 typedef struct fdir_cluster_server_array {
     FDIRClusterServerInfo *servers;
     int count;
+    int voter_count;  //the servers except the learners
     volatile int change_version;
 } FDIRClusterServerArray;
 
@@ -105,34 +150,50 @@ struct server_binlog_record_buffer;
 typedef struct fdir_record_buffer_queue {
     struct server_binlog_record_buffer *head;
     struct server_binlog_record_buffer *tail;
+    volatile int64_t bytes;  //the record bytes in the queue, for flow control
     pthread_mutex_t lock;
 } FDIRRecordBufferQueue;
 
+/* the slave acks of a write for the replica quorum, shared by
+ * the slave replications and freed when all slaves done
+ */
+typedef struct fdir_replica_quorum {
+    volatile int done_count;    //the slaves acked
+    volatile int fail_count;    //the slaves timeout, offline or discarded
+    volatile int reffer_count;  //the slaves not done
+    int64_t task_version;
+    struct fast_task_info *waiting_task;
+} FDIRReplicaQuorum;
+
 typedef struct fdir_binlog_push_result_entry {
-    uint64_t data_version;
+    FastTimerEntry timer;  //must be the first for the timeout wheel
+    uint64_t data_version; //0 for the free slot
     int64_t task_version;
-    time_t expires;
     struct fast_task_info *waiting_task;
-    struct fdir_binlog_push_result_entry *next;
+    FDIRReplicaQuorum *quorum;  //NULL for waiting all slaves
 } FDIRBinlogPushResultEntry;
 
+/* the entries indexed by the data version in the ring, the ring grows
+ * when the version span [start_version, end_version) exceeds its size
+ */
 typedef struct fdir_binlog_push_result_context {
     struct {
         FDIRBinlogPushResultEntry *entries;
-        FDIRBinlogPushResultEntry *start; //for consumer
-        FDIRBinlogPushResultEntry *end;   //for producer
-        int size;
+        int size;   //power of 2
+        int count;  //the waiting entries
+        uint64_t start_version;  //the min waiting version
+        uint64_t end_version;    //the max waiting version + 1
     } ring;
 
-    struct {
-        FDIRBinlogPushResultEntry *head;
-        FDIRBinlogPushResultEntry *tail;
-        struct fast_mblock_man rentry_allocator;
-    } queue;   //for overflow exceptions
-
+    FastTimer timer;  //the timeout wheel in seconds
     time_t last_check_timeout_time;
 } FDIRBinlogPushResultContext;
 
+typedef struct fdir_replication_window_batch {
+    int64_t last_data_version;
+    int bytes;
+} FDIRReplicationWindowBatch;
+
 struct binlog_read_thread_context;
 typedef struct fdir_replication_context {
     FDIRRecordBufferQueue queue;  //push to the slave
@@ -141,24 +202,67 @@ typedef struct fdir_replication_context {
     struct {
         int64_t by_queue;
         struct {
-            int64_t previous;
             int64_t current;
         } by_disk;
         int64_t by_resp;  //for flow control
     } last_data_versions;
 
+    /* the batches sent but not acked, a batch is acked when the slave
+     * responds a data version >= its last data version
+     */
+    struct {
+        FDIRReplicationWindowBatch *batches;  //the ring
+        int head;
+        int count;       //the batches in flight
+        int64_t bytes;   //the bytes in flight
+        int credits;     //the free buffers of the slave, -1 for unknown
+    } window;
+
     struct {
         int64_t start_time_ms;
         int64_t binlog_size;
         int64_t record_count;
     } sync_by_disk_stat;
+
+    struct {
+        int fd;           //the binlog file to send, -1 for not opened
+        int file_index;
+        int header_length;
+        int header_sent;
+        int64_t start_offset;
+        int64_t offset;   //the file offset to send
+        int64_t remain;   //the file bytes to send
+        //the proto header and the push binlog body header
+        char header[sizeof(FDIRProtoHeader) +
+            sizeof(FDIRProtoPushBinlogReqBodyHeader)];
+    } zero_copy;  //send the binlog file range directly for sync by disk
+
+    struct {
+        struct iovec *iovs;  //the packet headers and the record buffers
+        char *headers;       //the packet headers
+        struct server_binlog_record_buffer **rbs;  //release after sent
+        int iov_count;
+        int iov_index;       //the first iovec not sent
+        int rb_count;
+    } gather;  //send the record buffers of the queue without copy
 } FDIRReplicationContext;
 
+typedef struct fdir_replication_lag {
+    int64_t data_versions;  //the data versions not replied by the slave
+    int64_t bytes;          //the binlog bytes queued and in flight
+} FDIRReplicationLag;
+
 typedef struct fdir_slave_replication {
     struct fast_task_info *task;
     FDIRClusterServerInfo *slave;
     int stage;
     int index;  //for next links
+    bool relay; //relay the binlog received from the upstream (not master)
+
+    /* set by the flow control for the lagging slave NOT waited by the
+     * writers, the queue is discarded and the binlog synced from the disk
+     */
+    volatile int fallback_to_disk;
     struct {
         int start_time;
         int next_connect_time;
@@ -210,6 +314,19 @@ typedef struct server_task_arg {
 
                 struct fdir_binlog_record *record;
                 volatile int waiting_rpc_count;
+                volatile int waiting_rpc_result; //the first error of the rpcs
+                bool mutating;  //counted in the inflight mutations
+
+                /* the min data version to read for the request,
+                 * the committed data version for the update response
+                 */
+                int64_t data_version;
+                struct {
+                    struct fast_task_info *task;
+                    int64_t expires_ms;
+                    bool waiting;
+                    struct fc_list_head dlink;
+                } read_wait;  //for the slave read waiting data_version
             } service;
 
             struct {
@@ -234,8 +351,8 @@ typedef struct fdir_server_context {
 
         struct {
             bool clean_connected_replicas;   //for cleanup connected array
-            FDIRSlaveReplicationPtrArray connectings;  //master side
-            FDIRSlaveReplicationPtrArray connected;    //master side
+            FDIRSlaveReplicationPtrArray connectings;  //master or relay side
+            FDIRSlaveReplicationPtrArray connected;    //master or relay side
 
             struct replica_consumer_thread_context *consumer_ctx;//slave side
         } cluster;
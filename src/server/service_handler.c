@@ -25,6 +25,7 @@
 #include "common/fdir_proto.h"
 #include "binlog/binlog_producer.h"
 #include "binlog/binlog_pack.h"
+#include "binlog/binlog_local_consumer.h"
 #include "server_global.h"
 #include "server_func.h"
 #include "dentry.h"
@@ -32,8 +33,19 @@
 #include "cluster_relationship.h"
 #include "service_handler.h"
 
+#define READ_WAITING_CHECK_INTERVAL_MS  10
+
+typedef struct {
+    pthread_mutex_t lock;
+    struct fc_list_head head;  //the tasks waiting the data version to read
+    volatile int count;
+    volatile int64_t min_version;  //the min data version of the waitings
+    volatile int64_t last_check_ms;
+} ServiceReadWaitingContext;
+
 static volatile int64_t next_token = 0;   //next token for dentry list
 static int64_t dstat_mflags_mask = 0;
+static ServiceReadWaitingContext read_waiting_ctx;
 
 int service_handler_init()
 {
@@ -50,7 +62,9 @@ int service_handler_init()
     dstat_mflags_mask = mask.flags;
 
     next_token = ((int64_t)g_current_time) << 32;
-    return 0;
+
+    FC_INIT_LIST_HEAD(&read_waiting_ctx.head);
+    return init_pthread_lock(&read_waiting_ctx.lock);
 }
 
 int service_handler_destroy()
@@ -62,6 +76,24 @@ void service_accep_done_callback(struct fast_task_info *task,
         const bool bInnerPort)
 {
     FC_INIT_LIST_HEAD(FTASK_HEAD_PTR);
+    FC_INIT_LIST_HEAD(&READ_WAIT_CTX.dlink);
+    READ_WAIT_CTX.task = task;
+    READ_WAIT_CTX.waiting = false;
+}
+
+static inline void service_read_waiting_remove(struct fast_task_info *task)
+{
+    fc_list_del_init(&READ_WAIT_CTX.dlink);
+    READ_WAIT_CTX.waiting = false;
+    __sync_sub_and_fetch(&read_waiting_ctx.count, 1);
+}
+
+static inline void service_mutation_done(struct fast_task_info *task)
+{
+    if (TASK_ARG->context.service.mutating) {
+        TASK_ARG->context.service.mutating = false;
+        __sync_sub_and_fetch(&INFLIGHT_MUTATION_COUNT, 1);
+    }
 }
 
 static inline void release_flock_task(struct fast_task_info *task,
@@ -90,6 +122,15 @@ void service_task_finish_cleanup(struct fast_task_info *task)
     }
 
     dentry_array_free(&DENTRY_LIST_CACHE.array);
+    service_mutation_done(task);
+
+    if (READ_WAIT_CTX.waiting) {
+        PTHREAD_MUTEX_LOCK(&read_waiting_ctx.lock);
+        if (READ_WAIT_CTX.waiting) {
+            service_read_waiting_remove(task);
+        }
+        PTHREAD_MUTEX_UNLOCK(&read_waiting_ctx.lock);
+    }
 
     __sync_add_and_fetch(&((FDIRServerTaskArg *)task->arg)->task_version, 1);
     sf_task_finish_clean_up(task);
@@ -139,6 +180,7 @@ static int service_deal_cluster_stat(struct fast_task_info *task)
     FDIRProtoClusterStatRespBodyPart *body_part;
     FDIRClusterServerInfo *cs;
     FDIRClusterServerInfo *send;
+    FDIRReplicationLag lag;
 
     if ((result=server_expect_body_length(task, 0)) != 0) {
         return result;
@@ -160,6 +202,14 @@ static int service_deal_cluster_stat(struct fast_task_info *task)
                 SERVICE_GROUP_ADDRESS_FIRST_IP(cs->server));
         short2buff(SERVICE_GROUP_ADDRESS_FIRST_PORT(cs->server),
                 body_part->port);
+
+        if (!(MYSELF_IS_MASTER && binlog_local_consumer_slave_lag(
+                        cs, &lag) == 0))
+        {
+            lag.data_versions = lag.bytes = -1;
+        }
+        long2buff(lag.data_versions, body_part->replication_lag.data_versions);
+        long2buff(lag.bytes, body_part->replication_lag.bytes);
     }
 
     RESPONSE.header.body_len = (char *)body_part - REQUEST.body;
@@ -308,6 +358,57 @@ static int service_deal_get_readable_server(struct fast_task_info *task)
     return 0;
 }
 
+static int service_deal_transfer_master(struct fast_task_info *task)
+{
+    int result;
+    int server_id;
+    FDIRClusterServerInfo *target;
+
+    if ((result=server_expect_body_length(task,
+                    sizeof(FDIRProtoTransferMasterReq))) != 0)
+    {
+        return result;
+    }
+
+    server_id = buff2int(((FDIRProtoTransferMasterReq *)
+                REQUEST.body)->server_id);
+    if (server_id == 0) {
+        target = NULL;
+    } else if ((target=fdir_get_server_by_id(server_id)) == NULL) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "server id: %d not exist", server_id);
+        return ENOENT;
+    } else if (target == CLUSTER_MYSELF_PTR) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "server id: %d is the master", server_id);
+        return EINVAL;
+    } else if (target->is_learner) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "server id: %d is a learner", server_id);
+        return EINVAL;
+    } else if (!cluster_info_is_downstream(target)) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "server id: %d is not replicated by the master directly "
+                "(relayed by server id: %d)", server_id,
+                cluster_info_get_source(target)->server->id);
+        return EINVAL;
+    } else if (target->status != FDIR_SERVER_STATUS_ACTIVE) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "server id: %d is not active", server_id);
+        return EAGAIN;
+    }
+
+    if ((result=cluster_relationship_transfer_master(task, target)) != 0) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "the master transfer is in progress");
+        return result;
+    }
+
+    RESPONSE.header.cmd = FDIR_SERVICE_PROTO_TRANSFER_MASTER_RESP;
+    TASK_ARG->context.deal_func = NULL;  //respond the status directly
+    return TASK_STATUS_CONTINUE;
+}
+
 static int server_parse_dentry_info(struct fast_task_info *task,
         char *start, FDIRDEntryFullName *fullname)
 {
@@ -361,9 +462,48 @@ static int server_parse_dentry_info(struct fast_task_info *task,
     return 0;
 }
 
+/* the namespace migrated by fdir_migrate_namespace has the entry
+ * /<namespace> in the route namespace: the size 0 for frozen during
+ * the cutover, otherwise the id of the cluster which it moved to
+ */
+static int service_check_namespace_route(struct fast_task_info *task,
+        const string_t *ns, const bool is_update)
+{
+    FDIRDEntryFullName route;
+    FDIRServerDentry *dentry;
+    char path[NAME_MAX + 2];
+
+    FC_SET_STRING_EX(route.ns, FDIR_ROUTE_NAMESPACE_STR,
+            FDIR_ROUTE_NAMESPACE_LEN);
+    if (fc_string_equal(ns, &route.ns)) {
+        return 0;
+    }
+
+    *path = '/';
+    memcpy(path + 1, ns->str, ns->len);
+    FC_SET_STRING_EX(route.path, path, ns->len + 1);
+    if (dentry_find(&route, &dentry) != 0) {
+        return 0;
+    }
+
+    if (dentry->stat.size > 0) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "namespace: %.*s moved to cluster: %"PRId64,
+                ns->len, ns->str, dentry->stat.size);
+        return FDIR_STATUS_NAMESPACE_MOVED;
+    }
+    if (is_update) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "namespace: %.*s is frozen for the migration, "
+                "please try later", ns->len, ns->str);
+        return EBUSY;
+    }
+    return 0;
+}
+
 static int server_check_and_parse_dentry(struct fast_task_info *task,
         const int front_part_size, const int fixed_part_size,
-        FDIRDEntryFullName *fullname)
+        const bool is_update, FDIRDEntryFullName *fullname)
 {
     int result;
     int req_body_len;
@@ -391,7 +531,7 @@ static int server_check_and_parse_dentry(struct fast_task_info *task,
         return EINVAL;
     }
 
-    return 0;
+    return service_check_namespace_route(task, &fullname->ns, is_update);
 }
 
 static inline int alloc_record_object(struct fast_task_info *task)
@@ -427,7 +567,11 @@ static int server_binlog_produce(struct fast_task_info *task)
     }
 
     TASK_ARG->context.deal_func = NULL;
+    TASK_DATA_VERSION = RECORD->data_version;
     rbuffer->data_version = RECORD->data_version;
+    rbuffer->durability_level = server_get_durability_level(
+            &RECORD->fullname.ns, FDIR_PROTO_GET_DURABILITY(
+                REQUEST.header.flags));
     RECORD->timestamp = g_current_time;
 
     fast_buffer_reset(&rbuffer->buffer);
@@ -440,7 +584,10 @@ static int server_binlog_produce(struct fast_task_info *task)
         rbuffer->task_version = __sync_add_and_fetch(
                 &((FDIRServerTaskArg *)task->arg)->task_version, 0);
         binlog_push_to_producer_queue(rbuffer);
-        return SLAVE_SERVER_COUNT > 0 ? TASK_STATUS_CONTINUE : result;
+
+        /* waiting for the binlog writer and / or the slaves to notify */
+        return rbuffer->durability_level > FDIR_DURABILITY_LEVEL_MEMORY ?
+            TASK_STATUS_CONTINUE : result;
     } else {
         server_binlog_free_rbuffer(rbuffer);
         return result;
@@ -474,16 +621,30 @@ static void record_deal_done_notify(FDIRBinlogRecord *record,
             log_level = LOG_WARNING;
         }
 
-        log_it_ex(&g_log_context, log_level,
-                "file: "__FILE__", line: %d, "
-                "client ip: %s, %s dentry fail, "
-                "errno: %d, error info: %s, "
-                "inode: %"PRId64", namespace: %.*s, path: %.*s",
-                __LINE__, task->client_ip,
-                get_operation_caption(record->operation),
-                result, STRERROR(result), record->inode,
-                record->fullname.ns.len, record->fullname.ns.str,
-                record->fullname.path.len, record->fullname.path.str);
+        if (record->options.pname) {
+            log_it_ex(&g_log_context, log_level,
+                    "file: "__FILE__", line: %d, "
+                    "client ip: %s, %s dentry fail, "
+                    "errno: %d, error info: %s, namespace: %.*s, "
+                    "parent inode: %"PRId64", name: %.*s",
+                    __LINE__, task->client_ip,
+                    get_operation_caption(record->operation),
+                    result, STRERROR(result),
+                    record->fullname.ns.len, record->fullname.ns.str,
+                    record->pname.parent_inode, record->pname.name.len,
+                    record->pname.name.str);
+        } else {
+            log_it_ex(&g_log_context, log_level,
+                    "file: "__FILE__", line: %d, "
+                    "client ip: %s, %s dentry fail, "
+                    "errno: %d, error info: %s, "
+                    "inode: %"PRId64", namespace: %.*s, path: %.*s",
+                    __LINE__, task->client_ip,
+                    get_operation_caption(record->operation),
+                    result, STRERROR(result), record->inode,
+                    record->fullname.ns.len, record->fullname.ns.str,
+                    record->fullname.path.len, record->fullname.path.str);
+        }
     } else {
         if (RESPONSE.header.cmd == FDIR_SERVICE_PROTO_CREATE_DENTRY_RESP ||
                 RESPONSE.header.cmd == FDIR_SERVICE_PROTO_CREATE_BY_PNAME_RESP||
@@ -571,7 +732,7 @@ static int service_deal_create_dentry(struct fast_task_info *task)
 
     if ((result=server_check_and_parse_dentry(task,
                     sizeof(FDIRProtoCreateDEntryFront),
-                    sizeof(FDIRProtoCreateDEntryBody),
+                    sizeof(FDIRProtoCreateDEntryBody), true,
                     &RECORD->fullname)) != 0)
     {
         free_record_object(task);
@@ -612,8 +773,7 @@ static int service_deal_create_dentry_by_pname(struct fast_task_info *task)
     FDIRServerDentry *parent_dentry;
     int64_t parent_inode;
     char *ns_str;
-    char *req_name_str;
-    BufferInfo full_path;
+    string_t ns;
 
     if ((result=server_check_body_length(task, sizeof(
                         FDIRProtoCreateDEntryByPNameReq) + 2,
@@ -648,45 +808,38 @@ static int service_deal_create_dentry_by_pname(struct fast_task_info *task)
         return ENOENT;
     }
 
-    ns_str = REQUEST.body + sizeof(FDIRProtoStatDEntryResp) +
-        REQUEST.header.body_len;
-    full_path.buff = ns_str + req->ns_len;
-    full_path.alloc_size = (task->data + task->size) - full_path.buff;
-    full_path.length = 0;
-    if ((result=dentry_get_full_path(parent_dentry, &full_path,
-                    &RESPONSE.error)) != 0)
-    {
-        return result;
-    }
-
-    if (full_path.length + req->name_len + 1 >= full_path.alloc_size) {
+    FC_SET_STRING_EX(ns, req->ns_str, req->ns_len);
+    if (!dentry_belongs_to_namespace(parent_dentry, &ns)) {
         RESPONSE.error.length = sprintf(RESPONSE.error.message,
-                "path length: %d >= buff size: %d",
-                full_path.length + req->name_len + 1,
-                full_path.alloc_size);
-        return ENOSPC;
+                "parent inode: %"PRId64" not belong to namespace: %.*s",
+                parent_inode, ns.len, ns.str);
+        return ENOENT;
+    }
+    if ((result=service_check_namespace_route(task, &ns, true)) != 0) {
+        return result;
     }
-
-    req_name_str = req->ns_str + req->ns_len;
-    memcpy(ns_str, req->ns_str, req->ns_len);
-    full_path.length += sprintf(full_path.buff + full_path.length,
-            "/%.*s", req->name_len, req_name_str);
 
     if ((result=alloc_record_object(task)) != 0) {
         return result;
     }
 
+    /* copy the namespace and the name after the response space,
+     * the record is identified by the parent inode and the name
+     */
+    ns_str = REQUEST.body + sizeof(FDIRProtoStatDEntryResp) +
+        REQUEST.header.body_len;
+    memcpy(ns_str, req->ns_str, req->ns_len + req->name_len);
     RECORD->fullname.ns.str = ns_str;
     RECORD->fullname.ns.len = req->ns_len;
-    RECORD->fullname.path.str = full_path.buff;
-    RECORD->fullname.path.len = full_path.length;
-
-    logInfo("file: "__FILE__", line: %d, "
-            "ns: %.*s, path: %.*s", __LINE__, RECORD->fullname.ns.len,
-            RECORD->fullname.ns.str, RECORD->fullname.path.len,
-            RECORD->fullname.path.str);
+    RECORD->fullname.path.str = NULL;
+    RECORD->fullname.path.len = 0;
+    RECORD->pname.parent_inode = parent_inode;
+    RECORD->pname.name.str = ns_str + req->ns_len;
+    RECORD->pname.name.len = req->name_len;
 
     service_init_record(task);
+    RECORD->options.path_info.flags = 0;
+    RECORD->options.pname = 1;
     init_record_for_create(task, req->mode);
     RESPONSE.header.cmd = FDIR_SERVICE_PROTO_CREATE_BY_PNAME_RESP;
     return push_record_to_data_thread_queue(task);
@@ -701,7 +854,7 @@ static int service_deal_remove_dentry(struct fast_task_info *task)
     }
 
     if ((result=server_check_and_parse_dentry(task,
-                    0, sizeof(FDIRProtoRemoveDEntry),
+                    0, sizeof(FDIRProtoRemoveDEntry), true,
                     &RECORD->fullname)) != 0)
     {
         free_record_object(task);
@@ -721,7 +874,7 @@ static int service_deal_stat_dentry_by_path(struct fast_task_info *task)
     FDIRServerDentry *dentry;
 
     if ((result=server_check_and_parse_dentry(task, 0,
-                    sizeof(FDIRProtoDEntryInfo), &fullname)) != 0)
+                    sizeof(FDIRProtoDEntryInfo), false, &fullname)) != 0)
     {
         return result;
     }
@@ -743,7 +896,7 @@ static int service_deal_lookup_inode(struct fast_task_info *task)
     FDIRProtoLookupInodeResp *resp;
 
     if ((result=server_check_and_parse_dentry(task, 0,
-                    sizeof(FDIRProtoDEntryInfo), &fullname)) != 0)
+                    sizeof(FDIRProtoDEntryInfo), false, &fullname)) != 0)
     {
         return result;
     }
@@ -857,6 +1010,8 @@ static FDIRServerDentry *set_dentry_size(struct fast_task_info *task,
 
     RECORD->inode = inode;
     RECORD->dentry = dentry;
+    RECORD->fullname.ns.str = (char *)ns_str;
+    RECORD->fullname.ns.len = ns_len;
     RECORD->hash_code = simple_hash(ns_str, ns_len);
     RECORD->options.flags = 0;
     if ((modified_flags & FDIR_DENTRY_FIELD_MODIFIED_FLAG_SIZE)) {
@@ -878,6 +1033,7 @@ static int service_deal_set_dentry_size(struct fast_task_info *task)
 {
     FDIRProtoSetDentrySizeReq *req;
     FDIRServerDentry *dentry;
+    string_t ns;
     int result;
     int64_t inode;
     int64_t file_size;
@@ -906,6 +1062,11 @@ static int service_deal_set_dentry_size(struct fast_task_info *task)
         return EINVAL;
     }
 
+    FC_SET_STRING_EX(ns, req->ns_str, req->ns_len);
+    if ((result=service_check_namespace_route(task, &ns, true)) != 0) {
+        return result;
+    }
+
     RESPONSE.header.cmd = FDIR_SERVICE_PROTO_SET_DENTRY_SIZE_RESP;
     inode = buff2long(req->inode);
     file_size = buff2long(req->size);
@@ -934,6 +1095,8 @@ static FDIRServerDentry *modify_dentry_stat(struct fast_task_info *task,
     RECORD->inode = inode;
     RECORD->options.flags = flags;
     RECORD->stat = *stat;
+    RECORD->fullname.ns.str = (char *)ns_str;
+    RECORD->fullname.ns.len = ns_len;
     RECORD->hash_code = simple_hash(ns_str, ns_len);
     RECORD->operation = BINLOG_OP_UPDATE_DENTRY_INT;
 
@@ -954,6 +1117,7 @@ static int service_deal_modify_dentry_stat(struct fast_task_info *task)
     FDIRProtoModifyDentryStatReq *req;
     FDIRServerDentry *dentry;
     FDIRDEntryStatus stat;
+    string_t ns;
     int64_t inode;
     int64_t flags;
     int64_t masked_flags;
@@ -984,6 +1148,11 @@ static int service_deal_modify_dentry_stat(struct fast_task_info *task)
         return EINVAL;
     }
 
+    FC_SET_STRING_EX(ns, req->ns_str, req->ns_len);
+    if ((result=service_check_namespace_route(task, &ns, true)) != 0) {
+        return result;
+    }
+
     inode = buff2long(req->inode);
     flags = buff2long(req->mflags);
     masked_flags = (flags & dstat_mflags_mask);
@@ -1274,6 +1443,7 @@ static void on_sys_lock_release(FDIRServerDentry *dentry, void *args)
 static int service_deal_sys_unlock_dentry(struct fast_task_info *task)
 {
     FDIRProtoSysUnlockDEntryReq *req;
+    string_t ns;
     int result;
     int flags;
     int64_t inode;
@@ -1324,6 +1494,14 @@ static int service_deal_sys_unlock_dentry(struct fast_task_info *task)
             return ENOENT;
         }
 
+        //release the sys lock without the size change
+        FC_SET_STRING_EX(ns, req->ns_str, req->ns_len);
+        if ((result=service_check_namespace_route(task, &ns, true)) != 0) {
+            inode_index_sys_lock_release(SYS_LOCK_TASK);
+            SYS_LOCK_TASK = NULL;
+            return result;
+        }
+
         old_size = buff2long(req->old_size);
         new_size = buff2long(req->new_size);
         if (old_size != SYS_LOCK_TASK->dentry->stat.size) {
@@ -1416,7 +1594,7 @@ static int service_deal_list_dentry_first(struct fast_task_info *task)
     FDIRDEntryFullName fullname;
 
     if ((result=server_check_and_parse_dentry(task,
-                    0, sizeof(FDIRProtoListDEntryFirstBody),
+                    0, sizeof(FDIRProtoListDEntryFirstBody), false,
                     &fullname)) != 0)
     {
         return result;
@@ -1479,9 +1657,11 @@ static inline void init_task_context(struct fast_task_info *task)
     RESPONSE.error.message[0] = '\0';
     TASK_ARG->context.log_error = true;
     TASK_ARG->context.response_done = false;
+    WAITING_RPC_RESULT = 0;
 
     REQUEST.header.cmd = ((FDIRProtoHeader *)task->data)->cmd;
     REQUEST.header.body_len = task->length - sizeof(FDIRProtoHeader);
+    REQUEST.header.flags = buff2short(((FDIRProtoHeader *)task->data)->flags);
     REQUEST.body = task->data + sizeof(FDIRProtoHeader);
 }
 
@@ -1497,6 +1677,133 @@ static inline int service_check_master(struct fast_task_info *task)
     return 0;
 }
 
+/* check the master and count the mutation in flight, the master transfer
+ * sets the flag first then waits for the inflight mutations done
+ */
+static inline int service_check_master_for_update(struct fast_task_info *task)
+{
+    int result;
+    FDIRClusterServerInfo *slave;
+    FDIRReplicationLag lag;
+
+    if ((result=service_check_master(task)) != 0) {
+        return result;
+    }
+
+    __sync_add_and_fetch(&INFLIGHT_MUTATION_COUNT, 1);
+    if (__sync_add_and_fetch(&MASTER_TRANSFER_IN_PROGRESS, 0)) {
+        __sync_sub_and_fetch(&INFLIGHT_MUTATION_COUNT, 1);
+        RESPONSE.error.length = sprintf(
+                RESPONSE.error.message,
+                "the master is transferring, try again later");
+        return EAGAIN;
+    }
+
+    //the flow control for the memory of the replication queues
+    if ((slave=binlog_local_consumer_lagging_slave(&lag)) != NULL) {
+        __sync_sub_and_fetch(&INFLIGHT_MUTATION_COUNT, 1);
+        TASK_ARG->context.log_error = false;
+        RESPONSE.error.length = sprintf(
+                RESPONSE.error.message,
+                "the replication lag of slave id: %d is too large, "
+                "data versions: %"PRId64", bytes: %"PRId64", try again "
+                "later", slave->server->id, lag.data_versions, lag.bytes);
+        return EAGAIN;
+    }
+
+    TASK_ARG->context.service.mutating = true;
+    return 0;
+}
+
+static inline int service_parse_min_data_version(struct fast_task_info *task)
+{
+    if ((REQUEST.header.flags & FDIR_PROTO_FLAGS_MIN_DATA_VERSION) == 0) {
+        TASK_DATA_VERSION = 0;
+        return 0;
+    }
+
+    if (REQUEST.header.body_len < 8) {
+        RESPONSE.error.length = sprintf(
+                RESPONSE.error.message,
+                "request body length: %d < 8 for the min data version",
+                REQUEST.header.body_len);
+        return EINVAL;
+    }
+
+    REQUEST.header.body_len -= 8;
+    TASK_DATA_VERSION = buff2long(REQUEST.body + REQUEST.header.body_len);
+    return 0;
+}
+
+static inline void service_set_read_redirect_error(
+        struct fast_task_info *task, const int64_t applied_version)
+{
+    RESPONSE.error.length = sprintf(RESPONSE.error.message,
+            "the data version: %"PRId64" not reached, current: %"PRId64
+            ", read from the master", TASK_DATA_VERSION, applied_version);
+    TASK_ARG->context.log_error = false;
+}
+
+static int service_deal_read_after_wait(struct fast_task_info *task)
+{
+    if (RESPONSE_STATUS != 0) {
+        return RESPONSE_STATUS;
+    }
+
+    switch (REQUEST.header.cmd) {
+        case FDIR_SERVICE_PROTO_LOOKUP_INODE_REQ:
+            return service_deal_lookup_inode(task);
+        case FDIR_SERVICE_PROTO_STAT_BY_PATH_REQ:
+            return service_deal_stat_dentry_by_path(task);
+        case FDIR_SERVICE_PROTO_STAT_BY_INODE_REQ:
+            return service_deal_stat_dentry_by_inode(task);
+        case FDIR_SERVICE_PROTO_STAT_BY_PNAME_REQ:
+            return service_deal_stat_dentry_by_pname(task);
+        case FDIR_SERVICE_PROTO_LIST_DENTRY_FIRST_REQ:
+            return service_deal_list_dentry_first(task);
+        case FDIR_SERVICE_PROTO_LIST_DENTRY_NEXT_REQ:
+            return service_deal_list_dentry_next(task);
+        default:
+            RESPONSE.error.length = sprintf(
+                    RESPONSE.error.message,
+                    "unexpect cmd: %d", REQUEST.header.cmd);
+            return EINVAL;
+    }
+}
+
+/* the slave waits the data version applied in order for read your writes,
+ * the waiting task is woken up by the replica or expired by the nio loop
+ */
+static int service_wait_read_version(struct fast_task_info *task)
+{
+    int64_t applied_version;
+
+    PTHREAD_MUTEX_LOCK(&read_waiting_ctx.lock);
+    applied_version = __sync_add_and_fetch(&DATA_APPLIED_VERSION, 0);
+    if (TASK_DATA_VERSION <= applied_version) {
+        PTHREAD_MUTEX_UNLOCK(&read_waiting_ctx.lock);
+        return 0;
+    }
+
+    if (READ_WAIT_TIMEOUT_MS == 0) {
+        PTHREAD_MUTEX_UNLOCK(&read_waiting_ctx.lock);
+        service_set_read_redirect_error(task, applied_version);
+        return EAGAIN;
+    }
+
+    READ_WAIT_CTX.expires_ms = get_current_time_ms() + READ_WAIT_TIMEOUT_MS;
+    READ_WAIT_CTX.waiting = true;
+    fc_list_add_tail(&READ_WAIT_CTX.dlink, &read_waiting_ctx.head);
+    if (__sync_add_and_fetch(&read_waiting_ctx.count, 1) == 1 ||
+            TASK_DATA_VERSION < read_waiting_ctx.min_version)
+    {
+        read_waiting_ctx.min_version = TASK_DATA_VERSION;
+    }
+    TASK_ARG->context.deal_func = service_deal_read_after_wait;
+    PTHREAD_MUTEX_UNLOCK(&read_waiting_ctx.lock);
+    return TASK_STATUS_CONTINUE;
+}
+
 static inline int service_check_readable(struct fast_task_info *task)
 {
     if (!(CLUSTER_MYSELF_PTR == CLUSTER_MASTER_PTR ||
@@ -1508,6 +1815,71 @@ static inline int service_check_readable(struct fast_task_info *task)
         return EINVAL;
     }
 
+    if (TASK_DATA_VERSION > 0 && CLUSTER_MYSELF_PTR != CLUSTER_MASTER_PTR) {
+        return service_wait_read_version(task);
+    }
+    return 0;
+}
+
+void service_read_waiting_notify(const bool check_expires)
+{
+    FDIRServerTaskArg *task_arg;
+    FDIRServerTaskArg *next;
+    struct fast_task_info *task;
+    int64_t applied_version;
+    int64_t min_version;
+    int64_t now_ms;
+
+    if (__sync_add_and_fetch(&read_waiting_ctx.count, 0) == 0) {
+        return;
+    }
+
+    applied_version = __sync_add_and_fetch(&DATA_APPLIED_VERSION, 0);
+    if (check_expires) {
+        now_ms = get_current_time_ms();
+        if (now_ms - read_waiting_ctx.last_check_ms <
+                READ_WAITING_CHECK_INTERVAL_MS)
+        {
+            return;
+        }
+        read_waiting_ctx.last_check_ms = now_ms;
+    } else {
+        if (applied_version < __sync_add_and_fetch(
+                    &read_waiting_ctx.min_version, 0))
+        {
+            return;
+        }
+        now_ms = 0;
+    }
+
+    min_version = INT64_MAX;
+    PTHREAD_MUTEX_LOCK(&read_waiting_ctx.lock);
+    fc_list_for_each_entry_safe(task_arg, next, &read_waiting_ctx.head,
+            context.service.read_wait.dlink)
+    {
+        task = task_arg->context.service.read_wait.task;
+        if (TASK_DATA_VERSION <= applied_version) {
+            RESPONSE_STATUS = 0;
+        } else if (check_expires && now_ms >= READ_WAIT_CTX.expires_ms) {
+            service_set_read_redirect_error(task, applied_version);
+            RESPONSE_STATUS = EAGAIN;
+        } else {
+            if (TASK_DATA_VERSION < min_version) {
+                min_version = TASK_DATA_VERSION;
+            }
+            continue;
+        }
+
+        service_read_waiting_remove(task);
+        sf_nio_notify(task, SF_NIO_STAGE_CONTINUE);
+    }
+    read_waiting_ctx.min_version = min_version;
+    PTHREAD_MUTEX_UNLOCK(&read_waiting_ctx.lock);
+}
+
+int service_thread_loop_callback(struct nio_thread_data *thread_data)
+{
+    service_read_waiting_notify(true);
     return 0;
 }
 
@@ -1527,6 +1899,7 @@ static int deal_task_done(struct fast_task_info *task)
                 RESPONSE.error.message);
     }
 
+    service_mutation_done(task);
     proto_header = (FDIRProtoHeader *)task->data;
     if (!TASK_ARG->context.response_done) {
         RESPONSE.header.body_len = RESPONSE.error.length;
@@ -1536,6 +1909,29 @@ static int deal_task_done(struct fast_task_info *task)
         }
     }
 
+    //prefix the response body with the data version for read your writes
+    RESPONSE.header.flags = 0;
+    if ((REQUEST.header.flags & FDIR_PROTO_FLAGS_DATA_VERSION) &&
+            RESPONSE_STATUS == 0 && sizeof(FDIRProtoHeader) +
+            RESPONSE.header.body_len + 8 <= task->size)
+    {
+        char *body;
+
+        body = task->data + sizeof(FDIRProtoHeader);
+        if (RESPONSE.header.body_len > 0) {
+            memmove(body + 8, body, RESPONSE.header.body_len);
+        }
+        long2buff(TASK_DATA_VERSION, body);
+        RESPONSE.header.body_len += 8;
+        RESPONSE.header.flags = FDIR_PROTO_FLAGS_DATA_VERSION;
+    }
+    short2buff(RESPONSE.header.flags, proto_header->flags);
+
+    /* the request header is overwritten in place except the magic and
+     * the req_id, so the response echoes the req_id for the pipelining.
+     * one task per connection, the next request of the connection is
+     * received after this response sent, so the responses are in order
+     */
     short2buff(RESPONSE_STATUS >= 0 ? RESPONSE_STATUS : -1 * RESPONSE_STATUS,
             proto_header->status);
     proto_header->cmd = RESPONSE.header.cmd;
@@ -1584,7 +1980,11 @@ int service_deal_task(struct fast_task_info *task)
             result = TASK_ARG->context.deal_func(task);
         } else {
             result = RESPONSE_STATUS;
-            if (result == TASK_STATUS_CONTINUE) {
+            if (result == 0 && WAITING_RPC_RESULT != 0) {
+                result = WAITING_RPC_RESULT;
+                RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                        "the binlog persistence or replication fail");
+            } else if (result == TASK_STATUS_CONTINUE) {
                 logError("file: "__FILE__", line: %d, "
                         "unexpect status: %d", __LINE__, result);
                 result = EBUSY;
@@ -1592,6 +1992,10 @@ int service_deal_task(struct fast_task_info *task)
         }
     } else {
         init_task_context(task);
+        if ((result=service_parse_min_data_version(task)) != 0) {
+            RESPONSE_STATUS = result;
+            return deal_task_done(task);
+        }
 
         switch (REQUEST.header.cmd) {
             case FDIR_PROTO_ACTIVE_TEST_REQ:
@@ -1599,27 +2003,27 @@ int service_deal_task(struct fast_task_info *task)
                 result = service_deal_actvie_test(task);
                 break;
             case FDIR_SERVICE_PROTO_CREATE_DENTRY_REQ:
-                if ((result=service_check_master(task)) == 0) {
+                if ((result=service_check_master_for_update(task)) == 0) {
                     result = service_deal_create_dentry(task);
                 }
                 break;
             case FDIR_SERVICE_PROTO_CREATE_BY_PNAME_REQ:
-                if ((result=service_check_master(task)) == 0) {
+                if ((result=service_check_master_for_update(task)) == 0) {
                     result = service_deal_create_dentry_by_pname(task);
                 }
                 break;
             case FDIR_SERVICE_PROTO_REMOVE_DENTRY_REQ:
-                if ((result=service_check_master(task)) == 0) {
+                if ((result=service_check_master_for_update(task)) == 0) {
                     result = service_deal_remove_dentry(task);
                 }
                 break;
             case FDIR_SERVICE_PROTO_SET_DENTRY_SIZE_REQ:
-                if ((result=service_check_master(task)) == 0) {
+                if ((result=service_check_master_for_update(task)) == 0) {
                     result = service_deal_set_dentry_size(task);
                 }
                 break;
             case FDIR_SERVICE_PROTO_MODIFY_DENTRY_STAT_REQ:
-                if ((result=service_check_master(task)) == 0) {
+                if ((result=service_check_master_for_update(task)) == 0) {
                     result = service_deal_modify_dentry_stat(task);
                 }
                 break;
@@ -1669,7 +2073,7 @@ int service_deal_task(struct fast_task_info *task)
                 }
                 break;
             case FDIR_SERVICE_PROTO_SYS_UNLOCK_DENTRY_REQ:
-                if ((result=service_check_master(task)) == 0) {
+                if ((result=service_check_master_for_update(task)) == 0) {
                     result = service_deal_sys_unlock_dentry(task);
                 }
                 break;
@@ -1688,6 +2092,11 @@ int service_deal_task(struct fast_task_info *task)
             case FDIR_SERVICE_PROTO_GET_READABLE_SERVER_REQ:
                 result = service_deal_get_readable_server(task);
                 break;
+            case FDIR_SERVICE_PROTO_TRANSFER_MASTER_REQ:
+                if ((result=service_check_master(task)) == 0) {
+                    result = service_deal_transfer_master(task);
+                }
+                break;
             default:
                 RESPONSE.error.length = sprintf(
                         RESPONSE.error.message,
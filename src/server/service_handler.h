@@ -20,7 +20,12 @@ void service_task_finish_cleanup(struct fast_task_info *task);
 void *service_alloc_thread_extra_data(const int thread_index);
 void service_accep_done_callback(struct fast_task_info *task,
         const bool bInnerPort);
-//int service_thread_loop(struct nio_thread_data *thread_data);
+int service_thread_loop_callback(struct nio_thread_data *thread_data);
+
+/* wake up the read requests waiting the data version on the slave,
+ * expire the timed out ones when check_expires is true
+ */
+void service_read_waiting_notify(const bool check_expires);
 
 #ifdef __cplusplus
 }
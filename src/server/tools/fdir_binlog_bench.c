@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "../binlog/binlog_pack.h"
+
+#define BENCH_DEFAULT_MAX_SIZE  (256 * 1024 * 1024)
+#define BENCH_DETECT_STEP       4096
+
+typedef struct {
+    const char *filename;
+    char *content;  //the complete records of the binlog file
+    char *work;     //the text parser unescapes the strings in place
+    int64_t size;
+    int loops;
+} BenchContext;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-n loops] [-m max_size_mb] <binlog_file>\n"
+            "\tparse the binlog file by the original parser (basic) and "
+            "the fast parser, output the throughput of the record parsing "
+            "and the time of the record detecting\n", argv[0]);
+}
+
+static inline int64_t bench_get_time_us()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int bench_load_file(BenchContext *ctx, const int64_t max_size)
+{
+    const char *rec_end;
+    int64_t file_size;
+    int64_t bytes;
+    int fd;
+    int result;
+
+    if ((fd=open(ctx->filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, ctx->filename, result, STRERROR(result));
+        return result;
+    }
+
+    if ((file_size=lseek(fd, 0, SEEK_END)) < 0 ||
+            lseek(fd, 0, SEEK_SET) < 0)
+    {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "lseek file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, ctx->filename, result, STRERROR(result));
+        close(fd);
+        return result;
+    }
+    if (file_size > max_size) {
+        file_size = max_size;
+    }
+    if (file_size == 0) {
+        fprintf(stderr, "empty binlog file: %s\n", ctx->filename);
+        close(fd);
+        return ENOENT;
+    }
+
+    ctx->content = (char *)malloc(file_size);
+    ctx->work = (char *)malloc(file_size);
+    if (ctx->content == NULL || ctx->work == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %"PRId64" bytes fail", __LINE__, file_size);
+        close(fd);
+        return ENOMEM;
+    }
+
+    bytes = fc_safe_read(fd, ctx->content, file_size);
+    close(fd);
+    if (bytes != file_size) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "read from file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, ctx->filename, result, STRERROR(result));
+        return result;
+    }
+
+    //the records are cut at the max size, skip the last partial one
+    if (binlog_detect_last_record_end(ctx->content, file_size,
+                binlog_get_buffer_format(ctx->content, file_size),
+                &rec_end) != 0)
+    {
+        fprintf(stderr, "no complete record in binlog file: %s\n",
+                ctx->filename);
+        return ENOENT;
+    }
+
+    ctx->size = rec_end - ctx->content;
+    return 0;
+}
+
+static int bench_parse(BenchContext *ctx, const char *caption)
+{
+    FDIRBinlogRecord record;
+    const char *p;
+    const char *end;
+    const char *rec_end;
+    int64_t record_count;
+    int64_t start_time;
+    int64_t time_used;
+    int i;
+    int result;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+
+    record_count = 0;
+    time_used = 0;
+    end = ctx->work + ctx->size;
+    for (i=0; i<ctx->loops; i++) {
+        memcpy(ctx->work, ctx->content, ctx->size);
+
+        start_time = bench_get_time_us();
+        p = ctx->work;
+        while (p < end) {
+            if ((result=binlog_unpack_record(p, end - p, &record,
+                            &rec_end, error_info, sizeof(error_info))) != 0)
+            {
+                logError("file: "__FILE__", line: %d, "
+                        "binlog_unpack_record fail, binlog file: %s, "
+                        "offset: %"PRId64", error info: %s", __LINE__,
+                        ctx->filename, (int64_t)(p - ctx->work),
+                        *error_info != '\0' ? error_info :
+                        STRERROR(result));
+                return result;
+            }
+
+            record_count++;
+            p = rec_end;
+        }
+        time_used += bench_get_time_us() - start_time;
+    }
+
+    if (time_used == 0) {
+        time_used = 1;
+    }
+    printf("parser: %-5s parse records: %"PRId64", time used: %"PRId64
+            " ms, %.2f MB/s, %.1f ns per record\n", caption, record_count,
+            time_used / 1000, (double)ctx->size * ctx->loops / time_used,
+            (double)time_used * 1000 / record_count);
+    return 0;
+}
+
+/* detect the first record from every BENCH_DETECT_STEP offset as
+ * the binlog reader does after seeking to a position
+ */
+static int bench_detect(BenchContext *ctx, const char *caption)
+{
+    int64_t data_version;
+    int64_t offset;
+    int64_t detect_count;
+    int64_t start_time;
+    int64_t time_used;
+    int format;
+    int len;
+    int rstart_offset;
+    int rend_offset;
+    int i;
+    int result;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+
+    format = binlog_get_buffer_format(ctx->content, ctx->size);
+    detect_count = 0;
+    start_time = bench_get_time_us();
+    for (i=0; i<ctx->loops; i++) {
+        for (offset=0; offset<ctx->size; offset+=BENCH_DETECT_STEP) {
+            len = ctx->size - offset > BINLOG_BUFFER_SIZE ?
+                BINLOG_BUFFER_SIZE : ctx->size - offset;
+            result = binlog_detect_record_forward(ctx->content + offset,
+                    len, format, &data_version, &rstart_offset,
+                    &rend_offset, error_info, sizeof(error_info));
+            if (result != 0 && result != ENOENT) {
+                logError("file: "__FILE__", line: %d, "
+                        "binlog_detect_record_forward fail, "
+                        "binlog file: %s, offset: %"PRId64", "
+                        "error info: %s", __LINE__, ctx->filename,
+                        offset, *error_info != '\0' ? error_info :
+                        STRERROR(result));
+                return result;
+            }
+            detect_count++;
+        }
+    }
+    time_used = bench_get_time_us() - start_time;
+
+    if (time_used == 0) {
+        time_used = 1;
+    }
+    printf("parser: %-5s detect records: %"PRId64", time used: %"PRId64
+            " ms, %.1f ns per detect\n", caption, detect_count,
+            time_used / 1000, (double)time_used * 1000 / detect_count);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchContext ctx;
+    int64_t max_size;
+    int ch;
+    int result;
+
+    if (argc < 2) {
+        usage(argv);
+        return 1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.loops = 10;
+    max_size = BENCH_DEFAULT_MAX_SIZE;
+    while ((ch=getopt(argc, argv, "hn:m:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'n':
+                ctx.loops = strtol(optarg, NULL, 10);
+                if (ctx.loops <= 0) {
+                    ctx.loops = 1;
+                }
+                break;
+            case 'm':
+                max_size = strtoll(optarg, NULL, 10) * 1024 * 1024;
+                if (max_size <= 0) {
+                    max_size = BENCH_DEFAULT_MAX_SIZE;
+                }
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv);
+        return 1;
+    }
+
+    log_init();
+    if (BINLOG_BUFFER_SIZE <= 0) {
+        BINLOG_BUFFER_SIZE = FDIR_DEFAULT_BINLOG_BUFFER_SIZE;
+    }
+    if ((result=binlog_pack_init()) != 0) {
+        return result;
+    }
+
+    ctx.filename = argv[optind];
+    if ((result=bench_load_file(&ctx, max_size)) == 0) {
+        printf("binlog file: %s, format: %s, bench size: %"PRId64" bytes, "
+                "loops: %d\n", ctx.filename, binlog_get_buffer_format(
+                    ctx.content, ctx.size) == FDIR_BINLOG_RECORD_FORMAT_BINARY
+                ? "binary" : "text", ctx.size, ctx.loops);
+
+        //before: the original parser, after: the fast parser
+        binlog_pack_set_fast_parser(false);
+        if ((result=bench_parse(&ctx, "basic")) == 0 &&
+                (result=bench_detect(&ctx, "basic")) == 0)
+        {
+            binlog_pack_set_fast_parser(true);
+            if ((result=bench_parse(&ctx, "fast")) == 0) {
+                result = bench_detect(&ctx, "fast");
+            }
+        }
+    }
+
+    if (ctx.work != NULL) {
+        free(ctx.work);
+    }
+    if (ctx.content != NULL) {
+        free(ctx.content);
+    }
+    return result;
+}
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/fast_buffer.h"
+#include "../binlog/binlog_pack.h"
+
+#define CONVERT_OUTPUT_FLUSH_SIZE  (1024 * 1024)
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-f text|binary] "
+            "<src_binlog_file> <dest_binlog_file>\n"
+            "\tconvert the binlog records to the specify format, "
+            "the default format is binary\n", argv[0]);
+}
+
+static int flush_output(const char *filename, const int fd,
+        FastBuffer *buffer)
+{
+    int result;
+
+    if (buffer->length == 0) {
+        return 0;
+    }
+
+    if (fc_safe_write(fd, buffer->data, buffer->length) != buffer->length) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "write to file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    buffer->length = 0;
+    return 0;
+}
+
+static int convert_buffer(const char *src_filename, const char *buff,
+        const int len, const int64_t file_offset, const int format,
+        const char *dest_filename, const int fd, FastBuffer *buffer,
+        int64_t *record_count)
+{
+    FDIRBinlogRecord record;
+    const char *p;
+    const char *end;
+    const char *rec_end;
+    int result;
+    char error_info[FDIR_ERROR_INFO_SIZE];
+
+    p = buff;
+    end = buff + len;
+    while (p < end) {
+        if ((result=binlog_unpack_record(p, end - p, &record,
+                        &rec_end, error_info, sizeof(error_info))) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "binlog_unpack_record fail, binlog file: %s, "
+                    "offset: %"PRId64", error info: %s", __LINE__,
+                    src_filename, file_offset + (p - buff), *error_info
+                    != '\0' ? error_info : STRERROR(result));
+            return result;
+        }
+
+        if ((result=binlog_pack_record_ex(&record, format, buffer)) != 0) {
+            return result;
+        }
+
+        if (buffer->length >= CONVERT_OUTPUT_FLUSH_SIZE) {
+            if ((result=flush_output(dest_filename, fd, buffer)) != 0) {
+                return result;
+            }
+        }
+
+        (*record_count)++;
+        p = rec_end;
+    }
+
+    return 0;
+}
+
+/* read the source binlog by BINLOG_BUFFER_SIZE and convert the
+ * complete records of the buffer, the same as the binlog reader
+ */
+static int convert_binlog(const char *src_filename,
+        const char *dest_filename, const int format)
+{
+    FastBuffer buffer;
+    char *buff;
+    const char *rec_end;
+    int64_t file_offset;
+    int64_t record_count;
+    int src_fd;
+    int fd;
+    int remain;
+    int bytes;
+    int src_format;
+    int result;
+
+    if ((src_fd=open(src_filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, src_filename, result, STRERROR(result));
+        return result;
+    }
+
+    if ((buff=(char *)malloc(BINLOG_BUFFER_SIZE)) == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "malloc %d bytes fail", __LINE__, BINLOG_BUFFER_SIZE);
+        close(src_fd);
+        return ENOMEM;
+    }
+
+    if ((result=fast_buffer_init_ex(&buffer, 2 *
+                    CONVERT_OUTPUT_FLUSH_SIZE)) != 0)
+    {
+        free(buff);
+        close(src_fd);
+        return result;
+    }
+
+    fd = open(dest_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, dest_filename, result, STRERROR(result));
+        fast_buffer_destroy(&buffer);
+        free(buff);
+        close(src_fd);
+        return result;
+    }
+
+    record_count = 0;
+    file_offset = 0;
+    remain = 0;
+    src_format = -1;
+    while (1) {
+        if ((bytes=read(src_fd, buff + remain,
+                        BINLOG_BUFFER_SIZE - remain)) < 0)
+        {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "read from file \"%s\" fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    src_filename, result, STRERROR(result));
+            break;
+        }
+
+        remain += bytes;
+        if (remain == 0) {
+            break;
+        }
+
+        if (src_format < 0) {  //a binlog file holds the records of one format
+            src_format = binlog_get_buffer_format(buff, remain);
+        }
+        if (binlog_detect_last_record_end(buff, remain,
+                    src_format, &rec_end) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "binlog file: %s, offset: %"PRId64", no complete "
+                    "record in %d bytes", __LINE__, src_filename,
+                    file_offset, remain);
+            result = EINVAL;
+            break;
+        }
+
+        if ((result=convert_buffer(src_filename, buff, rec_end - buff,
+                        file_offset, format, dest_filename, fd,
+                        &buffer, &record_count)) != 0)
+        {
+            break;
+        }
+
+        file_offset += rec_end - buff;
+        remain -= rec_end - buff;
+        if (remain > 0) {
+            if (bytes == 0) {
+                logError("file: "__FILE__", line: %d, "
+                        "binlog file: %s, offset: %"PRId64", the last "
+                        "record is incomplete", __LINE__,
+                        src_filename, file_offset);
+                result = EINVAL;
+                break;
+            }
+            memmove(buff, rec_end, remain);
+        }
+    }
+
+    if (result == 0) {
+        result = flush_output(dest_filename, fd, &buffer);
+    }
+    if (result == 0 && fsync(fd) != 0) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "fsync file \"%s\" fail, errno: %d, error info: %s",
+                __LINE__, dest_filename, result, STRERROR(result));
+    }
+
+    close(fd);
+    fast_buffer_destroy(&buffer);
+    free(buff);
+    close(src_fd);
+
+    if (result == 0) {
+        printf("convert %"PRId64" records from %s to %s done\n",
+                record_count, src_filename, dest_filename);
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int ch;
+    int format;
+    int result;
+
+    if (argc < 3) {
+        usage(argv);
+        return 1;
+    }
+
+    format = FDIR_BINLOG_RECORD_FORMAT_BINARY;
+    while ((ch=getopt(argc, argv, "hf:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'f':
+                if (strcasecmp(optarg, "text") == 0) {
+                    format = FDIR_BINLOG_RECORD_FORMAT_TEXT;
+                } else if (strcasecmp(optarg, "binary") == 0) {
+                    format = FDIR_BINLOG_RECORD_FORMAT_BINARY;
+                } else {
+                    usage(argv);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    if (optind + 1 >= argc) {
+        usage(argv);
+        return 1;
+    }
+
+    log_init();
+    if (BINLOG_BUFFER_SIZE <= 0) {
+        BINLOG_BUFFER_SIZE = FDIR_DEFAULT_BINLOG_BUFFER_SIZE;
+    }
+    if ((result=binlog_pack_init()) != 0) {
+        return result;
+    }
+
+    return convert_binlog(argv[optind], argv[optind + 1], format);
+}
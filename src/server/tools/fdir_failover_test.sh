@@ -0,0 +1,190 @@
+#!/bin/sh
+
+# measure the failover time of a 3 servers cluster on the local host:
+# kill the master by SIGKILL and wait until another server is the ACTIVE
+# master, then restart the killed server and repeat for the rounds.
+#
+# Usage: fdir_failover_test.sh <bin_path> <work_path> [rounds]
+#   bin_path: the path of fdir_serverd and fdir_cluster_stat
+#   work_path: the config files, the data and the logs are in this path
+#
+# the config files are generated from conf/server.conf of the source,
+# heartbeat_interval_ms and master_suspect_timeout_ms can be set by the
+# environment variables HEARTBEAT_INTERVAL_MS and SUSPECT_TIMEOUT_MS
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <bin_path> <work_path> [rounds]" >&2
+  exit 1
+fi
+
+BIN_PATH=$1
+WORK_PATH=$2
+ROUNDS=${3:-10}
+HEARTBEAT_INTERVAL_MS=${HEARTBEAT_INTERVAL_MS:-200}
+SUSPECT_TIMEOUT_MS=${SUSPECT_TIMEOUT_MS:-1000}
+CONF_PATH=$(cd $(dirname $0)/../../../conf && pwd)
+
+# the server finds itself in the cluster by the local IP and the port
+HOST=$(hostname -I 2>/dev/null | awk '{print $1;}')
+if [ -z "$HOST" ]; then
+  HOST=$(hostname)
+fi
+
+now_ms() {
+  echo $(($(date +%s%N) / 1000000))
+}
+
+# output the server id of the ACTIVE master, empty for none
+active_master() {
+  $BIN_PATH/fdir_cluster_stat -c $WORK_PATH/client.conf 2>/dev/null | \
+    awk '/is_master: 1/ && /\(ACTIVE\)/ {sub(",", "", $2); print $2; exit;}'
+}
+
+wait_master() {
+  local old_master=$1
+  local master
+  local i=0
+
+  while [ $i -lt 6000 ]; do
+    master=$(active_master)
+    if [ -n "$master" ] && [ "$master" != "$old_master" ]; then
+      echo $master
+      return 0
+    fi
+    sleep 0.01
+    i=$((i + 1))
+  done
+  return 1
+}
+
+# wait until all the servers ACTIVE
+wait_all_active() {
+  local i=0
+  while [ $i -lt 600 ]; do
+    if [ $($BIN_PATH/fdir_cluster_stat -c $WORK_PATH/client.conf \
+      2>/dev/null | grep -c '(ACTIVE)') -eq 3 ]; then
+      return 0
+    fi
+    sleep 0.1
+    i=$((i + 1))
+  done
+  return 1
+}
+
+gen_config() {
+  local id
+  local cluster_port
+  local service_port
+
+  mkdir -p $WORK_PATH || exit 1
+  cat > $WORK_PATH/cluster_servers.conf <<EOF
+[group-cluster]
+port = 11011
+
+[group-service]
+port = 11012
+EOF
+
+  for id in 1 2 3; do
+    cluster_port=$((11009 + 2 * id))
+    service_port=$((cluster_port + 1))
+    mkdir -p $WORK_PATH/server-$id
+    cat >> $WORK_PATH/cluster_servers.conf <<EOF
+
+[server-$id]
+cluster-port = $cluster_port
+service-port = $service_port
+host = $HOST
+EOF
+
+    awk -v base_path=$WORK_PATH/server-$id \
+      -v cluster_port=$cluster_port -v service_port=$service_port \
+      -v cluster_config=$WORK_PATH/cluster_servers.conf \
+      -v heartbeat=$HEARTBEAT_INTERVAL_MS -v suspect=$SUSPECT_TIMEOUT_MS '
+      /^\[/ {section = $0;}
+      /^base_path *=/ {$0 = "base_path = " base_path;}
+      /^cluster_config_filename *=/ {
+        $0 = "cluster_config_filename = " cluster_config;
+      }
+      /^heartbeat_interval_ms *=/ {$0 = "heartbeat_interval_ms = " heartbeat;}
+      /^master_suspect_timeout_ms *=/ {
+        $0 = "master_suspect_timeout_ms = " suspect;
+      }
+      /^port *=/ {
+        if (section == "[cluster]") {
+          $0 = "port = " cluster_port;
+        } else if (section == "[service]") {
+          $0 = "port = " service_port;
+        }
+      }
+      {print;}' $CONF_PATH/server.conf > $WORK_PATH/server-$id.conf
+  done
+
+  cat > $WORK_PATH/client.conf <<EOF
+connect_timeout = 1
+network_timeout = 1
+base_path = $WORK_PATH
+dir_server = $HOST:11012
+dir_server = $HOST:11014
+dir_server = $HOST:11016
+EOF
+}
+
+start_server() {
+  $BIN_PATH/fdir_serverd $WORK_PATH/server-$1.conf start
+}
+
+stop_all() {
+  local id
+  for id in 1 2 3; do
+    $BIN_PATH/fdir_serverd $WORK_PATH/server-$id.conf stop >/dev/null 2>&1
+  done
+}
+
+gen_config
+for id in 1 2 3; do
+  start_server $id || exit 1
+done
+trap stop_all EXIT
+
+if ! wait_all_active; then
+  echo "the servers are not ACTIVE in 60 seconds" >&2
+  exit 2
+fi
+
+total=0
+min=0
+max=0
+round=1
+while [ $round -le $ROUNDS ]; do
+  master=$(active_master)
+  pid=$(cat $WORK_PATH/server-$master/serverd.pid)
+  start=$(now_ms)
+  kill -9 $pid
+  if ! new_master=$(wait_master $master); then
+    echo "round $round: no new master in 60 seconds" >&2
+    exit 2
+  fi
+  elapsed=$(($(now_ms) - start))
+  echo "round $round: master $master -> $new_master, failover: $elapsed ms"
+
+  total=$((total + elapsed))
+  if [ $min -eq 0 ] || [ $elapsed -lt $min ]; then
+    min=$elapsed
+  fi
+  if [ $elapsed -gt $max ]; then
+    max=$elapsed
+  fi
+
+  rm -f $WORK_PATH/server-$master/serverd.pid
+  start_server $master || exit 1
+  if ! wait_all_active; then
+    echo "round $round: server $master is not ACTIVE in 60 seconds" >&2
+    exit 2
+  fi
+  round=$((round + 1))
+done
+
+echo "heartbeat_interval_ms: $HEARTBEAT_INTERVAL_MS, " \
+  "master_suspect_timeout_ms: $SUSPECT_TIMEOUT_MS, rounds: $ROUNDS, " \
+  "failover min: $min ms, avg: $((total / ROUNDS)) ms, max: $max ms"